@@ -65,8 +65,12 @@
 #define upper_32_bits(addr)		((__u32)((uintptr_t)(addr) >> HZ_HADDR_SHIFT))
 
 #define HZ_MAX_SIZE			(8 * 1024 * 1024)
+/* sqes filled on the stack before one qm doorbell in batch send */
+#define HZ_SEND_BATCH_NUM		16
 
 #define RSV_OFFSET			64
+/* bytes of the ctx_buf after RSV_OFFSET the hardware uses */
+#define HZ_CTX_BUF_SIZE			(64 * 1024 - RSV_OFFSET)
 #define CTX_DW1_OFFSET			4
 #define CTX_DW2_OFFSET			8
 #define CTX_REPCODE1_OFFSET		12
@@ -212,6 +216,28 @@ static void fill_buf_size_deflate(struct hisi_zip_sqe *sqe, __u32 in_size,
 	sqe->dest_avail_out = out_size;
 }
 
+/*
+ * The device takes the dma addresses of the buffers if it has no SVA, they
+ * are in the reserved memory of the device then.
+ */
+static int hisi_zip_dma_map(handle_t h_qp, void **addr, __u32 size)
+{
+	struct hisi_qp *qp = (struct hisi_qp *)h_qp;
+	void *dma;
+
+	if (!*addr)
+		return 0;
+
+	dma = wd_ctx_iova_map(qp->h_ctx, *addr, size);
+	if (unlikely(!dma)) {
+		WD_ERR("invalid: zip buffer isn't dma memory without sva!\n");
+		return -WD_EINVAL;
+	}
+	*addr = dma;
+
+	return 0;
+}
+
 static void fill_buf_addr_deflate(struct hisi_zip_sqe *sqe, void *src,
 				  void *dst, void *ctx_buf)
 {
@@ -223,6 +249,23 @@ static void fill_buf_addr_deflate(struct hisi_zip_sqe *sqe, void *src,
 	sqe->stream_ctx_addr_h = upper_32_bits(ctx_buf);
 }
 
+/* the flat buffers, after their sizes are filled */
+static int fill_buf_addr_deflate_flat(handle_t h_qp, struct hisi_zip_sqe *sqe,
+				      void *src, void *dst, void *ctx_buf)
+{
+	int ret;
+
+	ret = hisi_zip_dma_map(h_qp, &src, sqe->input_data_length);
+	ret |= hisi_zip_dma_map(h_qp, &dst, sqe->dest_avail_out);
+	ret |= hisi_zip_dma_map(h_qp, &ctx_buf, HZ_CTX_BUF_SIZE);
+	if (ret)
+		return -WD_EINVAL;
+
+	fill_buf_addr_deflate(sqe, src, dst, ctx_buf);
+
+	return 0;
+}
+
 static int fill_buf_deflate(handle_t h_qp, struct hisi_zip_sqe *sqe,
 			    struct wd_comp_msg *msg)
 {
@@ -243,9 +286,8 @@ static int fill_buf_deflate(handle_t h_qp, struct hisi_zip_sqe *sqe,
 	else
 		ctx_buf = NULL;
 
-	fill_buf_addr_deflate(sqe, req->src, req->dst, ctx_buf);
-
-	return 0;
+	return fill_buf_addr_deflate_flat(h_qp, sqe, req->src, req->dst,
+					  ctx_buf);
 }
 
 static int fill_buf_zlib(handle_t h_qp, struct hisi_zip_sqe *sqe,
@@ -278,9 +320,7 @@ static int fill_buf_zlib(handle_t h_qp, struct hisi_zip_sqe *sqe,
 	if (msg->ctx_buf)
 		ctx_buf = msg->ctx_buf + RSV_OFFSET;
 
-	fill_buf_addr_deflate(sqe, src, dst, ctx_buf);
-
-	return 0;
+	return fill_buf_addr_deflate_flat(h_qp, sqe, src, dst, ctx_buf);
 }
 
 static int fill_buf_gzip(handle_t h_qp, struct hisi_zip_sqe *sqe,
@@ -313,9 +353,7 @@ static int fill_buf_gzip(handle_t h_qp, struct hisi_zip_sqe *sqe,
 	if (msg->ctx_buf)
 		ctx_buf = msg->ctx_buf + RSV_OFFSET;
 
-	fill_buf_addr_deflate(sqe, src, dst, ctx_buf);
-
-	return 0;
+	return fill_buf_addr_deflate_flat(h_qp, sqe, src, dst, ctx_buf);
 }
 
 static void fill_buf_type_sgl(struct hisi_zip_sqe *sqe)
@@ -487,7 +525,9 @@ static int fill_buf_lz77_zstd(handle_t h_qp, struct hisi_zip_sqe *sqe,
 	__u32 in_size = msg->req.src_len;
 	__u32 lit_size = in_size + ZSTD_LIT_RESV_SIZE;
 	__u32 out_size = msg->avail_out;
+	void *src, *lits_start, *seqs_start;
 	void *ctx_buf = NULL;
+	int ret;
 
 	if (unlikely(!data)) {
 		WD_ERR("wd_lz77_zstd_data address is NULL\n");
@@ -524,8 +564,17 @@ static int fill_buf_lz77_zstd(handle_t h_qp, struct hisi_zip_sqe *sqe,
 
 	fill_buf_size_lz77_zstd(sqe, in_size, lit_size, out_size - lit_size);
 
-	fill_buf_addr_lz77_zstd(sqe, req->src, req->dst,
-				req->dst + lit_size, ctx_buf);
+	src = req->src;
+	lits_start = req->dst;
+	seqs_start = req->dst + lit_size;
+	ret = hisi_zip_dma_map(h_qp, &src, in_size);
+	ret |= hisi_zip_dma_map(h_qp, &lits_start, lit_size);
+	ret |= hisi_zip_dma_map(h_qp, &seqs_start, out_size - lit_size);
+	ret |= hisi_zip_dma_map(h_qp, &ctx_buf, HZ_CTX_BUF_SIZE);
+	if (ret)
+		return -WD_EINVAL;
+
+	fill_buf_addr_lz77_zstd(sqe, src, lits_start, seqs_start, ctx_buf);
 
 	data->literals_start = req->dst;
 	data->sequences_start = req->dst + lit_size;
@@ -1003,6 +1052,55 @@ static void free_hw_sgl(handle_t h_qp, struct hisi_zip_sqe *sqe,
 	}
 }
 
+static int hisi_zip_comp_send_batch(handle_t ctx, struct wd_comp_msg **msgs,
+				    __u32 num, __u32 *count, void *priv)
+{
+	struct hisi_zip_sqe sqes[HZ_SEND_BATCH_NUM];
+	struct hisi_qp *qp = wd_ctx_get_priv(ctx);
+	handle_t h_qp = (handle_t)qp;
+	__u16 fill_num, send_num;
+	int ret = 0;
+	__u32 i;
+
+	*count = 0;
+	while (*count < num) {
+		fill_num = 0;
+		while (fill_num < HZ_SEND_BATCH_NUM && *count + fill_num < num) {
+			memset(&sqes[fill_num], 0, sizeof(struct hisi_zip_sqe));
+			ret = fill_zip_comp_sqe(qp, msgs[*count + fill_num],
+						&sqes[fill_num]);
+			if (ret < 0) {
+				WD_ERR("failed to fill zip sqe(%d)!\n", ret);
+				break;
+			}
+			fill_num++;
+		}
+
+		if (!fill_num)
+			break;
+
+		send_num = 0;
+		ret = hisi_qm_send(h_qp, sqes, fill_num, &send_num);
+		if (ret < 0 && ret != -WD_EBUSY)
+			WD_ERR("qm send is err(%d)!\n", ret);
+
+		/* the sqes which are not taken by the queue own no hw sgl now */
+		for (i = send_num; i < fill_num; i++)
+			if (msgs[*count + i]->req.data_fmt == WD_SGL_BUF)
+				free_hw_sgl(h_qp, &sqes[i],
+					    msgs[*count + i]->alg_type);
+
+		*count += send_num;
+		if (send_num < fill_num)
+			break;
+	}
+
+	if (*count)
+		hisi_qm_enable_interrupt(ctx, msgs[0]->is_polled);
+
+	return *count ? 0 : ret;
+}
+
 static int parse_zip_sqe(struct hisi_qp *qp, struct hisi_zip_sqe *sqe,
 			 struct wd_comp_msg *recv_msg)
 {
@@ -1047,8 +1145,8 @@ static int parse_zip_sqe(struct hisi_qp *qp, struct hisi_zip_sqe *sqe,
 	recv_msg->avail_out = sqe->dest_avail_out;
 	if (VA_ADDR(sqe->stream_ctx_addr_h, sqe->stream_ctx_addr_l)) {
 		/*
-		 * In ASYNC mode, recv_msg->ctx_buf is NULL.
-		 * recv_msg->ctx_buf is only valid in SYNC mode.
+		 * recv_msg->ctx_buf is only valid in stateful mode, in ASYNC
+		 * mode it is the ctx_buf of the stream session.
 		 * ctx_dwx uses 4 BYTES
 		 */
 		*(__u32 *)recv_msg->ctx_buf = sqe->ctx_dw0;
@@ -1079,15 +1177,19 @@ static int hisi_zip_comp_recv(handle_t ctx, struct wd_comp_msg *recv_msg,
 {
 	struct hisi_qp *qp = wd_ctx_get_priv(ctx);
 	handle_t h_qp = (handle_t)qp;
-	struct hisi_zip_sqe sqe = {0};
+	struct hisi_zip_sqe *sqe;
 	__u16 count = 0;
-	int ret;
+	int ret, err;
 
-	ret = hisi_qm_recv(h_qp, &sqe, 1, &count);
+	/* parse the sqe in the queue, and give it back after that */
+	ret = hisi_qm_recv_peek(h_qp, (void **)&sqe, 1, &count);
 	if (ret < 0)
 		return ret;
 
-	return parse_zip_sqe(qp, &sqe, recv_msg);
+	ret = parse_zip_sqe(qp, sqe, recv_msg);
+	err = hisi_qm_recv_release(h_qp, count);
+
+	return err ? err : ret;
 }
 
 struct wd_comp_driver hisi_zip = {
@@ -1098,6 +1200,7 @@ struct wd_comp_driver hisi_zip = {
 	.exit			= hisi_zip_exit,
 	.comp_send		= hisi_zip_comp_send,
 	.comp_recv		= hisi_zip_comp_recv,
+	.comp_send_batch	= hisi_zip_comp_send_batch,
 };
 
 WD_COMP_SET_DRIVER(hisi_zip);
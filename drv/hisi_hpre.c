@@ -35,6 +35,8 @@
 #define SM2_SQE_NUM	2
 
 #define MAX_WAIT_CNT			10000000
+/* sqes filled on the stack before one qm doorbell in batch send */
+#define HPRE_SEND_BATCH_NUM		16
 #define SM2_KEY_SIZE			32
 #define SM2_PONIT_SIZE			64
 #define MAX_HASH_LENS			BITS_TO_BYTES(521)
@@ -126,12 +128,15 @@ static bool is_hpre_bin_fmt(const char *data, int dsz, int bsz)
 	return false;
 }
 
+/*
+ * The conversions between the crypto bin and the hpre bin move the data in
+ * one block and zero the rest, memmove() and memset() of libc do that with
+ * the vector instructions of the cpu.
+ */
 static int crypto_bin_to_hpre_bin(char *dst, const char *src,
 				  int b_size, int d_size, const char *p_name)
 {
-	int i = d_size - 1;
 	bool is_hpre_bin;
-	int j;
 
 	if (!dst || !src || b_size <= 0 || d_size <= 0) {
 		WD_ERR("%s: trans to hpre bin parameters err!\n", p_name);
@@ -147,46 +152,52 @@ static int crypto_bin_to_hpre_bin(char *dst, const char *src,
 	if (b_size == d_size || (dst == src && is_hpre_bin))
 		return WD_SUCCESS;
 
-	for (j = b_size - 1; j >= 0; j--, i--) {
-		if (i >= 0)
-			dst[j] = src[i];
-		else
-			dst[j] = 0;
-	}
+	memmove(dst + b_size - d_size, src, d_size);
+	memset(dst, 0, b_size - d_size);
 
 	return WD_SUCCESS;
 }
 
+/* Count the leading zero bytes of @src, the last byte is always kept */
+static int hpre_bin_zero_len(const char *src, int b_size)
+{
+	__u64 word;
+	int k = 0;
+
+	while (k + (int)sizeof(word) < b_size) {
+		memcpy(&word, src + k, sizeof(word));
+		if (word)
+			break;
+		k += sizeof(word);
+	}
+
+	while (k < b_size - 1 && !src[k])
+		k++;
+
+	return k;
+}
+
 static int hpre_bin_to_crypto_bin(char *dst, const char *src, int b_size,
 				  const char *p_name)
 {
-	int i, cnt;
-	int j = 0;
-	int k = 0;
+	int k;
 
 	if (!dst || !src || b_size <= 0) {
 		WD_ERR("%s trans to crypto bin: parameters err!\n", p_name);
 		return 0;
 	}
 
-	while (!src[j] && k < (b_size - 1))
-		k = ++j;
-
-	if (j == 0 && src == dst)
+	k = hpre_bin_zero_len(src, b_size);
+	if (k == 0 && src == dst)
 		return b_size;
 
-	for (i = 0, cnt = j; i < b_size; j++, i++) {
-		if (i < b_size - cnt)
-			dst[i] = src[j];
-		else
-			dst[i] = 0;
-	}
+	memmove(dst, src + k, b_size - k);
+	memset(dst + b_size - k, 0, k);
 
 	return b_size - k;
 }
 
-static int fill_rsa_crt_prikey2(struct wd_rsa_prikey *prikey,
-				   void **data)
+static int fill_rsa_crt_prikey2(struct wd_rsa_prikey *prikey)
 {
 	struct wd_dtb *wd_dq, *wd_dp, *wd_qinv, *wd_q, *wd_p;
 	int ret;
@@ -213,19 +224,12 @@ static int fill_rsa_crt_prikey2(struct wd_rsa_prikey *prikey,
 	if (ret)
 		return ret;
 
-	ret = crypto_bin_to_hpre_bin(wd_qinv->data,
+	return crypto_bin_to_hpre_bin(wd_qinv->data,
 		(const char *)wd_qinv->data, wd_qinv->bsize,
 		wd_qinv->dsize, "rsa crt qinv");
-	if (ret)
-		return ret;
-
-	*data = wd_dq->data;
-
-	return (int)(wd_dq->bsize + wd_qinv->bsize + wd_p->bsize +
-			wd_q->bsize + wd_dp->bsize);
 }
 
-static int fill_rsa_prikey1(struct wd_rsa_prikey *prikey, void **data)
+static int fill_rsa_prikey1(struct wd_rsa_prikey *prikey)
 {
 	struct wd_dtb *wd_d, *wd_n;
 	int ret;
@@ -236,17 +240,11 @@ static int fill_rsa_prikey1(struct wd_rsa_prikey *prikey, void **data)
 	if (ret)
 		return ret;
 
-	ret = crypto_bin_to_hpre_bin(wd_n->data, (const char *)wd_n->data,
+	return crypto_bin_to_hpre_bin(wd_n->data, (const char *)wd_n->data,
 				wd_n->bsize, wd_n->dsize, "rsa n");
-	if (ret)
-		return ret;
-
-	*data = wd_d->data;
-
-	return (int)(wd_n->bsize + wd_d->bsize);
 }
 
-static int fill_rsa_pubkey(struct wd_rsa_pubkey *pubkey, void **data)
+static int fill_rsa_pubkey(struct wd_rsa_pubkey *pubkey)
 {
 	struct wd_dtb *wd_e, *wd_n;
 	int ret;
@@ -258,13 +256,8 @@ static int fill_rsa_pubkey(struct wd_rsa_pubkey *pubkey, void **data)
 		WD_ERR("rsa pubkey e format fail!\n");
 		return ret;
 	}
-	ret = crypto_bin_to_hpre_bin(wd_n->data, (const char *)wd_n->data,
+	return crypto_bin_to_hpre_bin(wd_n->data, (const char *)wd_n->data,
 				wd_n->bsize, wd_n->dsize, "rsa n");
-	if (ret)
-		return ret;
-
-	*data = wd_e->data;
-	return (int)(wd_n->bsize + wd_e->bsize);
 }
 
 static int fill_rsa_genkey_in(struct wd_rsa_kg_in *genkey)
@@ -373,33 +366,71 @@ static int rsa_out_transfer(struct wd_rsa_msg *msg,
 	return WD_SUCCESS;
 }
 
+static int rsa_fill_key(struct wd_rsa_msg *msg, __u8 alg)
+{
+	if (msg->req.op_type == WD_RSA_SIGN) {
+		if (alg == HPRE_ALG_NC_CRT)
+			return fill_rsa_crt_prikey2((void *)msg->key);
+
+		return fill_rsa_prikey1((void *)msg->key);
+	}
+
+	if (msg->req.op_type == WD_RSA_VERIFY)
+		return fill_rsa_pubkey((void *)msg->key);
+
+	return fill_rsa_genkey_in((void *)msg->key);
+}
+
+/*
+ * The key of a session is converted to hpre bin in place by the first send
+ * after it's set, and the later sends only take its address. The genkey input
+ * comes with each request, so it's converted every time.
+ */
+static int rsa_fmt_key(struct wd_rsa_msg *msg, __u8 alg)
+{
+	int ret;
+
+	if (!wd_key_fmt_begin(msg->key_fmt))
+		return WD_SUCCESS;
+
+	ret = rsa_fill_key(msg, alg);
+	wd_key_fmt_end(msg->key_fmt, ret);
+
+	return ret;
+}
+
 static int rsa_prepare_key(struct wd_rsa_msg *msg,
 			      struct hisi_hpre_sqe *hw_msg)
 {
 	struct wd_rsa_req *req = &msg->req;
+	struct wd_dtb *dtb;
 	void *data;
 	int ret;
 
+	if (req->op_type != WD_RSA_SIGN && req->op_type != WD_RSA_VERIFY &&
+	    req->op_type != WD_RSA_GENKEY) {
+		WD_ERR("Invalid rsa operatin type!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = rsa_fmt_key(msg, hw_msg->alg);
+	if (ret)
+		return ret;
+
 	if (req->op_type == WD_RSA_SIGN) {
 		if (hw_msg->alg == HPRE_ALG_NC_CRT) {
-			ret = fill_rsa_crt_prikey2((void *)msg->key, &data);
-			if (ret <= 0)
-				return ret;
+			wd_rsa_get_crt_prikey_params((void *)msg->key, &dtb,
+						     NULL, NULL, NULL, NULL);
 		} else {
-			ret = fill_rsa_prikey1((void *)msg->key, &data);
-			if (ret < 0)
-				return ret;
+			wd_rsa_get_prikey_params((void *)msg->key, &dtb, NULL);
 			hw_msg->alg = HPRE_ALG_NC_NCRT;
 		}
+		data = dtb->data;
 	} else if (req->op_type == WD_RSA_VERIFY) {
-		ret = fill_rsa_pubkey((void *)msg->key, &data);
-		if (ret < 0)
-			return ret;
+		wd_rsa_get_pubkey_params((void *)msg->key, &dtb, NULL);
+		data = dtb->data;
 		hw_msg->alg = HPRE_ALG_NC_NCRT;
-	} else if (req->op_type == WD_RSA_GENKEY) {
-		ret = fill_rsa_genkey_in((void *)msg->key);
-		if (ret)
-			return ret;
+	} else {
 		ret = wd_rsa_kg_in_data((void *)msg->key, (char **)&data);
 		if (ret < 0) {
 			WD_ERR("Get rsa gen key data in fail!\n");
@@ -409,9 +440,6 @@ static int rsa_prepare_key(struct wd_rsa_msg *msg,
 			hw_msg->alg = HPRE_ALG_KG_CRT;
 		else
 			hw_msg->alg = HPRE_ALG_KG_STD;
-	} else {
-		WD_ERR("Invalid rsa operatin type!\n");
-		return -WD_EINVAL;
 	}
 
 	hw_msg->low_key = LW_U32((uintptr_t)data);
@@ -498,66 +526,120 @@ static void hpre_exit(void *priv)
 	}
 }
 
-static int rsa_send(handle_t ctx, struct wd_rsa_msg *msg)
+static int rsa_fill_sqe(struct wd_rsa_msg *msg, struct hisi_hpre_sqe *hw_msg)
 {
-	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
-	struct hisi_hpre_sqe hw_msg;
-	__u16 send_cnt = 0;
 	int ret;
 
-	memset(&hw_msg, 0, sizeof(struct hisi_hpre_sqe));
+	memset(hw_msg, 0, sizeof(struct hisi_hpre_sqe));
 
 	if (msg->key_type == WD_RSA_PRIKEY1 ||
 	msg->key_type == WD_RSA_PUBKEY)
-		hw_msg.alg = HPRE_ALG_NC_NCRT;
+		hw_msg->alg = HPRE_ALG_NC_NCRT;
 	else if (msg->key_type == WD_RSA_PRIKEY2)
-		hw_msg.alg = HPRE_ALG_NC_CRT;
+		hw_msg->alg = HPRE_ALG_NC_CRT;
 	else
 		return -WD_EINVAL;
 
-	hw_msg.task_len1 = msg->key_bytes / BYTE_BITS - 0x1;
+	hw_msg->task_len1 = msg->key_bytes / BYTE_BITS - 0x1;
 
-	ret = rsa_prepare_key(msg, &hw_msg);
+	ret = rsa_prepare_key(msg, hw_msg);
 	if (ret < 0)
 		return ret;
 
 	/* prepare in/out put */
-	ret = rsa_prepare_iot(msg, &hw_msg);
+	ret = rsa_prepare_iot(msg, hw_msg);
 	if (ret < 0)
 		return ret;
 
-	hw_msg.done = 0x1;
-	hw_msg.etype = 0x0;
-	hw_msg.low_tag = msg->tag;
+	hw_msg->done = 0x1;
+	hw_msg->etype = 0x0;
+	hw_msg->low_tag = msg->tag;
+
+	return 0;
+}
+
+static int rsa_send(handle_t ctx, struct wd_rsa_msg *msg)
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	struct hisi_hpre_sqe hw_msg;
+	__u16 send_cnt = 0;
+	int ret;
+
+	ret = rsa_fill_sqe(msg, &hw_msg);
+	if (ret)
+		return ret;
 
 	return hisi_qm_send(h_qp, &hw_msg, 1, &send_cnt);
 }
 
+static int rsa_send_batch(handle_t ctx, struct wd_rsa_msg **msgs, __u32 num,
+			  __u32 *count)
+{
+	struct hisi_hpre_sqe sqes[HPRE_SEND_BATCH_NUM];
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	__u16 fill_num, send_num;
+	int ret = 0;
+
+	*count = 0;
+	while (*count < num) {
+		fill_num = 0;
+		while (fill_num < HPRE_SEND_BATCH_NUM &&
+		       *count + fill_num < num) {
+			ret = rsa_fill_sqe(msgs[*count + fill_num],
+					   &sqes[fill_num]);
+			if (ret)
+				break;
+			fill_num++;
+		}
+
+		if (!fill_num)
+			break;
+
+		send_num = 0;
+		ret = hisi_qm_send(h_qp, sqes, fill_num, &send_num);
+		*count += send_num;
+		if (send_num < fill_num)
+			break;
+	}
+
+	return *count ? 0 : ret;
+}
+
+/* Count a task failed on an I/O page fault in the counters of the queue */
+static void hpre_sva_error(handle_t h_qp, __u8 status)
+{
+	struct wd_ctx_queue_stats *stats = &((struct hisi_qp *)h_qp)->stats->queue;
+
+	WD_ERR("failed to SVA prefetch: status=%u\n", status);
+	__atomic_fetch_add(&stats->sva_err_num, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats->sva_status, status, __ATOMIC_RELAXED);
+}
+
 static int rsa_recv(handle_t ctx, struct wd_rsa_msg *msg)
 {
 	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
-	struct hisi_hpre_sqe hw_msg = {0};
+	struct hisi_hpre_sqe *hw_msg;
 	__u16 recv_cnt = 0;
 	int ret;
 
-	ret = hisi_qm_recv(h_qp, &hw_msg, 1, &recv_cnt);
+	/* parse the sqe in the queue, and give it back after that */
+	ret = hisi_qm_recv_peek(h_qp, (void **)&hw_msg, 1, &recv_cnt);
 	if (ret < 0)
 		return ret;
 
-	if (hw_msg.done != HPRE_HW_TASK_DONE ||
-			hw_msg.etype || hw_msg.etype1) {
+	if (hw_msg->done != HPRE_HW_TASK_DONE ||
+			hw_msg->etype || hw_msg->etype1) {
 		WD_ERR("HPRE do rsa fail!done=0x%x, etype=0x%x, etype1=0x%x\n",
-			hw_msg.done, hw_msg.etype, hw_msg.etype1);
-		if (hw_msg.etype1 & HPRE_HW_SVA_ERROR)
-			WD_ERR("failed to SVA prefetch: status=%u\n",
-				hw_msg.sva_status);
-		if (hw_msg.done == HPRE_HW_TASK_INIT)
+			hw_msg->done, hw_msg->etype, hw_msg->etype1);
+		if (hw_msg->etype1 & HPRE_HW_SVA_ERROR)
+			hpre_sva_error(h_qp, hw_msg->sva_status);
+		if (hw_msg->done == HPRE_HW_TASK_INIT)
 			msg->result = WD_EINVAL;
 		else
 			msg->result = WD_IN_EPARA;
 	} else {
-		msg->tag = LW_U16(hw_msg.low_tag);
-		ret = rsa_out_transfer(msg, &hw_msg);
+		msg->tag = LW_U16(hw_msg->low_tag);
+		ret = rsa_out_transfer(msg, hw_msg);
 		if (ret) {
 			WD_ERR("qm rsa out transfer fail!\n");
 			msg->result = WD_OUT_EPARA;
@@ -566,7 +648,7 @@ static int rsa_recv(handle_t ctx, struct wd_rsa_msg *msg)
 		}
 	}
 
-	return 0;
+	return hisi_qm_recv_release(h_qp, recv_cnt);
 }
 
 static struct wd_rsa_driver rsa_hisi_hpre = {
@@ -577,6 +659,7 @@ static struct wd_rsa_driver rsa_hisi_hpre = {
 	.exit			= hpre_exit,
 	.send			= rsa_send,
 	.recv			= rsa_recv,
+	.send_batch		= rsa_send_batch,
 };
 
 static int fill_dh_xp_params(struct wd_dh_msg *msg,
@@ -691,8 +774,7 @@ static int dh_recv(handle_t ctx, struct wd_dh_msg *msg)
 		WD_ERR("HPRE do dh fail!done=0x%x, etype=0x%x, etype1=0x%x\n",
 			hw_msg.done, hw_msg.etype, hw_msg.etype1);
 		if (hw_msg.etype1 & HPRE_HW_SVA_ERROR)
-			WD_ERR("failed to SVA prefetch: status=%u\n",
-				hw_msg.sva_status);
+			hpre_sva_error(h_qp, hw_msg.sva_status);
 		if (hw_msg.done == HPRE_HW_TASK_INIT)
 			msg->result = WD_EINVAL;
 		else
@@ -836,7 +918,7 @@ static bool less_than_latter(struct wd_dtb *d, struct wd_dtb *n)
 		return false;
 }
 
-static int ecc_prepare_prikey(struct wd_ecc_key *key, void **data, int id)
+static int fill_ecc_prikey(struct wd_ecc_key *key, int id)
 {
 	struct wd_ecc_point *g = NULL;
 	struct wd_dtb *p = NULL;
@@ -893,7 +975,23 @@ static int ecc_prepare_prikey(struct wd_ecc_key *key, void **data, int id)
 		return -WD_EINVAL;
 	}
 
-	*data = p->data;
+	return 0;
+}
+
+/* The key is converted by the first send after it's set, see rsa_fmt_key() */
+static int ecc_prepare_prikey(struct wd_ecc_key *key, void **data, int id)
+{
+	struct wd_ecc_prikey *prikey = key->prikey;
+	int ret;
+
+	if (wd_key_fmt_begin(&prikey->fmt)) {
+		ret = fill_ecc_prikey(key, id);
+		wd_key_fmt_end(&prikey->fmt, ret);
+		if (ret)
+			return ret;
+	}
+
+	*data = prikey->p.data;
 
 	return 0;
 }
@@ -914,7 +1012,7 @@ static int trans_pub_to_hpre_bin(struct wd_ecc_point *pub)
 				      temp->bsize, temp->dsize, "ecc pub y");
 }
 
-static int ecc_prepare_pubkey(struct wd_ecc_key *key, void **data)
+static int fill_ecc_pubkey(struct wd_ecc_key *key)
 {
 	struct wd_ecc_point *pub = NULL;
 	struct wd_ecc_point *g = NULL;
@@ -930,11 +1028,22 @@ static int ecc_prepare_pubkey(struct wd_ecc_key *key, void **data)
 	if (ret)
 		return ret;
 
-	ret = trans_pub_to_hpre_bin(pub);
-	if (ret)
-		return ret;
+	return trans_pub_to_hpre_bin(pub);
+}
 
-	*data = p->data;
+static int ecc_prepare_pubkey(struct wd_ecc_key *key, void **data)
+{
+	struct wd_ecc_pubkey *pubkey = key->pubkey;
+	int ret;
+
+	if (wd_key_fmt_begin(&pubkey->fmt)) {
+		ret = fill_ecc_pubkey(key);
+		wd_key_fmt_end(&pubkey->fmt, ret);
+		if (ret)
+			return ret;
+	}
+
+	*data = pubkey->p.data;
 
 	return 0;
 }
@@ -1381,6 +1490,7 @@ static __u32 get_hw_keysz(__u32 ksz)
 
 static void init_prikey(struct wd_ecc_prikey *prikey, __u32 bsz)
 {
+	prikey->fmt = WD_KEY_FMT_RAW;
 	prikey->p.dsize = 0;
 	prikey->p.bsize = bsz;
 	prikey->p.data = prikey->data;
@@ -1660,7 +1770,8 @@ static int sm2_enc_send(handle_t ctx, struct wd_ecc_msg *msg)
 		return -WD_EINVAL;
 	}
 
-	if (unlikely(!hash->cb || hash->type >= WD_HASH_MAX)) {
+	if (unlikely((!hash->cb && !wd_ecc_hash_is_soft(hash->type)) ||
+		     hash->type >= WD_HASH_MAX)) {
 		WD_ERR("hash parameter error, type = %u\n", hash->type);
 		return -WD_EINVAL;
 	}
@@ -1714,7 +1825,8 @@ static int sm2_dec_send(handle_t ctx, struct wd_ecc_msg *msg)
 		hash->type == WD_HASH_SM3)
 		return ecc_general_send(ctx, msg);
 
-	if (unlikely(!hash->cb || hash->type >= WD_HASH_MAX)) {
+	if (unlikely((!hash->cb && !wd_ecc_hash_is_soft(hash->type)) ||
+		     hash->type >= WD_HASH_MAX)) {
 		WD_ERR("hash parameter error, type = %u\n", hash->type);
 		return -WD_EINVAL;
 	}
@@ -1751,6 +1863,57 @@ static int ecc_send(handle_t ctx, struct wd_ecc_msg *msg)
 	return ecc_general_send(ctx, msg);
 }
 
+/*
+ * The sqes of the general operations are filled in a burst, sm2 encryption
+ * and decryption may be split into several sqes, so they are sent by
+ * ecc_send() one by one, after the burst in front of them.
+ */
+static int ecc_send_batch(handle_t ctx, struct wd_ecc_msg **msgs, __u32 num,
+			  __u32 *count)
+{
+	struct hisi_hpre_sqe sqes[HPRE_SEND_BATCH_NUM];
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	__u16 fill_num, send_num;
+	struct wd_ecc_msg *msg;
+	int ret = 0;
+
+	*count = 0;
+	while (*count < num) {
+		fill_num = 0;
+		while (fill_num < HPRE_SEND_BATCH_NUM &&
+		       *count + fill_num < num) {
+			msg = msgs[*count + fill_num];
+			if (msg->req.op_type == WD_SM2_ENCRYPT ||
+			    msg->req.op_type == WD_SM2_DECRYPT)
+				break;
+
+			ret = ecc_fill(msg, &sqes[fill_num]);
+			if (ret)
+				break;
+			fill_num++;
+		}
+
+		if (!fill_num) {
+			if (ret)
+				break;
+
+			ret = ecc_send(ctx, msgs[*count]);
+			if (ret)
+				break;
+			(*count)++;
+			continue;
+		}
+
+		send_num = 0;
+		ret = hisi_qm_send(h_qp, sqes, fill_num, &send_num);
+		*count += send_num;
+		if (send_num < fill_num)
+			break;
+	}
+
+	return *count ? 0 : ret;
+}
+
 static int ecdh_out_transfer(struct wd_ecc_msg *msg, struct hisi_hpre_sqe *hw_msg)
 {
 	struct wd_ecc_out *out = (void *)msg->req.dst;
@@ -1918,75 +2081,16 @@ static __u32 get_hash_bytes(__u8 type)
 	return val;
 }
 
-static void msg_pack(char *dst, __u64 dst_len, __u64 *out_len,
-		     const void *src, __u32 src_len)
-{
-	if (unlikely(!src || !src_len))
-		return;
-
-	memcpy(dst + *out_len, src, src_len);
-	*out_len += src_len;
-}
-
 static int sm2_kdf(struct wd_dtb *out, struct wd_ecc_point *x2y2,
 		   __u64 m_len, struct wd_hash_mt *hash)
 {
-	char p_out[MAX_HASH_LENS] = {0};
-	__u32 h_bytes, x2y2_len;
-	char *tmp = out->data;
-	__u64 in_len, lens;
-	char *p_in, *t_out;
-	__u8 ctr[4];
-	__u32 i = 1;
-	int ret;
+	__u32 h_bytes;
 
 	h_bytes = get_hash_bytes(hash->type);
 	if (unlikely(!h_bytes))
 		return -WD_EINVAL;
 
-	x2y2_len = x2y2->x.dsize + x2y2->y.dsize;
-	lens = x2y2_len + sizeof(ctr);
-	p_in = malloc(lens);
-	if (unlikely(!p_in))
-		return -WD_ENOMEM;
-
-	/*
-	 * Use big-endian mode to store the value of counter i in ctr,
-	 * i >> 8/16/24 for intercepts 8-bits whole-byte data.
-	 */
-	out->dsize = m_len;
-	while (1) {
-		in_len = 0;
-		ctr[3] = i & 0xFF;
-		ctr[2] = (i >> 8) & 0xFF;
-		ctr[1] = (i >> 16) & 0xFF;
-		ctr[0] = (i >> 24) & 0xFF;
-		msg_pack(p_in, lens, &in_len, x2y2->x.data, x2y2_len);
-		msg_pack(p_in, lens, &in_len, ctr, sizeof(ctr));
-
-		t_out = m_len >= h_bytes ? tmp : p_out;
-		ret = hash->cb(p_in, in_len, t_out, h_bytes, hash->usr);
-		if (ret) {
-			WD_ERR("failed to hash cb, ret = %d!\n", ret);
-			break;
-		}
-
-		if (m_len >= h_bytes) {
-			tmp += h_bytes;
-			m_len -= h_bytes;
-			if (!m_len)
-				break;
-		} else {
-			memcpy(tmp, p_out, m_len);
-			break;
-		}
-
-		i++;
-	}
-
-	free(p_in);
-
-	return ret;
+	return wd_ecc_sm2_kdf(out, x2y2, m_len, hash, h_bytes);
 }
 
 static void sm2_xor(struct wd_dtb *val1, struct wd_dtb *val2)
@@ -2011,37 +2115,28 @@ static int is_equal(struct wd_dtb *src, struct wd_dtb *dst)
 static int sm2_hash(struct wd_dtb *out, struct wd_ecc_point *x2y2,
 		    struct wd_dtb *msg, struct wd_hash_mt *hash)
 {
-	__u64 lens = (__u64)msg->dsize + 2 * (__u64)x2y2->x.dsize;
 	char hash_out[MAX_HASH_LENS] = {0};
-	__u64 in_len = 0;
+	struct wd_dtb in[3];
 	__u32 h_bytes;
-	char *p_in;
 	int ret;
 
 	h_bytes = get_hash_bytes(hash->type);
 	if (unlikely(!h_bytes))
 		return -WD_EINVAL;
 
-	p_in = malloc(lens);
-	if (unlikely(!p_in))
-		return -WD_ENOMEM;
-
-	msg_pack(p_in, lens, &in_len, x2y2->x.data, x2y2->x.dsize);
-	msg_pack(p_in, lens, &in_len, msg->data, msg->dsize);
-	msg_pack(p_in, lens, &in_len, x2y2->y.data, x2y2->y.dsize);
-	ret = hash->cb(p_in, in_len, hash_out, h_bytes, hash->usr);
+	in[0] = x2y2->x;
+	in[1] = *msg;
+	in[2] = x2y2->y;
+	ret = wd_ecc_hash_dtbs(hash, in, ARRAY_SIZE(in), hash_out, h_bytes);
 	if (unlikely(ret)) {
-		WD_ERR("failed to hash cb, ret = %d!\n", ret);
-		goto fail;
+		WD_ERR("failed to sm2 hash, ret = %d!\n", ret);
+		return ret;
 	}
 
 	out->dsize = h_bytes;
 	memcpy(out->data, hash_out, out->dsize);
 
-fail:
-	free(p_in);
-
-	return ret;
+	return 0;
 }
 
 static int sm2_convert_enc_out(struct wd_ecc_msg *src,
@@ -2150,7 +2245,8 @@ static int sm2_convert_dec_out(struct wd_ecc_msg *src,
 	return ret;
 }
 
-static int ecc_sqe_parse(struct wd_ecc_msg *msg, struct hisi_hpre_sqe *hw_msg)
+static int ecc_sqe_parse(handle_t h_qp, struct wd_ecc_msg *msg,
+			 struct hisi_hpre_sqe *hw_msg)
 {
 	int ret;
 
@@ -2159,8 +2255,7 @@ static int ecc_sqe_parse(struct wd_ecc_msg *msg, struct hisi_hpre_sqe *hw_msg)
 		WD_ERR("HPRE do ecc fail!done=0x%x, etype=0x%x, etype1=0x%x\n",
 			hw_msg->done, hw_msg->etype, hw_msg->etype1);
 		if (hw_msg->etype1 & HPRE_HW_SVA_ERROR)
-			WD_ERR("failed to SVA prefetch: status=%u\n",
-				hw_msg->sva_status);
+			hpre_sva_error(h_qp, hw_msg->sva_status);
 
 		if (hw_msg->done == HPRE_HW_TASK_INIT)
 			ret = -WD_EINVAL;
@@ -2209,7 +2304,7 @@ static int parse_second_sqe(handle_t h_qp,
 	dst = *(struct wd_ecc_msg **)((uintptr_t)data +
 		hsz * ECDH_OUT_PARAM_NUM);
 	hw_msg.low_tag = 0; /* use sync mode */
-	ret = ecc_sqe_parse(dst, &hw_msg);
+	ret = ecc_sqe_parse(h_qp, dst, &hw_msg);
 	msg->result = dst->result;
 	*second = dst;
 
@@ -2235,7 +2330,7 @@ static int sm2_enc_parse(handle_t h_qp,
 
 	/* parse first sqe */
 	hw_msg->low_tag = 0; /* use sync mode */
-	ret = ecc_sqe_parse(first, hw_msg);
+	ret = ecc_sqe_parse(h_qp, first, hw_msg);
 	if (ret) {
 		WD_ERR("failed to parse first BD, ret = %d\n", ret);
 		goto free_first;
@@ -2279,7 +2374,7 @@ static int sm2_dec_parse(handle_t ctx, struct wd_ecc_msg *msg,
 
 	/* parse first sqe */
 	hw_msg->low_tag = 0; /* use sync mode */
-	ret = ecc_sqe_parse(dst, hw_msg);
+	ret = ecc_sqe_parse(ctx, dst, hw_msg);
 	if (ret) {
 		WD_ERR("failed to parse decode BD, ret = %d\n", ret);
 		goto fail;
@@ -2317,7 +2412,7 @@ static int ecc_recv(handle_t ctx, struct wd_ecc_msg *msg)
 		hw_msg.sm2_mlen == HPRE_SM2_DEC)
 		return sm2_dec_parse(h_qp, msg, &hw_msg);
 
-	return ecc_sqe_parse(msg, &hw_msg);
+	return ecc_sqe_parse(h_qp, msg, &hw_msg);
 }
 
 static struct wd_ecc_driver ecc_hisi_hpre = {
@@ -2328,6 +2423,7 @@ static struct wd_ecc_driver ecc_hisi_hpre = {
 	.exit			= hpre_exit,
 	.send			= ecc_send,
 	.recv			= ecc_recv,
+	.send_batch		= ecc_send_batch,
 };
 
 WD_RSA_SET_DRIVER(rsa_hisi_hpre);
@@ -29,15 +29,29 @@
 /* the max sge num in one sgl */
 #define HISI_SGE_NUM_IN_SGL 255
 
-/* the max sge num in on BD, QM user it be the sgl pool size */
-#define HISI_SGL_NUM_IN_BD 256
+/* the sge num in one sgl of the shared pools, most lists are short */
+#define HISI_SGE_NUM_DEFAULT 16
+
+/* the sgl num shared by the qps in one NUMA node */
+#define HISI_SGL_NUM_IN_NODE 4096
+
+/* the sgls a qp keeps for itself before returning them to its node */
+#define HISI_SGL_CACHE_NUM 32
+/* the caches of all the qps of a node keep at most 1/4 of its sgls */
+#define HISI_SGL_CACHE_SHIFT 2
 
 /* sgl address must be 64 bytes aligned */
 #define HISI_SGL_ALIGE 64
 
 #define HISI_MAX_SIZE_IN_SGE (1024 * 1024 * 8)
 
-#define ADDR_ALIGN_64(addr) ((((uintptr_t)(addr) >> 6) + 1) << 6)
+#define SGL_HUGE_SIZE		(2UL * 1024 * 1024)
+#define SGL_NODE_MAX		64
+#define SGL_IDX_NONE		0xffffffffU
+/* the low 32 bits of a stack head is the top index, the high is a tag */
+#define SGL_TAG_NEXT(head)	(((head) & ~0xffffffffULL) + (1ULL << 32))
+#define SGL_SGE_NUM_ENV		"WD_SGL_SGE_NUM"
+#define SGL_NUM_ENV		"WD_SGL_NUM"
 
 struct hisi_qm_type {
 	__u16	qm_ver;
@@ -87,19 +101,42 @@ struct hisi_sgl {
 	struct hisi_sge sge_entries[];
 };
 
-struct hisi_sgl_pool {
-	/* the addr64 align offset base sgl */
-	void **sgl_align;
-	/* the sgl src address array */
-	void **sgl;
-	/* the sgl pool stack depth */
-	__u32 depth;
-	__u32 top;
+/* the sgls carved from one region, shared by the qps of a node */
+struct hisi_sgl_area {
+	void *base;
+	size_t mem_size;
+	/* the sgl size with its sges, 64 bytes aligned */
+	__u32 sgl_size;
 	__u32 sge_num;
 	__u32 sgl_num;
-	pthread_spinlock_t lock;
+	/* the lock free stack of the free sgls, linked by next[] */
+	__u64 head;
+	__u32 *next;
+	__u32 free_num;
+	__u32 peak_num;
+	__u32 fail_num;
+	/* the sgls in the caches of the pools, up to cache_limit */
+	__u32 cache_num;
+	__u32 cache_limit;
+	__u8 hugepage;
+	/* the node it's shared in, -1 for a private one */
+	int node;
+	int ref;
 };
 
+/* the view of a qp on an sgl area, with a cache of its own */
+struct hisi_sgl_pool {
+	struct hisi_sgl_area *area;
+	__u64 cache_head;
+	__u32 cache_num;
+	__u32 cache_max;
+};
+
+static struct hisi_sgl_area *sgl_areas[SGL_NODE_MAX];
+static pthread_mutex_t sgl_area_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static handle_t hisi_qm_get_node_sglpool(int node);
+
 static int hacc_db_v1(struct hisi_qm_queue_info *q, __u8 cmd,
 		      __u16 idx, __u8 priority)
 {
@@ -345,6 +382,50 @@ int hisi_qm_get_free_sqe_num(handle_t h_qp)
 	return get_free_num(&qp->q_info);
 }
 
+static void hisi_qm_stats_send(struct hisi_qp *qp, __u16 tail, __u16 num)
+{
+	struct wd_ctx_queue_stats *stats = &qp->stats->queue;
+	__u32 used = qp->q_info.used_num;
+	__u64 now;
+	__u16 i;
+
+	stats->send_num += num;
+	stats->inflight = used;
+	if (used > stats->inflight_peak)
+		stats->inflight_peak = used;
+
+	if (!qp->stamp)
+		return;
+
+	now = wd_ctx_stats_ns();
+	for (i = 0; i < num; i++)
+		qp->stamp[(tail + i) % QM_Q_DEPTH] = now;
+}
+
+/* Count @num completions, whose sqes are from @head on, under q_info.lock */
+static void hisi_qm_stats_recv(struct hisi_qp *qp, __u16 head, __u16 num)
+{
+	struct wd_ctx_queue_stats *stats = &qp->stats->queue;
+	__u64 now;
+	__u16 i;
+
+	if (!num) {
+		stats->empty_num++;
+		return;
+	}
+
+	stats->recv_num += num;
+	stats->inflight = qp->q_info.used_num;
+
+	if (!qp->stamp)
+		return;
+
+	now = wd_ctx_stats_ns();
+	for (i = 0; i < num; i++)
+		wd_ctx_stats_lat(stats->lat,
+				 now - qp->stamp[(head + i) % QM_Q_DEPTH]);
+}
+
 handle_t hisi_qm_alloc_qp(struct hisi_qm_priv *config, handle_t ctx)
 {
 	struct hisi_qp *qp;
@@ -363,12 +444,21 @@ handle_t hisi_qm_alloc_qp(struct hisi_qm_priv *config, handle_t ctx)
 		goto out;
 
 	qp->h_ctx = ctx;
+	qp->stats = wd_ctx_get_stats_area(ctx);
+	if (!qp->stats)
+		goto out_qp;
+
+	if (qp->stats->lat_en) {
+		qp->stamp = calloc(QM_Q_DEPTH, sizeof(__u64));
+		if (!qp->stamp)
+			goto out_qp;
+	}
 
 	ret = hisi_qm_setup_info(qp, config);
 	if (ret)
 		goto out_qp;
 
-	qp->h_sgl_pool = hisi_qm_create_sglpool(HISI_SGL_NUM_IN_BD, HISI_SGE_NUM_IN_SGL);
+	qp->h_sgl_pool = hisi_qm_get_node_sglpool(wd_get_numa_id(qp->h_ctx));
 	if (!qp->h_sgl_pool)
 		goto out_qp;
 
@@ -387,6 +477,7 @@ handle_t hisi_qm_alloc_qp(struct hisi_qm_priv *config, handle_t ctx)
 free_pool:
 	hisi_qm_destroy_sglpool(qp->h_sgl_pool);
 out_qp:
+	free(qp->stamp);
 	free(qp);
 out:
 	return (handle_t)NULL;
@@ -407,6 +498,7 @@ void hisi_qm_free_qp(handle_t h_qp)
 	if (qp->h_sgl_pool)
 		hisi_qm_destroy_sglpool(qp->h_sgl_pool);
 
+	free(qp->stamp);
 	free(qp);
 }
 
@@ -430,6 +522,7 @@ int hisi_qm_send(handle_t h_qp, const void *req, __u16 expect, __u16 *count)
 	pthread_spin_lock(&q_info->lock);
 	free_num = get_free_num(q_info);
 	if (!free_num) {
+		qp->stats->queue.busy_num++;
 		pthread_spin_unlock(&q_info->lock);
 		return -WD_EBUSY;
 	}
@@ -438,10 +531,11 @@ int hisi_qm_send(handle_t h_qp, const void *req, __u16 expect, __u16 *count)
 
 	tail = q_info->sq_tail_index;
 	hisi_qm_fill_sqe(req, q_info, tail, send_num);
+	q_info->used_num += send_num;
+	hisi_qm_stats_send(qp, tail, send_num);
 	tail = (tail + send_num) % QM_Q_DEPTH;
 	q_info->db(q_info, QM_DBELL_CMD_SQ, tail, 0);
 	q_info->sq_tail_index = tail;
-	q_info->used_num += send_num;
 	*count = send_num;
 
 	pthread_spin_unlock(&q_info->lock);
@@ -449,54 +543,71 @@ int hisi_qm_send(handle_t h_qp, const void *req, __u16 expect, __u16 *count)
 	return 0;
 }
 
-static int hisi_qm_recv_single(struct hisi_qm_queue_info *q_info, void *resp)
+/*
+ * Harvest up to @expect ready cqes under one lock, the cq doorbell is rung
+ * only once with the final head, instead of once per completion.
+ */
+static int hisi_qm_recv_bulk(struct hisi_qp *qp, void *resp,
+			     __u16 expect, __u16 *count)
 {
+	struct hisi_qm_queue_info *q_info = &qp->q_info;
+	__u16 recv_num = 0;
 	struct cqe *cqe;
+	int ret = 0;
+	__u16 head;
 	__u16 i, j;
 
 	pthread_spin_lock(&q_info->lock);
+	head = q_info->cq_head_index;
 	i = q_info->cq_head_index;
-	cqe = q_info->cq_base + i * sizeof(struct cqe);
+	while (recv_num < expect) {
+		cqe = q_info->cq_base + i * sizeof(struct cqe);
+		if (q_info->cqc_phase != CQE_PHASE(cqe)) {
+			ret = -WD_EAGAIN;
+			break;
+		}
 
-	if (q_info->cqc_phase == CQE_PHASE(cqe)) {
 		j = CQE_SQ_HEAD_INDEX(cqe);
 		if (j >= QM_Q_DEPTH) {
-			pthread_spin_unlock(&q_info->lock);
 			WD_ERR("CQE_SQ_HEAD_INDEX(%u) error\n", j);
-			return -WD_EIO;
+			ret = -WD_EIO;
+			break;
 		}
-		memcpy(resp, (void *)((uintptr_t)q_info->sq_base +
-			j * q_info->sqe_size), q_info->sqe_size);
-	} else {
-		pthread_spin_unlock(&q_info->lock);
-		return -WD_EAGAIN;
-	}
+		memcpy(resp + recv_num * q_info->sqe_size,
+		       (void *)((uintptr_t)q_info->sq_base +
+		       j * q_info->sqe_size), q_info->sqe_size);
+		recv_num++;
 
-	if (i == QM_Q_DEPTH - 1) {
-		q_info->cqc_phase = !(q_info->cqc_phase);
-		i = 0;
-	} else {
-		i++;
+		if (i == QM_Q_DEPTH - 1) {
+			q_info->cqc_phase = !(q_info->cqc_phase);
+			i = 0;
+		} else {
+			i++;
+		}
 	}
 
-	q_info->db(q_info, QM_DBELL_CMD_CQ, i, 0);
+	if (recv_num) {
+		q_info->db(q_info, QM_DBELL_CMD_CQ, i, 0);
 
-	/* only support one thread poll one queue, so no need protect */
-	q_info->cq_head_index = i;
-	q_info->sq_head_index = i;
+		/* only support one thread poll one queue, so no need protect */
+		q_info->cq_head_index = i;
+		q_info->sq_head_index = i;
 
-	q_info->used_num--;
+		q_info->used_num -= recv_num;
+	}
+	hisi_qm_stats_recv(qp, head, recv_num);
 	pthread_spin_unlock(&q_info->lock);
 
-	return 0;
+	*count = recv_num;
+
+	return ret;
 }
 
 int hisi_qm_recv(handle_t h_qp, void *resp, __u16 expect, __u16 *count)
 {
 	struct hisi_qp *qp = (struct hisi_qp *)h_qp;
 	struct hisi_qm_queue_info *q_info;
-	int recv_num = 0;
-	int i, ret, offset;
+	int ret;
 
 	if (!resp || !qp || !count)
 		return -WD_EINVAL;
@@ -510,188 +621,486 @@ int hisi_qm_recv(handle_t h_qp, void *resp, __u16 expect, __u16 *count)
 		return -WD_HW_EACCESS;
 	}
 
-	for (i = 0; i < expect; i++) {
-		offset = i * q_info->sqe_size;
-		ret = hisi_qm_recv_single(q_info, resp + offset);
-		if (ret)
+	ret = hisi_qm_recv_bulk(qp, resp, expect, count);
+	if (wd_ioread32(q_info->ds_rx_base) == 1) {
+		WD_ERR("wd queue hw error happened in qm receive!\n");
+		return -WD_HW_EACCESS;
+	}
+
+	return ret;
+}
+
+int hisi_qm_recv_peek(handle_t h_qp, void **sqes, __u16 expect, __u16 *count)
+{
+	struct hisi_qp *qp = (struct hisi_qp *)h_qp;
+	struct hisi_qm_queue_info *q_info;
+	__u16 recv_num = 0;
+	struct cqe *cqe;
+	bool phase;
+	int ret = 0;
+	__u16 i, j;
+
+	if (!qp || !sqes || !count)
+		return -WD_EINVAL;
+
+	*count = 0;
+	if (!expect)
+		return 0;
+
+	q_info = &qp->q_info;
+	if (wd_ioread32(q_info->ds_rx_base) == 1) {
+		WD_ERR("wd queue hw error happened before qm receive!\n");
+		return -WD_HW_EACCESS;
+	}
+
+	pthread_spin_lock(&q_info->lock);
+	i = q_info->cq_head_index;
+	phase = q_info->cqc_phase;
+	while (recv_num < expect) {
+		cqe = q_info->cq_base + i * sizeof(struct cqe);
+		if (phase != CQE_PHASE(cqe))
 			break;
-		recv_num++;
+
+		j = CQE_SQ_HEAD_INDEX(cqe);
+		if (j >= QM_Q_DEPTH) {
+			WD_ERR("CQE_SQ_HEAD_INDEX(%u) error\n", j);
+			ret = -WD_EIO;
+			break;
+		}
+		sqes[recv_num++] = (void *)((uintptr_t)q_info->sq_base +
+				   j * q_info->sqe_size);
+
+		if (i == QM_Q_DEPTH - 1) {
+			phase = !phase;
+			i = 0;
+		} else {
+			i++;
+		}
 	}
+	if (!recv_num)
+		qp->stats->queue.empty_num++;
+	pthread_spin_unlock(&q_info->lock);
+
+	*count = recv_num;
+	if (recv_num)
+		return 0;
+
+	return ret ? ret : -WD_EAGAIN;
+}
+
+int hisi_qm_recv_release(handle_t h_qp, __u16 num)
+{
+	struct hisi_qp *qp = (struct hisi_qp *)h_qp;
+	struct hisi_qm_queue_info *q_info;
+	__u16 head, i;
+
+	if (!qp)
+		return -WD_EINVAL;
+
+	if (!num)
+		return 0;
+
+	q_info = &qp->q_info;
+	pthread_spin_lock(&q_info->lock);
+	head = q_info->cq_head_index;
+	i = head + num;
+	if (i >= QM_Q_DEPTH) {
+		q_info->cqc_phase = !(q_info->cqc_phase);
+		i -= QM_Q_DEPTH;
+	}
+
+	q_info->db(q_info, QM_DBELL_CMD_CQ, i, 0);
+
+	/* only support one thread poll one queue, so no need protect */
+	q_info->cq_head_index = i;
+	q_info->sq_head_index = i;
+
+	q_info->used_num -= num;
+	hisi_qm_stats_recv(qp, head, num);
+	pthread_spin_unlock(&q_info->lock);
 
-	*count = recv_num++;
 	if (wd_ioread32(q_info->ds_rx_base) == 1) {
 		WD_ERR("wd queue hw error happened in qm receive!\n");
 		return -WD_HW_EACCESS;
 	}
 
-	return ret;
+	return 0;
 }
 
-static void *hisi_qm_create_sgl(__u32 sge_num)
+static void sgl_stack_push(__u64 *head, __u32 *next, __u32 idx)
 {
-	void *sgl;
-	int size;
+	__u64 old, new;
+
+	old = __atomic_load_n(head, __ATOMIC_RELAXED);
+	do {
+		__atomic_store_n(&next[idx], (__u32)old, __ATOMIC_RELAXED);
+		new = SGL_TAG_NEXT(old) | idx;
+	} while (!__atomic_compare_exchange_n(head, &old, new, true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
 
-	size = sizeof(struct hisi_sgl) +
-			sge_num * (sizeof(struct hisi_sge)) + HISI_SGL_ALIGE;
-	sgl = calloc(1, size);
-	if (!sgl) {
-		WD_ERR("failed to create sgl\n");
-		return NULL;
+/* the tag of the head changes on every update, so a stale next is refused */
+static __u32 sgl_stack_pop(__u64 *head, __u32 *next)
+{
+	__u64 old, new;
+	__u32 idx;
+
+	old = __atomic_load_n(head, __ATOMIC_ACQUIRE);
+	do {
+		idx = (__u32)old;
+		if (idx == SGL_IDX_NONE)
+			return idx;
+
+		new = SGL_TAG_NEXT(old) |
+		      __atomic_load_n(&next[idx], __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(head, &old, new, true,
+					      __ATOMIC_ACQUIRE,
+					      __ATOMIC_ACQUIRE));
+
+	return idx;
+}
+
+static struct hisi_sgl *sgl_of_idx(struct hisi_sgl_area *area, __u32 idx)
+{
+	return (struct hisi_sgl *)(area->base + (size_t)idx * area->sgl_size);
+}
+
+static __u32 sgl_to_idx(struct hisi_sgl_area *area, struct hisi_sgl *sgl)
+{
+	return ((uintptr_t)sgl - (uintptr_t)area->base) / area->sgl_size;
+}
+
+static void sgl_reset(struct hisi_sgl_area *area, struct hisi_sgl *sgl)
+{
+	sgl->next_dma = 0;
+	sgl->entry_sum_in_chain = area->sge_num;
+	sgl->entry_sum_in_sgl = 0;
+	sgl->entry_length_in_sgl = area->sge_num;
+	sgl->entry_size_in_sgl = 0;
+}
+
+/* all the sgls are carved from one region, backed by hugepages if possible */
+static int sgl_area_map(struct hisi_sgl_area *area)
+{
+	size_t size = (size_t)area->sgl_num * area->sgl_size;
+
+	area->mem_size = (size + SGL_HUGE_SIZE - 1) & ~(SGL_HUGE_SIZE - 1);
+	area->base = mmap(NULL, area->mem_size, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (area->base != MAP_FAILED) {
+		area->hugepage = 1;
+		return 0;
+	}
+
+	area->mem_size = (size + getpagesize() - 1) &
+			 ~((size_t)getpagesize() - 1);
+	area->base = mmap(NULL, area->mem_size, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area->base == MAP_FAILED) {
+		WD_ERR("failed to mmap %zu bytes for sgls\n", area->mem_size);
+		return -WD_ENOMEM;
 	}
 
-	return sgl;
+	/* transparent hugepages still help the TLB of a big one */
+	(void)madvise(area->base, area->mem_size, MADV_HUGEPAGE);
+
+	return 0;
 }
 
-static struct hisi_sgl *hisi_qm_align_sgl(const void *sgl, __u32 sge_num)
+static struct hisi_sgl_area *sgl_area_create(__u32 sgl_num, __u32 sge_num)
 {
-	struct hisi_sgl *sgl_align;
+	struct hisi_sgl_area *area;
+	__u32 i;
+
+	area = calloc(1, sizeof(*area));
+	if (!area) {
+		WD_ERR("sgl area alloc memory failed.\n");
+		return NULL;
+	}
+
+	area->next = calloc(sgl_num, sizeof(__u32));
+	if (!area->next) {
+		WD_ERR("sgl next array alloc memory failed.\n");
+		goto err_free_area;
+	}
 
+	area->sgl_num = sgl_num;
+	area->sge_num = sge_num;
 	/* Hardware require the address must be 64 bytes aligned */
-	sgl_align = (struct hisi_sgl *)ADDR_ALIGN_64(sgl);
-	sgl_align->entry_sum_in_chain = sge_num;
-	sgl_align->entry_sum_in_sgl = 0;
-	sgl_align->entry_length_in_sgl = sge_num;
-	sgl_align->next_dma = 0;
+	area->sgl_size = (sizeof(struct hisi_sgl) +
+			  sge_num * sizeof(struct hisi_sge) +
+			  HISI_SGL_ALIGE - 1) & ~(HISI_SGL_ALIGE - 1);
+	if (sgl_area_map(area))
+		goto err_free_next;
+
+	area->head = SGL_IDX_NONE;
+	for (i = sgl_num; i > 0; i--) {
+		sgl_reset(area, sgl_of_idx(area, i - 1));
+		sgl_stack_push(&area->head, area->next, i - 1);
+	}
+	area->free_num = sgl_num;
+	area->cache_limit = sgl_num >> HISI_SGL_CACHE_SHIFT;
+	area->ref = 1;
+
+	return area;
 
-	return sgl_align;
+err_free_next:
+	free(area->next);
+err_free_area:
+	free(area);
+	return NULL;
+}
+
+static void sgl_area_put(struct hisi_sgl_area *area)
+{
+	if (area->node >= 0) {
+		pthread_mutex_lock(&sgl_area_lock);
+		if (--area->ref) {
+			pthread_mutex_unlock(&sgl_area_lock);
+			return;
+		}
+		sgl_areas[area->node] = NULL;
+		pthread_mutex_unlock(&sgl_area_lock);
+	}
+
+	munmap(area->base, area->mem_size);
+	free(area->next);
+	free(area);
+}
+
+static __u32 sgl_env_num(const char *name, __u32 def, __u32 max)
+{
+	const char *env = getenv(name);
+	unsigned long val;
+	char *end;
+
+	if (!env)
+		return def;
+
+	val = strtoul(env, &end, 10);
+	if (*end || !val || val > max) {
+		WD_ERR("invalid: %s is %s, use %u!\n", name, env, def);
+		return def;
+	}
+
+	return val;
+}
+
+/* the qps of one NUMA node share the sgls, only their caches are private */
+static struct hisi_sgl_area *sgl_area_get_node(int node)
+{
+	struct hisi_sgl_area *area;
+	__u32 sgl_num, sge_num;
+
+	if (node < 0 || node >= SGL_NODE_MAX)
+		node = 0;
+
+	pthread_mutex_lock(&sgl_area_lock);
+	area = sgl_areas[node];
+	if (area) {
+		area->ref++;
+		pthread_mutex_unlock(&sgl_area_lock);
+		return area;
+	}
+
+	sge_num = sgl_env_num(SGL_SGE_NUM_ENV, HISI_SGE_NUM_DEFAULT,
+			      HISI_SGE_NUM_IN_SGL);
+	sgl_num = sgl_env_num(SGL_NUM_ENV, HISI_SGL_NUM_IN_NODE,
+			      SGL_IDX_NONE - 1);
+	area = sgl_area_create(sgl_num, sge_num);
+	if (area) {
+		area->node = node;
+		sgl_areas[node] = area;
+	}
+	pthread_mutex_unlock(&sgl_area_lock);
+
+	return area;
+}
+
+static struct hisi_sgl_pool *sgl_pool_create(struct hisi_sgl_area *area,
+					     __u32 cache_max)
+{
+	struct hisi_sgl_pool *pool;
+
+	pool = calloc(1, sizeof(struct hisi_sgl_pool));
+	if (!pool) {
+		WD_ERR("sgl pool alloc memory failed.\n");
+		return NULL;
+	}
+
+	pool->area = area;
+	pool->cache_head = SGL_IDX_NONE;
+	pool->cache_max = cache_max;
+
+	return pool;
 }
 
 handle_t hisi_qm_create_sglpool(__u32 sgl_num, __u32 sge_num)
 {
-	struct hisi_sgl_pool *sgl_pool;
-	int i;
+	struct hisi_sgl_area *area;
+	struct hisi_sgl_pool *pool;
 
-	if (!sgl_num || !sge_num || sge_num > HISI_SGE_NUM_IN_SGL) {
+	if (!sgl_num || !sge_num || sge_num > HISI_SGE_NUM_IN_SGL ||
+	    sgl_num >= SGL_IDX_NONE) {
 		WD_ERR("create sgl_pool failed, sgl_num=%u, sge_num=%u\n",
 			sgl_num, sge_num);
 		return 0;
 	}
 
-	sgl_pool = calloc(1, sizeof(struct hisi_sgl_pool));
-	if (!sgl_pool) {
-		WD_ERR("sgl pool alloc memory failed.\n");
+	area = sgl_area_create(sgl_num, sge_num);
+	if (!area)
 		return 0;
-	}
 
-	sgl_pool->sgl = calloc(sgl_num, sizeof(void *));
-	if (!sgl_pool->sgl) {
-		WD_ERR("sgl array alloc memory failed.\n");
-		goto err_out;
-	}
-
-	sgl_pool->sgl_align = calloc(sgl_num, sizeof(void *));
-	if (!sgl_pool->sgl_align) {
-		WD_ERR("sgl align array alloc memory failed.\n");
-		goto err_out;
+	/* a private pool has no cache in front of its sgls */
+	area->node = -1;
+	pool = sgl_pool_create(area, 0);
+	if (!pool) {
+		sgl_area_put(area);
+		return 0;
 	}
 
-	/* base the sgl_num create the sgl chain */
-	for (i = 0; i < sgl_num; i++) {
-		sgl_pool->sgl[i] = hisi_qm_create_sgl(sge_num);
-		if (!sgl_pool->sgl[i]) {
-			WD_ERR("sgl create failed.\n");
-			goto err_out;
-		}
+	return (handle_t)pool;
+}
 
-		sgl_pool->sgl_align[i] = hisi_qm_align_sgl(sgl_pool->sgl[i], sge_num);
-	}
+static handle_t hisi_qm_get_node_sglpool(int node)
+{
+	struct hisi_sgl_area *area;
+	struct hisi_sgl_pool *pool;
 
-	sgl_pool->sgl_num = sgl_num;
-	sgl_pool->sge_num = sge_num;
-	sgl_pool->depth = sgl_num;
-	sgl_pool->top = sgl_num;
-	pthread_spin_init(&sgl_pool->lock, PTHREAD_PROCESS_SHARED);
+	area = sgl_area_get_node(node);
+	if (!area)
+		return 0;
 
-	return (handle_t)sgl_pool;
+	pool = sgl_pool_create(area, HISI_SGL_CACHE_NUM);
+	if (!pool) {
+		sgl_area_put(area);
+		return 0;
+	}
 
-err_out:
-	hisi_qm_destroy_sglpool((handle_t)sgl_pool);
-	return (handle_t)0;
+	return (handle_t)pool;
 }
 
 void hisi_qm_destroy_sglpool(handle_t sgl_pool)
 {
 	struct hisi_sgl_pool *pool = (struct hisi_sgl_pool *)sgl_pool;
-	int i;
+	struct hisi_sgl_area *area;
+	__u32 idx;
 
 	if (!pool) {
 		WD_ERR("sgl_pool is NULL\n");
 		return;
 	}
-	if (pool->sgl) {
-		for (i = 0; i < pool->sgl_num; i++)
-			if (pool->sgl[i])
-				free(pool->sgl[i]);
 
-		free(pool->sgl);
+	/* the cached sgls go back to the other qps of the node */
+	area = pool->area;
+	while ((idx = sgl_stack_pop(&pool->cache_head, area->next)) !=
+	       SGL_IDX_NONE) {
+		__atomic_sub_fetch(&area->cache_num, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&area->free_num, 1, __ATOMIC_RELAXED);
+		sgl_stack_push(&area->head, area->next, idx);
 	}
 
-	if (pool->sgl_align)
-		free(pool->sgl_align);
+	sgl_area_put(area);
 	free(pool);
 }
 
 static struct hisi_sgl *hisi_qm_sgl_pop(struct hisi_sgl_pool *pool)
 {
-	struct hisi_sgl *hw_sgl;
-
-	pthread_spin_lock(&pool->lock);
+	struct hisi_sgl_area *area = pool->area;
+	__u32 idx, used, peak;
+
+	idx = sgl_stack_pop(&pool->cache_head, area->next);
+	if (idx != SGL_IDX_NONE) {
+		__atomic_sub_fetch(&pool->cache_num, 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&area->cache_num, 1, __ATOMIC_RELAXED);
+		return sgl_of_idx(area, idx);
+	}
 
-	if (pool->top == 0) {
-		WD_ERR("The sgl pool is empty\n");
-		pthread_spin_unlock(&pool->lock);
+	/* a common case under load, fail_num tells it without a log */
+	idx = sgl_stack_pop(&area->head, area->next);
+	if (idx == SGL_IDX_NONE) {
+		__atomic_add_fetch(&area->fail_num, 1, __ATOMIC_RELAXED);
 		return NULL;
 	}
 
-	pool->top--;
-	hw_sgl = pool->sgl_align[pool->top];
-	pthread_spin_unlock(&pool->lock);
-	return hw_sgl;
+	used = area->sgl_num -
+	       __atomic_sub_fetch(&area->free_num, 1, __ATOMIC_RELAXED);
+	peak = __atomic_load_n(&area->peak_num, __ATOMIC_RELAXED);
+	while (used > peak &&
+	       !__atomic_compare_exchange_n(&area->peak_num, &peak, used, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	return sgl_of_idx(area, idx);
 }
 
-static int hisi_qm_sgl_push(struct hisi_sgl_pool *pool, struct hisi_sgl *hw_sgl)
+static void hisi_qm_sgl_push(struct hisi_sgl_pool *pool, struct hisi_sgl *hw_sgl)
 {
-	pthread_spin_lock(&pool->lock);
-	if (pool->top >= pool->depth) {
-		WD_ERR("The sgl pool is full\n");
-		pthread_spin_unlock(&pool->lock);
-		return -WD_EINVAL;
+	struct hisi_sgl_area *area = pool->area;
+	__u32 idx = sgl_to_idx(area, hw_sgl);
+
+	sgl_reset(area, hw_sgl);
+
+	/*
+	 * A full cache is only exceeded by a few racing pushes. The caches of
+	 * a node are bounded together too, or a few qps could keep all of its
+	 * sgls from the others.
+	 */
+	if (__atomic_load_n(&pool->cache_num, __ATOMIC_RELAXED) <
+	    pool->cache_max &&
+	    __atomic_load_n(&area->cache_num, __ATOMIC_RELAXED) <
+	    area->cache_limit) {
+		__atomic_add_fetch(&pool->cache_num, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&area->cache_num, 1, __ATOMIC_RELAXED);
+		sgl_stack_push(&pool->cache_head, area->next, idx);
+		return;
 	}
 
-	hw_sgl->next_dma = 0;
-	hw_sgl->entry_sum_in_sgl = 0;
-	hw_sgl->entry_sum_in_chain = pool->sge_num;
-	hw_sgl->entry_length_in_sgl = pool->sge_num;
-	hw_sgl->entry_size_in_sgl = 0;
-
-	pool->sgl_align[pool->top] = hw_sgl;
-	pool->top++;
-	pthread_spin_unlock(&pool->lock);
-
-	return 0;
+	/* free_num never drops below the free sgls, so peak_num is in range */
+	__atomic_add_fetch(&area->free_num, 1, __ATOMIC_RELAXED);
+	sgl_stack_push(&area->head, area->next, idx);
 }
 
 void hisi_qm_put_hw_sgl(handle_t sgl_pool, void *hw_sgl)
 {
 	struct hisi_sgl_pool *pool = (struct hisi_sgl_pool *)sgl_pool;
 	struct hisi_sgl *cur = (struct hisi_sgl *)hw_sgl;
-	struct hisi_sgl *next = (struct hisi_sgl *)hw_sgl;
-	int ret;
+	struct hisi_sgl *next;
 
 	if (!pool)
 		return;
 
 	while (cur) {
 		next = (struct hisi_sgl *)cur->next_dma;
-		ret = hisi_qm_sgl_push(pool, cur);
-		if (ret)
-			break;
-
+		hisi_qm_sgl_push(pool, cur);
 		cur = next;
 	}
+}
 
-	return;
+int hisi_qm_get_sglpool_stat(handle_t sgl_pool, struct hisi_sgl_pool_stat *stat)
+{
+	struct hisi_sgl_pool *pool = (struct hisi_sgl_pool *)sgl_pool;
+	struct hisi_sgl_area *area;
+
+	if (!pool || !stat) {
+		WD_ERR("invalid: sgl_pool or stat is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	area = pool->area;
+	stat->sgl_num = area->sgl_num;
+	stat->sge_num = area->sge_num;
+	stat->sgl_size = area->sgl_size;
+	stat->mem_size = area->mem_size;
+	stat->hugepage = area->hugepage;
+	stat->shared = area->node >= 0;
+	stat->free_num = __atomic_load_n(&area->free_num, __ATOMIC_RELAXED);
+	stat->peak_num = __atomic_load_n(&area->peak_num, __ATOMIC_RELAXED);
+	stat->fail_num = __atomic_load_n(&area->fail_num, __ATOMIC_RELAXED);
+	stat->cache_num = __atomic_load_n(&pool->cache_num, __ATOMIC_RELAXED);
+
+	return 0;
 }
 
 void *hisi_qm_get_hw_sgl(handle_t sgl_pool, struct wd_datalist *sgl)
@@ -736,7 +1145,7 @@ void *hisi_qm_get_hw_sgl(handle_t sgl_pool, struct wd_datalist *sgl)
 		 * the sgl pool is not enough or all the data is transform to
 		 * hardware sgl.
 		 */
-		if (i == pool->sge_num && tmp->next) {
+		if (i == pool->area->sge_num && tmp->next) {
 			next = hisi_qm_sgl_pop(pool);
 			if (!next) {
 				WD_ERR("the sgl pool is not enough\n");
@@ -744,7 +1153,7 @@ void *hisi_qm_get_hw_sgl(handle_t sgl_pool, struct wd_datalist *sgl)
 			}
 			cur->next_dma = (uintptr_t)next;
 			cur = next;
-			head->entry_sum_in_chain += pool->sge_num;
+			head->entry_sum_in_chain += pool->area->sge_num;
 			/* In the new sgl chain, the subscript must be reset */
 			i = 0;
 		}
@@ -19,6 +19,10 @@
 #define WORD_BYTES		4
 #define BYTE_BITS		8
 #define SQE_BYTES_NUMS		128
+/* op types whose bds are kept in the WD_SQE_TMPL_SIZE of a session */
+#define SEC_TMPL_OP_NUM		2
+/* bds filled on the stack before one qm doorbell in batch send */
+#define SEC_SEND_BATCH_NUM	16
 #define SEC_FLAG_OFFSET		7
 #define SEC_AUTH_KEY_OFFSET	5
 #define SEC_HW_ICV_ERR		0x2
@@ -500,6 +504,12 @@ static void sec_dump_bd(unsigned char *bd, unsigned int len)
 }
 #endif
 
+/* the templates of a session, one bd for each op type of cipher and aead */
+static void *sec_tmpl_bd(struct wd_sqe_tmpl *tmpl, __u8 op_type)
+{
+	return (__u8 *)tmpl->data + op_type * SQE_BYTES_NUMS;
+}
+
 /* increment counter (128-bit int) by software */
 static void ctr_iv_inc(__u8 *counter, __u32 c)
 {
@@ -533,8 +543,9 @@ static void update_iv(struct wd_cipher_msg *msg)
 				msg->iv_bytes, msg->iv_bytes);
 		break;
 	case WD_CIPHER_CTR:
-			ctr_iv_inc(msg->iv, msg->iv_bytes >>
-				CTR_MODE_LEN_SHIFT);
+		/* a partial last block uses up its counter too */
+		ctr_iv_inc(msg->iv, (msg->in_bytes + AES_BLOCK_SIZE - 1) >>
+			   CTR_MODE_LEN_SHIFT);
 		break;
 	default:
 		break;
@@ -561,8 +572,9 @@ static void update_iv_sgl(struct wd_cipher_msg *msg)
 				msg->iv_bytes, msg->iv_bytes, COPY_SGL_TO_PBUFF);
 		break;
 	case WD_CIPHER_CTR:
-			ctr_iv_inc(msg->iv, msg->iv_bytes >>
-				CTR_MODE_LEN_SHIFT);
+		/* a partial last block uses up its counter too */
+		ctr_iv_inc(msg->iv, (msg->in_bytes + AES_BLOCK_SIZE - 1) >>
+			   CTR_MODE_LEN_SHIFT);
 		break;
 	default:
 		break;
@@ -673,7 +685,6 @@ static void fill_cipher_bd2_addr(struct wd_cipher_msg *msg, struct hisi_sec_sqe
 	sqe->type2.data_src_addr = (__u64)(uintptr_t)msg->in;
 	sqe->type2.data_dst_addr = (__u64)(uintptr_t)msg->out;
 	sqe->type2.c_ivin_addr = (__u64)(uintptr_t)msg->iv;
-	sqe->type2.c_key_addr = (__u64)(uintptr_t)msg->key;
 
 	/*
 	 * Because some special algorithms need to update IV
@@ -867,8 +878,9 @@ static int hisi_sec_fill_sgl_v3(handle_t h_qp, __u8 **in, __u8 **out,
 	return 0;
 }
 
-static int fill_cipher_bd2(struct wd_cipher_msg *msg, struct hisi_sec_sqe *sqe)
+static int fill_cipher_bd2(struct wd_cipher_msg *msg, void *bd)
 {
+	struct hisi_sec_sqe *sqe = bd;
 	__u8 scene, cipher, de;
 	int ret;
 
@@ -885,10 +897,7 @@ static int fill_cipher_bd2(struct wd_cipher_msg *msg, struct hisi_sec_sqe *sqe)
 		cipher = SEC_CIPHER_DEC << SEC_CIPHER_OFFSET;
 
 	sqe->type_auth_cipher |= cipher;
-
-	ret = cipher_len_check(msg);
-	if (ret)
-		return ret;
+	sqe->type2.c_key_addr = (__u64)(uintptr_t)msg->key;
 
 	ret = fill_cipher_bd2_alg(msg, sqe);
 	if (ret) {
@@ -905,25 +914,58 @@ static int fill_cipher_bd2(struct wd_cipher_msg *msg, struct hisi_sec_sqe *sqe)
 	return 0;
 }
 
-int hisi_sec_cipher_send(handle_t ctx, struct wd_cipher_msg *msg)
+/*
+ * Copy the session part of a cipher bd from the templates of the session,
+ * which fill_bd() builds for both op types by the first send after the key
+ * is set. The bd of a msg without templates is built by fill_bd() itself.
+ */
+static int fill_cipher_bd_tmpl(struct wd_cipher_msg *msg, void *bd,
+			       int (*fill_bd)(struct wd_cipher_msg *msg,
+					      void *bd))
 {
-	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
-	struct hisi_sec_sqe sqe;
-	__u16 count = 0;
-	int ret;
+	struct wd_sqe_tmpl *tmpl = msg->tmpl;
+	struct wd_cipher_msg tmp;
+	int ret = 0;
+	__u8 op;
 
-	if (!msg) {
-		WD_ERR("input cipher msg is NULL!\n");
-		return -WD_EINVAL;
+	if (!tmpl || msg->op_type >= SEC_TMPL_OP_NUM) {
+		memset(bd, 0, SQE_BYTES_NUMS);
+		return fill_bd(msg, bd);
 	}
 
-	memset(&sqe, 0, sizeof(struct hisi_sec_sqe));
-	ret = fill_cipher_bd2(msg, &sqe);
+	if (wd_key_fmt_begin(&tmpl->fmt)) {
+		tmp = *msg;
+		for (op = 0; op < SEC_TMPL_OP_NUM && !ret; op++) {
+			tmp.op_type = op;
+			memset(sec_tmpl_bd(tmpl, op), 0, SQE_BYTES_NUMS);
+			ret = fill_bd(&tmp, sec_tmpl_bd(tmpl, op));
+		}
+		wd_key_fmt_end(&tmpl->fmt, ret);
+		if (ret)
+			return ret;
+	}
+
+	memcpy(bd, sec_tmpl_bd(tmpl, msg->op_type), SQE_BYTES_NUMS);
+
+	return 0;
+}
+
+static int fill_cipher_bd2_sqe(handle_t h_qp, void *data, void *bd)
+{
+	struct wd_cipher_msg *msg = data;
+	struct hisi_sec_sqe *sqe = bd;
+	int ret;
+
+	ret = cipher_len_check(msg);
+	if (ret)
+		return ret;
+
+	ret = fill_cipher_bd_tmpl(msg, sqe, fill_cipher_bd2);
 	if (ret)
 		return ret;
 
 	if (msg->data_fmt == WD_SGL_BUF) {
-		ret = hisi_sec_fill_sgl(h_qp, &msg->in, &msg->out, &sqe,
+		ret = hisi_sec_fill_sgl(h_qp, &msg->in, &msg->out, sqe,
 					msg->alg_type);
 		if (ret) {
 			WD_ERR("failed to get sgl!\n");
@@ -931,9 +973,106 @@ int hisi_sec_cipher_send(handle_t ctx, struct wd_cipher_msg *msg)
 		}
 	}
 
-	sqe.type2.clen_ivhlen |= (__u32)msg->in_bytes;
-	sqe.type2.tag = (__u16)msg->tag;
-	fill_cipher_bd2_addr(msg, &sqe);
+	sqe->type2.clen_ivhlen |= (__u32)msg->in_bytes;
+	sqe->type2.tag = (__u16)msg->tag;
+	fill_cipher_bd2_addr(msg, sqe);
+
+	return 0;
+}
+
+/*
+ * Fill up to SEC_SEND_BATCH_NUM bds at a time and hand each group to the
+ * qm with a single doorbell. The sgls of the msgs which are filled but not
+ * taken by the queue are released by @put_sqe, *count is the number of msgs
+ * sent.
+ */
+static int hisi_sec_send_batch(handle_t h_qp, void **msgs, __u32 num,
+			       __u32 *count,
+			       int (*fill_sqe)(handle_t h_qp, void *msg,
+					       void *bd),
+			       void (*put_sqe)(handle_t h_qp, void *msg))
+{
+	__u64 sqes[SEC_SEND_BATCH_NUM * SQE_BYTES_NUMS / sizeof(__u64)];
+	__u16 fill_num, send_num;
+	int ret = 0;
+	__u32 i;
+
+	*count = 0;
+	while (*count < num) {
+		fill_num = 0;
+		while (fill_num < SEC_SEND_BATCH_NUM && *count + fill_num < num) {
+			ret = fill_sqe(h_qp, msgs[*count + fill_num],
+				       (__u8 *)sqes + fill_num * SQE_BYTES_NUMS);
+			if (ret)
+				break;
+			fill_num++;
+		}
+
+		if (!fill_num)
+			break;
+
+		send_num = 0;
+		ret = hisi_qm_send(h_qp, sqes, fill_num, &send_num);
+		if (ret < 0 && ret != -WD_EBUSY)
+			WD_ERR("sec send sqe is err(%d)!\n", ret);
+
+		for (i = send_num; i < fill_num; i++)
+			put_sqe(h_qp, msgs[*count + i]);
+
+		*count += send_num;
+		if (send_num < fill_num)
+			break;
+	}
+
+	return *count ? 0 : ret;
+}
+
+static void put_cipher_sqe(handle_t h_qp, void *data)
+{
+	struct wd_cipher_msg *msg = data;
+
+	if (msg->data_fmt == WD_SGL_BUF)
+		hisi_sec_put_sgl(h_qp, msg->alg_type, msg->in, msg->out);
+}
+
+static int hisi_sec_cipher_send_batch_common(handle_t ctx,
+					     struct wd_cipher_msg **msgs,
+					     __u32 num, __u32 *count,
+					     int (*fill_sqe)(handle_t h_qp,
+							     void *msg,
+							     void *bd))
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	int ret;
+
+	if (!msgs || !count) {
+		WD_ERR("input cipher msgs or count is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = hisi_sec_send_batch(h_qp, (void **)msgs, num, count, fill_sqe,
+				  put_cipher_sqe);
+	if (*count)
+		hisi_qm_enable_interrupt(ctx, msgs[0]->is_polled);
+
+	return ret;
+}
+
+int hisi_sec_cipher_send(handle_t ctx, struct wd_cipher_msg *msg)
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	struct hisi_sec_sqe sqe;
+	__u16 count = 0;
+	int ret;
+
+	if (!msg) {
+		WD_ERR("input cipher msg is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = fill_cipher_bd2_sqe(h_qp, msg, &sqe);
+	if (ret)
+		return ret;
 
 	ret = hisi_qm_send(h_qp, &sqe, 1, &count);
 	if (ret < 0) {
@@ -949,19 +1088,31 @@ int hisi_sec_cipher_send(handle_t ctx, struct wd_cipher_msg *msg)
 	return ret;
 }
 
+int hisi_sec_cipher_send_batch(handle_t ctx, struct wd_cipher_msg **msgs,
+			       __u32 num, __u32 *count)
+{
+	return hisi_sec_cipher_send_batch_common(ctx, msgs, num, count,
+						 fill_cipher_bd2_sqe);
+}
+
 int hisi_sec_cipher_recv(handle_t ctx, struct wd_cipher_msg *recv_msg)
 {
-	struct hisi_sec_sqe sqe;
 	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	struct hisi_sec_sqe *sqe;
 	__u16 count = 0;
 	int ret;
 
-	ret = hisi_qm_recv(h_qp, &sqe, 1, &count);
+	/* parse the bd in the queue, and give it back after that */
+	ret = hisi_qm_recv_peek(h_qp, (void **)&sqe, 1, &count);
 	if (ret < 0)
 		return ret;
 
-	parse_cipher_bd2(&sqe, recv_msg);
-	recv_msg->tag = sqe.type2.tag;
+	parse_cipher_bd2(sqe, recv_msg);
+	recv_msg->tag = sqe->type2.tag;
+
+	ret = hisi_qm_recv_release(h_qp, count);
+	if (ret < 0)
+		return ret;
 
 	if (recv_msg->data_fmt == WD_SGL_BUF)
 		hisi_sec_put_sgl(h_qp, recv_msg->alg_type, recv_msg->in,
@@ -1055,7 +1206,6 @@ static void fill_cipher_bd3_addr(struct wd_cipher_msg *msg,
 	sqe->data_src_addr = (__u64)(uintptr_t)msg->in;
 	sqe->data_dst_addr = (__u64)(uintptr_t)msg->out;
 	sqe->no_scene.c_ivin_addr = (__u64)(uintptr_t)msg->iv;
-	sqe->c_key_addr = (__u64)(uintptr_t)msg->key;
 
 	/*
 	 * Because some special algorithms need to update IV
@@ -1070,8 +1220,9 @@ static void fill_cipher_bd3_addr(struct wd_cipher_msg *msg,
 	sqe->mac_addr = (__u64)(uintptr_t)msg;
 }
 
-static int fill_cipher_bd3(struct wd_cipher_msg *msg, struct hisi_sec_sqe3 *sqe)
+static int fill_cipher_bd3(struct wd_cipher_msg *msg, void *bd)
 {
+	struct hisi_sec_sqe3 *sqe = bd;
 	__u16 scene, de;
 	int ret;
 
@@ -1086,10 +1237,7 @@ static int fill_cipher_bd3(struct wd_cipher_msg *msg, struct hisi_sec_sqe3 *sqe)
 		sqe->c_icv_key = SEC_CIPHER_ENC;
 	else
 		sqe->c_icv_key = SEC_CIPHER_DEC;
-
-	ret = cipher_len_check(msg);
-	if (ret)
-		return ret;
+	sqe->c_key_addr = (__u64)(uintptr_t)msg->key;
 
 	ret = fill_cipher_bd3_alg(msg, sqe);
 	if (ret) {
@@ -1106,25 +1254,22 @@ static int fill_cipher_bd3(struct wd_cipher_msg *msg, struct hisi_sec_sqe3 *sqe)
 	return 0;
 }
 
-int hisi_sec_cipher_send_v3(handle_t ctx, struct wd_cipher_msg *msg)
+static int fill_cipher_bd3_sqe(handle_t h_qp, void *data, void *bd)
 {
-	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
-	struct hisi_sec_sqe3 sqe;
-	__u16 count = 0;
+	struct wd_cipher_msg *msg = data;
+	struct hisi_sec_sqe3 *sqe = bd;
 	int ret;
 
-	if (!msg) {
-		WD_ERR("input cipher msg is NULL!\n");
-		return -WD_EINVAL;
-	}
+	ret = cipher_len_check(msg);
+	if (ret)
+		return ret;
 
-	memset(&sqe, 0, sizeof(struct hisi_sec_sqe3));
-	ret = fill_cipher_bd3(msg, &sqe);
+	ret = fill_cipher_bd_tmpl(msg, sqe, fill_cipher_bd3);
 	if (ret)
 		return ret;
 
 	if (msg->data_fmt == WD_SGL_BUF) {
-		ret = hisi_sec_fill_sgl_v3(h_qp, &msg->in, &msg->out, &sqe,
+		ret = hisi_sec_fill_sgl_v3(h_qp, &msg->in, &msg->out, sqe,
 					msg->alg_type);
 		if (ret) {
 			WD_ERR("failed to get sgl!\n");
@@ -1132,9 +1277,28 @@ int hisi_sec_cipher_send_v3(handle_t ctx, struct wd_cipher_msg *msg)
 		}
 	}
 
-	sqe.c_len_ivin = (__u32)msg->in_bytes;
-	sqe.tag = (__u64)(uintptr_t)msg->tag;
-	fill_cipher_bd3_addr(msg, &sqe);
+	sqe->c_len_ivin = (__u32)msg->in_bytes;
+	sqe->tag = (__u64)(uintptr_t)msg->tag;
+	fill_cipher_bd3_addr(msg, sqe);
+
+	return 0;
+}
+
+int hisi_sec_cipher_send_v3(handle_t ctx, struct wd_cipher_msg *msg)
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	struct hisi_sec_sqe3 sqe;
+	__u16 count = 0;
+	int ret;
+
+	if (!msg) {
+		WD_ERR("input cipher msg is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = fill_cipher_bd3_sqe(h_qp, msg, &sqe);
+	if (ret)
+		return ret;
 
 	ret = hisi_qm_send(h_qp, &sqe, 1, &count);
 	if (ret < 0) {
@@ -1150,6 +1314,13 @@ int hisi_sec_cipher_send_v3(handle_t ctx, struct wd_cipher_msg *msg)
 	return ret;
 }
 
+int hisi_sec_cipher_send_batch_v3(handle_t ctx, struct wd_cipher_msg **msgs,
+				  __u32 num, __u32 *count)
+{
+	return hisi_sec_cipher_send_batch_common(ctx, msgs, num, count,
+						 fill_cipher_bd3_sqe);
+}
+
 static void parse_cipher_bd3(struct hisi_sec_sqe3 *sqe, struct wd_cipher_msg *recv_msg)
 {
 	struct wd_cipher_msg *rmsg;
@@ -1178,17 +1349,22 @@ static void parse_cipher_bd3(struct hisi_sec_sqe3 *sqe, struct wd_cipher_msg *re
 
 int hisi_sec_cipher_recv_v3(handle_t ctx, struct wd_cipher_msg *recv_msg)
 {
-	struct hisi_sec_sqe3 sqe;
 	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	struct hisi_sec_sqe3 *sqe;
 	__u16 count = 0;
 	int ret;
 
-	ret = hisi_qm_recv(h_qp, &sqe, 1, &count);
+	/* parse the bd in the queue, and give it back after that */
+	ret = hisi_qm_recv_peek(h_qp, (void **)&sqe, 1, &count);
 	if (ret < 0)
 		return ret;
 
-	parse_cipher_bd3(&sqe, recv_msg);
-	recv_msg->tag = sqe.tag;
+	parse_cipher_bd3(sqe, recv_msg);
+	recv_msg->tag = sqe->tag;
+
+	ret = hisi_qm_recv_release(h_qp, count);
+	if (ret < 0)
+		return ret;
 
 	if (recv_msg->data_fmt == WD_SGL_BUF)
 		hisi_sec_put_sgl(h_qp, recv_msg->alg_type, recv_msg->in,
@@ -1205,7 +1381,6 @@ static int fill_digest_bd2_alg(struct wd_digest_msg *msg,
 		return -WD_EINVAL;
 	}
 
-	sqe->type2.mac_key_alg = msg->out_bytes / WORD_BYTES;
 	if (msg->mode == WD_DIGEST_NORMAL)
 		sqe->type2.mac_key_alg |=
 		(__u32)g_digest_a_alg[msg->alg] << AUTH_ALG_OFFSET;
@@ -1313,35 +1488,70 @@ static int digest_len_check(struct wd_digest_msg *msg,  enum sec_bd_type type)
 	return 0;
 }
 
-int hisi_sec_digest_send(handle_t ctx, struct wd_digest_msg *msg)
+/* Copy the session part of a digest bd, see fill_cipher_bd_tmpl() */
+static int fill_digest_bd_tmpl(struct wd_digest_msg *msg, void *bd,
+			       int (*fill_bd)(struct wd_digest_msg *msg,
+					      void *bd))
 {
-	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
-	struct hisi_sec_sqe sqe;
-	__u16 count = 0;
-	__u8 scene;
-	__u8 de;
+	struct wd_sqe_tmpl *tmpl = msg->tmpl;
 	int ret;
 
-	if (!msg) {
-		WD_ERR("input digest msg is NULL!\n");
-		return -WD_EINVAL;
+	if (!tmpl) {
+		memset(bd, 0, SQE_BYTES_NUMS);
+		return fill_bd(msg, bd);
 	}
 
-	ret = digest_len_check(msg, BD_TYPE2);
-	if (unlikely(ret))
-		return ret;
+	if (wd_key_fmt_begin(&tmpl->fmt)) {
+		memset(sec_tmpl_bd(tmpl, 0), 0, SQE_BYTES_NUMS);
+		ret = fill_bd(msg, sec_tmpl_bd(tmpl, 0));
+		wd_key_fmt_end(&tmpl->fmt, ret);
+		if (ret)
+			return ret;
+	}
+
+	memcpy(bd, sec_tmpl_bd(tmpl, 0), SQE_BYTES_NUMS);
+
+	return 0;
+}
+
+static int fill_digest_bd2(struct wd_digest_msg *msg, void *bd)
+{
+	struct hisi_sec_sqe *sqe = bd;
+	__u8 scene, de;
+	int ret;
 
-	memset(&sqe, 0, sizeof(struct hisi_sec_sqe));
 	/* config BD type */
-	sqe.type_auth_cipher = BD_TYPE2;
-	sqe.type_auth_cipher |= AUTH_HMAC_CALCULATE << AUTHTYPE_OFFSET;
+	sqe->type_auth_cipher = BD_TYPE2;
+	sqe->type_auth_cipher |= AUTH_HMAC_CALCULATE << AUTHTYPE_OFFSET;
 
 	/* config scene */
 	scene = SEC_IPSEC_SCENE << SEC_SCENE_OFFSET;
 	de = DATA_DST_ADDR_DISABLE << SEC_DE_OFFSET;
+	sqe->sds_sa_type = (__u8)(de | scene);
+
+	ret = fill_digest_bd2_alg(msg, sqe);
+	if (ret)
+		WD_ERR("failed to fill digest bd alg!\n");
+
+	return ret;
+}
+
+static int fill_digest_bd2_sqe(handle_t h_qp, void *data, void *bd)
+{
+	struct wd_digest_msg *msg = data;
+	struct hisi_sec_sqe *sqe = bd;
+	int ret;
+
+	ret = digest_len_check(msg, BD_TYPE2);
+	if (unlikely(ret))
+		return ret;
+
+	ret = fill_digest_bd_tmpl(msg, sqe, fill_digest_bd2);
+	if (ret)
+		return ret;
 
 	if (msg->data_fmt == WD_SGL_BUF) {
-		ret = hisi_sec_fill_sgl(h_qp, &msg->in, &msg->out, &sqe,
+		ret = hisi_sec_fill_sgl(h_qp, &msg->in, &msg->out, sqe,
 					msg->alg_type);
 		if (ret) {
 			WD_ERR("failed to get sgl!\n");
@@ -1349,25 +1559,70 @@ int hisi_sec_digest_send(handle_t ctx, struct wd_digest_msg *msg)
 		}
 	}
 
-	sqe.sds_sa_type |= (__u8)(de | scene);
-	sqe.type2.alen_ivllen |= (__u32)msg->in_bytes;
-	sqe.type2.data_src_addr = (__u64)(uintptr_t)msg->in;
-	sqe.type2.mac_addr = (__u64)(uintptr_t)msg->out;
-
-	ret = fill_digest_bd2_alg(msg, &sqe);
-	if (ret) {
-		WD_ERR("failed to fill digest bd alg!\n");
-		return ret;
-	}
+	sqe->type2.alen_ivllen |= (__u32)msg->in_bytes;
+	sqe->type2.data_src_addr = (__u64)(uintptr_t)msg->in;
+	sqe->type2.mac_addr = (__u64)(uintptr_t)msg->out;
+	sqe->type2.mac_key_alg |= msg->out_bytes / WORD_BYTES;
 
-	qm_fill_digest_long_bd(msg, &sqe);
+	qm_fill_digest_long_bd(msg, sqe);
 
 #ifdef DEBUG
 	WD_ERR("Dump digest send sqe-->!\n");
-	sec_dump_bd((unsigned char *)&sqe, SQE_BYTES_NUMS);
+	sec_dump_bd((unsigned char *)sqe, SQE_BYTES_NUMS);
 #endif
 
-	sqe.type2.tag = msg->tag;
+	sqe->type2.tag = msg->tag;
+
+	return 0;
+}
+
+static void put_digest_sqe(handle_t h_qp, void *data)
+{
+	struct wd_digest_msg *msg = data;
+
+	if (msg->data_fmt == WD_SGL_BUF)
+		hisi_sec_put_sgl(h_qp, msg->alg_type, msg->in, msg->out);
+}
+
+static int hisi_sec_digest_send_batch_common(handle_t ctx,
+					     struct wd_digest_msg **msgs,
+					     __u32 num, __u32 *count,
+					     int (*fill_sqe)(handle_t h_qp,
+							     void *msg,
+							     void *bd))
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	int ret;
+
+	if (!msgs || !count) {
+		WD_ERR("input digest msgs or count is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = hisi_sec_send_batch(h_qp, (void **)msgs, num, count, fill_sqe,
+				  put_digest_sqe);
+	if (*count)
+		hisi_qm_enable_interrupt(ctx, msgs[0]->is_polled);
+
+	return ret;
+}
+
+int hisi_sec_digest_send(handle_t ctx, struct wd_digest_msg *msg)
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	struct hisi_sec_sqe sqe;
+	__u16 count = 0;
+	int ret;
+
+	if (!msg) {
+		WD_ERR("input digest msg is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = fill_digest_bd2_sqe(h_qp, msg, &sqe);
+	if (ret)
+		return ret;
+
 	ret = hisi_qm_send(h_qp, &sqe, 1, &count);
 	if (ret < 0) {
 		if (ret != -WD_EBUSY)
@@ -1382,6 +1637,13 @@ int hisi_sec_digest_send(handle_t ctx, struct wd_digest_msg *msg)
 	return ret;
 }
 
+int hisi_sec_digest_send_batch(handle_t ctx, struct wd_digest_msg **msgs,
+			       __u32 num, __u32 *count)
+{
+	return hisi_sec_digest_send_batch_common(ctx, msgs, num, count,
+						 fill_digest_bd2_sqe);
+}
+
 int hisi_sec_digest_recv(handle_t ctx, struct wd_digest_msg *recv_msg)
 {
 	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
@@ -1420,8 +1682,6 @@ static int fill_digest_bd3_alg(struct wd_digest_msg *msg,
 		return -WD_EINVAL;
 	}
 
-	sqe->auth_mac_key |= (msg->out_bytes / WORD_BYTES) <<
-				SEC_MAC_OFFSET_V3;
 	if (msg->mode == WD_DIGEST_NORMAL) {
 		sqe->auth_mac_key |=
 		(__u32)g_digest_a_alg[msg->alg] << SEC_AUTH_ALG_OFFSET_V3;
@@ -1467,35 +1727,44 @@ static void qm_fill_digest_long_bd3(struct wd_digest_msg *msg,
 	}
 }
 
-int hisi_sec_digest_send_v3(handle_t ctx, struct wd_digest_msg *msg)
+static int fill_digest_bd3(struct wd_digest_msg *msg, void *bd)
 {
-	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
-	struct hisi_sec_sqe3 sqe;
-	__u16 count = 0;
-	__u16 scene;
-	__u16 de;
+	struct hisi_sec_sqe3 *sqe = bd;
+	__u16 scene, de;
 	int ret;
 
-	if (!msg) {
-		WD_ERR("input digest msg is NULL!\n");
-		return -WD_EINVAL;
-	}
-
-	ret = digest_len_check(msg, BD_TYPE3);
-	if (unlikely(ret))
-		return ret;
-
-	memset(&sqe, 0, sizeof(struct hisi_sec_sqe3));
 	/* config BD type */
-	sqe.bd_param = BD_TYPE3;
-	sqe.auth_mac_key = AUTH_HMAC_CALCULATE;
+	sqe->bd_param = BD_TYPE3;
+	sqe->auth_mac_key = AUTH_HMAC_CALCULATE;
 
 	/* config scene */
 	scene = SEC_STREAM_SCENE << SEC_SCENE_OFFSET_V3;
 	de = DATA_DST_ADDR_DISABLE << SEC_DE_OFFSET_V3;
+	sqe->bd_param |= (__u16)(de | scene);
+
+	ret = fill_digest_bd3_alg(msg, sqe);
+	if (ret)
+		WD_ERR("failed to fill digest bd alg!\n");
+
+	return ret;
+}
+
+static int fill_digest_bd3_sqe(handle_t h_qp, void *data, void *bd)
+{
+	struct wd_digest_msg *msg = data;
+	struct hisi_sec_sqe3 *sqe = bd;
+	int ret;
+
+	ret = digest_len_check(msg, BD_TYPE3);
+	if (unlikely(ret))
+		return ret;
+
+	ret = fill_digest_bd_tmpl(msg, sqe, fill_digest_bd3);
+	if (ret)
+		return ret;
 
 	if (msg->data_fmt == WD_SGL_BUF) {
-		ret = hisi_sec_fill_sgl_v3(h_qp, &msg->in, &msg->out, &sqe,
+		ret = hisi_sec_fill_sgl_v3(h_qp, &msg->in, &msg->out, sqe,
 					msg->alg_type);
 		if (ret) {
 			WD_ERR("failed to get sgl!\n");
@@ -1503,25 +1772,38 @@ int hisi_sec_digest_send_v3(handle_t ctx, struct wd_digest_msg *msg)
 		}
 	}
 
-	sqe.bd_param |= (__u16)(de | scene);
-	sqe.a_len_key = (__u32)msg->in_bytes;
-	sqe.data_src_addr = (__u64)(uintptr_t)msg->in;
-	sqe.mac_addr = (__u64)(uintptr_t)msg->out;
-
-	ret = fill_digest_bd3_alg(msg, &sqe);
-	if (ret) {
-		WD_ERR("failed to fill digest bd alg!\n");
-		return ret;
-	}
+	sqe->a_len_key = (__u32)msg->in_bytes;
+	sqe->data_src_addr = (__u64)(uintptr_t)msg->in;
+	sqe->mac_addr = (__u64)(uintptr_t)msg->out;
+	sqe->auth_mac_key |= (msg->out_bytes / WORD_BYTES) << SEC_MAC_OFFSET_V3;
 
-	qm_fill_digest_long_bd3(msg, &sqe);
+	qm_fill_digest_long_bd3(msg, sqe);
 
 #ifdef DEBUG
 	WD_ERR("Dump digest send sqe-->!\n");
-	sec_dump_bd((unsigned char *)&sqe, SQE_BYTES_NUMS);
+	sec_dump_bd((unsigned char *)sqe, SQE_BYTES_NUMS);
 #endif
 
-	sqe.tag = (__u64)(uintptr_t)msg->tag;
+	sqe->tag = (__u64)(uintptr_t)msg->tag;
+
+	return 0;
+}
+
+int hisi_sec_digest_send_v3(handle_t ctx, struct wd_digest_msg *msg)
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	struct hisi_sec_sqe3 sqe;
+	__u16 count = 0;
+	int ret;
+
+	if (!msg) {
+		WD_ERR("input digest msg is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = fill_digest_bd3_sqe(h_qp, msg, &sqe);
+	if (ret)
+		return ret;
 
 	ret = hisi_qm_send(h_qp, &sqe, 1, &count);
 	if (ret < 0) {
@@ -1537,6 +1819,13 @@ int hisi_sec_digest_send_v3(handle_t ctx, struct wd_digest_msg *msg)
 	return ret;
 }
 
+int hisi_sec_digest_send_batch_v3(handle_t ctx, struct wd_digest_msg **msgs,
+				  __u32 num, __u32 *count)
+{
+	return hisi_sec_digest_send_batch_common(ctx, msgs, num, count,
+						 fill_digest_bd3_sqe);
+}
+
 static void parse_digest_bd3(struct hisi_sec_sqe3 *sqe,
 				struct wd_digest_msg *recv_msg)
 {
@@ -1670,13 +1959,11 @@ static int fill_aead_bd2_mode(struct wd_aead_msg *msg,
 	case WD_CIPHER_CCM:
 		c_mode = C_MODE_CCM;
 		sqe->type_auth_cipher &= SEC_AUTH_MASK;
-		sqe->type2.alen_ivllen = msg->assoc_bytes;
 		sqe->type2.icvw_kmode |= msg->auth_bytes;
 		break;
 	case WD_CIPHER_GCM:
 		c_mode = C_MODE_GCM;
 		sqe->type_auth_cipher &= SEC_AUTH_MASK;
-		sqe->type2.alen_ivllen = msg->assoc_bytes;
 		sqe->type2.icvw_kmode |= msg->auth_bytes;
 		break;
 	default:
@@ -1776,8 +2063,6 @@ static void fill_aead_bd2_addr(struct wd_aead_msg *msg,
 	else
 		fill_aead_mac_addr_sgl(msg, &sqe->type2.mac_addr);
 
-	sqe->type2.c_key_addr = (__u64)(uintptr_t)msg->ckey;
-	sqe->type2.a_key_addr = (__u64)(uintptr_t)msg->akey;
 	sqe->type2.c_ivin_addr = (__u64)(uintptr_t)msg->iv;
 
 	/* CCM/GCM should init a_iv */
@@ -1802,8 +2087,53 @@ static int aead_len_check(struct wd_aead_msg *msg)
 	return 0;
 }
 
-static int fill_aead_bd2(struct wd_aead_msg *msg, struct hisi_sec_sqe *sqe)
+/* Copy the session part of an aead bd, see fill_cipher_bd_tmpl() */
+static int fill_aead_bd_tmpl(struct wd_aead_msg *msg, void *bd,
+			     int (*fill_bd)(struct wd_aead_msg *msg, void *bd))
 {
+	struct wd_sqe_tmpl *tmpl = msg->tmpl;
+	struct wd_aead_msg tmp;
+	int ret = 0;
+	__u8 op;
+
+	if (!tmpl || msg->op_type >= SEC_TMPL_OP_NUM) {
+		memset(bd, 0, SQE_BYTES_NUMS);
+		return fill_bd(msg, bd);
+	}
+
+	if (wd_key_fmt_begin(&tmpl->fmt)) {
+		tmp = *msg;
+		for (op = 0; op < SEC_TMPL_OP_NUM && !ret; op++) {
+			tmp.op_type = op;
+			memset(sec_tmpl_bd(tmpl, op), 0, SQE_BYTES_NUMS);
+			ret = fill_bd(&tmp, sec_tmpl_bd(tmpl, op));
+		}
+		wd_key_fmt_end(&tmpl->fmt, ret);
+		if (ret)
+			return ret;
+	}
+
+	memcpy(bd, sec_tmpl_bd(tmpl, msg->op_type), SQE_BYTES_NUMS);
+
+	return 0;
+}
+
+static void fill_aead_bd2_len(struct wd_aead_msg *msg,
+			      struct hisi_sec_sqe *sqe)
+{
+	sqe->type2.clen_ivhlen = msg->in_bytes;
+	sqe->type2.cipher_src_offset = msg->assoc_bytes;
+
+	/* CCM/GCM only authenticate the aad */
+	if (msg->cmode == WD_CIPHER_CCM || msg->cmode == WD_CIPHER_GCM)
+		sqe->type2.alen_ivllen = msg->assoc_bytes;
+	else
+		sqe->type2.alen_ivllen = msg->in_bytes + msg->assoc_bytes;
+}
+
+static int fill_aead_bd2(struct wd_aead_msg *msg, void *bd)
+{
+	struct hisi_sec_sqe *sqe = bd;
 	__u8 scene, cipher, de;
 	int ret;
 
@@ -1829,10 +2159,8 @@ static int fill_aead_bd2(struct wd_aead_msg *msg, struct hisi_sec_sqe *sqe)
 	}
 	sqe->sds_sa_type |= (__u8)(de | scene);
 	sqe->type_auth_cipher |= cipher;
-
-	sqe->type2.clen_ivhlen = msg->in_bytes;
-	sqe->type2.cipher_src_offset = msg->assoc_bytes;
-	sqe->type2.alen_ivllen = msg->in_bytes + msg->assoc_bytes;
+	sqe->type2.c_key_addr = (__u64)(uintptr_t)msg->ckey;
+	sqe->type2.a_key_addr = (__u64)(uintptr_t)msg->akey;
 
 	ret = fill_aead_bd2_alg(msg, sqe);
 	if (ret) {
@@ -1849,18 +2177,12 @@ static int fill_aead_bd2(struct wd_aead_msg *msg, struct hisi_sec_sqe *sqe)
 	return 0;
 }
 
-int hisi_sec_aead_send(handle_t ctx, struct wd_aead_msg *msg)
+static int fill_aead_bd2_sqe(handle_t h_qp, void *data, void *bd)
 {
-	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
-	struct hisi_sec_sqe sqe;
-	__u16 count = 0;
+	struct wd_aead_msg *msg = data;
+	struct hisi_sec_sqe *sqe = bd;
 	int ret;
 
-	if (unlikely(!msg)) {
-		WD_ERR("failed to check input aead msg!\n");
-		return -WD_EINVAL;
-	}
-
 	if (unlikely(msg->cmode != WD_CIPHER_CBC && msg->in_bytes == 0)) {
 		WD_ERR("ccm or gcm not supports 0 packet size at hw_v2!\n");
 		return -WD_EINVAL;
@@ -1870,27 +2192,78 @@ int hisi_sec_aead_send(handle_t ctx, struct wd_aead_msg *msg)
 	if (unlikely(ret))
 		return ret;
 
-	memset(&sqe, 0, sizeof(struct hisi_sec_sqe));
-	ret = fill_aead_bd2(msg, &sqe);
+	ret = fill_aead_bd_tmpl(msg, sqe, fill_aead_bd2);
 	if (unlikely(ret))
 		return ret;
 
+	fill_aead_bd2_len(msg, sqe);
+
 	if (msg->data_fmt == WD_SGL_BUF) {
-		ret = hisi_sec_fill_sgl(h_qp, &msg->in, &msg->out, &sqe, msg->alg_type);
+		ret = hisi_sec_fill_sgl(h_qp, &msg->in, &msg->out, sqe, msg->alg_type);
 		if (ret) {
 			WD_ERR("failed to get sgl!\n");
 			return ret;
 		}
 	}
 
-	fill_aead_bd2_addr(msg, &sqe);
+	fill_aead_bd2_addr(msg, sqe);
 
 #ifdef DEBUG
 	WD_ERR("Dump aead send sqe-->!\n");
-	sec_dump_bd((unsigned char *)&sqe, SQE_BYTES_NUMS);
+	sec_dump_bd((unsigned char *)sqe, SQE_BYTES_NUMS);
 #endif
 
-	sqe.type2.tag = (__u16)msg->tag;
+	sqe->type2.tag = (__u16)msg->tag;
+
+	return 0;
+}
+
+static void put_aead_sqe(handle_t h_qp, void *data)
+{
+	struct wd_aead_msg *msg = data;
+
+	if (msg->data_fmt == WD_SGL_BUF)
+		hisi_sec_put_sgl(h_qp, msg->alg_type, msg->in, msg->out);
+}
+
+static int hisi_sec_aead_send_batch_common(handle_t ctx,
+					   struct wd_aead_msg **msgs,
+					   __u32 num, __u32 *count,
+					   int (*fill_sqe)(handle_t h_qp,
+							   void *msg,
+							   void *bd))
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	int ret;
+
+	if (!msgs || !count) {
+		WD_ERR("input aead msgs or count is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = hisi_sec_send_batch(h_qp, (void **)msgs, num, count, fill_sqe,
+				  put_aead_sqe);
+	if (*count)
+		hisi_qm_enable_interrupt(ctx, msgs[0]->is_polled);
+
+	return ret;
+}
+
+int hisi_sec_aead_send(handle_t ctx, struct wd_aead_msg *msg)
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	struct hisi_sec_sqe sqe;
+	__u16 count = 0;
+	int ret;
+
+	if (unlikely(!msg)) {
+		WD_ERR("failed to check input aead msg!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = fill_aead_bd2_sqe(h_qp, msg, &sqe);
+	if (unlikely(ret))
+		return ret;
 
 	ret = hisi_qm_send(h_qp, &sqe, 1, &count);
 	if (ret < 0) {
@@ -1906,6 +2279,13 @@ int hisi_sec_aead_send(handle_t ctx, struct wd_aead_msg *msg)
 	return ret;
 }
 
+int hisi_sec_aead_send_batch(handle_t ctx, struct wd_aead_msg **msgs,
+			     __u32 num, __u32 *count)
+{
+	return hisi_sec_aead_send_batch_common(ctx, msgs, num, count,
+					       fill_aead_bd2_sqe);
+}
+
 static void parse_aead_bd2(struct hisi_sec_sqe *sqe,
 	struct wd_aead_msg *recv_msg)
 {
@@ -1981,11 +2361,6 @@ WD_AEAD_SET_DRIVER(hisi_aead_driver);
 
 static int aead_bd3_msg_check(struct wd_aead_msg *msg)
 {
-	if (unlikely(!msg->in_bytes)) {
-		WD_ERR("failed to check aead in_bytes 0 length!\n");
-		return -WD_EINVAL;
-	}
-
 	if (unlikely(msg->auth_bytes & WORD_ALIGNMENT_MASK)) {
 		WD_ERR("failed to check aead auth_bytes!\n");
 		return -WD_EINVAL;
@@ -2064,13 +2439,11 @@ static int fill_aead_bd3_mode(struct wd_aead_msg *msg,
 	case WD_CIPHER_CCM:
 		sqe->c_mode_alg |= C_MODE_CCM;
 		sqe->auth_mac_key &= SEC_AUTH_MASK_V3;
-		sqe->a_len_key = msg->assoc_bytes;
 		sqe->c_icv_key |= msg->auth_bytes << SEC_MAC_OFFSET_V3;
 		break;
 	case WD_CIPHER_GCM:
 		sqe->c_mode_alg |= C_MODE_GCM;
 		sqe->auth_mac_key &= SEC_AUTH_MASK_V3;
-		sqe->a_len_key = msg->assoc_bytes;
 		sqe->c_icv_key |= msg->auth_bytes << SEC_MAC_OFFSET_V3;
 		break;
 	default:
@@ -2096,8 +2469,6 @@ static void fill_aead_bd3_addr(struct wd_aead_msg *msg,
 		fill_aead_mac_addr_sgl(msg, &mac_addr);
 
 	sqe->mac_addr = mac_addr;
-	sqe->c_key_addr = (__u64)(uintptr_t)msg->ckey;
-	sqe->a_key_addr = (__u64)(uintptr_t)msg->akey;
 	sqe->no_scene.c_ivin_addr = (__u64)(uintptr_t)msg->iv;
 
 	/* CCM/GCM should init a_iv */
@@ -2107,8 +2478,22 @@ static void fill_aead_bd3_addr(struct wd_aead_msg *msg,
 }
 
 
-static int fill_aead_bd3(struct wd_aead_msg *msg, struct hisi_sec_sqe3 *sqe)
+static void fill_aead_bd3_len(struct wd_aead_msg *msg,
+			      struct hisi_sec_sqe3 *sqe)
 {
+	sqe->c_len_ivin = msg->in_bytes;
+	sqe->cipher_src_offset = msg->assoc_bytes;
+
+	/* CCM/GCM only authenticate the aad */
+	if (msg->cmode == WD_CIPHER_CCM || msg->cmode == WD_CIPHER_GCM)
+		sqe->a_len_key = msg->assoc_bytes;
+	else
+		sqe->a_len_key = msg->in_bytes + msg->assoc_bytes;
+}
+
+static int fill_aead_bd3(struct wd_aead_msg *msg, void *bd)
+{
+	struct hisi_sec_sqe3 *sqe = bd;
 	__u16 scene, de;
 	int ret;
 
@@ -2131,10 +2516,8 @@ static int fill_aead_bd3(struct wd_aead_msg *msg, struct hisi_sec_sqe3 *sqe)
 		return -WD_EINVAL;
 	}
 	sqe->bd_param |= (__u16)(de | scene);
-
-	sqe->c_len_ivin = msg->in_bytes;
-	sqe->cipher_src_offset = msg->assoc_bytes;
-	sqe->a_len_key = msg->in_bytes + msg->assoc_bytes;
+	sqe->c_key_addr = (__u64)(uintptr_t)msg->ckey;
+	sqe->a_key_addr = (__u64)(uintptr_t)msg->akey;
 
 	ret = fill_aead_bd3_alg(msg, sqe);
 	if (ret) {
@@ -2152,29 +2535,30 @@ static int fill_aead_bd3(struct wd_aead_msg *msg, struct hisi_sec_sqe3 *sqe)
 }
 
 
-int hisi_sec_aead_send_v3(handle_t ctx, struct wd_aead_msg *msg)
+static int fill_aead_bd3_sqe(handle_t h_qp, void *data, void *bd)
 {
-	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
-	struct hisi_sec_sqe3 sqe;
-	__u16 count = 0;
+	struct wd_aead_msg *msg = data;
+	struct hisi_sec_sqe3 *sqe = bd;
 	int ret;
 
-	if (!msg) {
-		WD_ERR("failed to check input aead msg!\n");
-		return -WD_EINVAL;
-	}
-
 	ret = aead_len_check(msg);
 	if (unlikely(ret))
 		return ret;
 
-	memset(&sqe, 0, sizeof(struct hisi_sec_sqe3));
-	ret = fill_aead_bd3(msg, &sqe);
+	if (unlikely(msg->cmode != WD_CIPHER_CCM &&
+		     msg->cmode != WD_CIPHER_GCM && !msg->in_bytes)) {
+		WD_ERR("failed to check aead in_bytes 0 length!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = fill_aead_bd_tmpl(msg, sqe, fill_aead_bd3);
 	if (unlikely(ret))
 		return ret;
 
+	fill_aead_bd3_len(msg, sqe);
+
 	if (msg->data_fmt == WD_SGL_BUF) {
-		ret = hisi_sec_fill_sgl_v3(h_qp, &msg->in, &msg->out, &sqe,
+		ret = hisi_sec_fill_sgl_v3(h_qp, &msg->in, &msg->out, sqe,
 					msg->alg_type);
 		if (ret) {
 			WD_ERR("failed to get sgl!\n");
@@ -2182,14 +2566,34 @@ int hisi_sec_aead_send_v3(handle_t ctx, struct wd_aead_msg *msg)
 		}
 	}
 
-	fill_aead_bd3_addr(msg, &sqe);
+	fill_aead_bd3_addr(msg, sqe);
 
 #ifdef DEBUG
 	WD_ERR("Dump aead send sqe-->!\n");
-	sec_dump_bd((unsigned char *)&sqe, SQE_BYTES_NUMS);
+	sec_dump_bd((unsigned char *)sqe, SQE_BYTES_NUMS);
 #endif
 
-	sqe.tag = msg->tag;
+	sqe->tag = msg->tag;
+
+	return 0;
+}
+
+int hisi_sec_aead_send_v3(handle_t ctx, struct wd_aead_msg *msg)
+{
+	handle_t h_qp = (handle_t)wd_ctx_get_priv(ctx);
+	struct hisi_sec_sqe3 sqe;
+	__u16 count = 0;
+	int ret;
+
+	if (!msg) {
+		WD_ERR("failed to check input aead msg!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = fill_aead_bd3_sqe(h_qp, msg, &sqe);
+	if (unlikely(ret))
+		return ret;
+
 	ret = hisi_qm_send(h_qp, &sqe, 1, &count);
 	if (ret < 0) {
 		if (ret != -WD_EBUSY)
@@ -2204,6 +2608,13 @@ int hisi_sec_aead_send_v3(handle_t ctx, struct wd_aead_msg *msg)
 	return ret;
 }
 
+int hisi_sec_aead_send_batch_v3(handle_t ctx, struct wd_aead_msg **msgs,
+				__u32 num, __u32 *count)
+{
+	return hisi_sec_aead_send_batch_common(ctx, msgs, num, count,
+					       fill_aead_bd3_sqe);
+}
+
 static void parse_aead_bd3(struct hisi_sec_sqe3 *sqe,
 	struct wd_aead_msg *recv_msg)
 {
@@ -2274,22 +2685,28 @@ static void hisi_sec_driver_adapter(struct hisi_qp *qp)
 	if (q_info.hw_type == HISI_QM_API_VER2_BASE) {
 		WD_ERR("hisi sec init Kunpeng920!\n");
 		hisi_cipher_driver.cipher_send = hisi_sec_cipher_send;
+		hisi_cipher_driver.cipher_send_batch = hisi_sec_cipher_send_batch;
 		hisi_cipher_driver.cipher_recv = hisi_sec_cipher_recv;
 
 		hisi_digest_driver.digest_send = hisi_sec_digest_send;
+		hisi_digest_driver.digest_send_batch = hisi_sec_digest_send_batch;
 		hisi_digest_driver.digest_recv = hisi_sec_digest_recv;
 
 		hisi_aead_driver.aead_send = hisi_sec_aead_send;
+		hisi_aead_driver.aead_send_batch = hisi_sec_aead_send_batch;
 		hisi_aead_driver.aead_recv = hisi_sec_aead_recv;
 	} else {
 		WD_ERR("hisi sec init Kunpeng930!\n");
 		hisi_cipher_driver.cipher_send = hisi_sec_cipher_send_v3;
+		hisi_cipher_driver.cipher_send_batch = hisi_sec_cipher_send_batch_v3;
 		hisi_cipher_driver.cipher_recv = hisi_sec_cipher_recv_v3;
 
 		hisi_digest_driver.digest_send = hisi_sec_digest_send_v3;
+		hisi_digest_driver.digest_send_batch = hisi_sec_digest_send_batch_v3;
 		hisi_digest_driver.digest_recv = hisi_sec_digest_recv_v3;
 
 		hisi_aead_driver.aead_send = hisi_sec_aead_send_v3;
+		hisi_aead_driver.aead_send_batch = hisi_sec_aead_send_batch_v3;
 		hisi_aead_driver.aead_recv = hisi_sec_aead_recv_v3;
 	}
 }
@@ -0,0 +1,304 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "drv/wd_comp_drv.h"
+#include "loopback_udrv.h"
+
+#define LB_MEM_LEVEL		8
+#define LB_GZIP_WBITS		16
+#define LB_MAX_LEVEL		9
+/* ctx_dw0..2 the hardware writes back to the ctx_buf of a request */
+#define LB_CTX_DW_SIZE		12
+
+struct lb_comp_ctx {
+	struct wd_ctx_config_internal config;
+};
+
+/* A stream kept behind the ctx_buf of a stateful session */
+struct lb_strm {
+	z_stream zs;
+	__u8 op_type;
+};
+
+/* zlib window bits of enum wd_comp_winsz_type */
+static const int lb_win_bits[] = {12, 13, 14, 15, 15};
+
+static int lb_get_wbits(struct wd_comp_msg *msg)
+{
+	int wbits = 15;
+
+	if (msg->req.op_type == WD_DIR_COMPRESS &&
+	    msg->win_sz < ARRAY_SIZE(lb_win_bits))
+		wbits = lb_win_bits[msg->win_sz];
+
+	if (msg->alg_type == WD_DEFLATE)
+		return -wbits;
+	if (msg->alg_type == WD_GZIP)
+		return wbits + LB_GZIP_WBITS;
+
+	return wbits;
+}
+
+static int lb_get_level(struct wd_comp_msg *msg)
+{
+	if (!msg->comp_lv)
+		return Z_DEFAULT_COMPRESSION;
+
+	return msg->comp_lv > LB_MAX_LEVEL ? LB_MAX_LEVEL : msg->comp_lv;
+}
+
+static int lb_strm_init(struct wd_comp_msg *msg, z_stream *zs)
+{
+	memset(zs, 0, sizeof(*zs));
+	if (msg->req.op_type == WD_DIR_COMPRESS)
+		return deflateInit2(zs, lb_get_level(msg), Z_DEFLATED,
+				    lb_get_wbits(msg), LB_MEM_LEVEL,
+				    Z_DEFAULT_STRATEGY);
+
+	return inflateInit2(zs, lb_get_wbits(msg));
+}
+
+static void lb_strm_end(__u8 op_type, z_stream *zs)
+{
+	if (op_type == WD_DIR_COMPRESS)
+		(void)deflateEnd(zs);
+	else
+		(void)inflateEnd(zs);
+}
+
+static __u32 lb_bit_reverse(__u32 x)
+{
+	__u32 r = 0;
+	int i;
+
+	for (i = 0; i < 32; i++, x >>= 1)
+		r = (r << 1) | (x & 1);
+
+	return r;
+}
+
+/*
+ * The checksum the same as the hardware: adler32 of zlib, and for gzip the
+ * crc32 register, that is the crc32 reversed and not inverted.
+ */
+static __u32 lb_get_checksum(struct wd_comp_msg *msg, z_stream *zs)
+{
+	if (msg->alg_type == WD_GZIP)
+		return ~lb_bit_reverse(zs->adler);
+
+	return zs->adler;
+}
+
+/* Run one step of @zs on the buffers of @msg, and fill the result in it */
+static void lb_strm_run(struct wd_comp_msg *msg, z_stream *zs, int flush)
+{
+	struct wd_comp_req *req = &msg->req;
+	int ret;
+
+	zs->next_in = req->src;
+	zs->avail_in = req->src_len;
+	zs->next_out = req->dst;
+	zs->avail_out = msg->avail_out;
+
+	if (req->op_type == WD_DIR_COMPRESS)
+		ret = deflate(zs, flush);
+	else
+		ret = inflate(zs, flush);
+
+	msg->in_cons = req->src_len - zs->avail_in;
+	msg->produced = msg->avail_out - zs->avail_out;
+	msg->avail_out = zs->avail_out;
+	msg->checksum = lb_get_checksum(msg, zs);
+	msg->isize = zs->total_in;
+
+	if (ret == Z_STREAM_END) {
+		req->status = req->op_type == WD_DIR_COMPRESS ? WD_SUCCESS :
+			      WD_STREAM_END;
+	} else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+		/* the same as the hardware, out of space needs a resend */
+		if (!zs->avail_out)
+			req->status = WD_EAGAIN;
+		else if (flush == Z_FINISH)
+			req->status = WD_IN_EPARA;
+		else
+			req->status = WD_SUCCESS;
+	} else {
+		WD_ERR("loopback zlib failed(%d)!\n", ret);
+		req->status = WD_IN_EPARA;
+	}
+}
+
+static void lb_comp_block(struct wd_comp_msg *msg)
+{
+	z_stream zs;
+
+	if (lb_strm_init(msg, &zs) != Z_OK) {
+		msg->req.status = WD_IN_EPARA;
+		return;
+	}
+
+	lb_strm_run(msg, &zs, Z_FINISH);
+	lb_strm_end(msg->req.op_type, &zs);
+}
+
+static void lb_strm_free(struct lb_strm **pstrm)
+{
+	struct lb_strm *strm = *pstrm;
+
+	if (!strm)
+		return;
+
+	lb_strm_end(strm->op_type, &strm->zs);
+	free(strm);
+	*pstrm = NULL;
+}
+
+/*
+ * The stream of a stateful session is kept behind the ctx_buf of the session,
+ * the place the hardware saves its stream context. It's released when the
+ * stream ends, a new stream resets the leftover of an aborted one, and
+ * lb_comp_ctx_buf_free() releases the one left when the ctx_buf is freed.
+ */
+static void lb_comp_strm(struct wd_comp_msg *msg)
+{
+	struct lb_strm **pstrm = (struct lb_strm **)msg->ctx_buf;
+	struct lb_strm *strm;
+	int flush;
+
+	if (msg->stream_pos == WD_COMP_STREAM_NEW)
+		lb_strm_free(pstrm);
+
+	strm = *pstrm;
+	if (!strm) {
+		strm = calloc(1, sizeof(*strm));
+		if (!strm || lb_strm_init(msg, &strm->zs) != Z_OK) {
+			free(strm);
+			msg->req.status = WD_IN_EPARA;
+			return;
+		}
+		strm->op_type = msg->req.op_type;
+		*pstrm = strm;
+	}
+
+	if (msg->req.op_type == WD_DIR_COMPRESS)
+		flush = msg->req.last ? Z_FINISH : Z_SYNC_FLUSH;
+	else
+		flush = Z_SYNC_FLUSH;
+
+	lb_strm_run(msg, &strm->zs, flush);
+	if (msg->req.status == WD_IN_EPARA ||
+	    (msg->req.status == WD_STREAM_END) ||
+	    (msg->req.op_type == WD_DIR_COMPRESS && msg->req.last &&
+	     msg->req.status == WD_SUCCESS))
+		lb_strm_free(pstrm);
+}
+
+static void lb_comp_ctx_buf_free(void *ctx_buf)
+{
+	lb_strm_free((struct lb_strm **)ctx_buf);
+}
+
+static void lb_comp_do_msg(void *data)
+{
+	struct wd_comp_msg *msg = data;
+
+	if (msg->stream_mode == WD_COMP_STATEFUL) {
+		lb_comp_strm(msg);
+		return;
+	}
+
+	lb_comp_block(msg);
+	/*
+	 * Like hisi_zip, write the ctx words back to any ctx_buf a stateless
+	 * request comes with, so a stale one breaks the stream it belongs to.
+	 */
+	if (msg->ctx_buf)
+		memset(msg->ctx_buf, 0, LB_CTX_DW_SIZE);
+}
+
+static void lb_comp_free_queues(struct wd_ctx_config_internal *config,
+				__u32 num)
+{
+	__u32 i;
+
+	for (i = 0; i < num; i++)
+		lb_free_queue((handle_t)wd_ctx_get_priv(config->ctxs[i].ctx));
+}
+
+static int lb_comp_init(struct wd_ctx_config_internal *config, void *priv)
+{
+	struct lb_comp_ctx *lb_ctx = (struct lb_comp_ctx *)priv;
+	__u32 i;
+
+	memcpy(&lb_ctx->config, config, sizeof(struct wd_ctx_config_internal));
+	for (i = 0; i < config->ctx_num; i++) {
+		if (!lb_alloc_queue(config->ctxs[i].ctx, lb_comp_do_msg)) {
+			lb_comp_free_queues(config, i);
+			return -WD_ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void lb_comp_exit(void *priv)
+{
+	struct lb_comp_ctx *lb_ctx = (struct lb_comp_ctx *)priv;
+	struct wd_ctx_config_internal *config = &lb_ctx->config;
+
+	lb_comp_free_queues(config, config->ctx_num);
+}
+
+static int lb_comp_send(handle_t ctx, struct wd_comp_msg *msg, void *priv)
+{
+	if (unlikely(msg->alg_type > WD_GZIP)) {
+		WD_ERR("invalid: loopback doesn't support alg(%d)!\n",
+		       msg->alg_type);
+		return -WD_EINVAL;
+	}
+
+	if (unlikely(msg->req.data_fmt != WD_FLAT_BUF)) {
+		WD_ERR("invalid: loopback only supports flat buffer!\n");
+		return -WD_EINVAL;
+	}
+
+	if (unlikely(msg->stream_mode == WD_COMP_STATEFUL && !msg->ctx_buf)) {
+		WD_ERR("invalid: stream ctx_buf is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	return lb_send((handle_t)wd_ctx_get_priv(ctx), msg);
+}
+
+static int lb_comp_recv(handle_t ctx, struct wd_comp_msg *recv_msg, void *priv)
+{
+	struct wd_comp_msg *msg;
+	int ret;
+
+	ret = lb_recv((handle_t)wd_ctx_get_priv(ctx), (void **)&msg);
+	if (ret)
+		return ret;
+
+	/* the async poll gives a msg of its own and looks the sent one up */
+	if (recv_msg != msg)
+		memcpy(recv_msg, msg, sizeof(*recv_msg));
+
+	return 0;
+}
+
+struct wd_comp_driver lb_comp = {
+	.drv_name		= "loopback",
+	.alg_name		= "zlib\ngzip\ndeflate",
+	.drv_ctx_size		= sizeof(struct lb_comp_ctx),
+	.init			= lb_comp_init,
+	.exit			= lb_comp_exit,
+	.comp_send		= lb_comp_send,
+	.comp_recv		= lb_comp_recv,
+	.ctx_buf_free		= lb_comp_ctx_buf_free,
+};
+
+WD_COMP_SET_DRIVER(lb_comp);
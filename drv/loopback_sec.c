@@ -0,0 +1,442 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "drv/wd_aead_drv.h"
+#include "drv/wd_cipher_drv.h"
+#include "drv/wd_digest_drv.h"
+#include "loopback_udrv.h"
+
+#define LB_AES_KEY_128		16
+#define LB_AES_KEY_192		24
+#define LB_AES_KEY_256		32
+#define LB_XTS_KEY_256		64
+#define LB_SM4_KEY		16
+#define LB_DES_KEY		8
+#define LB_3DES_2KEY		16
+#define LB_3DES_3KEY		24
+#define LB_CCM_L_MASK		0x7
+#define LB_CCM_NONCE_MAX	15
+
+struct lb_sec_ctx {
+	struct wd_ctx_config_internal config;
+};
+
+struct lb_cipher_alg {
+	__u8 alg;
+	__u8 mode;
+	__u16 key_bytes;
+	const EVP_CIPHER *(*get_cipher)(void);
+};
+
+/* the xts key is two keys of the same size */
+static const struct lb_cipher_alg lb_cipher_algs[] = {
+	{WD_CIPHER_AES, WD_CIPHER_ECB, LB_AES_KEY_128, EVP_aes_128_ecb},
+	{WD_CIPHER_AES, WD_CIPHER_ECB, LB_AES_KEY_192, EVP_aes_192_ecb},
+	{WD_CIPHER_AES, WD_CIPHER_ECB, LB_AES_KEY_256, EVP_aes_256_ecb},
+	{WD_CIPHER_AES, WD_CIPHER_CBC, LB_AES_KEY_128, EVP_aes_128_cbc},
+	{WD_CIPHER_AES, WD_CIPHER_CBC, LB_AES_KEY_192, EVP_aes_192_cbc},
+	{WD_CIPHER_AES, WD_CIPHER_CBC, LB_AES_KEY_256, EVP_aes_256_cbc},
+	{WD_CIPHER_AES, WD_CIPHER_CTR, LB_AES_KEY_128, EVP_aes_128_ctr},
+	{WD_CIPHER_AES, WD_CIPHER_CTR, LB_AES_KEY_192, EVP_aes_192_ctr},
+	{WD_CIPHER_AES, WD_CIPHER_CTR, LB_AES_KEY_256, EVP_aes_256_ctr},
+	{WD_CIPHER_AES, WD_CIPHER_OFB, LB_AES_KEY_128, EVP_aes_128_ofb},
+	{WD_CIPHER_AES, WD_CIPHER_OFB, LB_AES_KEY_192, EVP_aes_192_ofb},
+	{WD_CIPHER_AES, WD_CIPHER_OFB, LB_AES_KEY_256, EVP_aes_256_ofb},
+	{WD_CIPHER_AES, WD_CIPHER_CFB, LB_AES_KEY_128, EVP_aes_128_cfb128},
+	{WD_CIPHER_AES, WD_CIPHER_CFB, LB_AES_KEY_192, EVP_aes_192_cfb128},
+	{WD_CIPHER_AES, WD_CIPHER_CFB, LB_AES_KEY_256, EVP_aes_256_cfb128},
+	{WD_CIPHER_AES, WD_CIPHER_XTS, LB_AES_KEY_256, EVP_aes_128_xts},
+	{WD_CIPHER_AES, WD_CIPHER_XTS, LB_XTS_KEY_256, EVP_aes_256_xts},
+	{WD_CIPHER_AES, WD_CIPHER_CCM, LB_AES_KEY_128, EVP_aes_128_ccm},
+	{WD_CIPHER_AES, WD_CIPHER_CCM, LB_AES_KEY_192, EVP_aes_192_ccm},
+	{WD_CIPHER_AES, WD_CIPHER_CCM, LB_AES_KEY_256, EVP_aes_256_ccm},
+	{WD_CIPHER_AES, WD_CIPHER_GCM, LB_AES_KEY_128, EVP_aes_128_gcm},
+	{WD_CIPHER_AES, WD_CIPHER_GCM, LB_AES_KEY_192, EVP_aes_192_gcm},
+	{WD_CIPHER_AES, WD_CIPHER_GCM, LB_AES_KEY_256, EVP_aes_256_gcm},
+	{WD_CIPHER_SM4, WD_CIPHER_ECB, LB_SM4_KEY, EVP_sm4_ecb},
+	{WD_CIPHER_SM4, WD_CIPHER_CBC, LB_SM4_KEY, EVP_sm4_cbc},
+	{WD_CIPHER_SM4, WD_CIPHER_CTR, LB_SM4_KEY, EVP_sm4_ctr},
+	{WD_CIPHER_SM4, WD_CIPHER_OFB, LB_SM4_KEY, EVP_sm4_ofb},
+	{WD_CIPHER_SM4, WD_CIPHER_CFB, LB_SM4_KEY, EVP_sm4_cfb128},
+	{WD_CIPHER_DES, WD_CIPHER_ECB, LB_DES_KEY, EVP_des_ecb},
+	{WD_CIPHER_DES, WD_CIPHER_CBC, LB_DES_KEY, EVP_des_cbc},
+	{WD_CIPHER_3DES, WD_CIPHER_ECB, LB_3DES_2KEY, EVP_des_ede_ecb},
+	{WD_CIPHER_3DES, WD_CIPHER_CBC, LB_3DES_2KEY, EVP_des_ede_cbc},
+	{WD_CIPHER_3DES, WD_CIPHER_ECB, LB_3DES_3KEY, EVP_des_ede3_ecb},
+	{WD_CIPHER_3DES, WD_CIPHER_CBC, LB_3DES_3KEY, EVP_des_ede3_cbc},
+};
+
+static const EVP_CIPHER *lb_get_cipher(__u8 alg, __u8 mode, __u16 key_bytes)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(lb_cipher_algs); i++) {
+		if (lb_cipher_algs[i].alg == alg &&
+		    lb_cipher_algs[i].mode == mode &&
+		    lb_cipher_algs[i].key_bytes == key_bytes)
+			return lb_cipher_algs[i].get_cipher();
+	}
+
+	return NULL;
+}
+
+static const EVP_MD *lb_get_md(__u8 alg)
+{
+	switch (alg) {
+	case WD_DIGEST_SM3:
+		return EVP_sm3();
+	case WD_DIGEST_MD5:
+		return EVP_md5();
+	case WD_DIGEST_SHA1:
+		return EVP_sha1();
+	case WD_DIGEST_SHA256:
+		return EVP_sha256();
+	case WD_DIGEST_SHA224:
+		return EVP_sha224();
+	case WD_DIGEST_SHA384:
+		return EVP_sha384();
+	case WD_DIGEST_SHA512:
+		return EVP_sha512();
+	case WD_DIGEST_SHA512_224:
+		return EVP_sha512_224();
+	case WD_DIGEST_SHA512_256:
+		return EVP_sha512_256();
+	default:
+		return NULL;
+	}
+}
+
+static int lb_sec_init(struct wd_ctx_config_internal *config, void *priv,
+		       lb_do_msg_t do_msg)
+{
+	struct lb_sec_ctx *lb_ctx = (struct lb_sec_ctx *)priv;
+	__u32 i, j;
+
+	memcpy(&lb_ctx->config, config, sizeof(struct wd_ctx_config_internal));
+	for (i = 0; i < config->ctx_num; i++) {
+		if (!lb_alloc_queue(config->ctxs[i].ctx, do_msg))
+			goto out;
+	}
+
+	return 0;
+
+out:
+	for (j = 0; j < i; j++)
+		lb_free_queue((handle_t)wd_ctx_get_priv(config->ctxs[j].ctx));
+	return -WD_ENOMEM;
+}
+
+static void lb_sec_exit(void *priv)
+{
+	struct lb_sec_ctx *lb_ctx = (struct lb_sec_ctx *)priv;
+	struct wd_ctx_config_internal *config = &lb_ctx->config;
+	__u32 i;
+
+	for (i = 0; i < config->ctx_num; i++)
+		lb_free_queue((handle_t)wd_ctx_get_priv(config->ctxs[i].ctx));
+}
+
+static int lb_sec_recv(handle_t ctx, void *recv_msg, size_t size)
+{
+	void *msg;
+	int ret;
+
+	ret = lb_recv((handle_t)wd_ctx_get_priv(ctx), &msg);
+	if (ret)
+		return ret;
+
+	/* the async poll gives a msg of its own and looks the sent one up */
+	if (recv_msg != msg)
+		memcpy(recv_msg, msg, size);
+
+	return 0;
+}
+
+static int lb_cipher_run(struct wd_cipher_msg *msg, const EVP_CIPHER *cipher)
+{
+	int enc = msg->op_type == WD_CIPHER_ENCRYPTION;
+	EVP_CIPHER_CTX *ctx;
+	int len, flen;
+	int ret = 0;
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (!ctx)
+		return -WD_ENOMEM;
+
+	if (EVP_CipherInit_ex(ctx, cipher, NULL, msg->key, msg->iv, enc) != 1 ||
+	    EVP_CIPHER_CTX_set_padding(ctx, 0) != 1 ||
+	    EVP_CipherUpdate(ctx, msg->out, &len, msg->in,
+			     msg->in_bytes) != 1 ||
+	    EVP_CipherFinal_ex(ctx, msg->out + len, &flen) != 1) {
+		ret = -WD_EINVAL;
+		goto out;
+	}
+
+	/* chain the iv to the next request as the hardware does */
+	switch (msg->mode) {
+	case WD_CIPHER_CBC:
+	case WD_CIPHER_CTR:
+	case WD_CIPHER_OFB:
+	case WD_CIPHER_CFB:
+		if (EVP_CIPHER_CTX_get_updated_iv(ctx, msg->iv,
+						  msg->iv_bytes) != 1)
+			ret = -WD_EINVAL;
+		break;
+	default:
+		break;
+	}
+
+out:
+	EVP_CIPHER_CTX_free(ctx);
+	return ret;
+}
+
+static void lb_cipher_do_msg(void *data)
+{
+	struct wd_cipher_msg *msg = data;
+	const EVP_CIPHER *cipher;
+
+	cipher = lb_get_cipher(msg->alg, msg->mode, msg->key_bytes);
+	if (!cipher || lb_cipher_run(msg, cipher)) {
+		WD_ERR("loopback cipher failed, alg(%u) mode(%u)!\n",
+		       msg->alg, msg->mode);
+		msg->result = WD_IN_EPARA;
+		return;
+	}
+
+	msg->result = WD_SUCCESS;
+}
+
+static int lb_cipher_init(struct wd_ctx_config_internal *config, void *priv)
+{
+	return lb_sec_init(config, priv, lb_cipher_do_msg);
+}
+
+static int lb_cipher_send(handle_t ctx, struct wd_cipher_msg *msg)
+{
+	if (unlikely(msg->data_fmt != WD_FLAT_BUF)) {
+		WD_ERR("invalid: loopback only supports flat buffer!\n");
+		return -WD_EINVAL;
+	}
+
+	return lb_send((handle_t)wd_ctx_get_priv(ctx), msg);
+}
+
+static int lb_cipher_recv(handle_t ctx, struct wd_cipher_msg *recv_msg)
+{
+	return lb_sec_recv(ctx, recv_msg, sizeof(*recv_msg));
+}
+
+static struct wd_cipher_driver lb_cipher_driver = {
+	.drv_name	= "loopback",
+	.alg_name	= "cipher",
+	.drv_ctx_size	= sizeof(struct lb_sec_ctx),
+	.init		= lb_cipher_init,
+	.exit		= lb_sec_exit,
+	.cipher_send	= lb_cipher_send,
+	.cipher_recv	= lb_cipher_recv,
+};
+
+WD_CIPHER_SET_DRIVER(lb_cipher_driver);
+
+static void lb_digest_do_msg(void *data)
+{
+	struct wd_digest_msg *msg = data;
+	__u8 md_out[EVP_MAX_MD_SIZE];
+	unsigned int len = 0;
+	const EVP_MD *md;
+	int ret;
+
+	md = lb_get_md(msg->alg);
+	if (!md)
+		goto err;
+
+	if (msg->mode == WD_DIGEST_HMAC)
+		ret = HMAC(md, msg->key, msg->key_bytes, msg->in, msg->in_bytes,
+			   md_out, &len) ? 1 : 0;
+	else
+		ret = EVP_Digest(msg->in, msg->in_bytes, md_out, &len, md,
+				 NULL);
+	if (ret != 1 || msg->out_bytes > len)
+		goto err;
+
+	memcpy(msg->out, md_out, msg->out_bytes);
+	msg->result = WD_SUCCESS;
+	return;
+
+err:
+	WD_ERR("loopback digest failed, alg(%u) mode(%u)!\n",
+	       msg->alg, msg->mode);
+	msg->result = WD_IN_EPARA;
+}
+
+static int lb_digest_init(struct wd_ctx_config_internal *config, void *priv)
+{
+	return lb_sec_init(config, priv, lb_digest_do_msg);
+}
+
+static int lb_digest_send(handle_t ctx, struct wd_digest_msg *msg)
+{
+	if (unlikely(msg->data_fmt != WD_FLAT_BUF)) {
+		WD_ERR("invalid: loopback only supports flat buffer!\n");
+		return -WD_EINVAL;
+	}
+
+	/* the partial hash state lives in the hardware, not in the msg */
+	if (unlikely(msg->has_next || msg->iv_bytes)) {
+		WD_ERR("invalid: loopback doesn't support long hash!\n");
+		return -WD_EINVAL;
+	}
+
+	return lb_send((handle_t)wd_ctx_get_priv(ctx), msg);
+}
+
+static int lb_digest_recv(handle_t ctx, struct wd_digest_msg *recv_msg)
+{
+	return lb_sec_recv(ctx, recv_msg, sizeof(*recv_msg));
+}
+
+static struct wd_digest_driver lb_digest_driver = {
+	.drv_name	= "loopback",
+	.alg_name	= "digest",
+	.drv_ctx_size	= sizeof(struct lb_sec_ctx),
+	.init		= lb_digest_init,
+	.exit		= lb_sec_exit,
+	.digest_send	= lb_digest_send,
+	.digest_recv	= lb_digest_recv,
+};
+
+WD_DIGEST_SET_DRIVER(lb_digest_driver);
+
+/*
+ * The same layout as the hardware: src is assoc data + payload, followed by
+ * the mac when decrypting, and dst is assoc data + payload + mac when
+ * encrypting.
+ */
+static int lb_aead_run(struct wd_aead_msg *msg, const EVP_CIPHER *cipher)
+{
+	int enc = msg->op_type == WD_CIPHER_ENCRYPTION_DIGEST;
+	__u8 *mac_in = msg->in + msg->assoc_bytes + msg->in_bytes;
+	__u8 *mac_out = msg->out + msg->assoc_bytes + msg->in_bytes;
+	int ccm = msg->cmode == WD_CIPHER_CCM;
+	__u8 *iv = msg->iv;
+	int iv_len = msg->iv_bytes;
+	EVP_CIPHER_CTX *ctx;
+	int ret = -WD_EINVAL;
+	int len;
+
+	/* the ccm iv is the first counter block, flags byte and nonce */
+	if (ccm) {
+		iv_len = LB_CCM_NONCE_MAX - ((iv[0] & LB_CCM_L_MASK) + 1);
+		iv++;
+	}
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (!ctx)
+		return -WD_ENOMEM;
+
+	if (EVP_CipherInit_ex(ctx, cipher, NULL, NULL, NULL, enc) != 1 ||
+	    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, iv_len,
+				NULL) != 1)
+		goto out;
+
+	if (ccm && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG,
+				       msg->auth_bytes,
+				       enc ? NULL : mac_in) != 1)
+		goto out;
+
+	if (EVP_CipherInit_ex(ctx, NULL, NULL, msg->ckey, iv, enc) != 1)
+		goto out;
+
+	if (ccm && EVP_CipherUpdate(ctx, NULL, &len, NULL,
+				    msg->in_bytes) != 1)
+		goto out;
+
+	if (msg->assoc_bytes && EVP_CipherUpdate(ctx, NULL, &len, msg->in,
+						 msg->assoc_bytes) != 1)
+		goto out;
+
+	if (!ccm && !enc && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG,
+						msg->auth_bytes, mac_in) != 1)
+		goto out;
+
+	/* ccm verifies the mac in the update */
+	if (EVP_CipherUpdate(ctx, msg->out + msg->assoc_bytes, &len,
+			     msg->in + msg->assoc_bytes, msg->in_bytes) != 1)
+		goto out;
+
+	if (!ccm && EVP_CipherFinal_ex(ctx, msg->out + msg->assoc_bytes + len,
+				       &len) != 1)
+		goto out;
+
+	if (enc && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG,
+				       msg->auth_bytes, mac_out) != 1)
+		goto out;
+
+	if (msg->out != msg->in)
+		memcpy(msg->out, msg->in, msg->assoc_bytes);
+	ret = 0;
+
+out:
+	EVP_CIPHER_CTX_free(ctx);
+	return ret;
+}
+
+static void lb_aead_do_msg(void *data)
+{
+	struct wd_aead_msg *msg = data;
+	const EVP_CIPHER *cipher;
+
+	cipher = lb_get_cipher(msg->calg, msg->cmode, msg->ckey_bytes);
+	if (!cipher || lb_aead_run(msg, cipher)) {
+		WD_ERR("loopback aead failed, alg(%u) mode(%u)!\n",
+		       msg->calg, msg->cmode);
+		msg->result = WD_IN_EPARA;
+		return;
+	}
+
+	msg->result = WD_SUCCESS;
+}
+
+static int lb_aead_init(struct wd_ctx_config_internal *config, void *priv)
+{
+	return lb_sec_init(config, priv, lb_aead_do_msg);
+}
+
+static int lb_aead_send(handle_t ctx, struct wd_aead_msg *msg)
+{
+	if (unlikely(msg->data_fmt != WD_FLAT_BUF)) {
+		WD_ERR("invalid: loopback only supports flat buffer!\n");
+		return -WD_EINVAL;
+	}
+
+	if (unlikely(msg->cmode != WD_CIPHER_CCM &&
+		     msg->cmode != WD_CIPHER_GCM)) {
+		WD_ERR("invalid: loopback only supports ccm and gcm!\n");
+		return -WD_EINVAL;
+	}
+
+	return lb_send((handle_t)wd_ctx_get_priv(ctx), msg);
+}
+
+static int lb_aead_recv(handle_t ctx, struct wd_aead_msg *recv_msg)
+{
+	return lb_sec_recv(ctx, recv_msg, sizeof(*recv_msg));
+}
+
+static struct wd_aead_driver lb_aead_driver = {
+	.drv_name	= "loopback",
+	.alg_name	= "aead",
+	.drv_ctx_size	= sizeof(struct lb_sec_ctx),
+	.init		= lb_aead_init,
+	.exit		= lb_sec_exit,
+	.aead_send	= lb_aead_send,
+	.aead_recv	= lb_aead_recv,
+};
+
+WD_AEAD_SET_DRIVER(lb_aead_driver);
@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "loopback_udrv.h"
+
+#define LB_Q_DEPTH		1024
+#define LB_NSEC_PER_SEC		1000000000ULL
+#define LB_NSEC_PER_USEC	1000ULL
+#define LB_MAX_LATENCY		1000000
+
+struct lb_sqe {
+	void *msg;
+	/* CLOCK_MONOTONIC time before which the task can't complete */
+	__u64 due;
+	/* Send time, only when the latencies are counted */
+	__u64 stamp;
+};
+
+struct lb_queue {
+	struct lb_sqe ring[LB_Q_DEPTH];
+	/*
+	 * Free running indexes: sq_tail is the next slot to fill, wk_head the
+	 * next one for the worker and cq_head the next one to be received.
+	 */
+	__u32 sq_tail;
+	__u32 wk_head;
+	__u32 cq_head;
+	bool stop;
+	__u64 latency;
+	lb_do_msg_t do_msg;
+	handle_t h_ctx;
+	/* Queue counters of the ctx, updated under the lock */
+	struct wd_ctx_stats_area *stats;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t worker;
+};
+
+static __u64 lb_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * LB_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void lb_sleep_until(__u64 due)
+{
+	struct timespec ts;
+
+	ts.tv_sec = due / LB_NSEC_PER_SEC;
+	ts.tv_nsec = due % LB_NSEC_PER_SEC;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+static __u64 lb_get_latency(void)
+{
+	const char *env = getenv(LB_LATENCY_ENV);
+	long latency;
+
+	if (!env)
+		return 0;
+
+	latency = strtol(env, NULL, 10);
+	if (latency < 0 || latency > LB_MAX_LATENCY) {
+		WD_ERR("invalid: %s is %s, ignore it!\n", LB_LATENCY_ENV, env);
+		return 0;
+	}
+
+	return latency * LB_NSEC_PER_USEC;
+}
+
+/* Refresh the inflight counters, called under the lock */
+static void lb_stats_update(struct lb_queue *q)
+{
+	struct wd_ctx_queue_stats *stats = &q->stats->queue;
+	__u32 inflight = q->sq_tail - q->cq_head;
+
+	stats->inflight = inflight;
+	if (inflight > stats->inflight_peak)
+		stats->inflight_peak = inflight;
+}
+
+static void *lb_worker(void *data)
+{
+	struct lb_queue *q = data;
+	struct lb_sqe *sqe;
+
+	while (1) {
+		pthread_mutex_lock(&q->lock);
+		while (!q->stop && q->wk_head == q->sq_tail)
+			pthread_cond_wait(&q->cond, &q->lock);
+		if (q->stop) {
+			pthread_mutex_unlock(&q->lock);
+			break;
+		}
+		sqe = &q->ring[q->wk_head % LB_Q_DEPTH];
+		pthread_mutex_unlock(&q->lock);
+
+		q->do_msg(sqe->msg);
+		if (sqe->due > lb_now())
+			lb_sleep_until(sqe->due);
+
+		pthread_mutex_lock(&q->lock);
+		q->wk_head++;
+		pthread_mutex_unlock(&q->lock);
+
+		(void)wd_ctx_notify(q->h_ctx);
+	}
+
+	return NULL;
+}
+
+handle_t lb_alloc_queue(handle_t h_ctx, lb_do_msg_t do_msg)
+{
+	struct lb_queue *q;
+	int ret;
+
+	if (!h_ctx || !do_msg) {
+		WD_ERR("invalid: loopback queue parameter is NULL!\n");
+		return 0;
+	}
+
+	q = calloc(1, sizeof(*q));
+	if (!q)
+		return 0;
+
+	q->h_ctx = h_ctx;
+	q->stats = wd_ctx_get_stats_area(h_ctx);
+	q->do_msg = do_msg;
+	q->latency = lb_get_latency();
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->cond, NULL);
+
+	ret = pthread_create(&q->worker, NULL, lb_worker, q);
+	if (ret) {
+		WD_ERR("failed to create loopback worker (%d)!\n", ret);
+		goto out;
+	}
+
+	ret = wd_ctx_set_priv(h_ctx, q);
+	if (ret)
+		goto out_worker;
+
+	return (handle_t)q;
+
+out_worker:
+	pthread_mutex_lock(&q->lock);
+	q->stop = true;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+	pthread_join(q->worker, NULL);
+out:
+	pthread_cond_destroy(&q->cond);
+	pthread_mutex_destroy(&q->lock);
+	free(q);
+	return 0;
+}
+
+void lb_free_queue(handle_t h_q)
+{
+	struct lb_queue *q = (struct lb_queue *)h_q;
+
+	if (!q)
+		return;
+
+	pthread_mutex_lock(&q->lock);
+	q->stop = true;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+	pthread_join(q->worker, NULL);
+
+	wd_ctx_set_priv(q->h_ctx, NULL);
+	pthread_cond_destroy(&q->cond);
+	pthread_mutex_destroy(&q->lock);
+	free(q);
+}
+
+int lb_send(handle_t h_q, void *msg)
+{
+	struct lb_queue *q = (struct lb_queue *)h_q;
+	struct lb_sqe *sqe;
+
+	if (unlikely(!q || !msg))
+		return -WD_EINVAL;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->sq_tail - q->cq_head >= LB_Q_DEPTH) {
+		q->stats->queue.busy_num++;
+		pthread_mutex_unlock(&q->lock);
+		return -WD_EBUSY;
+	}
+
+	sqe = &q->ring[q->sq_tail % LB_Q_DEPTH];
+	sqe->msg = msg;
+	sqe->due = q->latency ? lb_now() + q->latency : 0;
+	sqe->stamp = q->stats->lat_en ? lb_now() : 0;
+	q->sq_tail++;
+	lb_stats_update(q);
+	q->stats->queue.send_num++;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+
+	return 0;
+}
+
+int lb_recv(handle_t h_q, void **msg)
+{
+	struct lb_queue *q = (struct lb_queue *)h_q;
+	struct lb_sqe *sqe;
+
+	if (unlikely(!q || !msg))
+		return -WD_EINVAL;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->cq_head == q->wk_head) {
+		q->stats->queue.empty_num++;
+		pthread_mutex_unlock(&q->lock);
+		return -WD_EAGAIN;
+	}
+
+	sqe = &q->ring[q->cq_head % LB_Q_DEPTH];
+	*msg = sqe->msg;
+	if (sqe->stamp)
+		wd_ctx_stats_lat(q->stats->queue.lat, lb_now() - sqe->stamp);
+	q->cq_head++;
+	lb_stats_update(q);
+	q->stats->queue.recv_num++;
+	pthread_mutex_unlock(&q->lock);
+
+	return 0;
+}
@@ -59,6 +59,8 @@ struct wd_aead_msg {
 	__u8 *out;
 	/* mac */
 	__u8 *mac;
+	/* Descriptor templates of the session, NULL if it has none */
+	struct wd_sqe_tmpl *tmpl;
 };
 
 struct wd_aead_driver {
@@ -69,6 +71,12 @@ struct wd_aead_driver {
 	void	(*exit)(void *priv);
 	int	(*aead_send)(handle_t ctx, struct wd_aead_msg *msg);
 	int	(*aead_recv)(handle_t ctx, struct wd_aead_msg *msg);
+	/*
+	 * Optional, send @num msgs with as few doorbells as possible.
+	 * @count returns the number of msgs taken by the hardware.
+	 */
+	int	(*aead_send_batch)(handle_t ctx, struct wd_aead_msg **msgs,
+				   __u32 num, __u32 *count);
 };
 
 void wd_aead_set_driver(struct wd_aead_driver *drv);
@@ -44,6 +44,8 @@ struct wd_cipher_msg {
 	__u8 *in;
 	/* output data pointer */
 	__u8 *out;
+	/* Descriptor templates of the session, NULL if it has none */
+	struct wd_sqe_tmpl *tmpl;
 };
 
 struct wd_cipher_driver {
@@ -54,6 +56,12 @@ struct wd_cipher_driver {
 	void	(*exit)(void *priv);
 	int	(*cipher_send)(handle_t ctx, struct wd_cipher_msg *msg);
 	int	(*cipher_recv)(handle_t ctx, struct wd_cipher_msg *msg);
+	/*
+	 * Optional, send @num msgs with as few doorbells as possible.
+	 * @count returns the number of msgs taken by the hardware.
+	 */
+	int	(*cipher_send_batch)(handle_t ctx, struct wd_cipher_msg **msgs,
+				     __u32 num, __u32 *count);
 };
 
 void wd_cipher_set_driver(struct wd_cipher_driver *drv);
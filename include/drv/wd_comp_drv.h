@@ -48,6 +48,14 @@ struct wd_comp_msg {
 	__u32 tag;
 	/* Epoll flag */
 	__u8 is_polled;
+	/* Session of an async stream, updated when the request completes */
+	void *strm_sess;
+	/* Denoted by enum wd_mem_type */
+	enum wd_mem_type mem_type;
+	/* Buffers of the user while the request uses bounce blocks */
+	void *usr_src;
+	void *usr_dst;
+	void *usr_ctx_buf;
 };
 
 struct wd_comp_driver {
@@ -58,6 +66,17 @@ struct wd_comp_driver {
 	void (*exit)(void *priv);
 	int (*comp_send)(handle_t ctx, struct wd_comp_msg *msg, void *priv);
 	int (*comp_recv)(handle_t ctx, struct wd_comp_msg *msg, void *priv);
+	/*
+	 * Optional, send @num msgs with as few doorbells as possible.
+	 * @count returns the number of msgs taken by the hardware.
+	 */
+	int (*comp_send_batch)(handle_t ctx, struct wd_comp_msg **msgs,
+			       __u32 num, __u32 *count, void *priv);
+	/*
+	 * Optional, release what the driver keeps behind the ctx_buf of a
+	 * stream, called before the ctx_buf is freed.
+	 */
+	void (*ctx_buf_free)(void *ctx_buf);
 };
 
 void wd_comp_set_driver(struct wd_comp_driver *drv);
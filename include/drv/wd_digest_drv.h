@@ -47,6 +47,8 @@ struct wd_digest_msg {
 	__u8 *out;
 	/* total of data for stream mode */
 	__u64 long_data_len;
+	/* Descriptor templates of the session, NULL if it has none */
+	struct wd_sqe_tmpl *tmpl;
 };
 
 struct wd_digest_driver {
@@ -57,6 +59,12 @@ struct wd_digest_driver {
 	void	(*exit)(void *priv);
 	int	(*digest_send)(handle_t ctx, struct wd_digest_msg *msg);
 	int	(*digest_recv)(handle_t ctx, struct wd_digest_msg *msg);
+	/*
+	 * Optional, send @num msgs with as few doorbells as possible.
+	 * @count returns the number of msgs taken by the hardware.
+	 */
+	int	(*digest_send_batch)(handle_t ctx, struct wd_digest_msg **msgs,
+				     __u32 num, __u32 *count);
 };
 
 void wd_digest_set_driver(struct wd_digest_driver *drv);
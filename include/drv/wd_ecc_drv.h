@@ -59,6 +59,7 @@ struct wd_ecc_pubkey {
 	struct wd_ecc_point g;
 	struct wd_ecc_point pub;
 	__u32 size;
+	__u32 fmt; /* Format state, denoted by enum wd_key_fmt_state */
 	void *data;
 };
 
@@ -70,6 +71,7 @@ struct wd_ecc_prikey {
 	struct wd_dtb n;
 	struct wd_ecc_point g;
 	__u32 size;
+	__u32 fmt; /* Format state, denoted by enum wd_key_fmt_state */
 	void *data;
 };
 
@@ -179,8 +181,79 @@ struct wd_ecc_driver {
 	void (*exit)(void *priv);
 	int (*send)(handle_t sess, struct wd_ecc_msg *msg);
 	int (*recv)(handle_t sess, struct wd_ecc_msg *msg);
+	/*
+	 * Optional, send @num msgs with as few doorbells as possible.
+	 * @count returns the number of msgs taken by the hardware.
+	 */
+	int (*send_batch)(handle_t ctx, struct wd_ecc_msg **msgs, __u32 num,
+			  __u32 *count);
 };
 
+#define WD_ECC_HASH_BLOCK		64
+#define WD_ECC_HASH_WORDS		8
+#define WD_ECC_HASH_MAX_BYTES		32
+
+/* State of the built-in hash, used for sm2 steps done by the cpu */
+struct wd_ecc_hash_ctx {
+	__u32 state[WD_ECC_HASH_WORDS];
+	__u8 buf[WD_ECC_HASH_BLOCK];
+	__u64 total;
+	__u32 buf_len;
+	__u8 type;
+};
+
+/**
+ * wd_ecc_hash_is_soft() - Check whether the hash of @type is built in.
+ * @type:	Hash type, denoted by enum wd_ecc_hash_type.
+ *
+ * WD_HASH_SM3 and WD_HASH_SHA256 are built in.
+ */
+bool wd_ecc_hash_is_soft(__u8 type);
+
+/**
+ * wd_ecc_hash_use_soft() - Check whether @hash is computed by the built-in
+ * hash, which is only when the session has no hash callback of its own.
+ * @hash:	Hash method of the session.
+ */
+bool wd_ecc_hash_use_soft(const struct wd_hash_mt *hash);
+
+/**
+ * wd_ecc_hash_init() - Start a built-in hash.
+ * @ctx:	Hash state, it can be copied to fork the hash of a common
+ *		prefix.
+ * @type:	WD_HASH_SM3 or WD_HASH_SHA256.
+ */
+int wd_ecc_hash_init(struct wd_ecc_hash_ctx *ctx, __u8 type);
+void wd_ecc_hash_update(struct wd_ecc_hash_ctx *ctx, const void *data,
+			__u64 len);
+/* Write the WD_ECC_HASH_MAX_BYTES bytes digest to @out */
+void wd_ecc_hash_final(struct wd_ecc_hash_ctx *ctx, void *out);
+
+/**
+ * wd_ecc_hash_dtbs() - Hash the concatenation of @num buffers.
+ * @hash:	Hash method of the session.
+ * @in:		Array of @num buffers, dsize bytes of each are hashed.
+ * @num:	Number of buffers.
+ * @out:	Output digest.
+ * @out_len:	Size of the digest of @hash.
+ *
+ * A set hash callback of the session is always used, with the buffers packed
+ * into one. Without it, the built-in hash is streamed over the buffers.
+ */
+int wd_ecc_hash_dtbs(struct wd_hash_mt *hash, const struct wd_dtb *in,
+		     __u32 num, char *out, __u32 out_len);
+
+/**
+ * wd_ecc_sm2_kdf() - The KDF of sm2 encryption, KDF(x2 || y2, @m_len).
+ * @out:	Output of @m_len bytes, its dsize is set to @m_len.
+ * @x2y2:	The point, x and y are next to each other in one buffer.
+ * @m_len:	Size of the key stream.
+ * @hash:	Hash method of the session.
+ * @h_bytes:	Digest size of the hash type of @hash.
+ */
+int wd_ecc_sm2_kdf(struct wd_dtb *out, const struct wd_ecc_point *x2y2,
+		   __u64 m_len, struct wd_hash_mt *hash, __u32 h_bytes);
+
 void wd_ecc_set_driver(struct wd_ecc_driver *drv);
 struct wd_ecc_driver *wd_ecc_get_driver(void);
 
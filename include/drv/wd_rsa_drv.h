@@ -40,6 +40,7 @@ struct wd_rsa_msg {
 	__u8 key_type; /* Denoted by enum wd_rsa_key_type */
 	__u8 result; /* Data format, denoted by WD error code */
 	__u8 *key; /* Input key VA pointer, should be DMA buffer */
+	__u32 *key_fmt; /* Format state of key, NULL if key is from req */
 };
 
 struct wd_rsa_driver {
@@ -51,6 +52,12 @@ struct wd_rsa_driver {
 	void (*exit)(void *priv);
 	int (*send)(handle_t sess, struct wd_rsa_msg *msg);
 	int (*recv)(handle_t sess, struct wd_rsa_msg *msg);
+	/*
+	 * Optional, send @num msgs with as few doorbells as possible.
+	 * @count returns the number of msgs taken by the hardware.
+	 */
+	int (*send_batch)(handle_t ctx, struct wd_rsa_msg **msgs, __u32 num,
+			  __u32 *count);
 };
 
 void wd_rsa_set_driver(struct wd_rsa_driver *drv);
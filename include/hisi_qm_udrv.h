@@ -11,6 +11,7 @@
 #include "config.h"
 #include "wd.h"
 #include "wd_alg_common.h"
+#include "wd_util.h"
 
 #define WD_CAPA_PRIV_DATA_SIZE		64
 
@@ -73,6 +74,10 @@ struct hisi_qp {
 	struct hisi_qm_queue_info q_info;
 	handle_t h_sgl_pool;
 	handle_t h_ctx;
+	/* Queue counters of the ctx, updated under q_info.lock */
+	struct wd_ctx_stats_area *stats;
+	/* Send time of each sqe, only when the latencies are counted */
+	__u64 *stamp;
 };
 
 /* Capabilities */
@@ -104,17 +109,71 @@ int hisi_qm_send(handle_t h_qp, const void *req, __u16 expect, __u16 *count);
  * @resp: Msg out buffer of the user.
  * @expect: User recieve req num.
  * @count: The count of actual recieving message.
+ *
+ * All the ready cqes up to @expect are taken under one lock and the cq
+ * doorbell is rung once. If less than @expect are ready, -WD_EAGAIN is
+ * returned and @count tells how many have been received.
  */
 int hisi_qm_recv(handle_t h_qp, void *resp, __u16 expect, __u16 *count);
 
+/**
+ * hisi_qm_recv_peek - Get the completed sqes in place, without copying.
+ * @h_qp: Handle of the qp.
+ * @sqes: Out array of the sqe pointers in the queue.
+ * @expect: User recieve req num.
+ * @count: The count of sqes got.
+ *
+ * The sqes stay owned by the queue until hisi_qm_recv_release() is called
+ * with @count, the caller parses them in between. Only one thread may
+ * poll a queue. If no sqe is completed, the return value is -WD_EAGAIN.
+ */
+int hisi_qm_recv_peek(handle_t h_qp, void **sqes, __u16 expect, __u16 *count);
+
+/**
+ * hisi_qm_recv_release - Give the peeked sqes back to the queue.
+ * @h_qp: Handle of the qp.
+ * @num: The count got from hisi_qm_recv_peek().
+ */
+int hisi_qm_recv_release(handle_t h_qp, __u16 num);
+
 handle_t hisi_qm_alloc_qp(struct hisi_qm_priv *config, handle_t ctx);
 void hisi_qm_free_qp(handle_t h_qp);
 
+/**
+ * struct hisi_sgl_pool_stat - Usage of an sgl pool.
+ * @sgl_num: The sgls of the pool, shared by the qps of a node if @shared.
+ * @sge_num: The sges in every sgl, a longer list chains several sgls.
+ * @sgl_size: The bytes of every sgl.
+ * @mem_size: The bytes of the region the sgls are carved from.
+ * @free_num: The sgls free in the pool, not counting the ones cached by qps.
+ * @cache_num: The free sgls cached by this qp.
+ * @peak_num: The most sgls ever out of the pool at the same time.
+ * @fail_num: Times an sgl was wanted when the pool was empty.
+ * @hugepage: The region is backed by hugepages.
+ * @shared: The pool is shared by the qps of a NUMA node.
+ */
+struct hisi_sgl_pool_stat {
+	__u32 sgl_num;
+	__u32 sge_num;
+	__u32 sgl_size;
+	__u64 mem_size;
+	__u32 free_num;
+	__u32 cache_num;
+	__u32 peak_num;
+	__u32 fail_num;
+	__u8 hugepage;
+	__u8 shared;
+};
+
 /**
  * hisi_qm_create_sglpool - Create sgl pool in qm.
  * @sgl_num: the sgl number.
  * @sge_num: the sge num in every sgl num.
  *
+ * The sgls are carved from one region, backed by hugepages when there are
+ * free ones. The pool of a qp is not created by it, the qps of a NUMA node
+ * share the sgls sized by WD_SGL_NUM and WD_SGL_SGE_NUM.
+ *
  * Fixed me: the sge buff's size now is Fixed.
  */
 handle_t hisi_qm_create_sglpool(__u32 sgl_num, __u32 sge_num);
@@ -147,6 +206,15 @@ void hisi_qm_put_hw_sgl(handle_t sgl_pool, void *hw_sgl);
  */
 handle_t hisi_qm_get_sglpool(handle_t h_qp);
 
+/**
+ * hisi_qm_get_sglpool_stat - Get the usage of an sgl pool.
+ * @sgl_pool: Handle of the sgl pool.
+ * @stat: Output statistics.
+ *
+ * Return 0 if successful or less than 0 otherwise.
+ */
+int hisi_qm_get_sglpool_stat(handle_t sgl_pool, struct hisi_sgl_pool_stat *stat);
+
 /**
  * hisi_qm_sgl_copy: Buffer copying from hw sgl to pbuff or pbuff to sgl
  * @dst_buff: Dst pbuff point
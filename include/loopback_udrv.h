@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+#ifndef __LOOPBACK_UDRV_H__
+#define __LOOPBACK_UDRV_H__
+
+#include <linux/types.h>
+
+#include "config.h"
+#include "wd.h"
+#include "wd_alg_common.h"
+#include "wd_util.h"
+
+/* Completion latency of every task in microseconds, 0 by default */
+#define LB_LATENCY_ENV		"WD_LOOPBACK_LATENCY"
+
+/*
+ * Do the task of @msg in place, which is the msg given to lb_send(). The
+ * result is carried by the msg itself.
+ */
+typedef void (*lb_do_msg_t)(void *msg);
+
+/**
+ * lb_alloc_queue - Set up the emulated queue of a loopback ctx.
+ * @h_ctx: The loopback ctx, the queue is kept as its priv.
+ * @do_msg: Software implementation of the algorithm.
+ *
+ * One worker thread plays the role of the engine behind the queue, it takes
+ * the tasks in ring order and completes each of them no earlier than
+ * WD_LOOPBACK_LATENCY microseconds after it was sent.
+ */
+handle_t lb_alloc_queue(handle_t h_ctx, lb_do_msg_t do_msg);
+void lb_free_queue(handle_t h_q);
+
+/**
+ * lb_send - Put one msg into the ring.
+ * @h_q: Handle of the queue.
+ * @msg: The msg must stay valid until it is returned by lb_recv().
+ *
+ * If the ring is full, the return value is -WD_EBUSY.
+ */
+int lb_send(handle_t h_q, void *msg);
+
+/**
+ * lb_recv - Get the oldest completed msg out of the ring.
+ * @h_q: Handle of the queue.
+ * @msg: The msg given to lb_send().
+ *
+ * If no msg is completed, the return value is -WD_EAGAIN.
+ */
+int lb_recv(handle_t h_q, void **msg);
+
+#endif
@@ -33,4 +33,10 @@ enum uacce_qfrt {
 	UACCE_QFRT_DUS = 1,	/* device user share */
 	UACCE_QFRT_MAX,
 };
+
+/*
+ * Static share region of the queue, the dma memory of a device without SVA.
+ * It isn't in enum uacce_qfrt as the SVA devices don't report it.
+ */
+#define UACCE_QFRT_SS		2
 #endif
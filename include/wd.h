@@ -280,6 +280,112 @@ void wd_ctx_unmap_qfr(handle_t h_ctx, enum uacce_qfrt qfrt);
  */
 int wd_ctx_wait(handle_t h_ctx, __u16 ms);
 
+/**
+ * wd_ctx_notify() - Wake up the waiter of a loopback context.
+ * @h_ctx: The handle of context.
+ *
+ * Return 0 if successful, less than 0 otherwise.
+ *
+ * The software loopback driver calls it when a task completes, in place of
+ * the interrupt of a hardware queue. Other contexts return -WD_EINVAL.
+ */
+int wd_ctx_notify(handle_t h_ctx);
+
+/* Bucket 0 counts latencies under 1us, bucket i those in [2^(i-1), 2^i)us */
+#define WD_CTX_LAT_BUCKETS		20
+/* Index to get the counters of all the ctxs of an algorithm */
+#define WD_CTX_STATS_ALL		(~0U)
+
+/**
+ * struct wd_ctx_queue_stats - Counters of the hardware queue of a ctx, kept
+ *			       by the driver under the queue lock.
+ * @send_num:	Messages taken by the queue.
+ * @busy_num:	Sends rejected as the queue was full.
+ * @recv_num:	Messages completed.
+ * @empty_num:	Receives which found no completion, the polls spun in vain.
+ * @sva_err_num: Messages failed as the device couldn't fault their pages in.
+ * @inflight:	Messages in the queue now.
+ * @inflight_peak: The most messages ever in the queue.
+ * @sva_status:	SVA prefetch status the device reported for the last of them.
+ * @lat:	Histogram of the time from send to completion, only counted
+ *		when WD_CTX_STATS_LAT is set.
+ */
+struct wd_ctx_queue_stats {
+	__u64 send_num;
+	__u64 busy_num;
+	__u64 recv_num;
+	__u64 empty_num;
+	__u64 sva_err_num;
+	__u32 inflight;
+	__u32 inflight_peak;
+	__u32 sva_status;
+	__u64 lat[WD_CTX_LAT_BUCKETS];
+} __attribute__((aligned(64)));
+
+/**
+ * struct wd_ctx_req_stats - Counters of the requests of a ctx, kept by the
+ *			     algorithm layer.
+ * @sync_num:	Sync requests done.
+ * @async_num:	Async requests sent.
+ * @busy_num:	Async requests rejected as all their messages were in use.
+ * @spin_num:	Receives the sync requests retried.
+ * @lat:	Histogram of the time from sending an async request to reaping
+ *		its completion, only counted when WD_CTX_STATS_LAT is set.
+ */
+struct wd_ctx_req_stats {
+	__u64 sync_num;
+	__u64 async_num;
+	__u64 busy_num;
+	__u64 spin_num;
+	__u64 lat[WD_CTX_LAT_BUCKETS];
+} __attribute__((aligned(64)));
+
+/**
+ * struct wd_ctx_msg_stats - Occupancy of the async message pool of a ctx,
+ *			     only filled by wd_<alg>_get_ctx_stats().
+ * @msg_num:	Messages of the pool.
+ * @alloc_num:	Messages allocated so far, the rest is allocated on demand.
+ * @in_use:	Messages held by async requests in flight.
+ * @peak:	The most messages ever in use at the same time.
+ */
+struct wd_ctx_msg_stats {
+	__u32 msg_num;
+	__u32 alloc_num;
+	__u32 in_use;
+	__u32 peak;
+};
+
+/**
+ * struct wd_ctx_stats - Counters of a ctx, or the sum of several ctxs.
+ * @queue:	Queue counters.
+ * @req:	Request counters of all the shards.
+ * @msg:	Message pool occupancy, the peak is the highest of the ctxs.
+ */
+struct wd_ctx_stats {
+	struct wd_ctx_queue_stats queue;
+	struct wd_ctx_req_stats req;
+	struct wd_ctx_msg_stats msg;
+};
+
+/**
+ * wd_ctx_get_stats() - Get the counters of a ctx.
+ * @h_ctx: The handle of context.
+ * @stats: Output counters, the request shards summed up.
+ *
+ * Return 0 if successful or less than 0 otherwise.
+ */
+int wd_ctx_get_stats(handle_t h_ctx, struct wd_ctx_stats *stats);
+
+/**
+ * wd_is_loopback() - Check if the software loopback device is selected.
+ *
+ * Return 1 if WD_LOOPBACK is set to a non zero value in the environment, then
+ * wd_get_accel_list() returns the loopback device for the zlib, gzip, deflate,
+ * cipher, digest and aead algorithms, and their drivers run on zlib and
+ * OpenSSL in worker threads. Return 0 otherwise.
+ */
+int wd_is_loopback(void);
+
 /**
  * wd_is_sva() - Check if the system supports SVA.
  * @h_ctx: The handle of context.
@@ -288,6 +394,109 @@ int wd_ctx_wait(handle_t h_ctx, __u16 ms);
  */
 int wd_is_sva(handle_t h_ctx);
 
+/**
+ * wd_ctx_reserve_mem() - Reserve the memory the device can access without SVA.
+ * @h_ctx: The handle of context.
+ * @size: Size of the memory, rounded up to 64KB.
+ *
+ * The memory is mapped from the share region of the queue, so it has to be
+ * reserved before the ctx is started by its driver, and only once per ctx.
+ * The device translates the addresses of it by wd_ctx_iova_map(), which works
+ * for the ctxs of the same device. The memory is released with the ctx.
+ *
+ * Return the address of the memory, NULL otherwise.
+ */
+void *wd_ctx_reserve_mem(handle_t h_ctx, size_t size);
+
+/**
+ * wd_ctx_unreserve_mem() - Release the memory reserved for a ctx early.
+ * @h_ctx: The handle of context.
+ *
+ * For a user of the memory that fails to set up, the device mustn't use the
+ * memory any more. Otherwise the memory is released with the ctx.
+ */
+void wd_ctx_unreserve_mem(handle_t h_ctx);
+
+/**
+ * wd_ctx_iova_map() - Get the address the device uses for a buffer.
+ * @h_ctx: The handle of context.
+ * @va: Start of the buffer.
+ * @size: Size of the buffer.
+ *
+ * Return @va itself if the ctx supports SVA. Otherwise return the dma address
+ * of the buffer if it's in the memory reserved for a ctx of the same device,
+ * and isn't across two discontiguous slices of it. NULL otherwise, then the
+ * buffer has to be copied to the reserved memory.
+ */
+void *wd_ctx_iova_map(handle_t h_ctx, void *va, size_t size);
+
+/* The device writes the buffer, so its pages are faulted in writable */
+#define WD_PREFAULT_WRITE	(1U << 0)
+/* Lock the pages so they are neither reclaimed nor migrated */
+#define WD_PREFAULT_LOCK	(1U << 1)
+/* Ask for transparent huge pages, fewer translations for the SMMU to walk */
+#define WD_PREFAULT_HUGE	(1U << 2)
+
+/**
+ * struct wd_prefault_stat - What the prefault helpers did in the process.
+ * @reg_num:	Buffers registered by wd_prefault_register().
+ * @page_num:	Pages touched, by the registers and on submit.
+ * @submit_num:	Request buffers touched on submit.
+ * @hit_num:	Request buffers skipped on submit as they were seen.
+ * @lock_fail_num: Registers whose pages failed to be locked.
+ */
+struct wd_prefault_stat {
+	__u64 reg_num;
+	__u64 page_num;
+	__u64 submit_num;
+	__u64 hit_num;
+	__u64 lock_fail_num;
+};
+
+/**
+ * wd_prefault_register() - Fault in the pages of a buffer used by the devices.
+ * @addr: Start of the buffer.
+ * @size: Size of the buffer.
+ * @flags: WD_PREFAULT_* flags.
+ *
+ * In SVA mode a page the device touches first is faulted in by an I/O page
+ * fault of the SMMU, which costs far more than a CPU fault and stalls the
+ * queue. Registering the long lived buffers once after they are allocated
+ * faults their pages in by the CPU, and with WD_PREFAULT_LOCK keeps them
+ * resident. The buffer is also taken as seen by the submit prefault.
+ *
+ * Return 0 if successful or less than 0 otherwise.
+ */
+int wd_prefault_register(void *addr, size_t size, __u32 flags);
+
+/**
+ * wd_prefault_unregister() - Unlock a buffer and forget it was seen, call it
+ * before the buffer is freed.
+ * @addr: Start of the buffer.
+ * @size: Size of the buffer.
+ */
+void wd_prefault_unregister(void *addr, size_t size);
+
+/**
+ * wd_prefault_submit() - Touch the pages of a request buffer not seen before.
+ * @addr: Start of the buffer.
+ * @size: Size of the buffer.
+ * @flags: WD_PREFAULT_WRITE for an output buffer.
+ *
+ * Called by the algorithm layer for the buffers of each request, it does
+ * nothing unless WD_SVA_PREFAULT is set. The pages touched are remembered
+ * in 64KB chunks, a buffer whose pages were all touched before is skipped.
+ */
+void wd_prefault_submit(void *addr, size_t size, __u32 flags);
+
+/**
+ * wd_get_prefault_stat() - Get what the prefault helpers did.
+ * @stat: Output statistics.
+ *
+ * Return 0 if successful or less than 0 otherwise.
+ */
+int wd_get_prefault_stat(struct wd_prefault_stat *stat);
+
 /**
  * wd_get_accel_name() - Get device name or driver name.
  * @dev_path: The path of device. e.g. /dev/hisi_zip-0.
@@ -365,11 +574,12 @@ unsigned long wd_ctx_get_region_size(handle_t h_ctx, enum uacce_qfrt qfrt);
 enum wd_page_type {
 	WD_HUGE_PAGE = 0,
 	WD_NORMAL_PAGE,
+	WD_DMA_PAGE,
 };
 
 /*
  * struct wd_mempool_stats - Use to dump statistics info about mempool
- * @page_type: 0 huge page, 1 mmap + pin.
+ * @page_type: 0 huge page, 1 mmap + pin, 2 memory reserved for a ctx.
  * @page_size: Page size.
  * @pape_num: Page numbers in mempool.
  * @blk_size: Memory in mempool will be divied into blocks with same size,
@@ -396,7 +606,7 @@ struct wd_mempool_stats {
  * struct wd_blockpool_stats - Use to dump statistics info about blkpool
  * @block_size: Block size.
  * @block_num: Number of blocks.
- * @free_block_num: Number of free blocks.
+ * @free_block_num: Number of free blocks, including the ones in caches.
  * @block_usage_rate: Block usage rate, e.g. 30 is 30%
  * @mem_waste_rate: When blkpool allocate memory from mempool, it may waste
  *		    some memory as below figure. This is the waste rate,
@@ -417,6 +627,19 @@ struct wd_blockpool_stats {
 	unsigned long mem_waste_rate;
 };
 
+/*
+ * struct wd_blockpool_cache_stats - Statistics of the per cpu caches of a
+ *				     blkpool, all zero without caches.
+ * @hit_num: Times of block alloc and free done in the per cpu caches.
+ * @miss_num: Times of the caches refilling from or flushing to blkpool.
+ * @hit_rate: Hit rate of the caches, e.g. 30 is 30%.
+ */
+struct wd_blockpool_cache_stats {
+	unsigned long hit_num;
+	unsigned long miss_num;
+	unsigned long hit_rate;
+};
+
 /**
  * wd_block_alloc() - Allocate block memory from blkpool.
  * @blkpool: The handle of blkpool.
@@ -451,6 +674,22 @@ handle_t wd_blockpool_create(handle_t mempool, size_t block_size,
  */
 void wd_blockpool_destroy(handle_t blkpool);
 
+/**
+ * wd_blockpool_create_cached() - Blkpool allocate memory from mempool, with
+ *				  a cache of free blocks per cpu in front of it.
+ * @mempool: The handle of mempool.
+ * @block_size: Size of every block in blkpool.
+ * @block_num: Number of blocks in blkpool.
+ * @cache_size: Max number of free blocks kept in one cache.
+ *
+ * Alloc and free take blocks from the cache of current cpu, and only refill
+ * or flush half of the cache from or to blkpool in bulk. This helps when
+ * many threads share one blkpool. The blkpool is released by
+ * wd_blockpool_destroy() too.
+ */
+handle_t wd_blockpool_create_cached(handle_t mempool, size_t block_size,
+				    size_t block_num, size_t cache_size);
+
 /**
  * wd_mempool_create() - Creat mempool.
  * @size: Size of mempool.
@@ -463,6 +702,21 @@ void wd_blockpool_destroy(handle_t blkpool);
  */
 handle_t wd_mempool_create(size_t size, int node);
 
+/**
+ * wd_mempool_create_dma() - Creat mempool on the memory reserved for a ctx.
+ * @h_ctx: The handle of context, not started by its driver yet.
+ * @size: Size of mempool.
+ *
+ * The memory is got by wd_ctx_reserve_mem(), so the blocks of the blkpools
+ * created on it can be accessed by the device without SVA. The mempool has
+ * to be destroyed before the ctx is released.
+ *
+ * Return handle of mempool if suceessful; On error, errno is set to indicate
+ * the error. WD_EINVAL: An invalid value was specified for h_ctx or size.
+ * WD_ENOMEM: The memory failed to be reserved.
+ */
+handle_t wd_mempool_create_dma(handle_t h_ctx, size_t size);
+
 /**
  * wd_mempool_destroy() - Destory mempool.
  * @mempool: The handle of mempool.
@@ -483,4 +737,13 @@ void wd_mempool_stats(handle_t mempool, struct wd_mempool_stats *stats);
  */
 void wd_blockpool_stats(handle_t blkpool, struct wd_blockpool_stats *stats);
 
+/**
+ * wd_blockpool_cache_stats() - Dump statistics information about the per cpu
+ *				caches of blkpool.
+ * @blkpool: The handle of blkpool.
+ * @stats: Pointer of struct wd_blockpool_cache_stats.
+ */
+void wd_blockpool_cache_stats(handle_t blkpool,
+			      struct wd_blockpool_cache_stats *stats);
+
 #endif
@@ -134,6 +134,19 @@ int wd_do_aead_sync(handle_t h_sess, struct wd_aead_req *req);
  */
 int wd_do_aead_async(handle_t h_sess, struct wd_aead_req *req);
 
+/**
+ * wd_do_aead_async_batch() - Send a batch of async aead requests of one
+ * session to one ctx with as few doorbells as the driver supports.
+ * @h_sess: Session handler.
+ * @reqs: Array of @num request pointers.
+ * @num: Number of requests.
+ *
+ * Return the number of requests sent from the head of @reqs, the callers
+ * resend the rest later. Return a negative error if none is sent.
+ */
+int wd_do_aead_async_batch(handle_t h_sess, struct wd_aead_req **reqs,
+			   __u32 num);
+
 /**
  * wd_aead_set_authsize() Set authenticate data length to aead session.
  * @h_sess: wd aead session.
@@ -214,4 +227,19 @@ void wd_aead_ctx_num_uninit(void);
 int wd_aead_get_env_param(__u32 node, __u32 type, __u32 mode,
 			  __u32 *num, __u8 *is_enable);
 
+/**
+ * wd_aead_get_sync_wait_stat() - Get how the sync requests of a ctx waited
+ * for their completions, by spinning on recv or by sleeping on the interrupt.
+ * @idx: index of the sync ctx.
+ * @stat: output statistics.
+ */
+int wd_aead_get_sync_wait_stat(__u32 idx, struct wd_sync_wait_stat *stat);
+
+/**
+ * wd_aead_get_ctx_stats() - Get the counters and the message pool of a ctx.
+ * @idx: index of the ctx, or WD_CTX_STATS_ALL for the sum of all the ctxs.
+ * @stats: output counters.
+ */
+int wd_aead_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats);
+
 #endif /* __WD_AEAD_H */
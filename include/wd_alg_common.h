@@ -9,6 +9,7 @@
 
 #include <asm/types.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include "wd.h"
 #include "wd_common.h"
 
@@ -58,11 +59,27 @@ struct wd_ctx_config {
 	void *priv;
 };
 
+/**
+ * struct wd_sync_wait_stat - How the sync requests of a ctx waited for
+ *			      their completions.
+ * @spins:	Times recv was retried without sleeping.
+ * @sleeps:	Times the ctx was waited on for its interrupt.
+ */
+struct wd_sync_wait_stat {
+	__u64 spins;
+	__u64 sleeps;
+};
+
 struct wd_ctx_internal {
 	handle_t ctx;
 	__u8 op_type;
 	__u8 ctx_mode;
 	pthread_spinlock_t lock;
+	/* Moving average of recv retries the recent sync requests needed */
+	__u32 spin_avg;
+	struct wd_sync_wait_stat wait_stat;
+	/* Counters of the ctx, see wd_ctx_get_stats() */
+	struct wd_ctx_stats_area *stats;
 };
 
 struct wd_ctx_config_internal {
@@ -103,4 +120,154 @@ struct wd_datalist {
 	struct wd_datalist *next;
 };
 
+/**
+ * struct wd_cb_dispatch_config - Threads running the callbacks of the async
+ *				  requests apart from the polling threads.
+ * @thread_num:		Number of the dispatcher threads.
+ * @queue_depth:	Completions the queue holds, rounded up to a power
+ *			of 2. 1024 if it's 0.
+ * @cpus:		CPUs the threads are bound to, thread i runs on
+ *			cpus[i % cpu_num]. NULL to leave them unbound.
+ * @cpu_num:		Number of @cpus.
+ */
+struct wd_cb_dispatch_config {
+	__u32 thread_num;
+	__u32 queue_depth;
+	__u32 *cpus;
+	__u32 cpu_num;
+};
+
+/**
+ * struct wd_async_thread_stat - Load of the async polling and dispatcher
+ *				 threads.
+ * @poll_thread_num:	Polling threads started by the wd_<alg>_env_init().
+ * @poll_queued:	Requests sent and not reaped by them yet.
+ * @poll_num:		Completions reaped by them.
+ * @cb_thread_num:	Dispatcher threads.
+ * @cb_depth:		Size of the completion queue.
+ * @cb_queued:		Completions waiting for their callbacks now.
+ * @cb_peak:		The most completions ever waiting at the same time.
+ * @cb_num:		Callbacks run by the dispatcher threads.
+ * @cb_full_num:	Callbacks run by the polling thread as the queue was
+ *			full.
+ */
+struct wd_async_thread_stat {
+	__u32 poll_thread_num;
+	__u32 poll_queued;
+	__u64 poll_num;
+	__u32 cb_thread_num;
+	__u32 cb_depth;
+	__u32 cb_queued;
+	__u32 cb_peak;
+	__u64 cb_num;
+	__u64 cb_full_num;
+};
+
+/**
+ * wd_cb_dispatch_init() - Start the threads running the callbacks of the
+ * async requests.
+ * @config:	Number, queue depth and CPUs of the threads.
+ *
+ * After it, wd_<alg>_poll_ctx() and the polling threads only reap the
+ * completions into a lock free queue, and the dispatcher threads run the
+ * callbacks. So a slow callback doesn't hold the hardware queue back. The
+ * callbacks of one ctx may run out of order and at the same time when there
+ * are several dispatcher threads. The message of a request is held until its
+ * callback returns, so the requests in flight are still bounded by the async
+ * pool. A completion is run by the polling thread itself if the queue is full.
+ *
+ * It's for all the algorithms of the process. Call it before sending any
+ * async request, and wd_cb_dispatch_uninit() after the polling stops.
+ *
+ * Return 0 if successful or less than 0 otherwise.
+ */
+int wd_cb_dispatch_init(struct wd_cb_dispatch_config *config);
+
+/**
+ * wd_cb_dispatch_uninit() - Run the callbacks left in the queue and stop the
+ * dispatcher threads.
+ */
+void wd_cb_dispatch_uninit(void);
+
+/**
+ * wd_get_async_thread_stat() - Get the load of the async polling and
+ * dispatcher threads.
+ * @stat:	Output statistics.
+ *
+ * Return 0 if successful or less than 0 otherwise.
+ */
+int wd_get_async_thread_stat(struct wd_async_thread_stat *stat);
+
+/* Format state of the key material kept in a session */
+enum wd_key_fmt_state {
+	WD_KEY_FMT_RAW,
+	WD_KEY_FMT_BUSY,
+	WD_KEY_FMT_DONE,
+};
+
+/**
+ * wd_key_fmt_begin() - Claim the conversion of a session key to the layout
+ * of the hardware.
+ * @state:	Format state of the key, NULL if the key comes with the request.
+ *
+ * The key is converted in place by the first send after it's set, the other
+ * threads sending with the session wait for it and then reuse the result.
+ *
+ * Return true if the caller has to convert the key and report the result by
+ * wd_key_fmt_end(), false if it has been converted.
+ */
+static inline bool wd_key_fmt_begin(__u32 *state)
+{
+	__u32 raw;
+
+	if (!state)
+		return true;
+
+	while (__atomic_load_n(state, __ATOMIC_ACQUIRE) != WD_KEY_FMT_DONE) {
+		raw = WD_KEY_FMT_RAW;
+		if (__atomic_compare_exchange_n(state, &raw, WD_KEY_FMT_BUSY,
+						false, __ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * wd_key_fmt_end() - Finish the conversion claimed by wd_key_fmt_begin().
+ * @state:	Format state of the key.
+ * @ret:	Result of the conversion, a failed one is retried by next send.
+ */
+static inline void wd_key_fmt_end(__u32 *state, int ret)
+{
+	if (state)
+		__atomic_store_n(state, ret ? WD_KEY_FMT_RAW : WD_KEY_FMT_DONE,
+				 __ATOMIC_RELEASE);
+}
+
+/* Drop the converted key after its parameters are set again */
+static inline void wd_key_fmt_reset(__u32 *state)
+{
+	__atomic_store_n(state, WD_KEY_FMT_RAW, __ATOMIC_RELEASE);
+}
+
+/* Bytes a session keeps for the descriptor templates of its driver */
+#define WD_SQE_TMPL_SIZE	256
+
+/**
+ * struct wd_sqe_tmpl - The fields of the hardware descriptors which depend
+ *			only on the session.
+ * @fmt:	Format state, denoted by enum wd_key_fmt_state.
+ * @data:	Templates in the layout of the driver.
+ *
+ * The driver builds the templates by the first send after the key or the
+ * parameters of the session are set, see wd_key_fmt_begin(), and then only
+ * adds the fields of the request to a copy of them.
+ */
+struct wd_sqe_tmpl {
+	__u32 fmt;
+	__u64 data[WD_SQE_TMPL_SIZE / sizeof(__u64)];
+};
+
 #endif
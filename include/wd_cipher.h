@@ -122,6 +122,23 @@ void wd_cipher_free_sess(handle_t h_sess);
  */
 int wd_cipher_set_key(handle_t h_sess, const __u8 *key, __u32 key_len);
 
+/**
+ * wd_cipher_set_split() Split the big sync requests of a session into
+ * segments, which are processed by several ctxs at the same time.
+ * @h_sess: wd cipher session, whose mode is ECB, CTR or XTS.
+ * @seg_size: bytes of one segment, aligned to AES_BLOCK_SIZE. 0 disables it.
+ *
+ * Only the sync requests of flat buffers longer than @seg_size are split,
+ * and they are spread only if the scheduler picks different ctxs for them.
+ * The result of ECB and CTR is the same as the unsplit one, so is the iv
+ * given back by CTR. For XTS every @seg_size bytes are one data unit, whose
+ * tweak is the iv plus the index of the unit as a 128-bit little endian
+ * number.
+ *
+ * Return 0 if successful or less than 0 otherwise.
+ */
+int wd_cipher_set_split(handle_t h_sess, __u32 seg_size);
+
 /**
  * wd_do_cipher_sync()/ async() Syn/asynchronous cipher operation
  * @sess: wd cipher session
@@ -129,6 +146,21 @@ int wd_cipher_set_key(handle_t h_sess, const __u8 *key, __u32 key_len);
  */
 int wd_do_cipher_sync(handle_t h_sess, struct wd_cipher_req *req);
 int wd_do_cipher_async(handle_t h_sess, struct wd_cipher_req *req);
+
+/**
+ * wd_do_cipher_async_batch() - Send a batch of async cipher requests of one
+ *				session to one ctx with as few doorbells as the
+ *				driver supports.
+ * @h_sess: wd cipher session.
+ * @reqs: array of @num request pointers.
+ * @num: number of requests.
+ *
+ * Return the number of requests sent from the head of @reqs, the callers
+ * resend the rest later. Return a negative error if none is sent.
+ */
+int wd_do_cipher_async_batch(handle_t h_sess, struct wd_cipher_req **reqs,
+			     __u32 num);
+
 /**
  * wd_cipher_poll_ctx() poll operation for asynchronous operation
  * @index: index of ctx which will be polled.
@@ -185,4 +217,19 @@ void wd_cipher_ctx_num_uninit(void);
 int wd_cipher_get_env_param(__u32 node, __u32 type, __u32 mode,
 			    __u32 *num, __u8 *is_enable);
 
+/**
+ * wd_cipher_get_sync_wait_stat() - Get how the sync requests of a ctx waited
+ * for their completions, by spinning on recv or by sleeping on the interrupt.
+ * @idx: index of the sync ctx.
+ * @stat: output statistics.
+ */
+int wd_cipher_get_sync_wait_stat(__u32 idx, struct wd_sync_wait_stat *stat);
+
+/**
+ * wd_cipher_get_ctx_stats() - Get the counters and the message pool of a ctx.
+ * @idx: index of the ctx, or WD_CTX_STATS_ALL for the sum of all the ctxs.
+ * @stats: output counters.
+ */
+int wd_cipher_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats);
+
 #endif /* __WD_CIPHER_H */
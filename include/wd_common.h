@@ -12,4 +12,12 @@ enum wd_buff_type {
 	WD_SGL_BUF,
 };
 
+/* Where the buffers of a request come from */
+enum wd_mem_type {
+	/* any memory, copied through bounce blocks if the device has no SVA */
+	WD_MEM_USER,
+	/* blocks of a wd_mempool_create_dma() mempool, used without a copy */
+	WD_MEM_MEMPOOL,
+};
+
 #endif /* __WD_COMMON_H */
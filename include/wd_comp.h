@@ -148,6 +148,38 @@ int wd_do_comp_strm(handle_t h_sess, struct wd_comp_req *req);
  */
 int wd_do_comp_async(handle_t h_sess, struct wd_comp_req *req);
 
+/**
+ * wd_do_comp_strm_async() - Send an async stream compression request.
+ * @h_sess:	The session of the stream.
+ * @req:	Request of the next chunk, last is 1 for the last chunk of a
+ *		compression stream.
+ *
+ * The stream state (hardware ctx cache, isize and checksum) stays in the
+ * session, the chunk completes through req->cb with src_len, dst_len and
+ * status filled as wd_do_comp_strm() does. Only one chunk of a stream can be
+ * in flight, -WD_EBUSY is returned until the callback of the previous one
+ * starts, so the next chunk can be sent from the callback. Different
+ * sessions are independent, one poll thread can drive many streams.
+ *
+ * An empty last chunk of deflate, zlib or gzip compression is completed at
+ * once, its callback is called before this function returns.
+ */
+int wd_do_comp_strm_async(handle_t h_sess, struct wd_comp_req *req);
+
+/**
+ * wd_do_comp_async_batch() - Send a batch of async compression requests of
+ *			      one session to one ctx with as few doorbells as
+ *			      the driver supports.
+ * @h_sess:	The session which requests will be sent to.
+ * @reqs:	Array of @num request pointers.
+ * @num:	Number of requests.
+ *
+ * Return the number of requests sent from the head of @reqs, the callers
+ * resend the rest later. Return a negative error if none is sent.
+ */
+int wd_do_comp_async_batch(handle_t h_sess, struct wd_comp_req **reqs,
+			   __u32 num);
+
 /**
  * wd_comp_poll_ctx() - Poll a ctx.
  * @index:	The index of ctx which will be polled.
@@ -170,6 +202,34 @@ int wd_comp_poll(__u32 expt, __u32 *count);
  */
 int wd_do_comp_sync2(handle_t h_sess, struct wd_comp_req *req);
 
+/**
+ * wd_comp_set_sync2_param() - Tune how wd_do_comp_sync2() splits the input.
+ * @h_sess:	The session to be tuned.
+ * @chunk_size:	Input bytes of each request, from 4KB to 8MB. 128KB by
+ *		default.
+ * @depth:	Max requests in flight, from 1 to 64. 1 by default.
+ *
+ * When @depth is more than 1, the compression input of a flat buffer longer
+ * than @chunk_size is compressed as independent chunks on several sync ctxs
+ * at once, which are joined into one zlib/gzip/deflate stream. It needs at
+ * least @depth sync ctxs to get the most out of it, and the dst should leave
+ * room for the incompressible chunks. Decompression is always done in
+ * sequence.
+ */
+int wd_comp_set_sync2_param(handle_t h_sess, __u32 chunk_size, __u32 depth);
+
+/**
+ * wd_comp_set_mem_type() - Tell where the buffers of a session come from.
+ * @h_sess:	The session to be set.
+ * @mem_type:	WD_MEM_USER by default.
+ *
+ * On a ctx without SVA, the requests of a WD_MEM_USER session are copied
+ * through the bounce blocks of the ctx. The buffers of a WD_MEM_MEMPOOL
+ * session must be blocks of a wd_mempool_create_dma() mempool, and are
+ * used without the copy.
+ */
+int wd_comp_set_mem_type(handle_t h_sess, enum wd_mem_type mem_type);
+
 /**
  * wd_comp_env_init() - Init ctx and schedule resources according to wd comp
  * environment variables.
@@ -217,4 +277,19 @@ void wd_comp_ctx_num_uninit(void);
 int wd_comp_get_env_param(__u32 node, __u32 type, __u32 mode,
 			  __u32 *num, __u8 *is_enable);
 
+/**
+ * wd_comp_get_sync_wait_stat() - Get how the sync requests of a ctx waited
+ * for their completions, by spinning on recv or by sleeping on the interrupt.
+ * @idx: index of the sync ctx.
+ * @stat: output statistics.
+ */
+int wd_comp_get_sync_wait_stat(__u32 idx, struct wd_sync_wait_stat *stat);
+
+/**
+ * wd_comp_get_ctx_stats() - Get the counters and the message pool of a ctx.
+ * @idx: index of the ctx, or WD_CTX_STATS_ALL for the sum of all the ctxs.
+ * @stats: output counters.
+ */
+int wd_comp_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats);
+
 #endif /* __WD_COMP_H */
@@ -69,4 +69,11 @@ void wd_dh_ctx_num_uninit(void);
 int wd_dh_get_env_param(__u32 node, __u32 type, __u32 mode,
 			__u32 *num, __u8 *is_enable);
 
+/**
+ * wd_dh_get_ctx_stats() - Get the counters and the message pool of a ctx.
+ * @idx: index of the ctx, or WD_CTX_STATS_ALL for the sum of all the ctxs.
+ * @stats: output counters.
+ */
+int wd_dh_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats);
+
 #endif /* __WD_DH_H */
@@ -143,6 +143,19 @@ int wd_do_digest_sync(handle_t h_sess, struct wd_digest_req *req);
  */
 int wd_do_digest_async(handle_t h_sess, struct wd_digest_req *req);
 
+/**
+ * wd_do_digest_async_batch() - Send a batch of async digest requests of one
+ * session to one ctx with as few doorbells as the driver supports.
+ * @h_sess: Session handler.
+ * @reqs: Array of @num request pointers.
+ * @num: Number of requests.
+ *
+ * Return the number of requests sent from the head of @reqs, the callers
+ * resend the rest later. Return a negative error if none is sent.
+ */
+int wd_do_digest_async_batch(handle_t h_sess, struct wd_digest_req **reqs,
+			     __u32 num);
+
 /**
  * wd_digest_set_key() - Set auth key to digest session.
  * @h_sess: Session handler
@@ -209,4 +222,19 @@ void wd_digest_ctx_num_uninit(void);
 int wd_digest_get_env_param(__u32 node, __u32 type, __u32 mode,
 			    __u32 *num, __u8 *is_enable);
 
+/**
+ * wd_digest_get_sync_wait_stat() - Get how the sync requests of a ctx waited
+ * for their completions, by spinning on recv or by sleeping on the interrupt.
+ * @idx: index of the sync ctx.
+ * @stat: output statistics.
+ */
+int wd_digest_get_sync_wait_stat(__u32 idx, struct wd_sync_wait_stat *stat);
+
+/**
+ * wd_digest_get_ctx_stats() - Get the counters and the message pool of a ctx.
+ * @idx: index of the ctx, or WD_CTX_STATS_ALL for the sum of all the ctxs.
+ * @stats: output counters.
+ */
+int wd_digest_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats);
+
 #endif /* __WD_DIGEST_H */
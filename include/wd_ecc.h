@@ -100,6 +100,11 @@ struct wd_rand_mt {
 	void *usr; /* user private param */
 };
 
+/*
+ * Hash method of sm2 steps done by the cpu. A set @cb is always used, without
+ * it WD_HASH_SM3 and WD_HASH_SHA256 are built in, the other types need it.
+ * Setting @cb still asks sm2 sign and verify to compute the digest by the cpu.
+ */
 struct wd_hash_mt {
 	wd_hash cb; /* rand callback */
 	void *usr; /* user private param */
@@ -470,6 +475,19 @@ int wd_do_ecc_sync(handle_t sess, struct wd_ecc_req *req);
  */
 int wd_do_ecc_async(handle_t sess, struct wd_ecc_req *req);
 
+/**
+ * wd_do_ecc_async_batch() - Send a batch of async ecc requests of one
+ *			     session to one ctx with as few doorbells as the
+ *			     driver supports.
+ * @sess:	The session which requests will be sent to.
+ * @reqs:	Array of @num request pointers.
+ * @num:	Number of requests.
+ *
+ * Return the number of requests sent from the head of @reqs, the callers
+ * resend the rest later. Return a negative error if none is sent.
+ */
+int wd_do_ecc_async_batch(handle_t sess, struct wd_ecc_req **reqs,
+			  __u32 num);
 
 /**
  * wd_ecc_poll_ctx() - Poll a ctx.
@@ -526,6 +544,13 @@ void wd_ecc_ctx_num_uninit(void);
 int wd_ecc_get_env_param(__u32 node, __u32 type, __u32 mode,
 			 __u32 *num, __u8 *is_enable);
 
+/**
+ * wd_ecc_get_ctx_stats() - Get the counters and the message pool of a ctx.
+ * @idx: index of the ctx, or WD_CTX_STATS_ALL for the sum of all the ctxs.
+ * @stats: output counters.
+ */
+int wd_ecc_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
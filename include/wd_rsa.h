@@ -151,6 +151,20 @@ int wd_do_rsa_sync(handle_t sess, struct wd_rsa_req *req);
  */
 int wd_do_rsa_async(handle_t sess, struct wd_rsa_req *req);
 
+/**
+ * wd_do_rsa_async_batch() - Send a batch of async rsa requests of one
+ *			     session to one ctx with as few doorbells as the
+ *			     driver supports.
+ * @sess:	The session which requests will be sent to.
+ * @reqs:	Array of @num request pointers.
+ * @num:	Number of requests.
+ *
+ * Return the number of requests sent from the head of @reqs, the callers
+ * resend the rest later. Return a negative error if none is sent.
+ */
+int wd_do_rsa_async_batch(handle_t sess, struct wd_rsa_req **reqs,
+			  __u32 num);
+
 /**
  * wd_rsa_poll() - Poll finished request.
  *
@@ -216,4 +230,11 @@ void wd_rsa_ctx_num_uninit(void);
 int wd_rsa_get_env_param(__u32 node, __u32 type, __u32 mode,
 			 __u32 *num, __u8 *is_enable);
 
+/**
+ * wd_rsa_get_ctx_stats() - Get the counters and the message pool of a ctx.
+ * @idx: index of the ctx, or WD_CTX_STATS_ALL for the sum of all the ctxs.
+ * @stats: output counters.
+ */
+int wd_rsa_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats);
+
 #endif /* __WD_RSA_H */
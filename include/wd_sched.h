@@ -15,6 +15,10 @@
 enum sched_policy_type {
 	/* requests will be sent to ctxs one by one */
 	SCHED_POLICY_RR = 0,
+	/* requests of one session will be spread over the ctxs of its region */
+	SCHED_POLICY_SPREAD,
+	/* requests will be sent to the ctx with the fewest outstanding ones */
+	SCHED_POLICY_LOAD,
 	SCHED_POLICY_BUTT
 };
 
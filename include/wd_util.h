@@ -8,6 +8,7 @@
 #define __WD_UTIL_H
 
 #include <stdbool.h>
+#include <time.h>
 #include "wd_alg_common.h"
 
 #define FOREACH_NUMA(i, config, config_numa) \
@@ -17,6 +18,27 @@
 struct wd_async_msg_pool {
 	struct msg_pool *pools;
 	__u32 pool_num;
+	/* msgs waiting for the dispatcher threads to run their callbacks */
+	__u32 cb_pending;
+};
+
+/* Run the callback of the request in an async msg */
+typedef void (*wd_msg_done_t)(void *msg);
+
+/* DMA-able blocks of a ctx without SVA */
+struct wd_bounce_pool {
+	handle_t mempool;
+	handle_t blkpool;
+};
+
+/*
+ * Blocks the requests are copied through when the ctxs don't support SVA.
+ * There is a pool for each ctx, its memory is reserved for the ctx.
+ */
+struct wd_bounce {
+	struct wd_bounce_pool *pools;
+	__u32 pool_num;
+	__u32 blk_size;
 };
 
 struct wd_ctx_range {
@@ -111,10 +133,13 @@ int wd_init_ctx_config(struct wd_ctx_config_internal *in,
  * wd_init_sched() - Init internal scheduler configuration.
  * @in: Scheduler configuration in global setting.
  * @from: Scheduler configuration input by user.
+ * @pool: Message pools in global setting, the load of the ctxs is read from
+ *	  them by the load policy of the sample scheduler.
  *
  * Return 0 if successful or less than 0 otherwise.
  */
-int wd_init_sched(struct wd_sched *in, struct wd_sched *from);
+int wd_init_sched(struct wd_sched *in, struct wd_sched *from,
+		  struct wd_async_msg_pool *pool);
 
 /*
  * wd_clear_sched() - Clear internal scheduler configuration.
@@ -138,24 +163,30 @@ void wd_memset_zero(void *data, __u32 size);
 /*
  * wd_init_async_request_pool() - Init message pools.
  * @pool: Pointer of message pool.
- * @pool_num: Message pool number.
- * @msg_num: Message entry number in one pool.
+ * @config: Ctx config, one pool is made for each ctx of it.
+ * @msg_num: Max message entry number in the pool of an async ctx.
  * @msg_size: Size of each message entry.
  *
  * Return 0 if successful or less than 0 otherwise.
  *
+ * The pool of a sync ctx is empty. The messages of an async ctx are allocated
+ * by segments on the numa node of its device, when the messages allocated
+ * before are all in use, so the pool only grows as deep as the requests in
+ * flight on the ctx.
+ *
  * pool
  *   pools
  *         +-------+-------+----+-------+ -+-
- *         | msg_0 | msg_1 |... | n - 1 |  |
+ *         | seg_0 | seg_1 |... |       |  |
  *         +-------+-------+----+-------+
  *         ...                             pool_num
  *         +-------+-------+----+-------+
- *         | msg_0 | msg_1 |... | n - 1 |  |
+ *         | seg_0 |       |... |       |  |
  *         +-------+-------+----+-------+ -+-
  *         |<------- msg_num ---------->|
  */
-int wd_init_async_request_pool(struct wd_async_msg_pool *pool, __u32 pool_num,
+int wd_init_async_request_pool(struct wd_async_msg_pool *pool,
+			       struct wd_ctx_config_internal *config,
 			       __u32 msg_num, __u32 msg_size);
 
 /*
@@ -196,6 +227,41 @@ void wd_put_msg_to_pool(struct wd_async_msg_pool *pool, int index, __u32 tag);
  */
 void *wd_find_msg_in_pool(struct wd_async_msg_pool *pool, int index, __u32 tag);
 
+/*
+ * wd_get_msg_pool_in_use() - Get the number of messages taken from a pool.
+ * @pool: Pointer of global pools.
+ * @index: Index of pool. Should be 0 ~ (pool_num - 1).
+ *
+ * Each async request holds a message from its send to its completion, so
+ * this is the number of requests in flight on the ctx. 0 if the pool
+ * isn't initialized.
+ */
+__u32 wd_get_msg_pool_in_use(struct wd_async_msg_pool *pool, __u32 index);
+
+/*
+ * wd_sched_bind_pool() - Give the message pools to the sample scheduler.
+ * @sched: Scheduler configuration in global setting.
+ * @pool: Message pools in global setting, NULL to unbind.
+ *
+ * Only the load policy of wd_sched.c uses them, other schedulers are left
+ * untouched.
+ */
+void wd_sched_bind_pool(struct wd_sched *sched, struct wd_async_msg_pool *pool);
+
+/*
+ * wd_complete_msg() - Finish a completed async msg.
+ * @pool: Pointer of global pools.
+ * @index: Index of pool. Should be 0 ~ (pool_num - 1).
+ * @tag: Tag of the msg.
+ * @msg: The msg, with its request updated from the response.
+ * @done: Runs the callback of the request.
+ *
+ * @done is run and the msg is put back to the pool, on a dispatcher thread
+ * if wd_cb_dispatch_init() is called or in place otherwise.
+ */
+void wd_complete_msg(struct wd_async_msg_pool *pool, int index, __u32 tag,
+		     void *msg, wd_msg_done_t done);
+
 /*
  * wd_check_datalist() - Check the data list length
  * @head: Data list's head pointer.
@@ -310,4 +376,200 @@ int wd_set_ctx_attr(struct wd_ctx_attr *ctx_attr,
  */
 int wd_check_ctx(struct wd_ctx_config_internal *config, __u8 mode, __u32 idx);
 
+/*
+ * wd_sync_wait_irq() - Check whether a sync request on the ctx should enable
+ *			the interrupt, as the recent ones could not complete
+ *			within the largest spin budget.
+ * @ctx: ctx the request is sent to.
+ */
+bool wd_sync_wait_irq(struct wd_ctx_internal *ctx);
+
+/*
+ * wd_sync_wait_sleep() - Check whether a sync request should sleep on the ctx
+ *			  before its next recv. The request spins for a budget
+ *			  learned from the recent completions of the ctx first.
+ * @ctx: ctx the request is sent to, its lock is held by the caller.
+ * @irq: whether the interrupt is enabled for the request.
+ * @retry: recv retries of the request till now.
+ */
+bool wd_sync_wait_sleep(struct wd_ctx_internal *ctx, __u8 irq, __u64 retry);
+
+/*
+ * wd_sync_wait_done() - Learn the spin budget from a completed sync request.
+ * @ctx: ctx the request is sent to, its lock is held by the caller.
+ * @retry: recv retries the request needed.
+ */
+void wd_sync_wait_done(struct wd_ctx_internal *ctx, __u64 retry);
+
+/*
+ * wd_prefault_req() - Touch the pages of a request not seen before, when
+ * WD_SVA_PREFAULT is set.
+ * @src: Input buffer, a struct wd_datalist for WD_SGL_BUF.
+ * @src_bytes: Bytes the device reads from @src.
+ * @dst: Output buffer, a struct wd_datalist for WD_SGL_BUF.
+ * @dst_bytes: Bytes the device may write to @dst.
+ * @data_fmt: WD_FLAT_BUF or WD_SGL_BUF.
+ */
+void wd_prefault_req(void *src, __u32 src_bytes, void *dst, __u32 dst_bytes,
+		     __u8 data_fmt);
+
+/* Threads updating the request counters of a ctx are spread over the shards */
+#define WD_CTX_STATS_SHARDS		8
+#define WD_CTX_STATS_SHM_MAGIC		0x54534457
+#define WD_CTX_STATS_SHM_VERSION	2
+
+/*
+ * struct wd_ctx_stats_area - All the counters of a ctx.
+ * @in_use:	1 if the area belongs to a ctx.
+ * @lat_en:	1 if the latencies are counted.
+ * @dev_name:	Device of the ctx.
+ * @queue:	Queue counters.
+ * @req:	Request counters, one shard per group of threads.
+ *
+ * The areas are allocated in /dev/shm/wd_ctx_stats.<pid> when
+ * WD_CTX_STATS_SHM is set, after a struct wd_ctx_stats_shm header, so a tool
+ * can map the file and read the counters of a running process.
+ */
+struct wd_ctx_stats_area {
+	__u32 in_use;
+	__u32 lat_en;
+	char dev_name[MAX_DEV_NAME_LEN];
+	struct wd_ctx_queue_stats queue;
+	struct wd_ctx_req_stats req[WD_CTX_STATS_SHARDS];
+};
+
+struct wd_ctx_stats_shm {
+	__u32 magic;
+	__u32 version;
+	__u32 area_num;
+	__u32 area_size;
+	struct wd_ctx_stats_area areas[];
+};
+
+/*
+ * wd_ctx_get_stats_area() - Get the counters of a ctx for updating them.
+ * @h_ctx: The handle of context.
+ *
+ * Return the area of the ctx, or NULL if @h_ctx is NULL.
+ */
+struct wd_ctx_stats_area *wd_ctx_get_stats_area(handle_t h_ctx);
+
+/*
+ * wd_ctx_stats_add() - Add the counters of a ctx to a sum.
+ * @area: Counters of the ctx.
+ * @stats: The sum, @stats->queue.inflight_peak takes the max of the ctxs.
+ */
+void wd_ctx_stats_add(struct wd_ctx_stats_area *area,
+		      struct wd_ctx_stats *stats);
+
+/*
+ * wd_ctx_req_shard() - Get the shard of the request counters of a ctx used by
+ * the calling thread. The shard of a thread is the same in all the libraries.
+ * @area: Counters of the ctx.
+ */
+struct wd_ctx_req_stats *wd_ctx_req_shard(struct wd_ctx_stats_area *area);
+
+/* Monotonic timestamp of the latency counters */
+static inline __u64 wd_ctx_stats_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Count a latency of @ns nanoseconds in a histogram */
+static inline void wd_ctx_stats_lat(__u64 *lat, __u64 ns)
+{
+	__u64 us = ns / 1000;
+	__u32 i = us ? 64 - __builtin_clzll(us) : 0;
+
+	if (i >= WD_CTX_LAT_BUCKETS)
+		i = WD_CTX_LAT_BUCKETS - 1;
+
+	__atomic_fetch_add(&lat[i], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * wd_ctx_stats_sync() - Count a sync request done in the ctx counters.
+ * @stats: Counters of the ctx the request is sent to.
+ * @retry: recv retries the request needed.
+ */
+void wd_ctx_stats_sync(struct wd_ctx_stats_area *stats, __u64 retry);
+
+/*
+ * wd_get_ctx_stats() - Get the counters of a ctx of an algorithm.
+ * @config: ctx config pointer.
+ * @pool: Message pools of the algorithm, their occupancy is read too.
+ * @idx: ctx index, or WD_CTX_STATS_ALL for the sum of all the ctxs.
+ * @stats: output counters.
+ */
+int wd_get_ctx_stats(struct wd_ctx_config_internal *config,
+		     struct wd_async_msg_pool *pool, __u32 idx,
+		     struct wd_ctx_stats *stats);
+
+/*
+ * wd_get_sync_wait_stat() - Get the wait statistics of a sync ctx.
+ * @config: ctx config pointer.
+ * @idx: ctx index.
+ * @stat: output statistics.
+ */
+int wd_get_sync_wait_stat(struct wd_ctx_config_internal *config, __u32 idx,
+			  struct wd_sync_wait_stat *stat);
+
+/*
+ * wd_init_bounce() - Reserve the bounce blocks for each ctx of the config.
+ * @bounce: bounce pools to init.
+ * @config: ctx config, the ctxs are not started by the driver yet.
+ * @blk_size: size of one block.
+ * @blk_num: number of blocks of each ctx.
+ *
+ * Nothing is reserved if the ctxs support SVA, then @bounce stays unused.
+ */
+int wd_init_bounce(struct wd_bounce *bounce,
+		   struct wd_ctx_config_internal *config,
+		   __u32 blk_size, __u32 blk_num);
+
+/*
+ * wd_uninit_bounce() - Release the bounce blocks, before the ctxs are stopped.
+ * @bounce: bounce pools to uninit.
+ */
+void wd_uninit_bounce(struct wd_bounce *bounce);
+
+static inline bool wd_bounce_enabled(struct wd_bounce *bounce)
+{
+	return bounce->pools != NULL;
+}
+
+/*
+ * wd_bounce_get() - Get a buffer of a request the device can access.
+ * @bounce: bounce pools.
+ * @config: ctx config.
+ * @idx: index of the ctx the request is sent to.
+ * @buf: buffer of the user.
+ * @len: bytes of @buf the device accesses.
+ * @copy: bytes of @buf copied to the block, for the input.
+ * @out: the buffer to give to the device.
+ *
+ * @buf itself is used if it's in the reserved memory of the device, e.g.
+ * a block of a wd_mempool_create_dma() mempool. Otherwise @out is a block.
+ * Return -WD_EINVAL if @len is bigger than a block, -WD_EBUSY if the blocks of
+ * the ctx are used up.
+ */
+int wd_bounce_get(struct wd_bounce *bounce,
+		  struct wd_ctx_config_internal *config, __u32 idx,
+		  void *buf, __u32 len, __u32 copy, void **out);
+
+/*
+ * wd_bounce_put() - Copy a block back and free it.
+ * @bounce: bounce pools.
+ * @idx: index of the ctx the request is sent to.
+ * @buf: buffer of the user.
+ * @blk: the buffer got by wd_bounce_get(), nothing is done if it's @buf.
+ * @copy: bytes of @blk copied back to @buf, for the output.
+ */
+void wd_bounce_put(struct wd_bounce *bounce, __u32 idx, void *buf, void *blk,
+		   __u32 copy);
+
 #endif /* __WD_UTIL_H */
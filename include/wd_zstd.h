@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+#ifndef __WD_ZSTD_H
+#define __WD_ZSTD_H
+
+#include "wd_comp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Max size of the frame header written by wd_zstd_encode_begin() */
+#define WD_ZSTD_FRAME_HEADER_MAX	14
+/* Max size of the block written by wd_zstd_encode_block() from @n bytes */
+#define WD_ZSTD_BLOCK_BOUND(n)		((n) + 3)
+/* Max input bytes of one block, the same as one lz77_zstd request */
+#define WD_ZSTD_BLOCK_MAX		(128 * 1024)
+
+/**
+ * wd_zstd_alloc_encoder() - Allocate an encoder which turns the literals and
+ * sequences of lz77_zstd requests into a zstd frame.
+ *
+ * The encoder keeps the repeat offsets of the frame and its own scratch
+ * buffers, so one encoder is needed for each stream encoded at the same time.
+ */
+handle_t wd_zstd_alloc_encoder(void);
+
+/**
+ * wd_zstd_free_encoder() - Free an encoder.
+ * @h_enc:	The encoder to be freed.
+ */
+void wd_zstd_free_encoder(handle_t h_enc);
+
+/**
+ * wd_zstd_encode_begin() - Start a new frame and write its header.
+ * @h_enc:	The encoder.
+ * @content_size: Size of the whole input of the frame, 0 if it's unknown.
+ * @dst:	Output buffer.
+ * @dst_len:	Size of @dst, WD_ZSTD_FRAME_HEADER_MAX is always enough.
+ *
+ * Return the size of the header, or a negative error code.
+ */
+int wd_zstd_encode_begin(handle_t h_enc, __u64 content_size, void *dst,
+			 __u32 dst_len);
+
+/**
+ * wd_zstd_encode_block() - Entropy code the output of one lz77_zstd request
+ * into a zstd block.
+ * @h_enc:	The encoder.
+ * @data:	The lz77_zstd output of a flat buffer request, which is
+ *		req->priv of the request.
+ * @src:	Input of the request, stored as it is when coding doesn't help.
+ * @src_len:	Size of @src, no more than WD_ZSTD_BLOCK_MAX.
+ * @last:	1 if it's the last block of the frame.
+ * @dst:	Output buffer.
+ * @dst_len:	Size of @dst, WD_ZSTD_BLOCK_BOUND(@src_len) is always enough.
+ *
+ * The blocks of a frame must be encoded in the order of the requests. The
+ * literals are Huffman coded and the sequences are FSE coded, with the tables
+ * of each block built from its own statistics.
+ *
+ * @data->blk_type is set to the type of the block written, which is what the
+ * next request of the stream expects if @data is reused for it. When several
+ * requests are in flight, each with its own @data, blk_type may be left as a
+ * compressed block in all of them: the repeat offsets are tracked for both the
+ * hardware and the decoder, and rewritten after a block stored as it is. So
+ * the next request doesn't have to wait for the coding of the previous one.
+ *
+ * Return the size of the block, or a negative error code.
+ */
+int wd_zstd_encode_block(handle_t h_enc, struct wd_lz77_zstd_data *data,
+			 const void *src, __u32 src_len, __u32 last,
+			 void *dst, __u32 dst_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WD_ZSTD_H */
@@ -0,0 +1,283 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+/*
+ * Split sync requests against the unsplit ones: the output and the iv given
+ * back of CTR, and the output of ECB and XTS. Run on the loopback device:
+ *	WD_LOOPBACK=1 ./wd_cipher_split_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd.h"
+#include "wd_cipher.h"
+#include "wd_sched.h"
+
+#define TEST_CTX_NUM		4
+#define TEST_MAX_LEN		(1024 * 1024)
+#define TEST_KEY_LEN		32
+#define TEST_BYTE_BITS		8
+
+struct split_case {
+	const char *name;
+	enum wd_cipher_mode mode;
+	__u32 key_len;
+	__u32 len;
+	__u32 seg;
+};
+
+static const struct split_case split_cases[] = {
+	/* more segments than a round, with a partial last block */
+	{ "ctr", WD_CIPHER_CTR, 16, 200 * 1024 + 5, 4096 },
+	/* segments long enough to sleep on the ctxs */
+	{ "ctr big segments", WD_CIPHER_CTR, 16, TEST_MAX_LEN, 128 * 1024 },
+	{ "ecb", WD_CIPHER_ECB, 16, 200 * 1024, 4096 },
+	/* a short last data unit */
+	{ "xts", WD_CIPHER_XTS, 32, 200 * 1024 + 20, 4096 },
+};
+
+static struct wd_ctx_config ctx_cfg;
+static struct wd_sched *sched;
+
+static void fill_data(__u8 *buf, __u32 len, __u32 seed)
+{
+	__u32 i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+}
+
+static int init_cipher(void)
+{
+	struct sched_params param = {0};
+	struct uacce_dev_list *list;
+	__u32 i;
+	int ret;
+
+	list = wd_get_accel_list("cipher");
+	if (!list) {
+		printf("no device of cipher!\n");
+		return -WD_ENODEV;
+	}
+
+	ctx_cfg.ctx_num = TEST_CTX_NUM;
+	ctx_cfg.ctxs = calloc(TEST_CTX_NUM, sizeof(struct wd_ctx));
+	if (!ctx_cfg.ctxs) {
+		ret = -WD_ENOMEM;
+		goto free_list;
+	}
+
+	for (i = 0; i < TEST_CTX_NUM; i++) {
+		ctx_cfg.ctxs[i].ctx = wd_request_ctx(list->dev);
+		if (!ctx_cfg.ctxs[i].ctx) {
+			ret = -WD_ENODEV;
+			goto free_ctxs;
+		}
+		ctx_cfg.ctxs[i].op_type = 0;
+		ctx_cfg.ctxs[i].ctx_mode = CTX_MODE_SYNC;
+	}
+
+	sched = wd_sched_rr_alloc(SCHED_POLICY_RR, 1, MAX_NUMA_NUM,
+				  wd_cipher_poll_ctx);
+	if (!sched) {
+		ret = -WD_ENOMEM;
+		goto free_ctxs;
+	}
+
+	sched->name = "sched_rr";
+	param.numa_id = list->dev->numa_id < 0 ? 0 : list->dev->numa_id;
+	param.mode = CTX_MODE_SYNC;
+	param.begin = 0;
+	param.end = TEST_CTX_NUM - 1;
+	ret = wd_sched_rr_instance(sched, &param);
+	if (ret)
+		goto free_sched;
+
+	ret = wd_cipher_init(&ctx_cfg, sched);
+	if (ret)
+		goto free_sched;
+
+	wd_free_list_accels(list);
+	return 0;
+
+free_sched:
+	wd_sched_rr_release(sched);
+free_ctxs:
+	for (i = 0; i < TEST_CTX_NUM; i++)
+		if (ctx_cfg.ctxs[i].ctx)
+			wd_release_ctx(ctx_cfg.ctxs[i].ctx);
+	free(ctx_cfg.ctxs);
+free_list:
+	wd_free_list_accels(list);
+	printf("failed to init cipher(%d)!\n", ret);
+	return ret;
+}
+
+static void uninit_cipher(void)
+{
+	__u32 i;
+
+	wd_cipher_uninit();
+	wd_sched_rr_release(sched);
+	for (i = 0; i < TEST_CTX_NUM; i++)
+		wd_release_ctx(ctx_cfg.ctxs[i].ctx);
+	free(ctx_cfg.ctxs);
+}
+
+static int do_cipher(handle_t h_sess, enum wd_cipher_op_type op_type,
+		     __u8 *src, __u8 *dst, __u32 len, __u8 *iv)
+{
+	struct wd_cipher_req req = {0};
+	int ret;
+
+	req.op_type = op_type;
+	req.src = src;
+	req.dst = dst;
+	req.in_bytes = len;
+	req.out_bytes = len;
+	req.out_buf_bytes = len;
+	req.iv = iv;
+	req.iv_bytes = iv ? AES_BLOCK_SIZE : 0;
+	req.data_fmt = WD_FLAT_BUF;
+	ret = wd_do_cipher_sync(h_sess, &req);
+	if (ret || req.state) {
+		printf("cipher failed(%d, %u)!\n", ret, req.state);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* the tweak of an XTS data unit is the iv plus its index, little endian */
+static void xts_tweak(__u8 *tweak, __u32 num)
+{
+	__u64 c = num;
+	__u32 n;
+
+	for (n = 0; n < AES_BLOCK_SIZE && c; n++) {
+		c += tweak[n];
+		tweak[n] = (__u8)c;
+		c >>= TEST_BYTE_BITS;
+	}
+}
+
+/* The unsplit result, an XTS request is cut into its data units */
+static int ref_cipher(handle_t h_sess, const struct split_case *tc,
+		      __u8 *src, __u8 *dst, __u8 *iv)
+{
+	__u8 tweak[AES_BLOCK_SIZE];
+	__u32 off, len;
+	int ret;
+
+	if (tc->mode != WD_CIPHER_XTS)
+		return do_cipher(h_sess, WD_CIPHER_ENCRYPTION, src, dst,
+				 tc->len, tc->mode == WD_CIPHER_ECB ? NULL : iv);
+
+	for (off = 0; off < tc->len; off += len) {
+		len = tc->len - off < tc->seg ? tc->len - off : tc->seg;
+		memcpy(tweak, iv, AES_BLOCK_SIZE);
+		xts_tweak(tweak, off / tc->seg);
+		ret = do_cipher(h_sess, WD_CIPHER_ENCRYPTION, src + off,
+				dst + off, len, tweak);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int test_split(const struct split_case *tc, __u8 *in, __u8 *out,
+		      __u8 *ref)
+{
+	struct wd_cipher_sess_setup setup = {0};
+	__u8 iv[AES_BLOCK_SIZE], ref_iv[AES_BLOCK_SIZE];
+	__u8 key[TEST_KEY_LEN];
+	struct sched_params param = {0};
+	handle_t h_sess;
+	int ret = -1;
+
+	setup.alg = WD_CIPHER_AES;
+	setup.mode = tc->mode;
+	setup.sched_param = &param;
+	h_sess = wd_cipher_alloc_sess(&setup);
+	if (!h_sess) {
+		printf("%s: failed to alloc sess!\n", tc->name);
+		return -1;
+	}
+
+	fill_data(key, tc->key_len, tc->len);
+	/* a carry through the low bytes of the counter */
+	memset(iv, 0xff, AES_BLOCK_SIZE);
+	iv[0] = 0x5a;
+	memcpy(ref_iv, iv, AES_BLOCK_SIZE);
+	if (wd_cipher_set_key(h_sess, key, tc->key_len))
+		goto free_sess;
+
+	if (ref_cipher(h_sess, tc, in, ref, ref_iv))
+		goto free_sess;
+
+	if (wd_cipher_set_split(h_sess, tc->seg) ||
+	    do_cipher(h_sess, WD_CIPHER_ENCRYPTION, in, out, tc->len,
+		      tc->mode == WD_CIPHER_ECB ? NULL : iv))
+		goto free_sess;
+
+	if (memcmp(out, ref, tc->len)) {
+		printf("%s: the split output is wrong!\n", tc->name);
+		goto free_sess;
+	}
+
+	if (tc->mode == WD_CIPHER_CTR && memcmp(iv, ref_iv, AES_BLOCK_SIZE)) {
+		printf("%s: the split iv is wrong!\n", tc->name);
+		goto free_sess;
+	}
+
+	/* the split decryption gives the input back */
+	memset(iv, 0xff, AES_BLOCK_SIZE);
+	iv[0] = 0x5a;
+	if (do_cipher(h_sess, WD_CIPHER_DECRYPTION, out, ref, tc->len,
+		      tc->mode == WD_CIPHER_ECB ? NULL : iv))
+		goto free_sess;
+
+	if (memcmp(ref, in, tc->len)) {
+		printf("%s: the split decryption is wrong!\n", tc->name);
+		goto free_sess;
+	}
+	printf("%s: ok\n", tc->name);
+	ret = 0;
+
+free_sess:
+	wd_cipher_free_sess(h_sess);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	__u8 *in, *out, *ref;
+	int ret = -1;
+	__u32 i;
+
+	in = malloc(TEST_MAX_LEN);
+	out = malloc(TEST_MAX_LEN);
+	ref = malloc(TEST_MAX_LEN);
+	if (!in || !out || !ref)
+		goto free_buf;
+
+	fill_data(in, TEST_MAX_LEN, 1);
+	ret = init_cipher();
+	if (ret)
+		goto free_buf;
+
+	for (i = 0; i < ARRAY_SIZE(split_cases); i++)
+		if (test_split(&split_cases[i], in, out, ref))
+			ret = -1;
+
+	uninit_cipher();
+free_buf:
+	free(in);
+	free(out);
+	free(ref);
+	return ret;
+}
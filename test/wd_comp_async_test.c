@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+/*
+ * A pooled async msg is reused by a stateless request after a stream request
+ * of another session, the stream has to go on unharmed. Run on the loopback
+ * device:
+ *	WD_LOOPBACK=1 ./wd_comp_async_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd.h"
+#include "wd_comp.h"
+#include "wd_sched.h"
+
+#define TEST_CTX_NUM		2
+#define TEST_CHUNK_LEN		(64 * 1024)
+#define TEST_STRM_LEN		(2 * TEST_CHUNK_LEN)
+#define TEST_STATELESS_LEN	(32 * 1024)
+#define TEST_BUF_LEN		(4 * TEST_STRM_LEN)
+#define TEST_POLL_TIMES		1000000
+
+struct test_result {
+	__u32 src_len;
+	__u32 dst_len;
+	__u32 status;
+	int done;
+};
+
+static struct wd_ctx_config ctx_cfg;
+static struct wd_sched *sched;
+
+static void fill_data(char *buf, __u32 len)
+{
+	__u32 seed = 1, i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = 'a' + ((seed >> 16) & 0x7);
+	}
+}
+
+/* the async compression on ctx 0, the sync decompression on ctx 1 */
+static int init_comp(void)
+{
+	static const __u8 modes[TEST_CTX_NUM] = {CTX_MODE_ASYNC, CTX_MODE_SYNC};
+	struct sched_params param = {0};
+	struct uacce_dev_list *list;
+	__u32 i;
+	int ret;
+
+	list = wd_get_accel_list("zlib");
+	if (!list) {
+		printf("no device of zlib!\n");
+		return -WD_ENODEV;
+	}
+
+	ctx_cfg.ctx_num = TEST_CTX_NUM;
+	ctx_cfg.ctxs = calloc(TEST_CTX_NUM, sizeof(struct wd_ctx));
+	if (!ctx_cfg.ctxs) {
+		ret = -WD_ENOMEM;
+		goto free_list;
+	}
+
+	for (i = 0; i < TEST_CTX_NUM; i++) {
+		ctx_cfg.ctxs[i].ctx = wd_request_ctx(list->dev);
+		if (!ctx_cfg.ctxs[i].ctx) {
+			ret = -WD_ENODEV;
+			goto free_ctxs;
+		}
+		ctx_cfg.ctxs[i].op_type = i;
+		ctx_cfg.ctxs[i].ctx_mode = modes[i];
+	}
+
+	sched = wd_sched_rr_alloc(SCHED_POLICY_RR, WD_DIR_MAX, MAX_NUMA_NUM,
+				  wd_comp_poll_ctx);
+	if (!sched) {
+		ret = -WD_ENOMEM;
+		goto free_ctxs;
+	}
+
+	sched->name = "sched_rr";
+	for (i = 0; i < TEST_CTX_NUM; i++) {
+		param.numa_id = list->dev->numa_id < 0 ? 0 : list->dev->numa_id;
+		param.type = i;
+		param.mode = modes[i];
+		param.begin = i;
+		param.end = i;
+		ret = wd_sched_rr_instance(sched, &param);
+		if (ret)
+			goto free_sched;
+	}
+
+	ret = wd_comp_init(&ctx_cfg, sched);
+	if (ret)
+		goto free_sched;
+
+	wd_free_list_accels(list);
+	return 0;
+
+free_sched:
+	wd_sched_rr_release(sched);
+free_ctxs:
+	for (i = 0; i < TEST_CTX_NUM; i++)
+		if (ctx_cfg.ctxs[i].ctx)
+			wd_release_ctx(ctx_cfg.ctxs[i].ctx);
+	free(ctx_cfg.ctxs);
+free_list:
+	wd_free_list_accels(list);
+	printf("failed to init comp(%d)!\n", ret);
+	return ret;
+}
+
+static void uninit_comp(void)
+{
+	__u32 i;
+
+	wd_comp_uninit();
+	wd_sched_rr_release(sched);
+	for (i = 0; i < TEST_CTX_NUM; i++)
+		wd_release_ctx(ctx_cfg.ctxs[i].ctx);
+	free(ctx_cfg.ctxs);
+}
+
+static handle_t alloc_sess(enum wd_comp_op_type op_type)
+{
+	struct wd_comp_sess_setup setup = {0};
+	struct sched_params param = {0};
+
+	setup.alg_type = WD_ZLIB;
+	setup.comp_lv = WD_COMP_L8;
+	setup.win_sz = WD_COMP_WS_32K;
+	setup.op_type = op_type;
+	param.type = op_type;
+	param.mode = op_type == WD_DIR_COMPRESS ? CTX_MODE_ASYNC :
+						  CTX_MODE_SYNC;
+	setup.sched_param = &param;
+
+	return wd_comp_alloc_sess(&setup);
+}
+
+static void *async_cb(struct wd_comp_req *req, void *cb_param)
+{
+	struct test_result *res = cb_param;
+
+	res->src_len = req->src_len;
+	res->dst_len = req->dst_len;
+	res->status = req->status;
+	res->done = 1;
+
+	return NULL;
+}
+
+/* Send one async compression request and reap it */
+static int comp_async(handle_t h_sess, bool strm, char *src, __u32 src_len,
+		      char *dst, __u32 last, __u32 *dst_len)
+{
+	struct test_result res = {0};
+	struct wd_comp_req req = {0};
+	__u32 count, i;
+	int ret;
+
+	req.op_type = WD_DIR_COMPRESS;
+	req.src = src;
+	req.src_len = src_len;
+	req.dst = dst;
+	req.dst_len = TEST_BUF_LEN;
+	req.last = last;
+	req.cb = async_cb;
+	req.cb_param = &res;
+	ret = strm ? wd_do_comp_strm_async(h_sess, &req) :
+		     wd_do_comp_async(h_sess, &req);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < TEST_POLL_TIMES && !res.done; i++)
+		(void)wd_comp_poll_ctx(0, 1, &count);
+
+	if (!res.done || res.status || res.src_len != src_len) {
+		printf("async compress failed(%d, %u, %u)!\n", res.done,
+		       res.status, res.src_len);
+		return -1;
+	}
+	*dst_len = res.dst_len;
+
+	return 0;
+}
+
+static int check_decomp(char *src, __u32 src_len, char *expect, __u32 len,
+			const char *name)
+{
+	struct wd_comp_req req = {0};
+	handle_t h_sess;
+	char *out;
+	int ret;
+
+	out = malloc(TEST_BUF_LEN);
+	h_sess = alloc_sess(WD_DIR_DECOMPRESS);
+	if (!out || !h_sess) {
+		free(out);
+		return -1;
+	}
+
+	req.op_type = WD_DIR_DECOMPRESS;
+	req.src = src;
+	req.src_len = src_len;
+	req.dst = out;
+	req.dst_len = TEST_BUF_LEN;
+	ret = wd_do_comp_sync(h_sess, &req);
+	if (ret || req.dst_len != len || memcmp(out, expect, len)) {
+		printf("%s: wrong output(%d, %u)!\n", name, ret, req.dst_len);
+		ret = -1;
+	}
+
+	wd_comp_free_sess(h_sess);
+	free(out);
+	return ret;
+}
+
+static int test_msg_reuse(char *in)
+{
+	__u32 strm_len = 0, len = 0;
+	handle_t h_strm, h_block;
+	char *strm_out, *out;
+	int ret = -1;
+
+	strm_out = malloc(TEST_BUF_LEN);
+	out = malloc(TEST_BUF_LEN);
+	h_strm = alloc_sess(WD_DIR_COMPRESS);
+	h_block = alloc_sess(WD_DIR_COMPRESS);
+	if (!strm_out || !out || !h_strm || !h_block)
+		goto out;
+
+	/* the stateless request reuses the msg of the first chunk */
+	if (comp_async(h_strm, true, in, TEST_CHUNK_LEN, strm_out, 0,
+		       &strm_len) ||
+	    comp_async(h_block, false, in, TEST_STATELESS_LEN, out, 1, &len) ||
+	    comp_async(h_strm, true, in + TEST_CHUNK_LEN, TEST_CHUNK_LEN,
+		       strm_out + strm_len, 1, &len))
+		goto out;
+	strm_len += len;
+
+	ret = check_decomp(strm_out, strm_len, in, TEST_STRM_LEN,
+			   "msg reuse");
+	if (!ret)
+		printf("msg reuse: ok\n");
+
+out:
+	if (h_strm)
+		wd_comp_free_sess(h_strm);
+	if (h_block)
+		wd_comp_free_sess(h_block);
+	free(strm_out);
+	free(out);
+	return ret;
+}
+
+/* The async requests are done, their messages are back in the pool */
+static int test_msg_stats(void)
+{
+	struct wd_ctx_stats stats;
+	int ret;
+
+	ret = wd_comp_get_ctx_stats(0, &stats);
+	if (ret || !stats.msg.msg_num || stats.msg.in_use ||
+	    stats.msg.peak != 1 || stats.req.async_num != 3) {
+		printf("msg stats: wrong counters(%d, %u, %u, %llu)!\n", ret,
+		       stats.msg.in_use, stats.msg.peak, stats.req.async_num);
+		return -1;
+	}
+	printf("msg stats: ok\n");
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char *in;
+	int ret;
+
+	in = malloc(TEST_STRM_LEN);
+	if (!in)
+		return -1;
+
+	fill_data(in, TEST_STRM_LEN);
+	ret = init_comp();
+	if (!ret) {
+		ret = test_msg_reuse(in);
+		if (!ret)
+			ret = test_msg_stats();
+		uninit_comp();
+	}
+
+	free(in);
+	return ret;
+}
@@ -0,0 +1,339 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+/*
+ * Round trips of the requests copied through the bounce blocks of a ctx
+ * without SVA, and of the requests on the blocks of a user mempool. Run on the
+ * loopback device:
+ *	WD_LOOPBACK=1 WD_LOOPBACK_NOSVA=1 ./wd_comp_nosva_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd.h"
+#include "wd_comp.h"
+#include "wd_sched.h"
+
+#define TEST_CTX_NUM		2
+#define TEST_BLK_SIZE		(512 * 1024)
+/* bigger than a bounce block, a stream request is cut */
+#define TEST_STRM_LEN		(3 * TEST_BLK_SIZE / 2 + 1000)
+#define TEST_STATELESS_LEN	(TEST_BLK_SIZE / 2)
+#define TEST_MEMPOOL_SIZE	(4 * TEST_BLK_SIZE)
+
+static struct wd_ctx_config ctx_cfg;
+static struct wd_sched *sched;
+static struct uacce_dev_list *list;
+
+static void fill_data(char *buf, __u32 len)
+{
+	__u32 seed = 1, i;
+
+	/* compressible, but not too much */
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = 'a' + ((seed >> 16) & 0x7);
+	}
+}
+
+static int init_comp(void)
+{
+	struct sched_params param = {0};
+	__u32 i;
+	int ret;
+
+	list = wd_get_accel_list("deflate");
+	if (!list) {
+		printf("no device of deflate!\n");
+		return -WD_ENODEV;
+	}
+
+	ctx_cfg.ctx_num = TEST_CTX_NUM;
+	ctx_cfg.ctxs = calloc(TEST_CTX_NUM, sizeof(struct wd_ctx));
+	if (!ctx_cfg.ctxs) {
+		ret = -WD_ENOMEM;
+		goto free_list;
+	}
+
+	for (i = 0; i < TEST_CTX_NUM; i++) {
+		ctx_cfg.ctxs[i].ctx = wd_request_ctx(list->dev);
+		if (!ctx_cfg.ctxs[i].ctx) {
+			ret = -WD_ENODEV;
+			goto free_ctxs;
+		}
+		ctx_cfg.ctxs[i].op_type = i;
+		ctx_cfg.ctxs[i].ctx_mode = CTX_MODE_SYNC;
+	}
+
+	sched = wd_sched_rr_alloc(SCHED_POLICY_RR, WD_DIR_MAX, MAX_NUMA_NUM,
+				  wd_comp_poll_ctx);
+	if (!sched) {
+		ret = -WD_ENOMEM;
+		goto free_ctxs;
+	}
+
+	sched->name = "sched_rr";
+	for (i = 0; i < TEST_CTX_NUM; i++) {
+		param.numa_id = list->dev->numa_id < 0 ? 0 : list->dev->numa_id;
+		param.type = i;
+		param.mode = CTX_MODE_SYNC;
+		param.begin = i;
+		param.end = i;
+		ret = wd_sched_rr_instance(sched, &param);
+		if (ret)
+			goto free_sched;
+	}
+
+	ret = wd_comp_init(&ctx_cfg, sched);
+	if (ret)
+		goto free_sched;
+
+	return 0;
+
+free_sched:
+	wd_sched_rr_release(sched);
+free_ctxs:
+	for (i = 0; i < TEST_CTX_NUM; i++)
+		if (ctx_cfg.ctxs[i].ctx)
+			wd_release_ctx(ctx_cfg.ctxs[i].ctx);
+	free(ctx_cfg.ctxs);
+free_list:
+	wd_free_list_accels(list);
+	printf("failed to init comp(%d)!\n", ret);
+	return ret;
+}
+
+static void uninit_comp(void)
+{
+	__u32 i;
+
+	wd_comp_uninit();
+	wd_sched_rr_release(sched);
+	for (i = 0; i < TEST_CTX_NUM; i++)
+		wd_release_ctx(ctx_cfg.ctxs[i].ctx);
+	free(ctx_cfg.ctxs);
+	wd_free_list_accels(list);
+}
+
+static handle_t alloc_sess(enum wd_comp_op_type op_type)
+{
+	struct wd_comp_sess_setup setup = {0};
+	struct sched_params param = {0};
+
+	setup.alg_type = WD_DEFLATE;
+	setup.comp_lv = WD_COMP_L8;
+	setup.win_sz = WD_COMP_WS_32K;
+	setup.op_type = op_type;
+	param.type = op_type;
+	setup.sched_param = &param;
+
+	return wd_comp_alloc_sess(&setup);
+}
+
+/* One stateless request in each direction, on any memory or on mempool blocks */
+static int test_stateless(char *in, char *mid, char *out, __u32 len,
+			  enum wd_mem_type mem_type, const char *name)
+{
+	struct wd_comp_req req = {0};
+	handle_t h_comp, h_decomp;
+	int ret = -1;
+
+	h_comp = alloc_sess(WD_DIR_COMPRESS);
+	h_decomp = alloc_sess(WD_DIR_DECOMPRESS);
+	if (!h_comp || !h_decomp) {
+		printf("%s: failed to alloc sess!\n", name);
+		goto free_sess;
+	}
+
+	if (wd_comp_set_mem_type(h_comp, mem_type) ||
+	    wd_comp_set_mem_type(h_decomp, mem_type)) {
+		printf("%s: failed to set mem type!\n", name);
+		goto free_sess;
+	}
+
+	req.op_type = WD_DIR_COMPRESS;
+	req.src = in;
+	req.src_len = len;
+	req.dst = mid;
+	req.dst_len = TEST_BLK_SIZE;
+	ret = wd_do_comp_sync(h_comp, &req);
+	if (ret || req.status) {
+		printf("%s: compress failed(%d, %u)!\n", name, ret, req.status);
+		ret = -1;
+		goto free_sess;
+	}
+
+	req.op_type = WD_DIR_DECOMPRESS;
+	req.src = mid;
+	req.src_len = req.dst_len;
+	req.dst = out;
+	req.dst_len = TEST_BLK_SIZE;
+	ret = wd_do_comp_sync(h_decomp, &req);
+	if (ret || req.dst_len != len || memcmp(in, out, len)) {
+		printf("%s: decompress failed(%d, %u)!\n", name, ret,
+		       req.dst_len);
+		ret = -1;
+		goto free_sess;
+	}
+	printf("%s: ok\n", name);
+
+free_sess:
+	if (h_comp)
+		wd_comp_free_sess(h_comp);
+	if (h_decomp)
+		wd_comp_free_sess(h_decomp);
+	return ret;
+}
+
+/* Feed a whole buffer to a stream, each request is cut to a bounce block */
+static int strm_all(handle_t h_sess, enum wd_comp_op_type op_type, char *src,
+		    __u32 src_len, char *dst, __u32 dst_len, __u32 *out_len)
+{
+	struct wd_comp_req req = {0};
+	__u32 in = 0, out = 0;
+	int ret;
+
+	req.op_type = op_type;
+	do {
+		req.src = src + in;
+		req.src_len = src_len - in;
+		req.dst = dst + out;
+		req.dst_len = dst_len - out;
+		req.last = 1;
+		ret = wd_do_comp_strm(h_sess, &req);
+		/* the output is cut to a bounce block too, then goes on */
+		if (ret || req.status == WD_IN_EPARA)
+			return ret ? ret : -1;
+
+		if (!wd_is_sva(ctx_cfg.ctxs[0].ctx) &&
+		    req.src_len > TEST_BLK_SIZE) {
+			printf("a request isn't cut to a bounce block!\n");
+			return -1;
+		}
+		in += req.src_len;
+		out += req.dst_len;
+	} while (op_type == WD_DIR_COMPRESS ? in < src_len :
+		 req.status != WD_STREAM_END);
+
+	*out_len = out;
+
+	return 0;
+}
+
+static int test_strm(char *in, char *mid, char *out)
+{
+	handle_t h_comp, h_decomp;
+	__u32 comp_len, len;
+	int ret = -1;
+
+	h_comp = alloc_sess(WD_DIR_COMPRESS);
+	h_decomp = alloc_sess(WD_DIR_DECOMPRESS);
+	if (!h_comp || !h_decomp) {
+		printf("stream cut: failed to alloc sess!\n");
+		goto free_sess;
+	}
+
+	ret = strm_all(h_comp, WD_DIR_COMPRESS, in, TEST_STRM_LEN, mid,
+		       2 * TEST_STRM_LEN, &comp_len);
+	if (ret) {
+		printf("stream cut: compress failed(%d)!\n", ret);
+		goto free_sess;
+	}
+
+	ret = strm_all(h_decomp, WD_DIR_DECOMPRESS, mid, comp_len, out,
+		       2 * TEST_STRM_LEN, &len);
+	if (ret || len != TEST_STRM_LEN || memcmp(in, out, len)) {
+		printf("stream cut: decompress failed(%d, %u)!\n", ret, len);
+		ret = -1;
+		goto free_sess;
+	}
+	printf("stream cut: ok\n");
+
+free_sess:
+	if (h_comp)
+		wd_comp_free_sess(h_comp);
+	if (h_decomp)
+		wd_comp_free_sess(h_decomp);
+	return ret;
+}
+
+/* The buffers are blocks of a mempool on the memory of a ctx of the user */
+static int test_mempool(char *in)
+{
+	handle_t h_ctx, mempool, blkpool;
+	char *blks[3] = {NULL};
+	int ret = -1;
+	__u32 i;
+
+	h_ctx = wd_request_ctx(list->dev);
+	if (!h_ctx) {
+		printf("mempool: failed to request ctx!\n");
+		return -1;
+	}
+
+	mempool = wd_mempool_create_dma(h_ctx, TEST_MEMPOOL_SIZE);
+	if (WD_IS_ERR(mempool)) {
+		printf("mempool: failed to create mempool!\n");
+		goto release_ctx;
+	}
+
+	blkpool = wd_blockpool_create(mempool, TEST_BLK_SIZE,
+				      ARRAY_SIZE(blks));
+	if (WD_IS_ERR(blkpool)) {
+		printf("mempool: failed to create blkpool!\n");
+		goto destroy_mempool;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(blks); i++) {
+		blks[i] = wd_block_alloc(blkpool);
+		if (!blks[i]) {
+			printf("mempool: failed to alloc block!\n");
+			goto free_blks;
+		}
+	}
+
+	memcpy(blks[0], in, TEST_STATELESS_LEN);
+	ret = test_stateless(blks[0], blks[1], blks[2], TEST_STATELESS_LEN,
+			     WD_MEM_MEMPOOL, "mempool");
+
+free_blks:
+	for (i = 0; i < ARRAY_SIZE(blks); i++)
+		if (blks[i])
+			wd_block_free(blkpool, blks[i]);
+	wd_blockpool_destroy(blkpool);
+destroy_mempool:
+	wd_mempool_destroy(mempool);
+release_ctx:
+	wd_release_ctx(h_ctx);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	char *in, *mid, *out;
+	int ret = -1;
+
+	in = malloc(TEST_STRM_LEN);
+	mid = malloc(2 * TEST_STRM_LEN);
+	out = malloc(2 * TEST_STRM_LEN);
+	if (!in || !mid || !out)
+		goto free_buf;
+
+	fill_data(in, TEST_STRM_LEN);
+	ret = init_comp();
+	if (ret)
+		goto free_buf;
+
+	ret = test_stateless(in, mid, out, TEST_STATELESS_LEN, WD_MEM_USER,
+			     "stateless");
+	ret |= test_strm(in, mid, out);
+	ret |= test_mempool(in);
+
+	uninit_comp();
+free_buf:
+	free(in);
+	free(mid);
+	free(out);
+	return ret ? -1 : 0;
+}
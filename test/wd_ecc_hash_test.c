@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+/*
+ * Known answers of the built-in SM3 and SHA-256 used by the sm2 steps done
+ * by the cpu, and of the sm2 KDF. No device is needed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd_ecc.h"
+#include "drv/wd_ecc_drv.h"
+
+#define TEST_LONG_LEN		1000
+#define TEST_KDF_LEN		100
+#define TEST_CB_BYTE		0x5a
+
+struct hash_kat {
+	const char *name;
+	__u8 type;
+	const char *msg;
+	__u32 repeat;
+	const char *digest;
+};
+
+struct kdf_kat {
+	const char *name;
+	__u8 type;
+	__u32 len;
+	const char *out;
+};
+
+static const struct hash_kat hash_kats[] = {
+	{ "sm3 abc", WD_HASH_SM3, "abc", 1,
+	  "66c7f0f462eeedd9d1f2d46bdc10e4e24167c4875cf2f7a2297da02b8f4ba8e0" },
+	{ "sm3 abcd x 16", WD_HASH_SM3, "abcd", 16,
+	  "debe9ff92275b8a138604889c18e5a4d6fdb70e5387e5765293dcba39c0c5732" },
+	{ "sm3 a x 1000", WD_HASH_SM3, "a", TEST_LONG_LEN,
+	  "f4bedca973227d45c5b822551d2e762d4cfb0e9af70b241452545727b5fb046f" },
+	{ "sha256 abc", WD_HASH_SHA256, "abc", 1,
+	  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+	{ "sha256 abcd x 16", WD_HASH_SHA256, "abcd", 16,
+	  "625b41490b883891943c5fa54ad45d7c900b9b6e91e159334e320b1f5215a209" },
+	{ "sha256 a x 1000", WD_HASH_SHA256, "a", TEST_LONG_LEN,
+	  "41edece42d63e8d9bf515a9ba6932e1c20cbc9f5a5d134645adb5db1b9737ea3" },
+};
+
+/* x2 || y2 of the sm2 encryption example of GM/T 0003.4 */
+static const char *kdf_x2 =
+	"64d20d27d0632957f8028c1e024f6b02edf23102a566c932ae8bd613a8e865fe";
+static const char *kdf_y2 =
+	"58d225eca784ae300a81a2d48281a828e1cedf11c4219099840265375077bf78";
+
+static const struct kdf_kat kdf_kats[] = {
+	/* klen 152 bits of the example */
+	{ "sm2 kdf sm3 19", WD_HASH_SM3, 19,
+	  "006e30dae231b071dfad8aa379e90264491603" },
+	{ "sm2 kdf sm3 100", WD_HASH_SM3, TEST_KDF_LEN,
+	  "006e30dae231b071dfad8aa379e90264491603b93fc2d0b2f64c3021e23c6cc8"
+	  "3065830fea992082fb7a8caa831d149a49b9ff1a67ba3954abf530c363ad80ac"
+	  "a0c2654d18991bf1940afdae9e6370c2664c100468208019d5160a0c266b3691"
+	  "f32022f7" },
+	{ "sm2 kdf sha256 100", WD_HASH_SHA256, TEST_KDF_LEN,
+	  "47f00fe8975bcd45c20abf91b45406f3e4a857c4d4e6ae66ebb68cd63f5db4f5"
+	  "f7db40a5ecd8eab2e2454f9017b33e3fa12807b358ae4c86be74fefa4a84330f"
+	  "30aa0a9771f30698a40fd16ab5ee98cc6d3907c06a41f5228f3e9ce199cdf9b1"
+	  "38cc87a2" },
+};
+
+static __u32 cb_calls;
+
+static __u32 hex_to_bin(const char *hex, char *bin)
+{
+	__u32 len = strlen(hex) / 2;
+	unsigned int val;
+	__u32 i;
+
+	for (i = 0; i < len; i++) {
+		sscanf(hex + 2 * i, "%2x", &val);
+		bin[i] = val;
+	}
+
+	return len;
+}
+
+static int check_out(const char *name, const char *expect, const char *out,
+		     __u32 len)
+{
+	char bin[TEST_KDF_LEN];
+
+	if (hex_to_bin(expect, bin) != len || memcmp(bin, out, len)) {
+		printf("%s: wrong answer!\n", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test_hash(const struct hash_kat *kat)
+{
+	char msg[TEST_LONG_LEN * 4];
+	char out[WD_ECC_HASH_MAX_BYTES];
+	struct wd_hash_mt hash = { .type = kat->type };
+	struct wd_ecc_hash_ctx ctx;
+	struct wd_dtb in[2];
+	__u32 mlen = strlen(kat->msg);
+	__u32 len = 0, i;
+	int ret;
+
+	for (i = 0; i < kat->repeat; i++, len += mlen)
+		memcpy(msg + len, kat->msg, mlen);
+
+	/* byte by byte, so every partial block is taken */
+	(void)wd_ecc_hash_init(&ctx, kat->type);
+	for (i = 0; i < len; i++)
+		wd_ecc_hash_update(&ctx, msg + i, 1);
+	wd_ecc_hash_final(&ctx, out);
+	ret = check_out(kat->name, kat->digest, out, sizeof(out));
+	if (ret)
+		return ret;
+
+	/* split in two buffers, without a callback */
+	in[0].data = msg;
+	in[0].dsize = len / 3;
+	in[1].data = msg + len / 3;
+	in[1].dsize = len - len / 3;
+	memset(out, 0, sizeof(out));
+	ret = wd_ecc_hash_dtbs(&hash, in, ARRAY_SIZE(in), out, sizeof(out));
+	if (ret) {
+		printf("%s: hash dtbs failed(%d)!\n", kat->name, ret);
+		return ret;
+	}
+
+	ret = check_out(kat->name, kat->digest, out, sizeof(out));
+	if (!ret)
+		printf("%s: ok\n", kat->name);
+
+	return ret;
+}
+
+static int hash_cb(const char *in, size_t in_len, char *out, size_t out_len,
+		   void *usr)
+{
+	cb_calls++;
+	memset(out, TEST_CB_BYTE, out_len);
+
+	return 0;
+}
+
+static int test_kdf(const struct kdf_kat *kat, char *z)
+{
+	struct wd_hash_mt hash = { .type = kat->type };
+	struct wd_ecc_point x2y2;
+	char buf[TEST_KDF_LEN];
+	struct wd_dtb out;
+	int ret;
+
+	x2y2.x.data = z;
+	x2y2.x.dsize = WD_ECC_HASH_MAX_BYTES;
+	x2y2.y.data = z + WD_ECC_HASH_MAX_BYTES;
+	x2y2.y.dsize = WD_ECC_HASH_MAX_BYTES;
+	out.data = buf;
+	out.bsize = sizeof(buf);
+
+	ret = wd_ecc_sm2_kdf(&out, &x2y2, kat->len, &hash,
+			     WD_ECC_HASH_MAX_BYTES);
+	if (ret || out.dsize != kat->len) {
+		printf("%s: kdf failed(%d)!\n", kat->name, ret);
+		return -1;
+	}
+
+	ret = check_out(kat->name, kat->out, buf, kat->len);
+	if (!ret)
+		printf("%s: ok\n", kat->name);
+
+	return ret;
+}
+
+/* A hash callback set by the user is used even for the built-in types */
+static int test_cb(char *z)
+{
+	struct wd_hash_mt hash = { .type = WD_HASH_SM3, .cb = hash_cb };
+	char out[TEST_KDF_LEN], expect[TEST_KDF_LEN];
+	struct wd_ecc_point x2y2;
+	struct wd_dtb in, kdf_out;
+	int ret;
+
+	memset(expect, TEST_CB_BYTE, sizeof(expect));
+
+	in.data = z;
+	in.dsize = 2 * WD_ECC_HASH_MAX_BYTES;
+	ret = wd_ecc_hash_dtbs(&hash, &in, 1, out, WD_ECC_HASH_MAX_BYTES);
+	if (ret || cb_calls != 1 ||
+	    memcmp(out, expect, WD_ECC_HASH_MAX_BYTES)) {
+		printf("hash cb: isn't used by hash dtbs!\n");
+		return -1;
+	}
+
+	x2y2.x.data = z;
+	x2y2.x.dsize = WD_ECC_HASH_MAX_BYTES;
+	x2y2.y.data = z + WD_ECC_HASH_MAX_BYTES;
+	x2y2.y.dsize = WD_ECC_HASH_MAX_BYTES;
+	kdf_out.data = out;
+	kdf_out.bsize = sizeof(out);
+	ret = wd_ecc_sm2_kdf(&kdf_out, &x2y2, TEST_KDF_LEN, &hash,
+			     WD_ECC_HASH_MAX_BYTES);
+	/* one call for each digest of the key stream */
+	if (ret || cb_calls != 1 + (TEST_KDF_LEN + WD_ECC_HASH_MAX_BYTES - 1) /
+	    WD_ECC_HASH_MAX_BYTES || memcmp(out, expect, TEST_KDF_LEN)) {
+		printf("hash cb: isn't used by sm2 kdf!\n");
+		return -1;
+	}
+	printf("hash cb: ok\n");
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char z[2 * WD_ECC_HASH_MAX_BYTES];
+	int ret = 0;
+	__u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(hash_kats); i++)
+		if (test_hash(&hash_kats[i]))
+			ret = -1;
+
+	(void)hex_to_bin(kdf_x2, z);
+	(void)hex_to_bin(kdf_y2, z + WD_ECC_HASH_MAX_BYTES);
+	for (i = 0; i < ARRAY_SIZE(kdf_kats); i++)
+		if (test_kdf(&kdf_kats[i], z))
+			ret = -1;
+
+	if (test_cb(z))
+		ret = -1;
+
+	return ret;
+}
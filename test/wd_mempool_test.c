@@ -60,6 +60,7 @@ struct test_option {
 	unsigned long blk_num[WD_MEM_MAX_THREAD];
 	unsigned long sleep_value[WD_MEM_MAX_THREAD];
 	unsigned long perf;
+	unsigned long cache_size;
 	unsigned thread_num;
 	__u32 algclass;
 	__u32 algtype;
@@ -123,6 +124,8 @@ static void show_help(void)
 			" --multi <num>  pthread num\n"
 			" --times <num>  if perf is 2, this is times for sec's alg in every pthread\n"
 			" --ctxnum <num> ctx num\n"
+			" --cache_size <num> per cpu cache size of block pool,\n"
+			"			 0 for no cache\n"
 			"			 in blkpool\n"
 			" --path	     file's path\n"
 			" --help		 show this help\n");
@@ -192,6 +195,7 @@ static int parse_cmd_line(int argc, char *argv[], struct test_option *opt)
 		{"async",		no_argument,       0, 10},
 		{"ctxnum",		required_argument, 0, 11},
 		{"help",		no_argument,       0, 12},
+		{"cache_size",		required_argument, 0, 13},
 		{0, 0, 0, 0}
 	};
 
@@ -242,6 +246,9 @@ static int parse_cmd_line(int argc, char *argv[], struct test_option *opt)
 			case 12:
 				show_help();
 				return -1;
+			case 13:
+				opt->cache_size = strtol(optarg, NULL, 0);
+				break;
 			default:
 				printf("bad input parameter, exit\n");
 				show_help();
@@ -277,6 +284,16 @@ static void dump_mp_bp(struct wd_mempool_stats *mp_s, struct wd_blockpool_stats
 	printf("---------------------------------------\n");
 }
 
+static void dump_bp_cache(handle_t bp)
+{
+	struct wd_blockpool_cache_stats cache_s = {0};
+
+	wd_blockpool_cache_stats(bp, &cache_s);
+	printf("bp cache_hit_num    : %lu\n", cache_s.hit_num);
+	printf("bp cache_miss_num   : %lu\n", cache_s.miss_num);
+	printf("bp cache_hit_rate   : %lu%%\n\n", cache_s.hit_rate);
+}
+
 void *alloc_free_thread(void *data)
 {
 	struct test_opt_per_thread *opt = data;
@@ -306,6 +323,8 @@ void *alloc_free_thread(void *data)
 static int test_blkpool(struct test_option *opt)
 {
 	struct test_opt_per_thread per_thread_opt[WD_MEM_MAX_THREAD] = {{0}};
+	struct wd_blockpool_stats bp_stats = {0};
+	struct wd_mempool_stats mp_stats = {0};
 	pthread_t threads[WD_MEM_MAX_THREAD];
 	int i, bp_thread_num = g_thread_num;
 	handle_t mp, bp;
@@ -316,7 +335,12 @@ static int test_blkpool(struct test_option *opt)
 		return -1;
 	}
 
-	bp = wd_blockpool_create(mp, opt->blk_size[0], opt->blk_num[0]);
+	if (opt->cache_size)
+		bp = wd_blockpool_create_cached(mp, opt->blk_size[0],
+						opt->blk_num[0],
+						opt->cache_size);
+	else
+		bp = wd_blockpool_create(mp, opt->blk_size[0], opt->blk_num[0]);
 	if (WD_IS_ERR(bp)) {
 		printf("Fail to create blkpool, err(%lld)!\n", WD_HANDLE_ERR(bp));
 		return -1;
@@ -335,6 +359,12 @@ static int test_blkpool(struct test_option *opt)
 		pthread_join(threads[i], NULL);
 	}
 
+	wd_mempool_stats(mp, &mp_stats);
+	wd_blockpool_stats(bp, &bp_stats);
+	dump_mp_bp(&mp_stats, &bp_stats);
+	if (opt->cache_size)
+		dump_bp_cache(bp);
+
 	wd_blockpool_destroy(bp);
 	wd_mempool_destroy(mp);
 
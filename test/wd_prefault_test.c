@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+/*
+ * The submit prefault touches the pages of a buffer once, then skips it:
+ *	./wd_prefault_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "wd.h"
+#include "wd_alg_common.h"
+
+#define TEST_CHUNK_SIZE		(64 * 1024)
+#define TEST_BUF_SIZE		(4 * TEST_CHUNK_SIZE)
+
+struct prefault_case {
+	const char *name;
+	size_t off;
+	size_t len;
+};
+
+static const struct prefault_case prefault_cases[] = {
+	/* shorter than a page, at the start of a chunk */
+	{ "short", 100, 200 },
+	/* another page of the same chunk is still touched */
+	{ "same chunk", 5 * 4096 + 7, 300 },
+	/* less than a chunk, not page aligned */
+	{ "partial chunk", TEST_CHUNK_SIZE + 1000, 10 * 1024 },
+	/* across a chunk boundary */
+	{ "cross chunk", 3 * TEST_CHUNK_SIZE - 3000, 6000 },
+};
+
+static int get_stat(struct wd_prefault_stat *stat)
+{
+	int ret;
+
+	ret = wd_get_prefault_stat(stat);
+	if (ret)
+		printf("failed to get prefault stat(%d)!\n", ret);
+
+	return ret;
+}
+
+/* A buffer is touched on its first submit and skipped on the second one */
+static int test_submit(const struct prefault_case *tc, char *buf)
+{
+	struct wd_prefault_stat before, mid, after;
+
+	if (get_stat(&before))
+		return -1;
+
+	wd_prefault_submit(buf + tc->off, tc->len, WD_PREFAULT_WRITE);
+	if (get_stat(&mid))
+		return -1;
+
+	wd_prefault_submit(buf + tc->off, tc->len, WD_PREFAULT_WRITE);
+	if (get_stat(&after))
+		return -1;
+
+	if (mid.submit_num != before.submit_num + 1 ||
+	    mid.hit_num != before.hit_num ||
+	    after.submit_num != mid.submit_num ||
+	    after.hit_num != mid.hit_num + 1) {
+		printf("%s: wrong counters(%llu, %llu)!\n", tc->name,
+		       after.submit_num - before.submit_num,
+		       after.hit_num - before.hit_num);
+		return -1;
+	}
+	printf("%s: ok\n", tc->name);
+
+	return 0;
+}
+
+/* A registered buffer is skipped, until it is unregistered */
+static int test_register(char *buf)
+{
+	struct wd_prefault_stat before, mid, after;
+	int ret;
+
+	ret = wd_prefault_register(buf, TEST_CHUNK_SIZE / 2, 0);
+	if (ret) {
+		printf("register: failed to register(%d)!\n", ret);
+		return -1;
+	}
+
+	if (get_stat(&before))
+		return -1;
+
+	wd_prefault_submit(buf + 10, 100, 0);
+	if (get_stat(&mid))
+		return -1;
+
+	wd_prefault_unregister(buf, TEST_CHUNK_SIZE / 2);
+	wd_prefault_submit(buf + 10, 100, 0);
+	if (get_stat(&after))
+		return -1;
+
+	if (mid.hit_num != before.hit_num + 1 ||
+	    after.submit_num != mid.submit_num + 1) {
+		printf("register: wrong counters(%llu, %llu)!\n",
+		       after.submit_num - before.submit_num,
+		       after.hit_num - before.hit_num);
+		return -1;
+	}
+	printf("register: ok\n");
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char *buf, *reg_buf;
+	int ret = 0;
+	__u32 i;
+
+	/* the pages are tracked by 4KB at most, bigger ones are counted once */
+	if (sysconf(_SC_PAGESIZE) != 4096) {
+		printf("the cases need 4KB pages, skipped\n");
+		return 0;
+	}
+
+	setenv("WD_SVA_PREFAULT", "1", 1);
+	buf = aligned_alloc(TEST_CHUNK_SIZE, TEST_BUF_SIZE);
+	reg_buf = aligned_alloc(TEST_CHUNK_SIZE, TEST_CHUNK_SIZE);
+	if (!buf || !reg_buf) {
+		ret = -1;
+		goto free_buf;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(prefault_cases); i++)
+		if (test_submit(&prefault_cases[i], buf))
+			ret = -1;
+
+	if (test_register(reg_buf))
+		ret = -1;
+
+free_buf:
+	free(buf);
+	free(reg_buf);
+	return ret;
+}
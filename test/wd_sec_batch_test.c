@@ -0,0 +1,416 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+/*
+ * Async batches of cipher, digest and aead requests against the same requests
+ * sent one by one. A batch is longer than the msgs given to the driver at a
+ * time. Run on the loopback device:
+ *	WD_LOOPBACK=1 ./wd_sec_batch_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd.h"
+#include "wd_aead.h"
+#include "wd_cipher.h"
+#include "wd_digest.h"
+#include "wd_sched.h"
+
+#define TEST_REQ_NUM		40
+#define TEST_LEN		256
+#define TEST_ASSOC_LEN		16
+#define TEST_MAC_LEN		16
+#define TEST_OUT_LEN		(TEST_ASSOC_LEN + TEST_LEN + TEST_MAC_LEN)
+#define TEST_KEY_LEN		16
+#define TEST_GCM_IV_LEN		12
+#define TEST_POLL_TIMES		1000000
+
+typedef int (*alg_init_t)(struct wd_ctx_config *config, struct wd_sched *sched);
+typedef int (*alg_poll_t)(__u32 idx, __u32 expt, __u32 *count);
+
+static struct wd_ctx_config ctx_cfg;
+static struct wd_sched *sched;
+static __u8 key[TEST_KEY_LEN];
+static __u8 ivs[TEST_REQ_NUM][AES_BLOCK_SIZE];
+
+static void fill_data(__u8 *buf, __u32 len, __u32 seed)
+{
+	__u32 i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+}
+
+/* CTR gives the iv of a request back advanced, so each run starts anew */
+static void fill_ivs(void)
+{
+	fill_data(ivs[0], sizeof(ivs), 3);
+}
+
+/* one async ctx for all of the requests */
+static int init_alg(const char *alg_name, alg_init_t init, alg_poll_t poll)
+{
+	struct sched_params param = {0};
+	struct uacce_dev_list *list;
+	int ret;
+
+	list = wd_get_accel_list(alg_name);
+	if (!list) {
+		printf("no device of %s!\n", alg_name);
+		return -WD_ENODEV;
+	}
+
+	ctx_cfg.ctx_num = 1;
+	ctx_cfg.ctxs = calloc(1, sizeof(struct wd_ctx));
+	if (!ctx_cfg.ctxs) {
+		ret = -WD_ENOMEM;
+		goto free_list;
+	}
+
+	ctx_cfg.ctxs[0].ctx = wd_request_ctx(list->dev);
+	if (!ctx_cfg.ctxs[0].ctx) {
+		ret = -WD_ENODEV;
+		goto free_ctxs;
+	}
+	ctx_cfg.ctxs[0].op_type = 0;
+	ctx_cfg.ctxs[0].ctx_mode = CTX_MODE_ASYNC;
+
+	sched = wd_sched_rr_alloc(SCHED_POLICY_RR, 1, MAX_NUMA_NUM, poll);
+	if (!sched) {
+		ret = -WD_ENOMEM;
+		goto release_ctx;
+	}
+
+	sched->name = "sched_rr";
+	param.numa_id = list->dev->numa_id < 0 ? 0 : list->dev->numa_id;
+	param.mode = CTX_MODE_ASYNC;
+	ret = wd_sched_rr_instance(sched, &param);
+	if (ret)
+		goto free_sched;
+
+	ret = init(&ctx_cfg, sched);
+	if (ret)
+		goto free_sched;
+
+	wd_free_list_accels(list);
+	return 0;
+
+free_sched:
+	wd_sched_rr_release(sched);
+release_ctx:
+	wd_release_ctx(ctx_cfg.ctxs[0].ctx);
+free_ctxs:
+	free(ctx_cfg.ctxs);
+free_list:
+	wd_free_list_accels(list);
+	printf("failed to init %s(%d)!\n", alg_name, ret);
+	return ret;
+}
+
+static void uninit_alg(void (*uninit)(void))
+{
+	uninit();
+	wd_sched_rr_release(sched);
+	wd_release_ctx(ctx_cfg.ctxs[0].ctx);
+	free(ctx_cfg.ctxs);
+}
+
+static int poll_done(alg_poll_t poll, int *done, int num)
+{
+	__u32 count, i;
+
+	for (i = 0; i < TEST_POLL_TIMES && *done < num; i++)
+		(void)poll(0, 1, &count);
+
+	return *done < num ? -1 : 0;
+}
+
+/* Resend what a batch call leaves until all of it is sent */
+static int send_batch(int (*batch)(handle_t h_sess, void **reqs, __u32 num),
+		      alg_poll_t poll, handle_t h_sess, void **reqs,
+		      int *done)
+{
+	__u32 sent = 0, count;
+	int ret, i;
+
+	for (i = 0; i < TEST_POLL_TIMES && sent < TEST_REQ_NUM; i++) {
+		ret = batch(h_sess, reqs + sent, TEST_REQ_NUM - sent);
+		if (ret == -WD_EBUSY) {
+			(void)poll(0, 1, &count);
+			continue;
+		}
+		if (ret <= 0) {
+			printf("batch send failed(%d)!\n", ret);
+			return -1;
+		}
+		sent += ret;
+	}
+
+	return poll_done(poll, done, TEST_REQ_NUM);
+}
+
+static int check_output(__u8 *out, __u8 *ref, __u32 len, const char *name)
+{
+	if (memcmp(out, ref, TEST_REQ_NUM * len)) {
+		printf("%s: the batch output is wrong!\n", name);
+		return -1;
+	}
+	printf("%s: ok\n", name);
+
+	return 0;
+}
+
+static void *cipher_cb(struct wd_cipher_req *req, void *cb_param)
+{
+	int *done = cb_param;
+
+	if (!req->state)
+		(*done)++;
+
+	return NULL;
+}
+
+static int cipher_batch(handle_t h_sess, void **reqs, __u32 num)
+{
+	return wd_do_cipher_async_batch(h_sess, (struct wd_cipher_req **)reqs,
+					num);
+}
+
+static int test_cipher(__u8 *in, __u8 *out, __u8 *ref)
+{
+	struct wd_cipher_req reqs[TEST_REQ_NUM] = {0};
+	struct wd_cipher_sess_setup setup = {0};
+	struct wd_cipher_req *preqs[TEST_REQ_NUM];
+	struct sched_params param = {0};
+	handle_t h_sess;
+	int done = 0, ret = -1, i;
+
+	if (init_alg("cipher", wd_cipher_init, wd_cipher_poll_ctx))
+		return -1;
+
+	setup.alg = WD_CIPHER_AES;
+	setup.mode = WD_CIPHER_CTR;
+	setup.sched_param = &param;
+	h_sess = wd_cipher_alloc_sess(&setup);
+	if (!h_sess || wd_cipher_set_key(h_sess, key, TEST_KEY_LEN))
+		goto out;
+
+	fill_ivs();
+	for (i = 0; i < TEST_REQ_NUM; i++) {
+		reqs[i].op_type = WD_CIPHER_ENCRYPTION;
+		reqs[i].src = in + i * TEST_LEN;
+		reqs[i].in_bytes = TEST_LEN;
+		reqs[i].out_bytes = TEST_LEN;
+		reqs[i].out_buf_bytes = TEST_LEN;
+		reqs[i].iv = ivs[i];
+		reqs[i].iv_bytes = AES_BLOCK_SIZE;
+		reqs[i].data_fmt = WD_FLAT_BUF;
+		reqs[i].cb = cipher_cb;
+		reqs[i].cb_param = &done;
+		preqs[i] = &reqs[i];
+	}
+
+	for (i = 0; i < TEST_REQ_NUM; i++) {
+		reqs[i].dst = ref + i * TEST_LEN;
+		if (wd_do_cipher_async(h_sess, &reqs[i]) ||
+		    poll_done(wd_cipher_poll_ctx, &done, i + 1))
+			goto out;
+	}
+
+	done = 0;
+	fill_ivs();
+	for (i = 0; i < TEST_REQ_NUM; i++)
+		reqs[i].dst = out + i * TEST_LEN;
+	if (send_batch(cipher_batch, wd_cipher_poll_ctx, h_sess,
+		       (void **)preqs, &done))
+		goto out;
+
+	ret = check_output(out, ref, TEST_LEN, "cipher");
+
+out:
+	if (ret)
+		printf("cipher: failed!\n");
+	if (h_sess)
+		wd_cipher_free_sess(h_sess);
+	uninit_alg(wd_cipher_uninit);
+	return ret;
+}
+
+static void *digest_cb(void *data)
+{
+	struct wd_digest_req *req = data;
+	int *done = req->cb_param;
+
+	if (!req->state)
+		(*done)++;
+
+	return NULL;
+}
+
+static int digest_batch(handle_t h_sess, void **reqs, __u32 num)
+{
+	return wd_do_digest_async_batch(h_sess, (struct wd_digest_req **)reqs,
+					num);
+}
+
+static int test_digest(__u8 *in, __u8 *out, __u8 *ref)
+{
+	struct wd_digest_req reqs[TEST_REQ_NUM] = {0};
+	struct wd_digest_sess_setup setup = {0};
+	struct wd_digest_req *preqs[TEST_REQ_NUM];
+	struct sched_params param = {0};
+	handle_t h_sess;
+	int done = 0, ret = -1, i;
+
+	if (init_alg("digest", wd_digest_init, wd_digest_poll_ctx))
+		return -1;
+
+	setup.alg = WD_DIGEST_SHA256;
+	setup.mode = WD_DIGEST_NORMAL;
+	setup.sched_param = &param;
+	h_sess = wd_digest_alloc_sess(&setup);
+	if (!h_sess)
+		goto out;
+
+	for (i = 0; i < TEST_REQ_NUM; i++) {
+		reqs[i].in = in + i * TEST_LEN;
+		reqs[i].in_bytes = TEST_LEN;
+		reqs[i].out_bytes = WD_DIGEST_SHA256_LEN;
+		reqs[i].out_buf_bytes = WD_DIGEST_SHA256_LEN;
+		reqs[i].data_fmt = WD_FLAT_BUF;
+		reqs[i].cb = digest_cb;
+		reqs[i].cb_param = &done;
+		preqs[i] = &reqs[i];
+	}
+
+	for (i = 0; i < TEST_REQ_NUM; i++) {
+		reqs[i].out = ref + i * WD_DIGEST_SHA256_LEN;
+		if (wd_do_digest_async(h_sess, &reqs[i]) ||
+		    poll_done(wd_digest_poll_ctx, &done, i + 1))
+			goto out;
+	}
+
+	done = 0;
+	for (i = 0; i < TEST_REQ_NUM; i++)
+		reqs[i].out = out + i * WD_DIGEST_SHA256_LEN;
+	if (send_batch(digest_batch, wd_digest_poll_ctx, h_sess,
+		       (void **)preqs, &done))
+		goto out;
+
+	ret = check_output(out, ref, WD_DIGEST_SHA256_LEN, "digest");
+
+out:
+	if (ret)
+		printf("digest: failed!\n");
+	if (h_sess)
+		wd_digest_free_sess(h_sess);
+	uninit_alg(wd_digest_uninit);
+	return ret;
+}
+
+static void *aead_cb(struct wd_aead_req *req, void *cb_param)
+{
+	int *done = cb_param;
+
+	if (!req->state)
+		(*done)++;
+
+	return NULL;
+}
+
+static int aead_batch(handle_t h_sess, void **reqs, __u32 num)
+{
+	return wd_do_aead_async_batch(h_sess, (struct wd_aead_req **)reqs,
+				      num);
+}
+
+/* the src of a request is its assoc data and payload */
+static int test_aead(__u8 *in, __u8 *out, __u8 *ref)
+{
+	struct wd_aead_req reqs[TEST_REQ_NUM] = {0};
+	struct wd_aead_sess_setup setup = {0};
+	struct wd_aead_req *preqs[TEST_REQ_NUM];
+	struct sched_params param = {0};
+	handle_t h_sess;
+	int done = 0, ret = -1, i;
+
+	if (init_alg("aead", wd_aead_init, wd_aead_poll_ctx))
+		return -1;
+
+	setup.calg = WD_CIPHER_AES;
+	setup.cmode = WD_CIPHER_GCM;
+	setup.sched_param = &param;
+	h_sess = wd_aead_alloc_sess(&setup);
+	if (!h_sess || wd_aead_set_ckey(h_sess, key, TEST_KEY_LEN) ||
+	    wd_aead_set_authsize(h_sess, TEST_MAC_LEN))
+		goto out;
+
+	for (i = 0; i < TEST_REQ_NUM; i++) {
+		reqs[i].op_type = WD_CIPHER_ENCRYPTION_DIGEST;
+		reqs[i].src = in + i * TEST_OUT_LEN;
+		reqs[i].in_bytes = TEST_LEN;
+		reqs[i].assoc_bytes = TEST_ASSOC_LEN;
+		reqs[i].out_bytes = TEST_ASSOC_LEN + TEST_LEN;
+		reqs[i].out_buf_bytes = TEST_OUT_LEN;
+		reqs[i].iv = ivs[i];
+		reqs[i].iv_bytes = TEST_GCM_IV_LEN;
+		reqs[i].data_fmt = WD_FLAT_BUF;
+		reqs[i].cb = aead_cb;
+		reqs[i].cb_param = &done;
+		preqs[i] = &reqs[i];
+	}
+
+	for (i = 0; i < TEST_REQ_NUM; i++) {
+		reqs[i].dst = ref + i * TEST_OUT_LEN;
+		if (wd_do_aead_async(h_sess, &reqs[i]) ||
+		    poll_done(wd_aead_poll_ctx, &done, i + 1))
+			goto out;
+	}
+
+	done = 0;
+	for (i = 0; i < TEST_REQ_NUM; i++)
+		reqs[i].dst = out + i * TEST_OUT_LEN;
+	if (send_batch(aead_batch, wd_aead_poll_ctx, h_sess,
+		       (void **)preqs, &done))
+		goto out;
+
+	ret = check_output(out, ref, TEST_OUT_LEN, "aead");
+
+out:
+	if (ret)
+		printf("aead: failed!\n");
+	if (h_sess)
+		wd_aead_free_sess(h_sess);
+	uninit_alg(wd_aead_uninit);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	__u32 len = TEST_REQ_NUM * TEST_OUT_LEN;
+	__u8 *in, *out, *ref;
+	int ret = -1;
+
+	in = malloc(len);
+	out = calloc(1, len);
+	ref = calloc(1, len);
+	if (!in || !out || !ref)
+		goto free_buf;
+
+	fill_data(in, len, 1);
+	fill_data(key, TEST_KEY_LEN, 2);
+	fill_ivs();
+
+	ret = test_cipher(in, out, ref);
+	ret |= test_digest(in, out, ref);
+	ret |= test_aead(in, out, ref);
+
+free_buf:
+	free(in);
+	free(out);
+	free(ref);
+	return ret ? -1 : 0;
+}
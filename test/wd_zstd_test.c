@@ -0,0 +1,376 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+/*
+ * Round trip of the zstd entropy stage, no device is needed: the literals and
+ * sequences the hardware outputs for lz77_zstd are made by a small greedy
+ * matcher, encoded into a frame by wd_zstd_encode_block(), and decoded again
+ * by libzstd. Without libzstd only the frame structure is checked.
+ */
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd_zstd.h"
+
+#define TEST_BLOCKS		24
+#define TEST_SIZE		(TEST_BLOCKS * WD_ZSTD_BLOCK_MAX + 1234)
+#define TEST_DST_SIZE		(WD_ZSTD_FRAME_HEADER_MAX + TEST_BLOCKS * \
+				 WD_ZSTD_BLOCK_BOUND(WD_ZSTD_BLOCK_MAX) + 64)
+#define HASH_LOG		16
+#define MIN_MATCH		4
+#define WIN_SIZE		(1 << 17)
+#define REP_NUM			3
+#define TEST_REC		1000
+/* the longest literal length of a hardware sequence */
+#define HW_LL_MAX		0xffff
+#define HW_ML_MAX		0xffff
+
+/* Block_Type of a compressed block */
+#define ZSTD_BLK_COMP		2
+#define ZSTD_MAGIC		0xFD2FB528
+#define ZSTD_FRAME_HDR_MIN	6
+
+/* a sequence the same as the hardware outputs */
+struct test_seq {
+	__u32 off;
+	__u16 ll;
+	__u16 ml;
+};
+
+struct test_matcher {
+	__u32 hash[1 << HASH_LOG];
+	__u32 rep[REP_NUM];
+	struct test_seq seqs[WD_ZSTD_BLOCK_MAX];
+	__u8 lits[WD_ZSTD_BLOCK_MAX];
+};
+
+typedef size_t (*zstd_decompress_t)(void *dst, size_t dst_cap,
+				    const void *src, size_t src_len);
+typedef unsigned (*zstd_is_error_t)(size_t code);
+
+static __u8 src[TEST_SIZE];
+static __u8 dst[TEST_DST_SIZE];
+static __u8 out[TEST_SIZE];
+static struct test_matcher matcher;
+
+static __u32 get_le24(const __u8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16);
+}
+
+static __u32 get_le32(const __u8 *p)
+{
+	return get_le24(p) | ((__u32)p[3] << 24);
+}
+
+static __u32 hash4(const __u8 *p)
+{
+	return (get_le32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+/* Text, runs, random bytes and repeated records, so every path is taken */
+static void fill_src(void)
+{
+	static const char *words[] = {
+		"uadk ", "warpdrive ", "accelerator ", "queue ", "ctx ",
+		"session ", "zstd ", "literal ", "sequence ", "offset\n",
+	};
+	__u32 seed = 1;
+	__u32 i = 0, n;
+	const char *w;
+
+	while (i < TEST_SIZE) {
+		seed = seed * 1103515245 + 12345;
+		switch ((seed >> 16) % 8) {
+		case 0:
+			/* a run, a block of it is stored as RLE */
+			n = (seed >> 8) % 3 ? 300 : WD_ZSTD_BLOCK_MAX * 2;
+			for (; n-- && i < TEST_SIZE; i++)
+				src[i] = 'z';
+			break;
+		case 1:
+			/* incompressible, a block of it is stored raw */
+			n = (seed >> 8) % 3 ? 20000 : WD_ZSTD_BLOCK_MAX * 2;
+			for (; n-- && i < TEST_SIZE; i++) {
+				seed = seed * 1103515245 + 12345;
+				src[i] = seed >> 16;
+			}
+			break;
+		case 2:
+			/*
+			 * A random record and its copies with a few bytes
+			 * changed, the matches after them are at a repeat offset.
+			 */
+			for (n = 0; n < TEST_REC * 8 && i < TEST_SIZE; n++, i++) {
+				seed = seed * 1103515245 + 12345;
+				src[i] = n < TEST_REC || !(n % 50) ? seed >> 16 :
+					 src[i - TEST_REC];
+			}
+			break;
+		default:
+			for (n = 400; n-- && i < TEST_SIZE;) {
+				seed = seed * 1103515245 + 12345;
+				w = words[(seed >> 16) % 10];
+
+				while (*w && i < TEST_SIZE)
+					src[i++] = *w++;
+			}
+			break;
+		}
+	}
+}
+
+/* The offset of a repeat Offset_Value from 1 to 3 */
+static __u32 rep_offset(const __u32 *rep, __u32 code, __u32 ll)
+{
+	/* without literals before, the repeat offsets are shifted by one */
+	__u32 idx = code - 1 + !ll;
+
+	return idx == REP_NUM ? rep[0] - 1 : rep[idx];
+}
+
+/* The Offset_Value of the hardware, a repeat offset if it can be */
+static __u32 seq_offset(__u32 *rep, __u32 offset, __u32 ll)
+{
+	__u32 code, idx;
+
+	for (code = 1; code <= REP_NUM; code++) {
+		if (offset != rep_offset(rep, code, ll))
+			continue;
+
+		idx = code - 1 + !ll;
+		if (idx) {
+			if (idx != 1)
+				rep[2] = rep[1];
+			rep[1] = rep[0];
+			rep[0] = offset;
+		}
+		return code;
+	}
+
+	rep[2] = rep[1];
+	rep[1] = rep[0];
+	rep[0] = offset;
+
+	return offset + REP_NUM;
+}
+
+/* Greedy lz77 of one block, the matches may reach into the blocks before */
+static void match_block(struct wd_lz77_zstd_data *data, __u32 start,
+			__u32 len)
+{
+	struct test_matcher *m = &matcher;
+	__u32 end = start + len;
+	__u32 pos = start, anchor = start;
+	__u32 nseq = 0, nlit = 0;
+	__u32 cand, code, off, ml, h;
+
+	while (pos + MIN_MATCH <= end) {
+		h = hash4(src + pos);
+		cand = m->hash[h];
+		m->hash[h] = pos;
+		if (pos - anchor > HW_LL_MAX) {
+			pos++;
+			continue;
+		}
+
+		/* the repeat offsets first, they are the cheapest to code */
+		for (code = 1; code <= REP_NUM; code++) {
+			off = rep_offset(m->rep, code, pos - anchor);
+			if (off && off <= pos &&
+			    get_le32(src + pos - off) == get_le32(src + pos))
+				break;
+		}
+
+		if (code <= REP_NUM)
+			cand = pos - off;
+		else if (!cand || pos - cand >= WIN_SIZE ||
+			 get_le32(src + cand) != get_le32(src + pos)) {
+			pos++;
+			continue;
+		}
+
+		ml = MIN_MATCH;
+		while (pos + ml < end && ml < HW_ML_MAX + 3 &&
+		       src[cand + ml] == src[pos + ml])
+			ml++;
+
+		memcpy(m->lits + nlit, src + anchor, pos - anchor);
+		nlit += pos - anchor;
+		m->seqs[nseq].ll = pos - anchor;
+		m->seqs[nseq].ml = ml - 3;
+		m->seqs[nseq].off = seq_offset(m->rep, pos - cand, pos - anchor);
+		nseq++;
+		pos += ml;
+		anchor = pos;
+	}
+
+	memcpy(m->lits + nlit, src + anchor, end - anchor);
+	nlit += end - anchor;
+
+	data->literals_start = m->lits;
+	data->sequences_start = m->seqs;
+	data->lit_num = nlit;
+	data->seq_num = nseq;
+	data->lit_length_overflow_cnt = 0;
+	data->lit_length_overflow_pos = 0;
+	data->freq = NULL;
+}
+
+/*
+ * Encode the whole input as one frame. With @pipelined, blk_type is left as
+ * a compressed block as if several requests were in flight, otherwise it's
+ * taken from the block before, like a request sent after the coding of the
+ * previous one. Return the frame size, or 0 on failure.
+ */
+static __u32 encode_frame(int pipelined)
+{
+	static const __u32 rep_init[REP_NUM] = {1, 4, 8};
+	__u32 rep_end[REP_NUM], rep_end_prev[REP_NUM];
+	__u32 blk_type = ZSTD_BLK_COMP;
+	struct wd_lz77_zstd_data data;
+	__u32 off, len, pos;
+	handle_t h_enc;
+	int ret;
+
+	memset(&matcher, 0, sizeof(matcher));
+	memcpy(rep_end, rep_init, sizeof(rep_end));
+	memcpy(rep_end_prev, rep_init, sizeof(rep_end_prev));
+
+	h_enc = wd_zstd_alloc_encoder();
+	if (!h_enc)
+		return 0;
+
+	off = 0;
+	ret = wd_zstd_encode_begin(h_enc, TEST_SIZE, dst, sizeof(dst));
+	if (ret < 0)
+		goto out;
+	pos = ret;
+
+	for (; off < TEST_SIZE; off += len) {
+		len = TEST_SIZE - off;
+		if (len > WD_ZSTD_BLOCK_MAX)
+			len = WD_ZSTD_BLOCK_MAX;
+
+		/*
+		 * The hardware told the previous block isn't compressed starts
+		 * from the repeat offsets of the block before that one.
+		 */
+		memcpy(matcher.rep, blk_type == ZSTD_BLK_COMP ? rep_end :
+		       rep_end_prev, sizeof(matcher.rep));
+		match_block(&data, off, len);
+		memcpy(rep_end_prev, rep_end, sizeof(rep_end_prev));
+		memcpy(rep_end, matcher.rep, sizeof(rep_end));
+
+		data.blk_type = blk_type;
+		ret = wd_zstd_encode_block(h_enc, &data, src + off, len,
+					   off + len == TEST_SIZE, dst + pos,
+					   sizeof(dst) - pos);
+		if (ret < 0)
+			goto out;
+		pos += ret;
+
+		if (!pipelined)
+			blk_type = data.blk_type;
+	}
+
+	wd_zstd_free_encoder(h_enc);
+	return pos;
+out:
+	printf("zstd encode failed(%d) at offset %u!\n", ret, off);
+	wd_zstd_free_encoder(h_enc);
+	return 0;
+}
+
+/* Walk the blocks of the frame, when there is no decoder to check it */
+static int check_frame(__u32 size)
+{
+	__u32 pos = ZSTD_FRAME_HDR_MIN, hdr, type, bsize, fcs;
+	__u64 content = 0;
+
+	if (size < ZSTD_FRAME_HDR_MIN || get_le32(dst) != ZSTD_MAGIC)
+		return -1;
+
+	fcs = dst[4] >> 6;
+	pos += fcs == 1 ? 2 : fcs == 2 ? 4 : fcs == 3 ? 8 : 0;
+	do {
+		if (pos + 3 > size)
+			return -1;
+		hdr = get_le24(dst + pos);
+		type = (hdr >> 1) & 3;
+		bsize = hdr >> 3;
+		pos += 3;
+		if (type == 3 || bsize > WD_ZSTD_BLOCK_MAX)
+			return -1;
+		if (type != 2)
+			content += bsize;
+		pos += type == 1 ? 1 : bsize;
+	} while (!(hdr & 1));
+
+	/* only raw and RLE blocks tell their decoded size */
+	if (pos != size || content > TEST_SIZE)
+		return -1;
+
+	return 0;
+}
+
+static int check_round_trip(const char *name, __u32 size, void *zstd)
+{
+	zstd_decompress_t decompress;
+	zstd_is_error_t is_error;
+	size_t ret;
+
+	if (!zstd) {
+		if (check_frame(size)) {
+			printf("%s: bad zstd frame!\n", name);
+			return -1;
+		}
+		printf("%s: %u -> %u, frame checked\n", name, TEST_SIZE, size);
+		return 0;
+	}
+
+	decompress = (zstd_decompress_t)dlsym(zstd, "ZSTD_decompress");
+	is_error = (zstd_is_error_t)dlsym(zstd, "ZSTD_isError");
+	if (!decompress || !is_error) {
+		printf("libzstd has no ZSTD_decompress!\n");
+		return -1;
+	}
+
+	memset(out, 0, sizeof(out));
+	ret = decompress(out, sizeof(out), dst, size);
+	if (is_error(ret) || ret != TEST_SIZE || memcmp(out, src, TEST_SIZE)) {
+		printf("%s: libzstd decode doesn't match the input!\n", name);
+		return -1;
+	}
+	printf("%s: %u -> %u, decoded by libzstd\n", name, TEST_SIZE, size);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	void *zstd;
+	__u32 size;
+	int ret = 0;
+
+	fill_src();
+
+	zstd = dlopen("libzstd.so.1", RTLD_NOW);
+	if (!zstd)
+		printf("libzstd isn't found, only the frames are checked\n");
+
+	size = encode_frame(0);
+	if (!size || check_round_trip("sequential", size, zstd))
+		ret = -1;
+
+	size = encode_frame(1);
+	if (!size || check_round_trip("pipelined", size, zstd))
+		ret = -1;
+
+	if (zstd)
+		dlclose(zstd);
+
+	return ret;
+}
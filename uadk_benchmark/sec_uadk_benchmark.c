@@ -1041,6 +1041,7 @@ int sec_uadk_benchmark(struct acc_option *options)
 		return -EINVAL;
 	}
 
+	init_stat_start();
 	ret = init_ctx_config(options->algclass, options->subtype, options->syncmode);
 	if (ret)
 		return ret;
@@ -1048,6 +1049,7 @@ int sec_uadk_benchmark(struct acc_option *options)
 	ret = init_uadk_bd_pool();
 	if (ret)
 		return ret;
+	init_stat_end();
 
 	get_pid_cpu_time(&ptime);
 	time_start(options->times);
@@ -1167,9 +1167,11 @@ int sec_wd_benchmark(struct acc_option *options)
 		return -EINVAL;
 	}
 
+	init_stat_start();
 	ret = init_wd_queue(options);
 	if (ret)
 		return ret;
+	init_stat_end();
 
 	get_pid_cpu_time(&ptime);
 	time_start(options->times);
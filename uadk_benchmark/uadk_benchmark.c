@@ -7,6 +7,8 @@
 #include "sec_uadk_benchmark.h"
 #include "sec_wd_benchmark.h"
 #include "sec_soft_benchmark.h"
+#include "zip_uadk_benchmark.h"
+#include "zip_wd_benchmark.h"
 
 #define BYTES_TO_KB	10
 #define TABLE_SPACE_SIZE	8
@@ -20,8 +22,17 @@ static struct _recv_data {
 	u64 recv_cnt;
 	u32 send_times;
 	u32 recv_times;
+	u64 raw_bytes;
+	u64 comp_bytes;
 } g_recv_data;
 
+/* cost of setting up the ctxs and pools before the run */
+static struct _init_data {
+	struct timeval start;
+	double init_ms;
+	u64 init_rss;
+} g_init_data;
+
 /* SVA mode and NOSVA mode change need re_insmode driver ko */
 enum test_type {
 	SVA_MODE = 0x1,
@@ -144,12 +155,22 @@ u32 get_recv_time(void)
 	return g_recv_data.recv_times;
 }
 
+void add_comp_data(u64 raw_bytes, u64 comp_bytes)
+{
+	pthread_mutex_lock(&acc_mutex);
+	g_recv_data.raw_bytes += raw_bytes;
+	g_recv_data.comp_bytes += comp_bytes;
+	pthread_mutex_unlock(&acc_mutex);
+}
+
 void init_recv_data(void)
 {
 	g_recv_data.send_cnt = 0;
 	g_recv_data.recv_cnt = 0;
 	g_recv_data.send_times = 0;
 	g_recv_data.recv_times = 0;
+	g_recv_data.raw_bytes = 0;
+	g_recv_data.comp_bytes = 0;
 }
 
 int get_run_state(void)
@@ -287,6 +308,66 @@ void get_rand_data(u8 *addr, int size)
 	}
 }
 
+/* window size in KB to the index of wd_comp_winsz_type and wcrypto_comp_win_type */
+int get_comp_win_type(u32 winsize)
+{
+	switch(winsize) {
+	case 4:
+		return 0;
+	case 8:
+		return 1;
+	case 16:
+		return 2;
+	case 24:
+		return 3;
+	case 32:
+		return 4;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Fill the buffer with the next size bytes of the corpus file, reading again
+ * from its start at the end. Without a corpus file, the data is random but
+ * of 16 symbols only, so it compresses about 2:1.
+ */
+int get_comp_data(int fd, u8 *addr, u32 size)
+{
+	u32 done = 0;
+	bool wrapped = false;
+	ssize_t ret;
+	int i;
+
+	if (fd < 0) {
+		get_rand_data(addr, size);
+		for (i = 0; i < size; i++)
+			addr[i] = 'a' + (addr[i] & 0xF);
+		return 0;
+	}
+
+	while (done < size) {
+		ret = read(fd, addr + done, size - done);
+		if (ret < 0) {
+			ACC_TST_PRT("read input file fail: %d!\n", errno);
+			return -errno;
+		} else if (!ret) {
+			/* the file is empty if it ends right after wrapping */
+			if (wrapped) {
+				ACC_TST_PRT("input file is empty!\n");
+				return -EINVAL;
+			}
+			lseek(fd, 0, SEEK_SET);
+			wrapped = true;
+			continue;
+		}
+		wrapped = false;
+		done += ret;
+	}
+
+	return 0;
+}
+
 /*-------------------------------------main code------------------------------------------------------*/
 
 static void parse_alg_param(struct acc_option *option)
@@ -360,6 +441,40 @@ static void parse_alg_param(struct acc_option *option)
 	}
 }
 
+/* resident memory of the process in KB, 0 if it can't be read */
+static u64 get_rss_kb(void)
+{
+	unsigned long size, rss;
+	FILE *fp;
+	int ret;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (!fp)
+		return 0;
+
+	ret = fscanf(fp, "%lu %lu", &size, &rss);
+	fclose(fp);
+	if (ret != 2)
+		return 0;
+
+	return (u64)rss * (sysconf(_SC_PAGESIZE) >> BYTES_TO_KB);
+}
+
+void init_stat_start(void)
+{
+	gettimeofday(&g_init_data.start, NULL);
+}
+
+void init_stat_end(void)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	g_init_data.init_ms = (end.tv_sec - g_init_data.start.tv_sec) * 1000.0 +
+			      (end.tv_usec - g_init_data.start.tv_usec) / 1000.0;
+	g_init_data.init_rss = get_rss_kb();
+}
+
 void cal_perfermance_data(struct acc_option *option, u32 sttime)
 {
 	u8 palgname[MAX_ALG_NAME];
@@ -405,6 +520,14 @@ void cal_perfermance_data(struct acc_option *option, u32 sttime)
 	ACC_TST_PRT("algname:	length:		perf:		iops:		CPU_rate:\n"
 			"%s	%uBytes	%.1fKB/s	%.1fKops 	%.2f%%\n",
 			palgname, option->pktlen, perfermance, ops, cpu_rate);
+	if (option->acctype == ZIP_TYPE && g_recv_data.comp_bytes)
+		ACC_TST_PRT("compress ratio: %.2f\n",
+			    (double)g_recv_data.raw_bytes / g_recv_data.comp_bytes);
+	if (g_init_data.init_rss)
+		ACC_TST_PRT("init time: %.2fms	init RSS: %lluKB	run RSS: %lluKB\n",
+			    g_init_data.init_ms,
+			    (unsigned long long)g_init_data.init_rss,
+			    (unsigned long long)get_rss_kb());
 }
 
 static int benchmark_run(struct acc_option *option)
@@ -426,6 +549,11 @@ static int benchmark_run(struct acc_option *option)
 	case HPRE_TYPE:
 		break;
 	case ZIP_TYPE:
+		if (option->modetype & SVA_MODE) {
+			ret = zip_uadk_benchmark(option);
+		} else if (option->modetype & NOSVA_MODE) {
+			ret = zip_wd_benchmark(option);
+		}
 		break;
 	}
 
@@ -446,6 +574,11 @@ static void dump_param(struct acc_option *option)
 	ACC_TST_PRT("    [--algclass]:%s\n", option->algclass);
 	ACC_TST_PRT("    [--acctype]: %u\n", option->acctype);
 	ACC_TST_PRT("    [--engine]:  %s\n", option->engine);
+	if (option->acctype == ZIP_TYPE) {
+		ACC_TST_PRT("    [--winsize]: %uKB\n", option->winsize);
+		ACC_TST_PRT("    [--complevel]:%u\n", option->complevel);
+		ACC_TST_PRT("    [--input]:   %s\n", option->inputfile);
+	}
 }
 
 static int acc_benchmark_run(struct acc_option *option)
@@ -544,8 +677,9 @@ static void print_help(void)
 	ACC_TST_PRT("        The name of the algorithm for benchmarking\n");
 	ACC_TST_PRT("    [--mode sva/nosva/soft/sva-soft/nosva-soft]: start UADK or Warpdrive or Openssl mode test\n");
 	ACC_TST_PRT("    [--sync/--async]: start asynchronous/synchronous mode test\n");
-	ACC_TST_PRT("    [--optype 0/1]:\n");
+	ACC_TST_PRT("    [--optype 0/1/2/3]:\n");
 	ACC_TST_PRT("        encryption/decryption or compression/decompression\n");
+	ACC_TST_PRT("        2/3 is stream compression/decompression, sync mode only\n");
 	ACC_TST_PRT("    [--pktlen]:\n");
 	ACC_TST_PRT("        set the length of BD message in bytes\n");
 	ACC_TST_PRT("    [--seconds]:\n");
@@ -558,10 +692,18 @@ static void print_help(void)
 	ACC_TST_PRT("        the number of QP queues used by the entire test task\n");
 	ACC_TST_PRT("    [--engine]:\n");
 	ACC_TST_PRT("        set the test openssl engine\n");
+	ACC_TST_PRT("    [--winsize 4/8/16/24/32]:\n");
+	ACC_TST_PRT("        set the compression window size in KB, default 32\n");
+	ACC_TST_PRT("    [--complevel]:\n");
+	ACC_TST_PRT("        set the compression level, default 8\n");
+	ACC_TST_PRT("    [--input]:\n");
+	ACC_TST_PRT("        set the corpus file to compress, default random data\n");
 	ACC_TST_PRT("    [--help]  = usage\n");
 	ACC_TST_PRT("Example\n");
 	ACC_TST_PRT("    ./uadk_benchmark --alg aes-128-cbc --mode sva --optype 0 --sync\n");
 	ACC_TST_PRT("    	     --pktlen 1024 --seconds 1 --multi 1 --thread 1 --ctxnum 4\n");
+	ACC_TST_PRT("    ./uadk_benchmark --alg zlib --mode sva --optype 0 --async\n");
+	ACC_TST_PRT("    	     --pktlen 65536 --seconds 3 --thread 4 --ctxnum 4 --input ./corpus\n");
 	ACC_TST_PRT("UPDATE:2021-7-28\n");
 }
 
@@ -583,6 +725,9 @@ static void acc_cmd_parse(int argc, char *argv[], struct acc_option *option)
 		{"ctxnum",    required_argument, 0,  10},
 		{"engine",    required_argument,    0,11},
 		{"help",      no_argument,       0,  12},
+		{"winsize",   required_argument, 0,  13},
+		{"complevel", required_argument, 0,  14},
+		{"input",     required_argument, 0,  15},
 		{0, 0, 0, 0}
 	};
 
@@ -630,6 +775,15 @@ static void acc_cmd_parse(int argc, char *argv[], struct acc_option *option)
 		case 12:
 			print_help();
 			break;
+		case 13:
+			option->winsize = strtol(optarg, NULL, 0);
+			break;
+		case 14:
+			option->complevel = strtol(optarg, NULL, 0);
+			break;
+		case 15:
+			snprintf(option->inputfile, MAX_PATH_LENTH, "%s", optarg);
+			break;
 		default:
 			ACC_TST_PRT("bad input test parameter!\n");
 			print_help();
@@ -681,6 +835,19 @@ static int acc_option_convert(struct acc_option *option)
 	} else if (!option->ctxnums)
 		option->ctxnums = 1;
 
+	if (!option->winsize)
+		option->winsize = 32;
+	if (get_comp_win_type(option->winsize) < 0) {
+		ACC_TST_PRT("uadk benchmark window size is 4/8/16/24/32 KB\n");
+		goto param_err;
+	}
+
+	if (option->complevel > 15) {
+		ACC_TST_PRT("uadk benchmark max compression level is 15\n");
+		goto param_err;
+	} else if (!option->complevel)
+		option->complevel = 8;
+
 	option->engine_flag = true;
 	if (!strlen(option->engine)) {
 		option->engine_flag = false;
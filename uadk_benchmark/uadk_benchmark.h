@@ -28,6 +28,7 @@
 #define MAX_DATA_SIZE	(15 * 1024 * 1024)
 #define MAX_ALG_NAME 64
 #define ACC_QUEUE_SIZE	1024
+#define MAX_PATH_LENTH	256
 
 typedef unsigned char u8;
 typedef unsigned int u32;
@@ -39,6 +40,9 @@ typedef unsigned     long long   u64;
  * @algclass: 0:cipher 1:digest
  * @acctype: The sub alg type, reference func get_cipher_resource.
  * @syncmode: 0:sync mode 1:async mode
+ * @winsize: compression window size in KB, 4/8/16/24/32
+ * @complevel: compression level
+ * @inputfile: the corpus file compression data is read from
  */
 struct acc_option {
 	char  algname[64];
@@ -56,6 +60,9 @@ struct acc_option {
 	u32 subtype;
 	char  engine[64];
 	u32 engine_flag;
+	u32 winsize;
+	u32 complevel;
+	char  inputfile[MAX_PATH_LENTH];
 };
 
 enum acc_type {
@@ -83,6 +90,15 @@ enum sync_type {
 	ASYNC_MODE,
 };
 
+/* the optype of zip alg */
+enum zip_op_type {
+	COMPRESSION,
+	DECOMPRESSION,
+	STREAM_COMPRESSION,
+	STREAM_DECOMPRESSION,
+	ZIP_OP_MAX,
+};
+
 enum test_alg {
 	ZLIB, // zlib alg
 	GZIP, // gzip
@@ -162,6 +178,8 @@ extern void mdelay(u32 ms);
 extern int get_pid_cpu_time(u32 *ptime);
 extern void cal_perfermance_data(struct acc_option *option, u32 sttime);
 extern void time_start(u32 seconds);
+extern void init_stat_start(void);
+extern void init_stat_end(void);
 extern int get_run_state(void);
 extern void set_run_state(int state);
 extern int get_rand_int(int range);
@@ -169,5 +187,8 @@ extern void get_rand_data(u8 *addr, int size);
 extern void add_recv_data(u32 cnt);
 extern void add_send_complete(void);
 extern u32 get_recv_time(void);
+extern void add_comp_data(u64 raw_bytes, u64 comp_bytes);
+extern int get_comp_win_type(u32 winsize);
+extern int get_comp_data(int fd, u8 *addr, u32 size);
 
 #endif /* UADK_BENCHMARK_H */
@@ -0,0 +1,668 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include "uadk_benchmark.h"
+
+#include "zip_uadk_benchmark.h"
+#include "include/wd_comp.h"
+#include "include/wd_sched.h"
+
+#define ZIP_TST_PRT printf
+
+struct zip_bd {
+	u8 *src;
+	u8 *dst;
+	u32 src_len;
+	struct wd_lz77_zstd_data zstd_data;
+};
+
+struct bd_pool {
+	struct zip_bd *bds;
+};
+
+static struct thread_pool {
+	struct bd_pool *pool;
+} g_zip_pool;
+
+typedef struct uadk_thread_res {
+	u32 alg;
+	u32 comp_lv;
+	u32 win_sz;
+	u32 optype;
+	u32 td_id;
+	/* filled by the async callbacks */
+	u64 raw_bytes;
+	u64 comp_bytes;
+} thread_data;
+
+#define MAX_POOL_LENTH_COMP	512
+/* source data of one thread, the pool gets shorter for big packets */
+#define MAX_POOL_SIZE_COMP	(64 * 1024 * 1024)
+/* lz77_zstd outputs literals with 16 bytes more and 784 bytes frequency */
+#define COMP_DST_RSV_SIZE	1024
+/* packets of one stream in stream compression */
+#define STREAM_BLOCK_NUM	16
+#define MAX_TRY_CNT		5000
+#define SEND_USLEEP		100
+
+static struct wd_ctx_config g_ctx_cfg;
+static struct wd_sched *g_sched;
+static unsigned int g_thread_num;
+static unsigned int g_ctxnum;
+static unsigned int g_pktlen;
+static unsigned int g_dst_len;
+static unsigned int g_pool_len;
+static struct sched_params g_param;
+/* the sync compression ctx making the data of decompression */
+static struct sched_params g_prep_param;
+static thread_data g_threads_args[THREADS_NUM];
+
+static void *zip_async_cb(struct wd_comp_req *req, void *data)
+{
+	thread_data *pdata = (thread_data *)data;
+	u32 raw_len, comp_len;
+
+	if (req->op_type == WD_DIR_COMPRESS) {
+		raw_len = req->src_len;
+		comp_len = req->dst_len;
+	} else {
+		raw_len = req->dst_len;
+		comp_len = req->src_len;
+	}
+
+	/* only the poll thread calls back, it is joined before the sum */
+	pdata->raw_bytes += raw_len;
+	pdata->comp_bytes += comp_len;
+
+	return NULL;
+}
+
+static bool is_decomp(u32 optype)
+{
+	return optype == DECOMPRESSION || optype == STREAM_DECOMPRESSION;
+}
+
+static int zip_uadk_param_parse(thread_data *tddata, struct acc_option *options)
+{
+	u32 algtype = options->algtype;
+	u32 optype = options->optype;
+	u8 alg;
+
+	switch(algtype) {
+	case ZLIB:
+		alg = WD_ZLIB;
+		break;
+	case GZIP:
+		alg = WD_GZIP;
+		break;
+	case DEFLATE:
+		alg = WD_DEFLATE;
+		break;
+	case LZ77_ZSTD:
+		alg = WD_LZ77_ZSTD;
+		if (optype != COMPRESSION) {
+			ZIP_TST_PRT("lz77_zstd just support block compression\n");
+			return -EINVAL;
+		}
+		break;
+	default:
+		ZIP_TST_PRT("Fail to set zip alg\n");
+		return -EINVAL;
+	}
+
+	if (optype >= ZIP_OP_MAX) {
+		ZIP_TST_PRT("ZIP optype error: %u\n", optype);
+		return -EINVAL;
+	}
+
+	if (optype >= STREAM_COMPRESSION && options->syncmode == ASYNC_MODE) {
+		ZIP_TST_PRT("ZIP stream mode just support sync mode\n");
+		return -EINVAL;
+	}
+
+	tddata->alg = alg;
+	tddata->comp_lv = options->complevel;
+	tddata->win_sz = get_comp_win_type(options->winsize);
+	tddata->optype = optype;
+
+	return 0;
+}
+
+static int init_ctx_config(struct acc_option *options)
+{
+	u8 op_type = is_decomp(options->optype) ? WD_DIR_DECOMPRESS :
+			WD_DIR_COMPRESS;
+	u8 mode = options->syncmode;
+	struct uacce_dev_list *list;
+	u32 ctx_num = g_ctxnum;
+	int ret, i;
+
+	list = wd_get_accel_list(options->algclass);
+	if (!list) {
+		ZIP_TST_PRT("Fail to get %s device\n", options->algclass);
+		return -ENODEV;
+	}
+
+	if (op_type == WD_DIR_DECOMPRESS)
+		ctx_num++;
+
+	memset(&g_ctx_cfg, 0, sizeof(struct wd_ctx_config));
+	g_ctx_cfg.ctx_num = ctx_num;
+	g_ctx_cfg.ctxs = calloc(ctx_num, sizeof(struct wd_ctx));
+	if (!g_ctx_cfg.ctxs) {
+		ret = -ENOMEM;
+		goto free_list;
+	}
+
+	for (i = 0; i < ctx_num; i++) {
+		g_ctx_cfg.ctxs[i].ctx = wd_request_ctx(list->dev);
+		if (!g_ctx_cfg.ctxs[i].ctx) {
+			ZIP_TST_PRT("Fail to request ctx %d\n", i);
+			ret = -ENODEV;
+			goto free_ctxs;
+		}
+		g_ctx_cfg.ctxs[i].op_type = op_type;
+		g_ctx_cfg.ctxs[i].ctx_mode = mode;
+	}
+
+	/* the last ctx compresses the data to be decompressed */
+	if (op_type == WD_DIR_DECOMPRESS) {
+		g_ctx_cfg.ctxs[g_ctxnum].op_type = WD_DIR_COMPRESS;
+		g_ctx_cfg.ctxs[g_ctxnum].ctx_mode = CTX_MODE_SYNC;
+	}
+
+	g_sched = wd_sched_rr_alloc(SCHED_POLICY_RR, WD_DIR_MAX, MAX_NUMA_NUM,
+				    wd_comp_poll_ctx);
+	if (!g_sched) {
+		ZIP_TST_PRT("Fail to alloc sched!\n");
+		ret = -ENOMEM;
+		goto free_ctxs;
+	}
+
+	/* If there is no numa, we defualt config to zero */
+	if (list->dev->numa_id < 0)
+		list->dev->numa_id = 0;
+
+	g_sched->name = SCHED_SINGLE;
+	g_param.numa_id = list->dev->numa_id;
+	g_param.type = op_type;
+	g_param.mode = mode;
+	g_param.begin = 0;
+	g_param.end = g_ctxnum - 1;
+	ret = wd_sched_rr_instance(g_sched, &g_param);
+	if (ret) {
+		ZIP_TST_PRT("Fail to fill sched data!\n");
+		goto free_sched;
+	}
+
+	if (op_type == WD_DIR_DECOMPRESS) {
+		g_prep_param.numa_id = list->dev->numa_id;
+		g_prep_param.type = WD_DIR_COMPRESS;
+		g_prep_param.mode = CTX_MODE_SYNC;
+		g_prep_param.begin = g_ctxnum;
+		g_prep_param.end = g_ctxnum;
+		ret = wd_sched_rr_instance(g_sched, &g_prep_param);
+		if (ret) {
+			ZIP_TST_PRT("Fail to fill prepare sched data!\n");
+			goto free_sched;
+		}
+	}
+
+	ret = wd_comp_init(&g_ctx_cfg, g_sched);
+	if (ret) {
+		ZIP_TST_PRT("Fail to init comp ctx!\n");
+		goto free_sched;
+	}
+
+	wd_free_list_accels(list);
+
+	return 0;
+
+free_sched:
+	wd_sched_rr_release(g_sched);
+free_ctxs:
+	for (i = 0; i < ctx_num; i++)
+		if (g_ctx_cfg.ctxs[i].ctx)
+			wd_release_ctx(g_ctx_cfg.ctxs[i].ctx);
+	free(g_ctx_cfg.ctxs);
+free_list:
+	wd_free_list_accels(list);
+
+	return ret;
+}
+
+static void uninit_ctx_config(void)
+{
+	int i;
+
+	wd_comp_uninit();
+	for (i = 0; i < g_ctx_cfg.ctx_num; i++)
+		wd_release_ctx(g_ctx_cfg.ctxs[i].ctx);
+	free(g_ctx_cfg.ctxs);
+	wd_sched_rr_release(g_sched);
+}
+
+static void free_uadk_bd_pool(void)
+{
+	int i, j;
+
+	if (!g_zip_pool.pool)
+		return;
+
+	for (i = 0; i < g_thread_num; i++) {
+		if (g_zip_pool.pool[i].bds) {
+			for (j = 0; j < g_pool_len; j++) {
+				free(g_zip_pool.pool[i].bds[j].src);
+				free(g_zip_pool.pool[i].bds[j].dst);
+			}
+		}
+		free(g_zip_pool.pool[i].bds);
+		g_zip_pool.pool[i].bds = NULL;
+	}
+	free(g_zip_pool.pool);
+	g_zip_pool.pool = NULL;
+}
+
+/* compress the raw data in dst into src as the data to be decompressed */
+static int prepare_decomp_data(handle_t h_sess, struct zip_bd *bd)
+{
+	struct wd_comp_req creq = {0};
+	int ret;
+
+	creq.op_type = WD_DIR_COMPRESS;
+	creq.data_fmt = WD_FLAT_BUF;
+	creq.src = bd->dst;
+	creq.src_len = g_pktlen;
+	creq.dst = bd->src;
+	creq.dst_len = g_dst_len;
+
+	ret = wd_do_comp_sync(h_sess, &creq);
+	if (ret || creq.status == WD_IN_EPARA) {
+		ZIP_TST_PRT("Fail to compress the decompression data!\n");
+		return ret ? ret : -EINVAL;
+	}
+	bd->src_len = creq.dst_len;
+
+	return 0;
+}
+
+static int init_uadk_bd_pool(struct acc_option *options, thread_data *tddata)
+{
+	struct wd_comp_sess_setup setup = {0};
+	bool decomp = is_decomp(options->optype);
+	handle_t h_sess = 0;
+	struct zip_bd *bd;
+	int ret = 0;
+	int fd = -1;
+	int i, j;
+
+	if (strlen(options->inputfile)) {
+		fd = open(options->inputfile, O_RDONLY);
+		if (fd < 0) {
+			ZIP_TST_PRT("Fail to open input file %s!\n",
+				    options->inputfile);
+			return -errno;
+		}
+	}
+
+	if (decomp) {
+		setup.alg_type = tddata->alg;
+		setup.comp_lv = tddata->comp_lv;
+		setup.win_sz = tddata->win_sz;
+		setup.op_type = WD_DIR_COMPRESS;
+		setup.sched_param = (void *)&g_prep_param;
+		h_sess = wd_comp_alloc_sess(&setup);
+		if (!h_sess) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	g_zip_pool.pool = calloc(g_thread_num, sizeof(struct bd_pool));
+	if (!g_zip_pool.pool) {
+		ZIP_TST_PRT("init uadk pool alloc thread failed!\n");
+		ret = -ENOMEM;
+		goto free_sess;
+	}
+
+	for (i = 0; i < g_thread_num; i++) {
+		g_zip_pool.pool[i].bds = calloc(g_pool_len, sizeof(struct zip_bd));
+		if (!g_zip_pool.pool[i].bds) {
+			ret = -ENOMEM;
+			goto free_pool;
+		}
+
+		for (j = 0; j < g_pool_len; j++) {
+			bd = &g_zip_pool.pool[i].bds[j];
+			bd->src = malloc(g_dst_len);
+			bd->dst = malloc(g_dst_len);
+			if (!bd->src || !bd->dst) {
+				ret = -ENOMEM;
+				goto free_pool;
+			}
+
+			ret = get_comp_data(fd, decomp ? bd->dst : bd->src,
+					    g_pktlen);
+			if (ret)
+				goto free_pool;
+
+			if (decomp) {
+				ret = prepare_decomp_data(h_sess, bd);
+				if (ret)
+					goto free_pool;
+			} else {
+				bd->src_len = g_pktlen;
+			}
+		}
+	}
+
+	goto free_sess;
+
+free_pool:
+	ZIP_TST_PRT("init uadk bd pool failed!\n");
+	free_uadk_bd_pool();
+free_sess:
+	if (h_sess)
+		wd_comp_free_sess(h_sess);
+out:
+	if (fd >= 0)
+		close(fd);
+
+	return ret;
+}
+
+/*-------------------------------uadk benchmark main code-------------------------------------*/
+
+static void fill_zip_req(thread_data *pdata, struct wd_comp_req *creq,
+			 struct zip_bd *bd)
+{
+	creq->src = bd->src;
+	creq->src_len = bd->src_len;
+	creq->dst = bd->dst;
+	creq->dst_len = g_dst_len;
+	if (pdata->alg == WD_LZ77_ZSTD)
+		creq->priv = &bd->zstd_data;
+}
+
+void *zip_uadk_poll(void *data)
+{
+	u32 expt = ACC_QUEUE_SIZE * g_thread_num;
+	u32 last_time = 2; /* poll need one more recv time */
+	u32 count = 0;
+	u32 recv = 0;
+	u32 i = 0;
+	int  ret;
+
+	while (last_time) {
+		for (i = 0; i < g_ctxnum; i++) {
+			ret = wd_comp_poll_ctx(i, expt, &recv);
+			count += recv;
+			recv = 0;
+			if (unlikely(ret != -WD_EAGAIN && ret < 0)) {
+				ZIP_TST_PRT("poll ret: %d!\n", ret);
+				goto recv_error;
+			}
+		}
+
+		if (get_run_state() == 0)
+			last_time--;
+	}
+
+recv_error:
+	add_recv_data(count);
+
+	return NULL;
+}
+
+static handle_t zip_uadk_alloc_sess(thread_data *pdata)
+{
+	struct wd_comp_sess_setup setup = {0};
+
+	setup.alg_type = pdata->alg;
+	setup.comp_lv = pdata->comp_lv;
+	setup.win_sz = pdata->win_sz;
+	setup.op_type = is_decomp(pdata->optype) ? WD_DIR_DECOMPRESS :
+			WD_DIR_COMPRESS;
+	setup.sched_param = (void *)&g_param;
+
+	return wd_comp_alloc_sess(&setup);
+}
+
+static void *zip_uadk_async_run(void *arg)
+{
+	thread_data *pdata = (thread_data *)arg;
+	struct bd_pool *uadk_pool;
+	struct wd_comp_req creq;
+	int try_cnt = 0;
+	handle_t h_sess;
+	u32 count = 0;
+	int ret, i = 0;
+
+	if (pdata->td_id > g_thread_num)
+		return NULL;
+
+	uadk_pool = &g_zip_pool.pool[pdata->td_id];
+	h_sess = zip_uadk_alloc_sess(pdata);
+	if (!h_sess)
+		return NULL;
+
+	memset(&creq, 0, sizeof(creq));
+	creq.op_type = is_decomp(pdata->optype) ? WD_DIR_DECOMPRESS :
+		       WD_DIR_COMPRESS;
+	creq.data_fmt = WD_FLAT_BUF;
+	creq.cb = zip_async_cb;
+	creq.cb_param = pdata;
+
+	while(1) {
+		if (get_run_state() == 0)
+			break;
+
+		i = count % g_pool_len;
+		fill_zip_req(pdata, &creq, &uadk_pool->bds[i]);
+		ret = wd_do_comp_async(h_sess, &creq);
+		if (ret < 0) {
+			usleep(SEND_USLEEP * try_cnt);
+			try_cnt++;
+			if (try_cnt > MAX_TRY_CNT) {
+				ZIP_TST_PRT("Test comp send fail %d times!\n", MAX_TRY_CNT);
+				try_cnt = 0;
+			}
+			continue;
+		}
+		try_cnt = 0;
+		count++;
+	}
+	wd_comp_free_sess(h_sess);
+
+	add_send_complete();
+
+	return NULL;
+}
+
+static void *zip_uadk_sync_run(void *arg)
+{
+	thread_data *pdata = (thread_data *)arg;
+	struct bd_pool *uadk_pool;
+	struct wd_comp_req creq;
+	u64 raw_bytes = 0;
+	u64 comp_bytes = 0;
+	handle_t h_sess;
+	u32 count = 0;
+	int ret, i = 0;
+
+	if (pdata->td_id > g_thread_num)
+		return NULL;
+
+	uadk_pool = &g_zip_pool.pool[pdata->td_id];
+	h_sess = zip_uadk_alloc_sess(pdata);
+	if (!h_sess)
+		return NULL;
+
+	memset(&creq, 0, sizeof(creq));
+	creq.op_type = is_decomp(pdata->optype) ? WD_DIR_DECOMPRESS :
+		       WD_DIR_COMPRESS;
+	creq.data_fmt = WD_FLAT_BUF;
+
+	while(1) {
+		i = count % g_pool_len;
+		fill_zip_req(pdata, &creq, &uadk_pool->bds[i]);
+		switch(pdata->optype) {
+		case STREAM_COMPRESSION:
+			/* every STREAM_BLOCK_NUM packets make a stream */
+			creq.last = (count % STREAM_BLOCK_NUM) == STREAM_BLOCK_NUM - 1;
+			ret = wd_do_comp_strm(h_sess, &creq);
+			break;
+		case STREAM_DECOMPRESSION:
+			/* every packet is a whole compressed stream */
+			creq.last = 1;
+			ret = wd_do_comp_strm(h_sess, &creq);
+			break;
+		default:
+			ret = wd_do_comp_sync(h_sess, &creq);
+			break;
+		}
+		if (ret || creq.status == WD_IN_EPARA)
+			break;
+
+		count++;
+		if (creq.op_type == WD_DIR_COMPRESS) {
+			raw_bytes += creq.src_len;
+			comp_bytes += creq.dst_len;
+		} else {
+			raw_bytes += creq.dst_len;
+			comp_bytes += creq.src_len;
+		}
+		if (get_run_state() == 0)
+			break;
+	}
+	wd_comp_free_sess(h_sess);
+
+	add_comp_data(raw_bytes, comp_bytes);
+	add_recv_data(count);
+
+	return NULL;
+}
+
+int zip_uadk_sync_threads(thread_data *threads_option)
+{
+	pthread_t tdid[THREADS_NUM];
+	int i, ret;
+
+	for (i = 0; i < g_thread_num; i++) {
+		g_threads_args[i] = *threads_option;
+		g_threads_args[i].td_id = i;
+		ret = pthread_create(&tdid[i], NULL, zip_uadk_sync_run, &g_threads_args[i]);
+		if (ret) {
+			ZIP_TST_PRT("Create sync thread fail!\n");
+			goto sync_error;
+		}
+	}
+
+	/* join thread */
+	for (i = 0; i < g_thread_num; i++) {
+		ret = pthread_join(tdid[i], NULL);
+		if (ret) {
+			ZIP_TST_PRT("Join sync thread fail!\n");
+			goto sync_error;
+		}
+	}
+
+sync_error:
+	return ret;
+}
+
+int zip_uadk_async_threads(thread_data *threads_option)
+{
+	pthread_t tdid[THREADS_NUM];
+	pthread_t pollid;
+	int i, ret;
+
+	/* poll thread */
+	ret = pthread_create(&pollid, NULL, zip_uadk_poll, NULL);
+	if (ret) {
+		ZIP_TST_PRT("Create poll thread fail!\n");
+		goto async_error;
+	}
+
+	for (i = 0; i < g_thread_num; i++) {
+		g_threads_args[i] = *threads_option;
+		g_threads_args[i].td_id = i;
+		ret = pthread_create(&tdid[i], NULL, zip_uadk_async_run, &g_threads_args[i]);
+		if (ret) {
+			ZIP_TST_PRT("Create async thread fail!\n");
+			goto async_error;
+		}
+	}
+
+	/* join thread */
+	for (i = 0; i < g_thread_num; i++) {
+		ret = pthread_join(tdid[i], NULL);
+		if (ret) {
+			ZIP_TST_PRT("Join async thread fail!\n");
+			goto async_error;
+		}
+	}
+
+	ret = pthread_join(pollid, NULL);
+	if (ret) {
+		ZIP_TST_PRT("Join poll thread fail!\n");
+		goto async_error;
+	}
+
+	/* all the callbacks are done after the poll thread ends */
+	for (i = 0; i < g_thread_num; i++)
+		add_comp_data(g_threads_args[i].raw_bytes,
+			      g_threads_args[i].comp_bytes);
+
+async_error:
+	return ret;
+}
+
+int zip_uadk_benchmark(struct acc_option *options)
+{
+	thread_data threads_option = {0};
+	u32 ptime;
+	int ret;
+
+	g_thread_num = options->threads;
+	g_pktlen = options->pktlen;
+	g_ctxnum = options->ctxnums;
+	g_dst_len = g_pktlen * 2 + COMP_DST_RSV_SIZE;
+	g_pool_len = MAX_POOL_SIZE_COMP / g_pktlen;
+	if (g_pool_len > MAX_POOL_LENTH_COMP)
+		g_pool_len = MAX_POOL_LENTH_COMP;
+	else if (!g_pool_len)
+		g_pool_len = 1;
+
+	/* alg param parse and set to thread data */
+	ret = zip_uadk_param_parse(&threads_option, options);
+	if (ret)
+		return ret;
+
+	init_stat_start();
+	ret = init_ctx_config(options);
+	if (ret)
+		return ret;
+
+	ret = init_uadk_bd_pool(options, &threads_option);
+	if (ret) {
+		uninit_ctx_config();
+		return ret;
+	}
+	init_stat_end();
+
+	get_pid_cpu_time(&ptime);
+	time_start(options->times);
+	if (options->syncmode)
+		ret = zip_uadk_async_threads(&threads_option);
+	else
+		ret = zip_uadk_sync_threads(&threads_option);
+	cal_perfermance_data(options, ptime);
+	if (ret)
+		return ret;
+
+	/* stop the ctxs first, the requests left in them still use the bds */
+	uninit_ctx_config();
+	free_uadk_bd_pool();
+
+	return 0;
+}
@@ -0,0 +1,674 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include "uadk_benchmark.h"
+#include "zip_wd_benchmark.h"
+
+#include "v1/wd.h"
+#include "v1/wd_comp.h"
+#include "v1/wd_bmm.h"
+#include "v1/wd_util.h"
+
+#define ZIP_TST_PRT printf
+
+typedef struct wd_thread_res {
+	u32 alg;
+	u32 comp_lv;
+	u32 win_size;
+	u32 optype;
+	u32 td_id;
+	/* filled by the async callbacks */
+	u64 raw_bytes;
+	u64 comp_bytes;
+} thread_data;
+
+struct zip_bd {
+	void *in;
+	void *out;
+	u32 in_len;
+	struct wcrypto_lz77_zstd_format zstd_format;
+};
+
+struct thread_bd_res {
+	struct wd_queue *queue;
+	void *pool;
+	struct zip_bd *bds;
+};
+
+static struct thread_queue_res {
+	struct thread_bd_res *bd_res;
+} g_thread_queue;
+
+#define MAX_POOL_LENTH_COMP	512
+/* source data of one thread, the pool gets shorter for big packets */
+#define MAX_POOL_SIZE_COMP	(16 * 1024 * 1024)
+/* lz77_zstd outputs literals with 16 bytes more and 784 bytes frequency */
+#define COMP_DST_RSV_SIZE	1024
+/* packets of one stream in stream compression */
+#define STREAM_BLOCK_NUM	16
+#define MAX_TRY_CNT		5000
+#define SEND_USLEEP		100
+#define SQE_SIZE		128
+
+static unsigned int g_thread_num;
+static unsigned int g_pktlen;
+static unsigned int g_dst_len;
+static unsigned int g_pool_len;
+static thread_data g_threads_args[THREADS_NUM];
+
+static void zip_async_cb(const void *message, void *tag)
+{
+	const struct wcrypto_comp_msg *msg = message;
+	thread_data *pdata = tag;
+
+	/* only the poll thread calls back, it is joined before the sum */
+	if (msg->op_type == WCRYPTO_DEFLATE) {
+		pdata->raw_bytes += msg->in_cons;
+		pdata->comp_bytes += msg->produced;
+	} else {
+		pdata->raw_bytes += msg->produced;
+		pdata->comp_bytes += msg->in_cons;
+	}
+}
+
+static bool is_decomp(u32 optype)
+{
+	return optype == DECOMPRESSION || optype == STREAM_DECOMPRESSION;
+}
+
+static int zip_wd_param_parse(thread_data *tddata, struct acc_option *options)
+{
+	u32 algtype = options->algtype;
+	u32 optype = options->optype;
+	u8 alg;
+
+	switch(algtype) {
+	case ZLIB:
+		alg = WCRYPTO_ZLIB;
+		break;
+	case GZIP:
+		alg = WCRYPTO_GZIP;
+		break;
+	case DEFLATE:
+		alg = WCRYPTO_RAW_DEFLATE;
+		break;
+	case LZ77_ZSTD:
+		alg = WCRYPTO_LZ77_ZSTD;
+		if (optype != COMPRESSION) {
+			ZIP_TST_PRT("lz77_zstd just support block compression\n");
+			return -EINVAL;
+		}
+		break;
+	default:
+		ZIP_TST_PRT("Fail to set zip alg\n");
+		return -EINVAL;
+	}
+
+	if (optype >= ZIP_OP_MAX) {
+		ZIP_TST_PRT("ZIP optype error: %u\n", optype);
+		return -EINVAL;
+	}
+
+	if (optype >= STREAM_COMPRESSION && options->syncmode == ASYNC_MODE) {
+		ZIP_TST_PRT("ZIP stream mode just support sync mode\n");
+		return -EINVAL;
+	}
+
+	if (options->complevel > WCRYPTO_COMP_L9) {
+		ZIP_TST_PRT("warpdrive max compression level is 9\n");
+		return -EINVAL;
+	}
+
+	tddata->alg = alg;
+	tddata->comp_lv = options->complevel;
+	tddata->win_size = get_comp_win_type(options->winsize);
+	tddata->optype = optype;
+
+	return 0;
+}
+
+static struct wd_queue *request_zip_queue(char *alg, u32 direction)
+{
+	struct wd_queue *queue;
+	int ret;
+
+	queue = calloc(1, sizeof(struct wd_queue));
+	if (!queue)
+		return NULL;
+
+	queue->capa.alg = alg;
+	// 0 is COMP, 1 is DECOMP
+	queue->capa.priv.direction = direction;
+	ret = wd_request_queue(queue);
+	if (ret) {
+		free(queue);
+		return NULL;
+	}
+
+	return queue;
+}
+
+static void release_zip_queue(struct wd_queue *queue)
+{
+	wd_release_queue(queue);
+	free(queue);
+}
+
+static void set_comp_ctx_setup(struct wcrypto_comp_ctx_setup *setup,
+			       thread_data *pdata, void *pool)
+{
+	memset(setup, 0, sizeof(*setup));
+	setup->alg_type = pdata->alg;
+	setup->op_type = is_decomp(pdata->optype) ? WCRYPTO_INFLATE :
+			 WCRYPTO_DEFLATE;
+	setup->stream_mode = pdata->optype >= STREAM_COMPRESSION ?
+			     WCRYPTO_COMP_STATEFUL : WCRYPTO_COMP_STATELESS;
+	setup->comp_lv = pdata->comp_lv;
+	setup->win_size = pdata->win_size;
+	setup->cb = zip_async_cb;
+	setup->br.alloc = (void *)wd_alloc_blk;
+	setup->br.free = (void *)wd_free_blk;
+	setup->br.iova_map = (void *)wd_blk_iova_map;
+	setup->br.iova_unmap = (void *)wd_blk_iova_unmap;
+	setup->br.get_bufsize = (void *)wd_blksize;
+	setup->br.usr = pool;
+}
+
+struct zip_prep_res {
+	struct wd_queue *queue;
+	void *pool;
+	void *ctx;
+	void *in;
+	void *out;
+};
+
+static void uninit_prep_res(struct zip_prep_res *prep)
+{
+	if (prep->ctx)
+		wcrypto_del_comp_ctx(prep->ctx);
+	if (prep->in)
+		wd_free_blk(prep->pool, prep->in);
+	if (prep->out)
+		wd_free_blk(prep->pool, prep->out);
+	if (prep->pool)
+		wd_blkpool_destroy(prep->pool);
+	if (prep->queue)
+		release_zip_queue(prep->queue);
+}
+
+/* a sync compression queue making the data of decompression */
+static int init_prep_res(struct zip_prep_res *prep, thread_data *tddata,
+			 struct acc_option *options)
+{
+	struct wcrypto_comp_ctx_setup setup;
+	struct wd_blkpool_setup blksetup;
+	thread_data prep_data = *tddata;
+
+	memset(prep, 0, sizeof(*prep));
+	prep->queue = request_zip_queue(options->algclass, WCRYPTO_DEFLATE);
+	if (!prep->queue) {
+		ZIP_TST_PRT("request prepare queue fail!\n");
+		return -ENODEV;
+	}
+
+	memset(&blksetup, 0, sizeof(blksetup));
+	blksetup.block_size = g_dst_len;
+	blksetup.block_num = 2;
+	blksetup.align_size = SQE_SIZE;
+	prep->pool = wd_blkpool_create(prep->queue, &blksetup);
+	if (!prep->pool)
+		goto err;
+
+	prep->in = wd_alloc_blk(prep->pool);
+	prep->out = wd_alloc_blk(prep->pool);
+	if (!prep->in || !prep->out)
+		goto err;
+
+	prep_data.optype = COMPRESSION;
+	set_comp_ctx_setup(&setup, &prep_data, prep->pool);
+	prep->ctx = wcrypto_create_comp_ctx(prep->queue, &setup);
+	if (!prep->ctx)
+		goto err;
+
+	return 0;
+
+err:
+	ZIP_TST_PRT("init prepare resource fail!\n");
+	uninit_prep_res(prep);
+	return -ENOMEM;
+}
+
+static int prepare_decomp_data(struct zip_prep_res *prep, struct zip_bd *bd)
+{
+	struct wcrypto_comp_op_data opdata = {0};
+	int ret;
+
+	/* the raw data is in out now */
+	memcpy(prep->in, bd->out, g_pktlen);
+	opdata.in = prep->in;
+	opdata.in_len = g_pktlen;
+	opdata.out = prep->out;
+	opdata.avail_out = g_dst_len;
+	opdata.flush = WCRYPTO_FINISH;
+	opdata.stream_pos = WCRYPTO_COMP_STREAM_NEW;
+
+	ret = wcrypto_do_comp(prep->ctx, &opdata, NULL);
+	if (ret || opdata.status == WD_IN_EPARA) {
+		ZIP_TST_PRT("Fail to compress the decompression data!\n");
+		return ret ? ret : -EINVAL;
+	}
+
+	memcpy(bd->in, prep->out, opdata.produced);
+	bd->in_len = opdata.produced;
+
+	return 0;
+}
+
+static void uninit_wd_queue(void)
+{
+	struct thread_bd_res *bd_res;
+	int i, j;
+
+	if (!g_thread_queue.bd_res)
+		return;
+
+	for (i = 0; i < g_thread_num; i++) {
+		bd_res = &g_thread_queue.bd_res[i];
+		if (bd_res->bds) {
+			for (j = 0; j < g_pool_len; j++) {
+				if (bd_res->bds[j].in)
+					wd_free_blk(bd_res->pool, bd_res->bds[j].in);
+				if (bd_res->bds[j].out)
+					wd_free_blk(bd_res->pool, bd_res->bds[j].out);
+			}
+			free(bd_res->bds);
+		}
+		if (bd_res->pool)
+			wd_blkpool_destroy(bd_res->pool);
+		if (bd_res->queue)
+			release_zip_queue(bd_res->queue);
+	}
+
+	free(g_thread_queue.bd_res);
+	g_thread_queue.bd_res = NULL;
+}
+
+static int init_wd_queue(struct acc_option *options, thread_data *tddata)
+{
+	u32 direction = is_decomp(options->optype) ? WCRYPTO_INFLATE :
+			WCRYPTO_DEFLATE;
+	struct wd_blkpool_setup blksetup;
+	struct thread_bd_res *bd_res;
+	struct zip_prep_res prep;
+	struct zip_bd *bd;
+	int fd = -1;
+	int i, j, ret;
+
+	if (strlen(options->inputfile)) {
+		fd = open(options->inputfile, O_RDONLY);
+		if (fd < 0) {
+			ZIP_TST_PRT("Fail to open input file %s!\n",
+				    options->inputfile);
+			return -errno;
+		}
+	}
+
+	if (direction == WCRYPTO_INFLATE) {
+		ret = init_prep_res(&prep, tddata, options);
+		if (ret)
+			goto close_fd;
+	}
+
+	g_thread_queue.bd_res = calloc(g_thread_num, sizeof(struct thread_bd_res));
+	if (!g_thread_queue.bd_res) {
+		ZIP_TST_PRT("malloc thread res memory fail!\n");
+		ret = -ENOMEM;
+		goto free_prep;
+	}
+
+	// use no-sva pbuffer
+	memset(&blksetup, 0, sizeof(blksetup));
+	blksetup.block_size = g_dst_len;
+	blksetup.block_num = g_pool_len * 2; //set pool in + out
+	blksetup.align_size = SQE_SIZE;
+	ZIP_TST_PRT("create pool memory: %u KB\n",
+		    (blksetup.block_num * blksetup.block_size) >> 10);
+
+	for (i = 0; i < g_thread_num; i++) {
+		bd_res = &g_thread_queue.bd_res[i];
+		bd_res->queue = request_zip_queue(options->algclass, direction);
+		if (!bd_res->queue) {
+			ZIP_TST_PRT("request queue %d fail!\n", i);
+			ret = -ENODEV;
+			goto queue_err;
+		}
+
+		bd_res->pool = wd_blkpool_create(bd_res->queue, &blksetup);
+		if (!bd_res->pool) {
+			ZIP_TST_PRT("create %dth pool fail!\n", i);
+			ret = -ENOMEM;
+			goto queue_err;
+		}
+
+		bd_res->bds = calloc(g_pool_len, sizeof(struct zip_bd));
+		if (!bd_res->bds) {
+			ret = -ENOMEM;
+			goto queue_err;
+		}
+
+		for (j = 0; j < g_pool_len; j++) {
+			bd = &bd_res->bds[j];
+			bd->in = wd_alloc_blk(bd_res->pool);
+			bd->out = wd_alloc_blk(bd_res->pool);
+			if (!bd->in || !bd->out) {
+				ZIP_TST_PRT("create pool %dth memory fail!\n", i);
+				ret = -ENOMEM;
+				goto queue_err;
+			}
+
+			ret = get_comp_data(fd, direction == WCRYPTO_INFLATE ?
+					    bd->out : bd->in, g_pktlen);
+			if (ret)
+				goto queue_err;
+
+			if (direction == WCRYPTO_INFLATE) {
+				ret = prepare_decomp_data(&prep, bd);
+				if (ret)
+					goto queue_err;
+			} else {
+				bd->in_len = g_pktlen;
+			}
+		}
+	}
+
+	goto free_prep;
+
+queue_err:
+	uninit_wd_queue();
+free_prep:
+	if (direction == WCRYPTO_INFLATE)
+		uninit_prep_res(&prep);
+close_fd:
+	if (fd >= 0)
+		close(fd);
+
+	return ret;
+}
+
+/*-------------------------------uadk benchmark main code-------------------------------------*/
+
+static void fill_zip_opdata(thread_data *pdata, struct wcrypto_comp_op_data *opdata,
+			    struct zip_bd *bd)
+{
+	opdata->in = bd->in;
+	opdata->in_len = bd->in_len;
+	opdata->out = bd->out;
+	opdata->avail_out = g_dst_len;
+	opdata->priv = &bd->zstd_format;
+}
+
+void *zip_wd_poll(void *data)
+{
+	u32 expt = ACC_QUEUE_SIZE * g_thread_num;
+	u32 last_time = 2; /* poll need one more recv time */
+	u32 count = 0;
+	int recv = 0;
+	u32 i = 0;
+
+	while (last_time) {
+		for (i = 0; i < g_thread_num; i++) {
+			recv = wcrypto_comp_poll(g_thread_queue.bd_res[i].queue, expt);
+			if (unlikely(recv < 0)) {
+				ZIP_TST_PRT("poll ret: %d!\n", recv);
+				goto recv_error;
+			}
+			count += recv;
+			recv = 0;
+		}
+
+		if (get_run_state() == 0)
+			last_time--;
+	}
+
+recv_error:
+	add_recv_data(count);
+
+	return NULL;
+}
+
+static void *zip_wd_async_run(void *arg)
+{
+	thread_data *pdata = (thread_data *)arg;
+	struct wcrypto_comp_ctx_setup setup;
+	struct wcrypto_comp_op_data opdata;
+	struct thread_bd_res *bd_res;
+	void *ctx = NULL;
+	int try_cnt = 0;
+	u32 count = 0;
+	int ret, i = 0;
+
+	if (pdata->td_id > g_thread_num)
+		return NULL;
+
+	bd_res = &g_thread_queue.bd_res[pdata->td_id];
+	set_comp_ctx_setup(&setup, pdata, bd_res->pool);
+	ctx = wcrypto_create_comp_ctx(bd_res->queue, &setup);
+	if (!ctx) {
+		ZIP_TST_PRT("wd create comp ctx fail!\n");
+		return NULL;
+	}
+
+	memset(&opdata, 0, sizeof(opdata));
+	opdata.alg_type = pdata->alg;
+	opdata.flush = WCRYPTO_FINISH;
+	opdata.stream_pos = WCRYPTO_COMP_STREAM_NEW;
+
+	while(1) {
+		if (get_run_state() == 0)
+			break;
+
+		i = count % g_pool_len;
+		fill_zip_opdata(pdata, &opdata, &bd_res->bds[i]);
+		ret = wcrypto_do_comp(ctx, &opdata, pdata);
+		if (ret == -WD_EBUSY) {
+			usleep(SEND_USLEEP * try_cnt);
+			try_cnt++;
+			if (try_cnt > MAX_TRY_CNT) {
+				ZIP_TST_PRT("Test comp send fail %d times!\n", MAX_TRY_CNT);
+				try_cnt = 0;
+			}
+			continue;
+		} else if (ret) {
+			break;
+		}
+		try_cnt = 0;
+		count++;
+	}
+	wcrypto_del_comp_ctx(ctx);
+
+	add_send_complete();
+
+	return NULL;
+}
+
+static void *zip_wd_sync_run(void *arg)
+{
+	thread_data *pdata = (thread_data *)arg;
+	struct wcrypto_comp_ctx_setup setup;
+	struct wcrypto_comp_op_data opdata;
+	struct thread_bd_res *bd_res;
+	u64 raw_bytes = 0;
+	u64 comp_bytes = 0;
+	void *ctx = NULL;
+	u32 count = 0;
+	int ret, i = 0;
+
+	if (pdata->td_id > g_thread_num)
+		return NULL;
+
+	bd_res = &g_thread_queue.bd_res[pdata->td_id];
+	set_comp_ctx_setup(&setup, pdata, bd_res->pool);
+	ctx = wcrypto_create_comp_ctx(bd_res->queue, &setup);
+	if (!ctx) {
+		ZIP_TST_PRT("wd create comp ctx fail!\n");
+		return NULL;
+	}
+
+	memset(&opdata, 0, sizeof(opdata));
+	opdata.alg_type = pdata->alg;
+	opdata.flush = WCRYPTO_FINISH;
+	opdata.stream_pos = WCRYPTO_COMP_STREAM_NEW;
+
+	while(1) {
+		i = count % g_pool_len;
+		fill_zip_opdata(pdata, &opdata, &bd_res->bds[i]);
+		if (pdata->optype == STREAM_COMPRESSION) {
+			/* every STREAM_BLOCK_NUM packets make a stream */
+			opdata.stream_pos = (count % STREAM_BLOCK_NUM) ?
+					    WCRYPTO_COMP_STREAM_OLD :
+					    WCRYPTO_COMP_STREAM_NEW;
+			opdata.flush = (count % STREAM_BLOCK_NUM) == STREAM_BLOCK_NUM - 1 ?
+				       WCRYPTO_FINISH : WCRYPTO_SYNC_FLUSH;
+			if (opdata.stream_pos == WCRYPTO_COMP_STREAM_NEW) {
+				opdata.isize = 0;
+				opdata.checksum = 0;
+			}
+		}
+
+		ret = wcrypto_do_comp(ctx, &opdata, NULL);
+		if (ret || opdata.status == WD_IN_EPARA)
+			break;
+
+		count++;
+		if (is_decomp(pdata->optype)) {
+			raw_bytes += opdata.produced;
+			comp_bytes += opdata.consumed;
+		} else {
+			raw_bytes += opdata.consumed;
+			comp_bytes += opdata.produced;
+		}
+		if (get_run_state() == 0)
+			break;
+	}
+	wcrypto_del_comp_ctx(ctx);
+
+	add_comp_data(raw_bytes, comp_bytes);
+	add_recv_data(count);
+
+	return NULL;
+}
+
+int zip_wd_sync_threads(thread_data *threads_option)
+{
+	pthread_t tdid[THREADS_NUM];
+	int i, ret;
+
+	for (i = 0; i < g_thread_num; i++) {
+		g_threads_args[i] = *threads_option;
+		g_threads_args[i].td_id = i;
+		ret = pthread_create(&tdid[i], NULL, zip_wd_sync_run, &g_threads_args[i]);
+		if (ret) {
+			ZIP_TST_PRT("Create sync thread fail!\n");
+			goto sync_error;
+		}
+	}
+
+	/* join thread */
+	for (i = 0; i < g_thread_num; i++) {
+		ret = pthread_join(tdid[i], NULL);
+		if (ret) {
+			ZIP_TST_PRT("Join sync thread fail!\n");
+			goto sync_error;
+		}
+	}
+
+sync_error:
+	return ret;
+}
+
+int zip_wd_async_threads(thread_data *threads_option)
+{
+	pthread_t tdid[THREADS_NUM];
+	pthread_t pollid;
+	int i, ret;
+
+	/* poll thread */
+	ret = pthread_create(&pollid, NULL, zip_wd_poll, NULL);
+	if (ret) {
+		ZIP_TST_PRT("Create poll thread fail!\n");
+		goto async_error;
+	}
+
+	for (i = 0; i < g_thread_num; i++) {
+		g_threads_args[i] = *threads_option;
+		g_threads_args[i].td_id = i;
+		ret = pthread_create(&tdid[i], NULL, zip_wd_async_run, &g_threads_args[i]);
+		if (ret) {
+			ZIP_TST_PRT("Create async thread fail!\n");
+			goto async_error;
+		}
+	}
+
+	/* join thread */
+	for (i = 0; i < g_thread_num; i++) {
+		ret = pthread_join(tdid[i], NULL);
+		if (ret) {
+			ZIP_TST_PRT("Join async thread fail!\n");
+			goto async_error;
+		}
+	}
+
+	ret = pthread_join(pollid, NULL);
+	if (ret) {
+		ZIP_TST_PRT("Join poll thread fail!\n");
+		goto async_error;
+	}
+
+	/* all the callbacks are done after the poll thread ends */
+	for (i = 0; i < g_thread_num; i++)
+		add_comp_data(g_threads_args[i].raw_bytes,
+			      g_threads_args[i].comp_bytes);
+
+async_error:
+	return ret;
+}
+
+int zip_wd_benchmark(struct acc_option *options)
+{
+	thread_data threads_option = {0};
+	u32 ptime;
+	int ret;
+
+	g_thread_num = options->threads;
+	g_pktlen = options->pktlen;
+	g_dst_len = g_pktlen * 2 + COMP_DST_RSV_SIZE;
+	g_pool_len = MAX_POOL_SIZE_COMP / g_pktlen;
+	if (g_pool_len > MAX_POOL_LENTH_COMP)
+		g_pool_len = MAX_POOL_LENTH_COMP;
+	else if (!g_pool_len)
+		g_pool_len = 1;
+
+	/* alg param parse and set to thread data */
+	ret = zip_wd_param_parse(&threads_option, options);
+	if (ret)
+		return ret;
+
+	init_stat_start();
+	ret = init_wd_queue(options, &threads_option);
+	if (ret)
+		return ret;
+	init_stat_end();
+
+	get_pid_cpu_time(&ptime);
+	time_start(options->times);
+	if (options->syncmode)
+		ret = zip_wd_async_threads(&threads_option);
+	else
+		ret = zip_wd_sync_threads(&threads_option);
+	cal_perfermance_data(options, ptime);
+	if (ret)
+		return ret;
+
+	uninit_wd_queue();
+
+	return 0;
+}
@@ -12,15 +12,42 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <numa.h>
 #include <sched.h>
+#include <pthread.h>
 
 #include "wd.h"
 #include "wd_alg_common.h"
+#include "wd_util.h"
 
 #define SYS_CLASS_DIR			"/sys/class/uacce"
+#define LOOPBACK_ENV			"WD_LOOPBACK"
+#define LOOPBACK_DEV_NAME		"loopback"
+/* algorithms served by the software loopback drivers */
+#define LOOPBACK_ALGS			"zlib\ngzip\ndeflate\ncipher\ndigest\naead\n"
+#define LOOPBACK_AVAIL_CTX		1024
+#define CTX_STATS_SHM_ENV		"WD_CTX_STATS_SHM"
+#define CTX_STATS_LAT_ENV		"WD_CTX_STATS_LAT"
+#define CTX_STATS_SHM_PATH		"/dev/shm/wd_ctx_stats"
+/* ctxs a process can export at the same time */
+#define CTX_STATS_SHM_AREAS		1024
+#define PREFAULT_ENV			"WD_SVA_PREFAULT"
+/* the submit prefault remembers the pages it touched in 64KB chunks */
+#define PREFAULT_CHUNK_SHIFT		16
+#define PREFAULT_CHUNK_SIZE		(1UL << PREFAULT_CHUNK_SHIFT)
+#define PREFAULT_SEEN_NUM		4096
+/* a bit for each page of a chunk, 16 pages of 4KB at most */
+#define PREFAULT_PAGE_BITS		16
+#define PREFAULT_PAGE_MASK		((1ULL << PREFAULT_PAGE_BITS) - 1)
+#define LOOPBACK_NOSVA_ENV		"WD_LOOPBACK_NOSVA"
+/* GET_SS_DMA returns the dma address and the 64KB units of a slice */
+#define SS_GRAN_SHIFT			16
+#define SS_GRAN_SIZE			(1UL << SS_GRAN_SHIFT)
+#define SS_GRAN_NUM_MASK		0xfffUL
+#define SS_SLICE_MAX			64
 
 const char *WD_VERSION = UADK_VERSION_NUMBER;
 
@@ -33,8 +60,48 @@ struct wd_ctx_h {
 	void *qfrs_base[UACCE_QFRT_MAX];
 	struct uacce_dev *dev;
 	void *priv;
+	struct wd_ctx_stats_area *stats;
+	struct wd_ss_region *ss;
 };
 
+/* the dma addresses are contiguous in one slice of the reserved memory */
+struct wd_ss_slice {
+	void *va;
+	__u64 dma;
+	size_t size;
+};
+
+/* memory reserved for a ctx without SVA, see wd_ctx_reserve_mem() */
+struct wd_ss_region {
+	struct wd_ctx_h *ctx;
+	void *va;
+	size_t size;
+	__u32 slice_num;
+	struct wd_ss_slice slices[SS_SLICE_MAX];
+	struct wd_ss_region *next;
+};
+
+static struct wd_ctx_stats_shm *ctx_stats_shm;
+static char ctx_stats_path[PATH_STR_SIZE];
+static pthread_once_t ctx_stats_once = PTHREAD_ONCE_INIT;
+static int ctx_stats_lat;
+
+/*
+ * Direct mapped chunks touched before, entry = (chunk index + 1) <<
+ * PREFAULT_PAGE_BITS | bitmap of the pages touched. A chunk evicted by
+ * another one or a page bit lost in a race is only touched again, so no lock
+ * is needed.
+ */
+static __u64 prefault_seen[PREFAULT_SEEN_NUM];
+static struct wd_prefault_stat prefault_stat;
+static pthread_once_t prefault_once = PTHREAD_ONCE_INIT;
+static int prefault_en;
+static size_t prefault_page;
+
+/* reserved memory of all the ctxs, looked up by wd_ctx_iova_map() */
+static struct wd_ss_region *ss_regions;
+static pthread_rwlock_t ss_lock = PTHREAD_RWLOCK_INITIALIZER;
+
 static int get_raw_attr(const char *dev_root, const char *attr, char *buf,
 			size_t sz)
 {
@@ -286,12 +353,187 @@ static void free_uacce_dev(struct uacce_dev *dev)
 	free(dev);
 }
 
+static bool is_loopback_dev(struct uacce_dev *dev)
+{
+	return !strcmp(dev->char_dev_path, LOOPBACK_DEV_NAME);
+}
+
 static void wd_ctx_init_qfrs_offs(struct wd_ctx_h *ctx)
 {
 	memcpy(&ctx->qfrs_offs, &ctx->dev->qfrs_offs,
 	       sizeof(ctx->qfrs_offs));
 }
 
+static bool env_enabled(const char *name)
+{
+	const char *env = secure_getenv(name);
+
+	return env && strcmp(env, "0");
+}
+
+/* the export is best effort, the areas fall back to the heap on failure */
+static void ctx_stats_shm_init(void)
+{
+	char *path = ctx_stats_path;
+	struct wd_ctx_stats_shm *shm;
+	size_t size;
+	int fd;
+
+	ctx_stats_lat = env_enabled(CTX_STATS_LAT_ENV);
+	if (!env_enabled(CTX_STATS_SHM_ENV))
+		return;
+
+	/*
+	 * The name is a new file of this process. One already there, even a
+	 * link, is left alone: it isn't ours to overwrite or to unlink.
+	 */
+	snprintf(path, PATH_STR_SIZE, "%s.%d", CTX_STATS_SHM_PATH, getpid());
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+		  0644);
+	if (fd < 0) {
+		if (errno == EEXIST)
+			WD_ERR("%s exists, ctx stats are disabled!\n", path);
+		else
+			WD_ERR("failed to create %s (%d)!\n", path, -errno);
+		path[0] = '\0';
+		return;
+	}
+
+	size = sizeof(*shm) + CTX_STATS_SHM_AREAS *
+	       sizeof(struct wd_ctx_stats_area);
+	if (ftruncate(fd, size)) {
+		WD_ERR("failed to size %s (%d)!\n", path, -errno);
+		goto unlink;
+	}
+
+	shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) {
+		WD_ERR("failed to map %s (%d)!\n", path, -errno);
+		goto unlink;
+	}
+
+	shm->version = WD_CTX_STATS_SHM_VERSION;
+	shm->area_num = CTX_STATS_SHM_AREAS;
+	shm->area_size = sizeof(struct wd_ctx_stats_area);
+	/* the tool takes the file as valid once the magic is there */
+	__atomic_store_n(&shm->magic, WD_CTX_STATS_SHM_MAGIC, __ATOMIC_RELEASE);
+	ctx_stats_shm = shm;
+	close(fd);
+	return;
+
+unlink:
+	unlink(path);
+	path[0] = '\0';
+	close(fd);
+}
+
+static void __attribute__((destructor)) ctx_stats_shm_exit(void)
+{
+	/* the counters are gone with the process */
+	if (ctx_stats_path[0])
+		unlink(ctx_stats_path);
+}
+
+static struct wd_ctx_stats_area *ctx_stats_alloc(struct wd_ctx_h *ctx)
+{
+	struct wd_ctx_stats_area *area = NULL;
+	__u32 i, free_area;
+
+	pthread_once(&ctx_stats_once, ctx_stats_shm_init);
+
+	for (i = 0; ctx_stats_shm && i < CTX_STATS_SHM_AREAS; i++) {
+		free_area = 0;
+		if (__atomic_compare_exchange_n(&ctx_stats_shm->areas[i].in_use,
+						&free_area, 1, false,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED)) {
+			area = &ctx_stats_shm->areas[i];
+			break;
+		}
+	}
+
+	if (!area) {
+		area = calloc(1, sizeof(*area));
+		if (!area)
+			return NULL;
+		area->in_use = 1;
+	}
+
+	area->lat_en = ctx_stats_lat;
+	strncpy(area->dev_name, ctx->dev_name, MAX_DEV_NAME_LEN - 1);
+
+	return area;
+}
+
+static void ctx_stats_free(struct wd_ctx_stats_area *area)
+{
+	struct wd_ctx_stats_area *areas;
+
+	if (!area)
+		return;
+
+	areas = ctx_stats_shm ? ctx_stats_shm->areas : NULL;
+	if (areas && area >= areas && area < areas + CTX_STATS_SHM_AREAS) {
+		memset((void *)area + sizeof(area->in_use), 0,
+		       sizeof(*area) - sizeof(area->in_use));
+		__atomic_store_n(&area->in_use, 0, __ATOMIC_RELEASE);
+		return;
+	}
+
+	free(area);
+}
+
+/*
+ * There is no char device behind a loopback ctx, an eventfd stands in for it
+ * so that wd_ctx_wait() can sleep until the driver calls wd_ctx_notify().
+ */
+static handle_t request_loopback_ctx(struct uacce_dev *dev)
+{
+	struct wd_ctx_h	*ctx;
+
+	ctx = calloc(1, sizeof(struct wd_ctx_h));
+	if (!ctx)
+		return 0;
+
+	ctx->dev_name = strdup(LOOPBACK_DEV_NAME);
+	if (!ctx->dev_name)
+		goto free_ctx;
+
+	ctx->drv_name = strdup(LOOPBACK_DEV_NAME);
+	if (!ctx->drv_name)
+		goto free_dev_name;
+
+	ctx->dev = clone_uacce_dev(dev);
+	if (!ctx->dev)
+		goto free_drv_name;
+
+	strncpy(ctx->dev_path, LOOPBACK_DEV_NAME, MAX_DEV_NAME_LEN - 1);
+
+	ctx->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ctx->fd < 0) {
+		WD_ERR("failed to create loopback eventfd (%d).\n", -errno);
+		goto free_dev;
+	}
+
+	ctx->stats = ctx_stats_alloc(ctx);
+	if (!ctx->stats) {
+		close(ctx->fd);
+		goto free_dev;
+	}
+
+	return (handle_t)ctx;
+
+free_dev:
+	free_uacce_dev(ctx->dev);
+free_drv_name:
+	free(ctx->drv_name);
+free_dev_name:
+	free(ctx->dev_name);
+free_ctx:
+	free(ctx);
+	return 0;
+}
+
 handle_t wd_request_ctx(struct uacce_dev *dev)
 {
 	struct wd_ctx_h	*ctx;
@@ -301,6 +543,9 @@ handle_t wd_request_ctx(struct uacce_dev *dev)
 	if (!dev || !strlen(dev->dev_root))
 		return 0;
 
+	if (is_loopback_dev(dev))
+		return request_loopback_ctx(dev);
+
 	ptrRet = realpath(dev->char_dev_path, char_dev_path);
 	if (ptrRet == NULL)
 		return 0;
@@ -332,6 +577,12 @@ handle_t wd_request_ctx(struct uacce_dev *dev)
 		goto free_dev;
 	}
 
+	ctx->stats = ctx_stats_alloc(ctx);
+	if (!ctx->stats) {
+		close(ctx->fd);
+		goto free_dev;
+	}
+
 	return (handle_t)ctx;
 
 free_dev:
@@ -345,6 +596,28 @@ free_ctx:
 	return 0;
 }
 
+static void ss_region_release(struct wd_ctx_h *ctx)
+{
+	struct wd_ss_region **pos;
+	struct wd_ss_region *rgn = ctx->ss;
+
+	if (!rgn)
+		return;
+
+	pthread_rwlock_wrlock(&ss_lock);
+	for (pos = &ss_regions; *pos; pos = &(*pos)->next) {
+		if (*pos == rgn) {
+			*pos = rgn->next;
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&ss_lock);
+
+	munmap(rgn->va, rgn->size);
+	free(rgn);
+	ctx->ss = NULL;
+}
+
 void wd_release_ctx(handle_t h_ctx)
 {
 	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
@@ -352,7 +625,9 @@ void wd_release_ctx(handle_t h_ctx)
 	if (!ctx)
 		return;
 
+	ss_region_release(ctx);
 	close(ctx->fd);
+	ctx_stats_free(ctx->stats);
 	free(ctx->dev);
 	free(ctx->drv_name);
 	free(ctx->dev_name);
@@ -465,6 +740,7 @@ int wd_ctx_wait(handle_t h_ctx, __u16 ms)
 {
 	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
 	struct pollfd fds[1];
+	eventfd_t val;
 	int ret;
 
 	if (!ctx)
@@ -476,9 +752,103 @@ int wd_ctx_wait(handle_t h_ctx, __u16 ms)
 	if (ret == -1)
 		return -errno;
 
+	/* consume the completions, the caller polls the queue after waking */
+	if (ret > 0 && is_loopback_dev(ctx->dev))
+		(void)eventfd_read(ctx->fd, &val);
+
 	return ret;
 }
 
+int wd_ctx_notify(handle_t h_ctx)
+{
+	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
+
+	if (!ctx || !is_loopback_dev(ctx->dev))
+		return -WD_EINVAL;
+
+	if (eventfd_write(ctx->fd, 1))
+		return -errno;
+
+	return 0;
+}
+
+struct wd_ctx_stats_area *wd_ctx_get_stats_area(handle_t h_ctx)
+{
+	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
+
+	return ctx ? ctx->stats : NULL;
+}
+
+void wd_ctx_stats_add(struct wd_ctx_stats_area *area,
+		      struct wd_ctx_stats *stats)
+{
+	struct wd_ctx_queue_stats *queue = &area->queue;
+	struct wd_ctx_req_stats *req;
+	__u32 i, j, peak, status;
+
+#define STATS_ADD(sum, cnt)	((sum) += __atomic_load_n(&(cnt), __ATOMIC_RELAXED))
+	STATS_ADD(stats->queue.send_num, queue->send_num);
+	STATS_ADD(stats->queue.busy_num, queue->busy_num);
+	STATS_ADD(stats->queue.recv_num, queue->recv_num);
+	STATS_ADD(stats->queue.empty_num, queue->empty_num);
+	STATS_ADD(stats->queue.sva_err_num, queue->sva_err_num);
+	STATS_ADD(stats->queue.inflight, queue->inflight);
+	for (j = 0; j < WD_CTX_LAT_BUCKETS; j++)
+		STATS_ADD(stats->queue.lat[j], queue->lat[j]);
+
+	peak = __atomic_load_n(&queue->inflight_peak, __ATOMIC_RELAXED);
+	if (peak > stats->queue.inflight_peak)
+		stats->queue.inflight_peak = peak;
+
+	status = __atomic_load_n(&queue->sva_status, __ATOMIC_RELAXED);
+	if (status)
+		stats->queue.sva_status = status;
+
+	for (i = 0; i < WD_CTX_STATS_SHARDS; i++) {
+		req = &area->req[i];
+		STATS_ADD(stats->req.sync_num, req->sync_num);
+		STATS_ADD(stats->req.async_num, req->async_num);
+		STATS_ADD(stats->req.busy_num, req->busy_num);
+		STATS_ADD(stats->req.spin_num, req->spin_num);
+		for (j = 0; j < WD_CTX_LAT_BUCKETS; j++)
+			STATS_ADD(stats->req.lat[j], req->lat[j]);
+	}
+#undef STATS_ADD
+}
+
+struct wd_ctx_req_stats *wd_ctx_req_shard(struct wd_ctx_stats_area *area)
+{
+	static __thread __u32 shard_id;
+	static __u32 shard_next;
+
+	if (!shard_id)
+		shard_id = __atomic_add_fetch(&shard_next, 1, __ATOMIC_RELAXED);
+
+	return &area->req[(shard_id - 1) % WD_CTX_STATS_SHARDS];
+}
+
+int wd_ctx_get_stats(handle_t h_ctx, struct wd_ctx_stats *stats)
+{
+	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
+
+	if (!ctx || !stats) {
+		WD_ERR("invalid: ctx or stats is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	wd_ctx_stats_add(ctx->stats, stats);
+
+	return 0;
+}
+
+int wd_is_loopback(void)
+{
+	const char *env = getenv(LOOPBACK_ENV);
+
+	return env && strcmp(env, "0");
+}
+
 int wd_is_sva(handle_t h_ctx)
 {
 	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
@@ -492,6 +862,391 @@ int wd_is_sva(handle_t h_ctx)
 	return 0;
 }
 
+static void ss_add_slice(struct wd_ss_region *rgn, void *va, __u64 dma,
+			 size_t size)
+{
+	struct wd_ss_slice *last = rgn->slices + rgn->slice_num - 1;
+
+	/* merge the slices contiguous in both va and dma */
+	if (rgn->slice_num && last->va + last->size == va &&
+	    last->dma + last->size == dma) {
+		last->size += size;
+		return;
+	}
+
+	rgn->slices[rgn->slice_num].va = va;
+	rgn->slices[rgn->slice_num].dma = dma;
+	rgn->slices[rgn->slice_num].size = size;
+	rgn->slice_num++;
+}
+
+static int ss_get_slices(struct wd_ctx_h *ctx, struct wd_ss_region *rgn)
+{
+	bool iommu = !strstr(ctx->dev->api, UACCE_API_VER_NOIOMMU_SUBFIX);
+	unsigned long info;
+	size_t off = 0, size;
+	__u32 i;
+	int ret;
+
+	for (i = 0; i < SS_SLICE_MAX && off < rgn->size; i++) {
+		info = i;
+		ret = ioctl(ctx->fd, UACCE_CMD_GET_SS_DMA, &info);
+		if (ret < 0) {
+			WD_ERR("failed to get dma of slice %u on %s (%d).\n",
+			       i, ctx->dev_path, -errno);
+			return -WD_EINVAL;
+		}
+
+		/* the iommu maps the whole region contiguously */
+		size = iommu ? rgn->size :
+		       (info & SS_GRAN_NUM_MASK) << SS_GRAN_SHIFT;
+		if (!size || size > rgn->size - off)
+			size = rgn->size - off;
+
+		ss_add_slice(rgn, rgn->va + off, info & ~SS_GRAN_NUM_MASK,
+			     size);
+		off += size;
+		/* 0 means there are no more slices */
+		if (!ret)
+			break;
+	}
+
+	if (off < rgn->size) {
+		WD_ERR("too many dma slices of %s.\n", ctx->dev_path);
+		return -WD_EINVAL;
+	}
+
+	return 0;
+}
+
+static int ss_region_map(struct wd_ctx_h *ctx, struct wd_ss_region *rgn)
+{
+	int ret;
+
+	if (is_loopback_dev(ctx->dev)) {
+		rgn->va = mmap(NULL, rgn->size, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (rgn->va == MAP_FAILED)
+			return -WD_ENOMEM;
+
+		/* the loopback driver works on the va */
+		ss_add_slice(rgn, rgn->va, (uintptr_t)rgn->va, rgn->size);
+		return 0;
+	}
+
+	rgn->va = mmap(NULL, rgn->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		       ctx->fd, UACCE_QFRT_SS * getpagesize());
+	if (rgn->va == MAP_FAILED) {
+		WD_ERR("failed to mmap share region of %s (%d).\n",
+		       ctx->dev_path, -errno);
+		return -WD_ENOMEM;
+	}
+
+	ret = ss_get_slices(ctx, rgn);
+	if (ret)
+		munmap(rgn->va, rgn->size);
+
+	return ret;
+}
+
+void *wd_ctx_reserve_mem(handle_t h_ctx, size_t size)
+{
+	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
+	struct wd_ss_region *rgn;
+	int ret;
+
+	if (!ctx || !size) {
+		WD_ERR("invalid: ctx is NULL or size is 0!\n");
+		return NULL;
+	}
+
+	if (ctx->ss) {
+		WD_ERR("invalid: memory of ctx is reserved already!\n");
+		return NULL;
+	}
+
+	rgn = calloc(1, sizeof(*rgn));
+	if (!rgn)
+		return NULL;
+
+	rgn->ctx = ctx;
+	rgn->size = (size + SS_GRAN_SIZE - 1) & ~(SS_GRAN_SIZE - 1);
+	ret = ss_region_map(ctx, rgn);
+	if (ret) {
+		free(rgn);
+		return NULL;
+	}
+
+	pthread_rwlock_wrlock(&ss_lock);
+	rgn->next = ss_regions;
+	ss_regions = rgn;
+	pthread_rwlock_unlock(&ss_lock);
+	ctx->ss = rgn;
+
+	return rgn->va;
+}
+
+void wd_ctx_unreserve_mem(handle_t h_ctx)
+{
+	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
+
+	if (ctx)
+		ss_region_release(ctx);
+}
+
+static void *ss_region_iova(struct wd_ss_region *rgn, uintptr_t start,
+			    uintptr_t end)
+{
+	struct wd_ss_slice *slice;
+	uintptr_t va;
+	__u32 i;
+
+	for (i = 0; i < rgn->slice_num; i++) {
+		slice = rgn->slices + i;
+		va = (uintptr_t)slice->va;
+		if (start < va || start >= va + slice->size)
+			continue;
+
+		/* the device can't go across two discontiguous slices */
+		if (end > va + slice->size)
+			return NULL;
+
+		return (void *)(uintptr_t)(slice->dma + start - va);
+	}
+
+	return NULL;
+}
+
+void *wd_ctx_iova_map(handle_t h_ctx, void *va, size_t size)
+{
+	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
+	uintptr_t start = (uintptr_t)va;
+	uintptr_t end = start + (size ? size : 1);
+	struct wd_ss_region *rgn;
+	void *dma = NULL;
+
+	if (unlikely(!ctx || !va))
+		return NULL;
+
+	if (likely((unsigned int)ctx->dev->flags & UACCE_DEV_SVA))
+		return va;
+
+	pthread_rwlock_rdlock(&ss_lock);
+	for (rgn = ss_regions; rgn; rgn = rgn->next) {
+		if (start < (uintptr_t)rgn->va ||
+		    end > (uintptr_t)rgn->va + rgn->size ||
+		    strcmp(rgn->ctx->dev_name, ctx->dev_name))
+			continue;
+
+		dma = ss_region_iova(rgn, start, end);
+		break;
+	}
+	pthread_rwlock_unlock(&ss_lock);
+
+	return dma;
+}
+
+static void prefault_init(void)
+{
+	prefault_en = env_enabled(PREFAULT_ENV);
+	prefault_page = sysconf(_SC_PAGESIZE);
+}
+
+/* Touch each page [start, end) has a byte in */
+static void prefault_touch(uintptr_t start, uintptr_t end, __u32 flags)
+{
+	__u64 page_num = 0;
+	__u8 *p;
+
+	/* an atomic add of 0 dirties the page without racing with the user */
+	start &= ~(prefault_page - 1);
+	for (p = (__u8 *)start; p < (__u8 *)end;
+	     p += prefault_page, page_num++) {
+		if (flags & WD_PREFAULT_WRITE)
+			(void)__atomic_fetch_add(p, 0, __ATOMIC_RELAXED);
+		else
+			(void)*(volatile __u8 *)p;
+	}
+
+	__atomic_fetch_add(&prefault_stat.page_num, page_num, __ATOMIC_RELAXED);
+}
+
+static void prefault_populate(uintptr_t start, uintptr_t end, __u32 flags)
+{
+#if defined(MADV_POPULATE_READ) && defined(MADV_POPULATE_WRITE)
+	int advice = flags & WD_PREFAULT_WRITE ? MADV_POPULATE_WRITE :
+		     MADV_POPULATE_READ;
+
+	/* one syscall for the whole range on the kernels supporting it */
+	if (!madvise((void *)start, end - start, advice)) {
+		__atomic_fetch_add(&prefault_stat.page_num,
+				   (end - start) / prefault_page,
+				   __ATOMIC_RELAXED);
+		return;
+	}
+#endif
+	prefault_touch(start, end, flags);
+}
+
+/* Bitmap of the pages of chunk @c that [start, end) has a byte in */
+static __u64 prefault_pages(uintptr_t c, uintptr_t start, uintptr_t end)
+{
+	uintptr_t base = c << PREFAULT_CHUNK_SHIFT;
+	uintptr_t from = start > base ? start : base;
+	uintptr_t to = end < base + PREFAULT_CHUNK_SIZE ? end :
+		       base + PREFAULT_CHUNK_SIZE;
+	__u32 first = (from - base) / prefault_page;
+	__u32 last = (to - 1 - base) / prefault_page;
+
+	return ((2ULL << last) - 1) & ~((1ULL << first) - 1);
+}
+
+/* The pages of chunk @c seen before, 0 if its entry holds another chunk */
+static __u64 prefault_seen_pages(uintptr_t c)
+{
+	__u64 entry = __atomic_load_n(&prefault_seen[c % PREFAULT_SEEN_NUM],
+				      __ATOMIC_RELAXED);
+
+	return entry >> PREFAULT_PAGE_BITS == (__u64)c + 1 ?
+	       entry & PREFAULT_PAGE_MASK : 0;
+}
+
+static void prefault_set_seen(uintptr_t c, __u64 pages)
+{
+	__atomic_store_n(&prefault_seen[c % PREFAULT_SEEN_NUM],
+			 ((__u64)c + 1) << PREFAULT_PAGE_BITS | pages,
+			 __ATOMIC_RELAXED);
+}
+
+/* Mark the pages [start, end) has a byte in as @seen or forget their chunks */
+static void prefault_mark(uintptr_t start, uintptr_t end, bool seen)
+{
+	uintptr_t c = start >> PREFAULT_CHUNK_SHIFT;
+	uintptr_t last = (end - 1) >> PREFAULT_CHUNK_SHIFT;
+
+	for (; c <= last; c++) {
+		if (seen)
+			prefault_set_seen(c, prefault_seen_pages(c) |
+					  prefault_pages(c, start, end));
+		else
+			__atomic_store_n(&prefault_seen[c % PREFAULT_SEEN_NUM],
+					 0, __ATOMIC_RELAXED);
+	}
+}
+
+int wd_prefault_register(void *addr, size_t size, __u32 flags)
+{
+	uintptr_t start, end;
+
+	if (!addr || !size) {
+		WD_ERR("invalid: prefault addr is NULL or size is 0!\n");
+		return -WD_EINVAL;
+	}
+
+	pthread_once(&prefault_once, prefault_init);
+	start = (uintptr_t)addr & ~(prefault_page - 1);
+	end = ((uintptr_t)addr + size + prefault_page - 1) &
+	      ~(prefault_page - 1);
+
+	/* THP is only a hint, the mapping may not be anonymous */
+	if (flags & WD_PREFAULT_HUGE)
+		(void)madvise((void *)start, end - start, MADV_HUGEPAGE);
+
+	if (flags & WD_PREFAULT_LOCK) {
+		/* mlock faults the pages in, writable for a private mapping */
+		if (mlock((void *)start, end - start)) {
+			WD_ERR("failed to lock prefault pages (%d)!\n", -errno);
+			__atomic_fetch_add(&prefault_stat.lock_fail_num, 1,
+					   __ATOMIC_RELAXED);
+			return -WD_ENOMEM;
+		}
+		__atomic_fetch_add(&prefault_stat.page_num,
+				   (end - start) / prefault_page,
+				   __ATOMIC_RELAXED);
+	} else {
+		prefault_populate(start, end, flags);
+	}
+
+	prefault_mark((uintptr_t)addr, (uintptr_t)addr + size, true);
+	__atomic_fetch_add(&prefault_stat.reg_num, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+void wd_prefault_unregister(void *addr, size_t size)
+{
+	uintptr_t start, end;
+
+	if (!addr || !size)
+		return;
+
+	pthread_once(&prefault_once, prefault_init);
+	start = (uintptr_t)addr & ~(prefault_page - 1);
+	end = ((uintptr_t)addr + size + prefault_page - 1) &
+	      ~(prefault_page - 1);
+
+	/* a buffer registered without WD_PREFAULT_LOCK isn't locked */
+	(void)munlock((void *)start, end - start);
+	prefault_mark((uintptr_t)addr, (uintptr_t)addr + size, false);
+}
+
+void wd_prefault_submit(void *addr, size_t size, __u32 flags)
+{
+	uintptr_t start = (uintptr_t)addr;
+	uintptr_t end = start + size;
+	uintptr_t c, last, page;
+	__u64 need, seen;
+	bool touched = false;
+	__u32 i;
+
+	pthread_once(&prefault_once, prefault_init);
+	if (!prefault_en || !addr || !size)
+		return;
+
+	last = (end - 1) >> PREFAULT_CHUNK_SHIFT;
+	for (c = start >> PREFAULT_CHUNK_SHIFT; c <= last; c++) {
+		need = prefault_pages(c, start, end);
+		seen = prefault_seen_pages(c);
+		if ((need & seen) == need)
+			continue;
+
+		for (i = 0; i < PREFAULT_PAGE_BITS; i++) {
+			if (!((need & ~seen) >> i & 1))
+				continue;
+			page = (c << PREFAULT_CHUNK_SHIFT) + i * prefault_page;
+			prefault_touch(page, page + 1, flags);
+		}
+		prefault_set_seen(c, seen | need);
+		touched = true;
+	}
+
+	if (!touched) {
+		__atomic_fetch_add(&prefault_stat.hit_num, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	__atomic_fetch_add(&prefault_stat.submit_num, 1, __ATOMIC_RELAXED);
+}
+
+int wd_get_prefault_stat(struct wd_prefault_stat *stat)
+{
+	if (!stat) {
+		WD_ERR("invalid: prefault stat is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+#define STAT_LOAD(cnt)	(stat->cnt = __atomic_load_n(&prefault_stat.cnt, \
+						     __ATOMIC_RELAXED))
+	STAT_LOAD(reg_num);
+	STAT_LOAD(page_num);
+	STAT_LOAD(submit_num);
+	STAT_LOAD(hit_num);
+	STAT_LOAD(lock_fail_num);
+#undef STAT_LOAD
+
+	return 0;
+}
+
 int wd_get_numa_id(handle_t h_ctx)
 {
 	struct wd_ctx_h	*ctx = (struct wd_ctx_h *)h_ctx;
@@ -506,6 +1261,12 @@ int wd_get_avail_ctx(struct uacce_dev *dev)
 {
 	int avail_ctx, ret;
 
+	if (!dev)
+		return -WD_EINVAL;
+
+	if (is_loopback_dev(dev))
+		return LOOPBACK_AVAIL_CTX;
+
 	ret = get_int_attr(dev, "available_instances", &avail_ctx);
 	if (ret < 0)
 		return ret;
@@ -583,6 +1344,33 @@ static int check_alg_name(const char *alg_name)
 	return 0;
 }
 
+static struct uacce_dev_list *get_loopback_list(void)
+{
+	struct uacce_dev_list *node;
+	struct uacce_dev *dev;
+
+	node = calloc(1, sizeof(*node));
+	if (!node)
+		return NULL;
+
+	dev = calloc(1, sizeof(*dev));
+	if (!dev) {
+		free(node);
+		return NULL;
+	}
+
+	/* a loopback device without SVA runs the bounce path of the algs */
+	dev->flags = env_enabled(LOOPBACK_NOSVA_ENV) ? 0 : UACCE_DEV_SVA;
+	strncpy(dev->api, LOOPBACK_DEV_NAME, WD_NAME_SIZE - 1);
+	strncpy(dev->algs, LOOPBACK_ALGS, MAX_ATTR_STR_SIZE - 1);
+	strncpy(dev->dev_root, LOOPBACK_DEV_NAME, PATH_STR_SIZE - 1);
+	strncpy(dev->char_dev_path, LOOPBACK_DEV_NAME, MAX_DEV_NAME_LEN - 1);
+	dev->numa_id = 0;
+	node->dev = dev;
+
+	return node;
+}
+
 struct uacce_dev_list *wd_get_accel_list(const char *alg_name)
 {
 	struct uacce_dev_list *node, *head = NULL;
@@ -594,6 +1382,9 @@ struct uacce_dev_list *wd_get_accel_list(const char *alg_name)
 	if (check_alg_name(alg_name))
 		return NULL;
 
+	if (wd_is_loopback() && dev_has_alg(LOOPBACK_ALGS, alg_name))
+		return get_loopback_list();
+
 	wd_class = opendir(SYS_CLASS_DIR);
 	if (!wd_class) {
 		WD_ERR("UADK framework isn't enabled in system!\n");
@@ -699,6 +1490,10 @@ int wd_ctx_set_io_cmd(handle_t h_ctx, unsigned long cmd, void *arg)
 	if (!ctx)
 		return -WD_EINVAL;
 
+	/* nothing in the kernel to configure for a loopback ctx */
+	if (is_loopback_dev(ctx->dev))
+		return 0;
+
 	if (!arg)
 		return ioctl(ctx->fd, cmd);
 
@@ -19,6 +19,8 @@
 #define WD_AEAD_CCM_GCM_MIN	4U
 #define WD_AEAD_CCM_GCM_MAX	16
 #define WD_POOL_MAX_ENTRIES	1024
+/* msgs sent to the driver at a time in async batch */
+#define WD_AEAD_BATCH_NUM	32
 #define MAX_RETRY_COUNTS	200000000
 
 #define POLL_SIZE		70000
@@ -54,6 +56,7 @@ struct wd_aead_sess {
 	__u16			auth_bytes;
 	void			*priv;
 	void			*sched_key;
+	struct wd_sqe_tmpl	tmpl;
 };
 
 struct wd_env_config wd_aead_env_config;
@@ -68,9 +71,12 @@ static void wd_aead_set_static_drv(void)
 #else
 static void __attribute__((constructor)) wd_aead_open_driver(void)
 {
-	wd_aead_setting.dlhandle = dlopen("libhisi_sec.so", RTLD_NOW);
+	const char *lib = wd_is_loopback() ? "libloopback_sec.so" :
+			  "libhisi_sec.so";
+
+	wd_aead_setting.dlhandle = dlopen(lib, RTLD_NOW);
 	if (!wd_aead_setting.dlhandle)
-		WD_ERR("failed to open libhisi_sec.so\n");
+		WD_ERR("failed to open %s\n", lib);
 }
 
 static void __attribute__((destructor)) wd_aead_close_driver(void)
@@ -155,6 +161,7 @@ int wd_aead_set_ckey(handle_t h_sess, const __u8 *key, __u16 key_len)
 
 	sess->ckey_bytes = key_len;
 	memcpy(sess->ckey, key, key_len);
+	wd_key_fmt_reset(&sess->tmpl.fmt);
 
 	return 0;
 }
@@ -185,6 +192,7 @@ int wd_aead_set_akey(handle_t h_sess, const __u8 *key, __u16 key_len)
 
 	sess->akey_bytes = key_len;
 	memcpy(sess->akey, key, key_len);
+	wd_key_fmt_reset(&sess->tmpl.fmt);
 
 	return 0;
 
@@ -225,6 +233,7 @@ int wd_aead_set_authsize(handle_t h_sess, __u16 authsize)
 	}
 
 	sess->auth_bytes = authsize;
+	wd_key_fmt_reset(&sess->tmpl.fmt);
 
 	return 0;
 }
@@ -394,7 +403,8 @@ int wd_aead_init(struct wd_ctx_config *config, struct wd_sched *sched)
 		return ret;
 	}
 
-	ret = wd_init_sched(&wd_aead_setting.sched, sched);
+	ret = wd_init_sched(&wd_aead_setting.sched, sched,
+			    &wd_aead_setting.pool);
 	if (ret < 0) {
 		WD_ERR("failed to set sched, ret = %d!\n", ret);
 		goto out;
@@ -405,9 +415,10 @@ int wd_aead_init(struct wd_ctx_config *config, struct wd_sched *sched)
 	wd_aead_set_static_drv();
 #endif
 
-	/* init sync request pool */
+	/* the msgs of the async ctxs are allocated on demand */
 	ret = wd_init_async_request_pool(&wd_aead_setting.pool,
-				config->ctx_num, WD_POOL_MAX_ENTRIES,
+				&wd_aead_setting.config,
+				WD_POOL_MAX_ENTRIES,
 				sizeof(struct wd_aead_msg));
 	if (ret < 0) {
 		WD_ERR("failed to init aead aysnc request pool.\n");
@@ -482,6 +493,10 @@ static void fill_request_msg(struct wd_aead_msg *msg, struct wd_aead_req *req,
 	msg->assoc_bytes = req->assoc_bytes;
 	msg->auth_bytes = sess->auth_bytes;
 	msg->data_fmt = req->data_fmt;
+	msg->tmpl = &sess->tmpl;
+
+	wd_prefault_req(req->src, req->assoc_bytes + req->in_bytes, req->dst,
+			req->out_buf_bytes, req->data_fmt);
 }
 
 static int send_recv_sync(struct wd_ctx_internal *ctx,
@@ -498,7 +513,7 @@ static int send_recv_sync(struct wd_ctx_internal *ctx,
 	}
 
 	do {
-		if (msg->is_polled) {
+		if (wd_sync_wait_sleep(ctx, msg->is_polled, recv_cnt)) {
 			ret = wd_ctx_wait(ctx->ctx, POLL_TIME);
 			if (unlikely(ret < 0))
 				WD_ERR("wd aead ctx wait timeout(%d)!\n", ret);
@@ -516,6 +531,7 @@ static int send_recv_sync(struct wd_ctx_internal *ctx,
 		}
 	} while (ret < 0);
 
+	wd_sync_wait_done(ctx, recv_cnt);
 out:
 	pthread_spin_unlock(&ctx->lock);
 	return ret;
@@ -547,6 +563,7 @@ int wd_do_aead_sync(handle_t h_sess, struct wd_aead_req *req)
 		return ret;
 
 	ctx = config->ctxs + idx;
+	msg.is_polled |= wd_sync_wait_irq(ctx);
 	ret = send_recv_sync(ctx, &msg);
 	req->state = msg.result;
 
@@ -597,6 +614,7 @@ int wd_do_aead_async(handle_t h_sess, struct wd_aead_req *req)
 			WD_ERR("failed to send BD, hw is err!\n");
 
 		wd_put_msg_to_pool(&wd_aead_setting.pool, idx, msg->tag);
+		return ret;
 	}
 
 	wd_add_task_to_async_queue(&wd_aead_env_config, idx);
@@ -604,12 +622,113 @@ int wd_do_aead_async(handle_t h_sess, struct wd_aead_req *req)
 	return ret;
 }
 
+static int aead_send_batch(handle_t h_ctx, struct wd_aead_msg **msgs,
+			   __u32 num, __u32 *count)
+{
+	struct wd_aead_driver *driver = wd_aead_setting.driver;
+	int ret = 0;
+
+	if (driver->aead_send_batch)
+		return driver->aead_send_batch(h_ctx, msgs, num, count);
+
+	for (*count = 0; *count < num; (*count)++) {
+		ret = driver->aead_send(h_ctx, msgs[*count]);
+		if (ret < 0)
+			break;
+	}
+
+	return *count ? 0 : ret;
+}
+
+int wd_do_aead_async_batch(handle_t h_sess, struct wd_aead_req **reqs,
+			   __u32 num)
+{
+	struct wd_ctx_config_internal *config = &wd_aead_setting.config;
+	struct wd_aead_sess *sess = (struct wd_aead_sess *)h_sess;
+	struct wd_aead_msg *msgs[WD_AEAD_BATCH_NUM];
+	__u32 sent = 0, fill_num, cnt, idx, i;
+	struct wd_ctx_internal *ctx;
+	int tag, ret = 0;
+
+	if (unlikely(!reqs || !num)) {
+		WD_ERR("invalid: aead batch reqs is NULL or num is 0!\n");
+		return -WD_EINVAL;
+	}
+
+	for (i = 0; i < num; i++) {
+		ret = aead_param_check(sess, reqs[i]);
+		if (unlikely(ret))
+			return -WD_EINVAL;
+
+		if (unlikely(!reqs[i]->cb)) {
+			WD_ERR("aead input req(%u) cb is NULL.\n", i);
+			return -WD_EINVAL;
+		}
+	}
+
+	idx = wd_aead_setting.sched.pick_next_ctx(
+		wd_aead_setting.sched.h_sched_ctx,
+		sess->sched_key, CTX_MODE_ASYNC);
+	ret = wd_check_ctx(config, CTX_MODE_ASYNC, idx);
+	if (ret)
+		return ret;
+
+	ctx = config->ctxs + idx;
+
+	while (sent < num) {
+		for (fill_num = 0; fill_num < WD_AEAD_BATCH_NUM &&
+		     sent + fill_num < num; fill_num++) {
+			tag = wd_get_msg_from_pool(&wd_aead_setting.pool, idx,
+						   (void **)&msgs[fill_num]);
+			if (tag < 0)
+				break;
+
+			fill_request_msg(msgs[fill_num], reqs[sent + fill_num],
+					 sess);
+			msgs[fill_num]->tag = tag;
+			msgs[fill_num]->is_polled = 0;
+		}
+
+		if (!fill_num) {
+			ret = -WD_EBUSY;
+			break;
+		}
+
+		cnt = 0;
+		ret = aead_send_batch(ctx->ctx, msgs, fill_num, &cnt);
+		for (i = cnt; i < fill_num; i++)
+			wd_put_msg_to_pool(&wd_aead_setting.pool, idx,
+					   msgs[i]->tag);
+
+		sent += cnt;
+		if (cnt < fill_num)
+			break;
+	}
+
+	for (i = 0; i < sent; i++)
+		wd_add_task_to_async_queue(&wd_aead_env_config, idx);
+
+	if (!sent) {
+		if (ret != -WD_EBUSY)
+			WD_ERR("wd aead batch send err(%d)!\n", ret);
+		return ret ? ret : -WD_EBUSY;
+	}
+
+	return sent;
+}
+
+static void aead_msg_done(void *msg)
+{
+	struct wd_aead_req *req = &((struct wd_aead_msg *)msg)->req;
+
+	req->cb(req, req->cb_param);
+}
+
 int wd_aead_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 {
 	struct wd_ctx_config_internal *config = &wd_aead_setting.config;
 	struct wd_ctx_internal *ctx;
 	struct wd_aead_msg resp_msg, *msg;
-	struct wd_aead_req *req;
 	__u64 recv_count = 0;
 	int ret;
 
@@ -645,10 +764,8 @@ int wd_aead_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 
 		msg->tag = resp_msg.tag;
 		msg->req.state = resp_msg.result;
-		req = &msg->req;
-		req->cb(req, req->cb_param);
-		wd_put_msg_to_pool(&wd_aead_setting.pool,
-					       idx, resp_msg.tag);
+		wd_complete_msg(&wd_aead_setting.pool, idx, resp_msg.tag,
+				msg, aead_msg_done);
 		*count = recv_count;
 	} while (--expt);
 
@@ -726,3 +843,14 @@ int wd_aead_get_env_param(__u32 node, __u32 type, __u32 mode,
 	return wd_alg_get_env_param(&wd_aead_env_config,
 				    ctx_attr, num, is_enable);
 }
+
+int wd_aead_get_sync_wait_stat(__u32 idx, struct wd_sync_wait_stat *stat)
+{
+	return wd_get_sync_wait_stat(&wd_aead_setting.config, idx, stat);
+}
+
+int wd_aead_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats)
+{
+	return wd_get_ctx_stats(&wd_aead_setting.config, &wd_aead_setting.pool,
+				idx, stats);
+}
@@ -25,6 +25,14 @@
 #define POLL_SIZE		100000
 #define POLL_TIME		1000
 
+/* msgs sent to the driver at a time in async batch */
+#define WD_CIPHER_BATCH_NUM	32
+
+/* segments of a split request which are in flight at the same time */
+#define CIPHER_SPLIT_SEG_NUM	32
+#define CTR_BLOCK_SHIFT		4
+#define CIPHER_BYTE_BITS	8
+
 static __u64 des_weak_key[DES_WEAK_KEY_NUM] = {
 	0x0101010101010101, 0xFEFEFEFEFEFEFEFE,
 	0xE0E0E0E0F1F1F1F1, 0x1F1F1F1F0E0E0E0E
@@ -50,6 +58,25 @@ struct wd_cipher_sess {
 	unsigned char		key[MAX_CIPHER_KEY_SIZE];
 	__u32			key_bytes;
 	void			*sched_key;
+	struct wd_sqe_tmpl	tmpl;
+	/* Bytes of the segments the big sync requests are split into */
+	__u32			split_size;
+};
+
+/* The segments of a split request sent to one ctx */
+struct cipher_split_grp {
+	struct wd_ctx_internal *ctx;
+	struct wd_cipher_msg **msgs;
+	__u32 num;
+	__u32 sent;
+	__u32 recv;
+	/* recv retries of the oldest segment in flight */
+	__u64 retry;
+	int ret;
+	__u8 irq;
+	/* the ctx lock is held while a round of the segments is in flight */
+	bool locked;
+	bool done;
 };
 
 struct wd_env_config wd_cipher_env_config;
@@ -64,9 +91,12 @@ static void wd_cipher_set_static_drv(void)
 #else
 static void __attribute__((constructor)) wd_cipher_open_driver(void)
 {
-	wd_cipher_setting.dlhandle = dlopen("libhisi_sec.so", RTLD_NOW);
+	const char *lib = wd_is_loopback() ? "libloopback_sec.so" :
+			  "libhisi_sec.so";
+
+	wd_cipher_setting.dlhandle = dlopen(lib, RTLD_NOW);
 	if (!wd_cipher_setting.dlhandle)
-		WD_ERR("fail to open libhisi_sec.so\n");
+		WD_ERR("fail to open %s\n", lib);
 }
 
 static void __attribute__((destructor)) wd_cipher_close_driver(void)
@@ -180,6 +210,33 @@ int wd_cipher_set_key(handle_t h_sess, const __u8 *key, __u32 key_len)
 
 	sess->key_bytes = key_len;
 	memcpy(sess->key, key, key_len);
+	wd_key_fmt_reset(&sess->tmpl.fmt);
+
+	return 0;
+}
+
+int wd_cipher_set_split(handle_t h_sess, __u32 seg_size)
+{
+	struct wd_cipher_sess *sess = (struct wd_cipher_sess *)h_sess;
+
+	if (unlikely(!sess)) {
+		WD_ERR("invalid: cipher session is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	if (sess->mode != WD_CIPHER_ECB && sess->mode != WD_CIPHER_CTR &&
+	    sess->mode != WD_CIPHER_XTS) {
+		WD_ERR("invalid: cipher mode %d can't be split!\n", sess->mode);
+		return -WD_EINVAL;
+	}
+
+	if (seg_size % AES_BLOCK_SIZE) {
+		WD_ERR("invalid: split size %u isn't aligned to %d!\n",
+		       seg_size, AES_BLOCK_SIZE);
+		return -WD_EINVAL;
+	}
+
+	sess->split_size = seg_size;
 
 	return 0;
 }
@@ -245,7 +302,8 @@ int wd_cipher_init(struct wd_ctx_config *config, struct wd_sched *sched)
 		return ret;
 	}
 
-	ret = wd_init_sched(&wd_cipher_setting.sched, sched);
+	ret = wd_init_sched(&wd_cipher_setting.sched, sched,
+			    &wd_cipher_setting.pool);
 	if (ret < 0) {
 		WD_ERR("failed to set sched, ret = %d!\n", ret);
 		goto out;
@@ -256,9 +314,10 @@ int wd_cipher_init(struct wd_ctx_config *config, struct wd_sched *sched)
 	wd_cipher_set_static_drv();
 #endif
 
-	/* allocate async pool for every ctx */
+	/* the msgs of the async ctxs are allocated on demand */
 	ret = wd_init_async_request_pool(&wd_cipher_setting.pool,
-					 config->ctx_num, WD_POOL_MAX_ENTRIES,
+					 &wd_cipher_setting.config,
+					 WD_POOL_MAX_ENTRIES,
 					 sizeof(struct wd_cipher_msg));
 	if (ret < 0) {
 		WD_ERR("failed to init req pool, ret = %d!\n", ret);
@@ -327,6 +386,10 @@ static void fill_request_msg(struct wd_cipher_msg *msg,
 	msg->iv = req->iv;
 	msg->iv_bytes = req->iv_bytes;
 	msg->data_fmt = req->data_fmt;
+	msg->tmpl = &sess->tmpl;
+
+	wd_prefault_req(req->src, req->in_bytes, req->dst, req->in_bytes,
+			req->data_fmt);
 }
 
 static int cipher_iv_len_check(struct wd_cipher_req *req,
@@ -418,7 +481,7 @@ static int send_recv_sync(struct wd_ctx_internal *ctx,
 	}
 
 	do {
-		if (msg->is_polled) {
+		if (wd_sync_wait_sleep(ctx, msg->is_polled, recv_cnt)) {
 			ret = wd_ctx_wait(ctx->ctx, POLL_TIME);
 			if (unlikely(ret < 0))
 				WD_ERR("wd cipher ctx wait timeout(%d)!\n", ret);
@@ -436,11 +499,326 @@ static int send_recv_sync(struct wd_ctx_internal *ctx,
 		}
 	} while (ret < 0);
 
+	wd_sync_wait_done(ctx, recv_cnt);
 out:
 	pthread_spin_unlock(&ctx->lock);
 	return ret;
 }
 
+static int cipher_send_batch(handle_t h_ctx, struct wd_cipher_msg **msgs,
+			     __u32 num, __u32 *count)
+{
+	struct wd_cipher_driver *driver = wd_cipher_setting.driver;
+	int ret = 0;
+
+	if (driver->cipher_send_batch)
+		return driver->cipher_send_batch(h_ctx, msgs, num, count);
+
+	for (*count = 0; *count < num; (*count)++) {
+		ret = driver->cipher_send(h_ctx, msgs[*count]);
+		if (ret < 0)
+			break;
+	}
+
+	return *count ? 0 : ret;
+}
+
+/* add @num to the 128-bit big endian counter of CTR */
+static void cipher_ctr_add(__u8 *ctr, __u64 num)
+{
+	__u32 n = AES_BLOCK_SIZE;
+	__u64 c = num;
+
+	while (n-- && c) {
+		c += ctr[n];
+		ctr[n] = (__u8)c;
+		c >>= CIPHER_BYTE_BITS;
+	}
+}
+
+/* add @num to the 128-bit little endian tweak of XTS, as dm-crypt plain64 */
+static void cipher_xts_add(__u8 *tweak, __u64 num)
+{
+	__u64 c = num;
+	__u32 n;
+
+	for (n = 0; n < AES_BLOCK_SIZE && c; n++) {
+		c += tweak[n];
+		tweak[n] = (__u8)c;
+		c >>= CIPHER_BYTE_BITS;
+	}
+}
+
+static bool cipher_split_enabled(struct wd_cipher_sess *sess,
+				 struct wd_cipher_req *req)
+{
+	return sess->split_size && req->data_fmt == WD_FLAT_BUF &&
+	       req->in_bytes > sess->split_size;
+}
+
+static void cipher_split_finish(struct cipher_split_grp *grp, int ret)
+{
+	if (grp->locked) {
+		pthread_spin_unlock(&grp->ctx->lock);
+		grp->locked = false;
+	}
+	if (!grp->ret)
+		grp->ret = ret;
+	grp->done = true;
+}
+
+/* Send the next round of the segments of a ctx, once the ctx is free */
+static bool cipher_split_send(struct cipher_split_grp *grp)
+{
+	__u32 cnt = 0;
+	int ret;
+
+	if (pthread_spin_trylock(&grp->ctx->lock))
+		return false;
+
+	grp->locked = true;
+	ret = cipher_send_batch(grp->ctx->ctx, grp->msgs + grp->sent,
+				grp->num - grp->sent, &cnt);
+	if (unlikely(!cnt)) {
+		/* nothing is in flight, so the queue can not make progress */
+		if (ret != -WD_EBUSY)
+			WD_ERR("wd cipher split send err!\n");
+		cipher_split_finish(grp, ret ? ret : -WD_EBUSY);
+		return true;
+	}
+
+	grp->sent += cnt;
+	grp->retry = 0;
+
+	return true;
+}
+
+/* Poll one ctx of a split request, return true if it made progress */
+static bool cipher_split_poll(struct cipher_split_grp *grp,
+			      struct wd_cipher_msg *msgs, __u32 num)
+{
+	struct wd_cipher_msg resp_msg;
+	int ret;
+
+	if (!grp->locked)
+		return cipher_split_send(grp);
+
+	ret = wd_cipher_setting.driver->cipher_recv(grp->ctx->ctx, &resp_msg);
+	if (ret == -WD_HW_EACCESS) {
+		WD_ERR("wd cipher split recv err!\n");
+		cipher_split_finish(grp, ret);
+		return true;
+	} else if (ret < 0) {
+		if (++grp->retry > MAX_RETRY_COUNTS) {
+			WD_ERR("wd cipher split recv timeout fail!\n");
+			cipher_split_finish(grp, -WD_ETIMEDOUT);
+			return true;
+		}
+		return false;
+	}
+
+	if (unlikely(resp_msg.tag >= num)) {
+		WD_ERR("wd cipher split recv invalid tag(%u)!\n", resp_msg.tag);
+		cipher_split_finish(grp, -WD_EINVAL);
+		return true;
+	}
+	msgs[resp_msg.tag].result = resp_msg.result;
+
+	/* the round is received, the other sync users may take the ctx */
+	if (++grp->recv == grp->sent) {
+		wd_sync_wait_done(grp->ctx, grp->retry);
+		pthread_spin_unlock(&grp->ctx->lock);
+		grp->locked = false;
+		if (grp->sent == grp->num)
+			cipher_split_finish(grp, 0);
+	}
+	grp->retry = 0;
+
+	return true;
+}
+
+/* Sleep on the first ctx whose segments are in flight beyond its spin budget */
+static void cipher_split_wait(struct cipher_split_grp *grps, __u32 grp_num)
+{
+	__u32 i;
+	int ret;
+
+	for (i = 0; i < grp_num; i++) {
+		if (!grps[i].locked ||
+		    !wd_sync_wait_sleep(grps[i].ctx, grps[i].irq, grps[i].retry))
+			continue;
+
+		ret = wd_ctx_wait(grps[i].ctx->ctx, POLL_TIME);
+		if (unlikely(ret < 0))
+			WD_ERR("wd cipher ctx wait timeout(%d)!\n", ret);
+		return;
+	}
+}
+
+/*
+ * Send the segments to the ctxs picked for them and wait for all of them.
+ * The completions of a ctx are not matched to their senders, so a ctx is
+ * only locked from the send of a round of its segments until the round is
+ * received. The lock is only tried, as the ones of the other ctxs may be held
+ * meanwhile, and another ctx is polled instead.
+ */
+static int cipher_split_send_recv(struct wd_cipher_sess *sess,
+				  struct wd_cipher_msg *msgs, __u32 num)
+{
+	struct wd_ctx_config_internal *config = &wd_cipher_setting.config;
+	struct cipher_split_grp grps[CIPHER_SPLIT_SEG_NUM];
+	struct wd_cipher_msg *order[CIPHER_SPLIT_SEG_NUM];
+	__u32 pos[CIPHER_SPLIT_SEG_NUM];
+	__u32 grp_num = 0, left, i, j;
+	struct wd_cipher_msg *tmp_msg;
+	struct cipher_split_grp *grp;
+	__u64 retry_cnt = 0;
+	bool progress;
+	__u32 tmp_pos;
+	int ret = 0;
+
+	for (i = 0; i < num; i++) {
+		pos[i] = wd_cipher_setting.sched.pick_next_ctx(
+			     wd_cipher_setting.sched.h_sched_ctx,
+			     sess->sched_key, CTX_MODE_SYNC);
+		ret = wd_check_ctx(config, CTX_MODE_SYNC, pos[i]);
+		if (unlikely(ret))
+			return ret;
+
+		/* keep the segments grouped by their ctx */
+		order[i] = msgs + i;
+		for (j = i; j > 0 && pos[j - 1] > pos[j]; j--) {
+			tmp_pos = pos[j];
+			pos[j] = pos[j - 1];
+			pos[j - 1] = tmp_pos;
+			tmp_msg = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = tmp_msg;
+		}
+	}
+
+	for (i = 0; i < num; i++) {
+		if (!i || pos[i] != pos[i - 1]) {
+			grp = &grps[grp_num++];
+			memset(grp, 0, sizeof(struct cipher_split_grp));
+			grp->ctx = config->ctxs + pos[i];
+			grp->msgs = order + i;
+			grp->irq = wd_sync_wait_irq(grp->ctx);
+		}
+
+		grp->num++;
+		if (order[i]->in_bytes >= POLL_SIZE)
+			grp->irq = 1;
+	}
+
+	for (i = 0; i < grp_num; i++)
+		for (j = 0; j < grps[i].num; j++)
+			grps[i].msgs[j]->is_polled = grps[i].irq;
+
+	for (left = grp_num; left;) {
+		progress = false;
+		for (i = 0; i < grp_num; i++) {
+			if (grps[i].done)
+				continue;
+
+			progress |= cipher_split_poll(&grps[i], msgs, num);
+			if (grps[i].done)
+				left--;
+		}
+
+		if (progress)
+			continue;
+
+		if (++retry_cnt > MAX_RETRY_COUNTS) {
+			WD_ERR("wd cipher split recv timeout fail!\n");
+			ret = -WD_ETIMEDOUT;
+			break;
+		}
+		cipher_split_wait(grps, grp_num);
+	}
+
+	for (i = 0; i < grp_num; i++) {
+		if (!grps[i].done)
+			cipher_split_finish(&grps[i], 0);
+		if (!ret)
+			ret = grps[i].ret;
+	}
+
+	return ret;
+}
+
+/*
+ * Cut a big request into segments of split_size, which are sent to several
+ * ctxs at once. A CTR segment starts from the counter of its offset, the
+ * last one uses the iv of the request, so it's updated as the unsplit one.
+ * Every segment of an XTS request is a data unit, whose tweak is the one of
+ * the request plus the index of the segment.
+ */
+static int cipher_split_sync(struct wd_cipher_sess *sess,
+			     struct wd_cipher_req *req)
+{
+	__u8 ivs[CIPHER_SPLIT_SEG_NUM][AES_BLOCK_SIZE];
+	struct wd_cipher_msg msgs[CIPHER_SPLIT_SEG_NUM];
+	__u32 seg = sess->split_size;
+	__u32 off, len, num, i;
+	__u8 base[AES_BLOCK_SIZE] = {0};
+	int ret = 0;
+
+	if (sess->mode == WD_CIPHER_XTS && req->in_bytes % seg &&
+	    req->in_bytes % seg < AES_BLOCK_SIZE) {
+		WD_ERR("invalid: the last xts data unit is %u bytes!\n",
+		       req->in_bytes % seg);
+		return -WD_EINVAL;
+	}
+
+	if (sess->mode != WD_CIPHER_ECB)
+		memcpy(base, req->iv, AES_BLOCK_SIZE);
+
+	fill_request_msg(&msgs[0], req, sess);
+	req->state = 0;
+	for (off = 0; off < req->in_bytes && !ret; off += len) {
+		for (i = 0, len = 0; i < CIPHER_SPLIT_SEG_NUM &&
+		     off + len < req->in_bytes; i++) {
+			msgs[i] = msgs[0];
+			msgs[i].in = (__u8 *)req->src + off + len;
+			msgs[i].out = (__u8 *)req->dst + off + len;
+			msgs[i].in_bytes = req->in_bytes - off - len;
+			if (msgs[i].in_bytes > seg)
+				msgs[i].in_bytes = seg;
+			msgs[i].out_bytes = msgs[i].in_bytes;
+			msgs[i].is_polled = 0;
+			/* the tag is the index of the segment in this round */
+			msgs[i].tag = i;
+			/* segments which are not sent keep this state */
+			msgs[i].result = WD_EBUSY;
+
+			if (sess->mode == WD_CIPHER_CTR) {
+				memcpy(ivs[i], base, AES_BLOCK_SIZE);
+				cipher_ctr_add(ivs[i], (off + len) >>
+					       CTR_BLOCK_SHIFT);
+				msgs[i].iv = ivs[i];
+				if (off + len + msgs[i].in_bytes ==
+				    req->in_bytes) {
+					memcpy(req->iv, ivs[i], AES_BLOCK_SIZE);
+					msgs[i].iv = req->iv;
+				}
+			} else if (sess->mode == WD_CIPHER_XTS) {
+				memcpy(ivs[i], base, AES_BLOCK_SIZE);
+				cipher_xts_add(ivs[i], (off + len) / seg);
+				msgs[i].iv = ivs[i];
+			}
+			len += msgs[i].in_bytes;
+		}
+		num = i;
+
+		ret = cipher_split_send_recv(sess, msgs, num);
+		for (i = 0; i < num && !req->state; i++)
+			req->state = msgs[i].result;
+	}
+
+	return ret;
+}
+
 int wd_do_cipher_sync(handle_t h_sess, struct wd_cipher_req *req)
 {
 	struct wd_ctx_config_internal *config = &wd_cipher_setting.config;
@@ -456,6 +834,9 @@ int wd_do_cipher_sync(handle_t h_sess, struct wd_cipher_req *req)
 		return ret;
 	}
 
+	if (cipher_split_enabled(sess, req))
+		return cipher_split_sync(sess, req);
+
 	memset(&msg, 0, sizeof(struct wd_cipher_msg));
 	fill_request_msg(&msg, req, sess);
 	msg.is_polled = (req->in_bytes >= POLL_SIZE);
@@ -469,6 +850,7 @@ int wd_do_cipher_sync(handle_t h_sess, struct wd_cipher_req *req)
 		return ret;
 
 	ctx = config->ctxs + idx;
+	msg.is_polled |= wd_sync_wait_irq(ctx);
 	ret = send_recv_sync(ctx, &msg);
 	req->state = msg.result;
 
@@ -516,6 +898,7 @@ int wd_do_cipher_async(handle_t h_sess, struct wd_cipher_req *req)
 			WD_ERR("wd cipher async send err!\n");
 
 		wd_put_msg_to_pool(&wd_cipher_setting.pool, idx, msg->tag);
+		return ret;
 	}
 
 	wd_add_task_to_async_queue(&wd_cipher_env_config, idx);
@@ -523,12 +906,92 @@ int wd_do_cipher_async(handle_t h_sess, struct wd_cipher_req *req)
 	return ret;
 }
 
+int wd_do_cipher_async_batch(handle_t h_sess, struct wd_cipher_req **reqs,
+			     __u32 num)
+{
+	struct wd_ctx_config_internal *config = &wd_cipher_setting.config;
+	struct wd_cipher_sess *sess = (struct wd_cipher_sess *)h_sess;
+	struct wd_cipher_msg *msgs[WD_CIPHER_BATCH_NUM];
+	__u32 sent = 0, fill_num, cnt, idx, i;
+	struct wd_ctx_internal *ctx;
+	int tag, ret = 0;
+
+	if (unlikely(!reqs || !num)) {
+		WD_ERR("invalid: cipher batch reqs is NULL or num is 0!\n");
+		return -WD_EINVAL;
+	}
+
+	for (i = 0; i < num; i++) {
+		ret = wd_cipher_check_params(h_sess, reqs[i], CTX_MODE_ASYNC);
+		if (unlikely(ret)) {
+			WD_ERR("failed to check cipher params of req(%u)!\n", i);
+			return ret;
+		}
+	}
+
+	idx = wd_cipher_setting.sched.pick_next_ctx(
+		     wd_cipher_setting.sched.h_sched_ctx,
+		     sess->sched_key, CTX_MODE_ASYNC);
+	ret = wd_check_ctx(config, CTX_MODE_ASYNC, idx);
+	if (ret)
+		return ret;
+
+	ctx = config->ctxs + idx;
+
+	while (sent < num) {
+		for (fill_num = 0; fill_num < WD_CIPHER_BATCH_NUM &&
+		     sent + fill_num < num; fill_num++) {
+			tag = wd_get_msg_from_pool(&wd_cipher_setting.pool, idx,
+						   (void **)&msgs[fill_num]);
+			if (tag < 0)
+				break;
+
+			fill_request_msg(msgs[fill_num], reqs[sent + fill_num],
+					 sess);
+			msgs[fill_num]->tag = tag;
+			msgs[fill_num]->is_polled = 0;
+		}
+
+		if (!fill_num) {
+			ret = -WD_EBUSY;
+			break;
+		}
+
+		cnt = 0;
+		ret = cipher_send_batch(ctx->ctx, msgs, fill_num, &cnt);
+		for (i = cnt; i < fill_num; i++)
+			wd_put_msg_to_pool(&wd_cipher_setting.pool, idx,
+					   msgs[i]->tag);
+
+		sent += cnt;
+		if (cnt < fill_num)
+			break;
+	}
+
+	for (i = 0; i < sent; i++)
+		wd_add_task_to_async_queue(&wd_cipher_env_config, idx);
+
+	if (!sent) {
+		if (ret != -WD_EBUSY)
+			WD_ERR("wd cipher batch send err(%d)!\n", ret);
+		return ret ? ret : -WD_EBUSY;
+	}
+
+	return sent;
+}
+
+static void cipher_msg_done(void *msg)
+{
+	struct wd_cipher_req *req = &((struct wd_cipher_msg *)msg)->req;
+
+	req->cb(req, req->cb_param);
+}
+
 int wd_cipher_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 {
 	struct wd_ctx_config_internal *config = &wd_cipher_setting.config;
 	struct wd_ctx_internal *ctx;
 	struct wd_cipher_msg resp_msg, *msg;
-	struct wd_cipher_req *req;
 	__u64 recv_count = 0;
 	int ret;
 
@@ -563,12 +1026,9 @@ int wd_cipher_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 
 		msg->tag = resp_msg.tag;
 		msg->req.state = resp_msg.result;
-		req = &msg->req;
-
-		req->cb(req, req->cb_param);
-		/* free msg cache to msg_pool */
-		wd_put_msg_to_pool(&wd_cipher_setting.pool, idx,
-				   resp_msg.tag);
+		/* the msg goes back to msg_pool after its callback */
+		wd_complete_msg(&wd_cipher_setting.pool, idx, resp_msg.tag,
+				msg, cipher_msg_done);
 		*count = recv_count;
 	} while (--expt);
 
@@ -646,3 +1106,14 @@ int wd_cipher_get_env_param(__u32 node, __u32 type, __u32 mode,
 	return wd_alg_get_env_param(&wd_cipher_env_config,
 				    ctx_attr, num, is_enable);
 }
+
+int wd_cipher_get_sync_wait_stat(__u32 idx, struct wd_sync_wait_stat *stat)
+{
+	return wd_get_sync_wait_stat(&wd_cipher_setting.config, idx, stat);
+}
+
+int wd_cipher_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats)
+{
+	return wd_get_ctx_stats(&wd_cipher_setting.config, &wd_cipher_setting.pool,
+				idx, stats);
+}
@@ -18,9 +18,26 @@
 #include "wd_util.h"
 
 #define WD_POOL_MAX_ENTRIES		1024
+/* msgs sent to the driver at a time in async batch */
+#define WD_COMP_BATCH_NUM		32
 #define MAX_RETRY_COUNTS		200000000
 #define HW_CTX_SIZE			(64 * 1024)
 #define STREAM_CHUNK			(128 * 1024)
+#define STREAM_CHUNK_MIN		(4 * 1024)
+#define STREAM_CHUNK_MAX		(8 * 1024 * 1024)
+#define PIPE_MAX_DEPTH			64
+/* blocks of each ctx the requests are copied through without SVA */
+#define COMP_BOUNCE_BLK_SIZE		(512 * 1024)
+#define COMP_BOUNCE_BLK_NUM		16
+/* deflate output of a chunk with the worst ratio, in stored blocks */
+#define PIPE_OUT_SIZE(len)		((len) + ((len) >> 3) + 64)
+
+#define ZLIB_HEADER			"\x78\x9c"
+#define ZLIB_HEADER_SZ			2
+#define GZIP_HEADER			"\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03"
+#define GZIP_HEADER_SZ			10
+#define ADLER_BASE			65521
+#define CRC32_POLY			0xedb88320
 
 #define POLL_SIZE			250000
 #define POLL_TIME			1000
@@ -42,6 +59,37 @@ struct wd_comp_sess {
 	__u32 checksum;
 	__u8 *ctx_buf;
 	void *sched_key;
+	/* ctx used by the current stream, all of its requests stay on it */
+	__u32 strm_idx;
+	/* an async stream request is in flight, set before it is sent */
+	__u32 strm_busy;
+	/* input bytes of each request of wd_do_comp_sync2() */
+	__u32 chunk_size;
+	/* max requests of wd_do_comp_sync2() in flight */
+	__u32 pipe_depth;
+	enum wd_mem_type mem_type;
+};
+
+struct comp_pipe_slot {
+	struct wd_comp_msg msg;
+	struct wd_ctx_internal *ctx;
+	__u8 *ctx_buf;
+	__u8 *dst;
+};
+
+/* chunks of one wd_do_comp_sync2() compressed on several sync ctxs */
+struct comp_pipe {
+	struct wd_comp_sess *sess;
+	struct wd_comp_req *req;
+	struct comp_pipe_slot *slots;
+	__u32 depth;
+	__u32 slot_out;
+	/* the oldest chunk in flight and the next one to be sent */
+	__u32 head;
+	__u32 tail;
+	__u32 checksum;
+	/* status of the first chunk that failed */
+	__u8 status;
 };
 
 struct wd_comp_setting {
@@ -51,6 +99,9 @@ struct wd_comp_setting {
 	void *priv;
 	void *dlhandle;
 	struct wd_async_msg_pool pool;
+	struct wd_bounce bounce;
+	/* a sync request of each ctx the device didn't complete in time */
+	struct wd_comp_msg **lost;
 } wd_comp_setting;
 
 struct wd_env_config wd_comp_env_config;
@@ -65,9 +116,12 @@ static void wd_comp_set_static_drv(void)
 #else
 static void __attribute__((constructor)) wd_comp_open_driver(void)
 {
-	wd_comp_setting.dlhandle = dlopen("libhisi_zip.so", RTLD_NOW);
+	const char *lib = wd_is_loopback() ? "libloopback_comp.so" :
+			  "libhisi_zip.so";
+
+	wd_comp_setting.dlhandle = dlopen(lib, RTLD_NOW);
 	if (!wd_comp_setting.dlhandle)
-		WD_ERR("Fail to open libhisi_zip.so\n");
+		WD_ERR("Fail to open %s\n", lib);
 }
 
 static void __attribute__((destructor)) wd_comp_close_driver(void)
@@ -92,17 +146,13 @@ int wd_comp_init(struct wd_ctx_config *config, struct wd_sched *sched)
 		return -WD_EINVAL;
 	}
 
-	if (!wd_is_sva(config->ctxs[0].ctx)) {
-		WD_ERR("err, non sva, please check system!\n");
-		return -WD_EINVAL;
-	}
-
 	ret = wd_init_ctx_config(&wd_comp_setting.config, config);
 	if (ret < 0) {
 		WD_ERR("failed to set config, ret = %d!\n", ret);
 		return ret;
 	}
-	ret = wd_init_sched(&wd_comp_setting.sched, sched);
+	ret = wd_init_sched(&wd_comp_setting.sched, sched,
+			    &wd_comp_setting.pool);
 	if (ret < 0) {
 		WD_ERR("failed to set sched, ret = %d!\n", ret);
 		goto out;
@@ -121,19 +171,38 @@ int wd_comp_init(struct wd_ctx_config *config, struct wd_sched *sched)
 	wd_comp_set_static_drv();
 #endif
 
-	/* fix me: sadly find we allocate async pool for every ctx */
+	/* the msgs of the async ctxs are allocated on demand */
 	ret = wd_init_async_request_pool(&wd_comp_setting.pool,
-					 config->ctx_num, WD_POOL_MAX_ENTRIES,
+					 &wd_comp_setting.config,
+					 WD_POOL_MAX_ENTRIES,
 					 sizeof(struct wd_comp_msg));
 	if (ret < 0) {
 		WD_ERR("failed to init req pool, ret = %d!\n", ret);
 		goto out_sched;
 	}
+
+	/* the memory is reserved before the driver starts the ctxs */
+	ret = wd_init_bounce(&wd_comp_setting.bounce, &wd_comp_setting.config,
+			     COMP_BOUNCE_BLK_SIZE, COMP_BOUNCE_BLK_NUM);
+	if (ret < 0) {
+		WD_ERR("failed to init bounce blocks, ret = %d!\n", ret);
+		goto out_priv;
+	}
+
+	if (wd_bounce_enabled(&wd_comp_setting.bounce)) {
+		wd_comp_setting.lost = calloc(wd_comp_setting.config.ctx_num,
+					      sizeof(struct wd_comp_msg *));
+		if (!wd_comp_setting.lost) {
+			ret = -WD_ENOMEM;
+			goto out_bounce;
+		}
+	}
+
 	/* init ctx related resources in specific driver */
 	priv = calloc(1, wd_comp_setting.driver->drv_ctx_size);
 	if (!priv) {
 		ret = -WD_ENOMEM;
-		goto out_priv;
+		goto out_bounce;
 	}
 	wd_comp_setting.priv = priv;
 	ret = wd_comp_setting.driver->init(&wd_comp_setting.config, priv);
@@ -145,6 +214,10 @@ int wd_comp_init(struct wd_ctx_config *config, struct wd_sched *sched)
 
 out_init:
 	free(priv);
+out_bounce:
+	free(wd_comp_setting.lost);
+	wd_comp_setting.lost = NULL;
+	wd_uninit_bounce(&wd_comp_setting.bounce);
 out_priv:
 	wd_uninit_async_request_pool(&wd_comp_setting.pool);
 out_sched:
@@ -157,10 +230,18 @@ out:
 void wd_comp_uninit(void)
 {
 	void *priv = wd_comp_setting.priv;
+	__u32 i;
 
 	if (!priv)
 		return;
 
+	/* the blocks of the lost requests go with their mempools */
+	for (i = 0; wd_comp_setting.lost &&
+	     i < wd_comp_setting.config.ctx_num; i++)
+		free(wd_comp_setting.lost[i]);
+	free(wd_comp_setting.lost);
+	wd_comp_setting.lost = NULL;
+	wd_uninit_bounce(&wd_comp_setting.bounce);
 	wd_comp_setting.driver->exit(priv);
 	free(priv);
 	wd_comp_setting.priv = NULL;
@@ -178,6 +259,174 @@ struct wd_comp_msg *wd_comp_get_msg(__u32 idx, __u32 tag)
 	return wd_find_msg_in_pool(&wd_comp_setting.pool, idx, tag);
 }
 
+static void wd_do_comp_strm_end_check(struct wd_comp_sess *sess,
+				      struct wd_comp_req *req,
+				      __u32 src_len);
+
+/* Save the stream state of an async stream request back to its session */
+static void wd_comp_strm_async_done(struct wd_comp_msg *msg, __u32 src_len)
+{
+	struct wd_comp_sess *sess = msg->strm_sess;
+
+	sess->isize = msg->isize;
+	sess->checksum = msg->checksum;
+	sess->stream_pos = WD_COMP_STREAM_OLD;
+	wd_do_comp_strm_end_check(sess, &msg->req, src_len);
+}
+
+static void comp_msg_done(void *data)
+{
+	struct wd_comp_msg *msg = data;
+	struct wd_comp_req *req = &msg->req;
+	struct wd_comp_sess *sess = msg->strm_sess;
+
+	/*
+	 * The next request of a stream may be sent once the callback of this
+	 * one starts, which may be on the dispatcher thread, not at reaping.
+	 */
+	if (msg->stream_mode == WD_COMP_STATEFUL)
+		__atomic_store_n(&sess->strm_busy, 0, __ATOMIC_RELEASE);
+
+	if (req->cb)
+		req->cb(req, req->cb_param);
+}
+
+/*
+ * Without SVA, copy the buffers of a request to the bounce blocks of the ctx
+ * it's sent to. A stream request is cut to a block and goes on with the rest
+ * in the next request, a stateless one has to fit in a block.
+ */
+static int comp_bounce_in(struct wd_comp_msg *msg, __u32 idx)
+{
+	struct wd_ctx_config_internal *config = &wd_comp_setting.config;
+	struct wd_bounce *bounce = &wd_comp_setting.bounce;
+	struct wd_comp_req *req = &msg->req;
+	void *src, *dst, *ctx_buf = NULL;
+	int ret;
+
+	msg->usr_src = NULL;
+	if (!wd_bounce_enabled(bounce) || msg->mem_type == WD_MEM_MEMPOOL)
+		return 0;
+
+	if (unlikely(req->data_fmt == WD_SGL_BUF ||
+		     msg->alg_type == WD_LZ77_ZSTD)) {
+		WD_ERR("invalid: sgl or lz77_zstd needs dma mempool without sva!\n");
+		return -WD_EINVAL;
+	}
+
+	if (msg->stream_mode == WD_COMP_STATEFUL &&
+	    req->src_len > bounce->blk_size) {
+		req->src_len = bounce->blk_size;
+		req->last = 0;
+	}
+	if (msg->avail_out > bounce->blk_size)
+		msg->avail_out = bounce->blk_size;
+
+	ret = wd_bounce_get(bounce, config, idx, req->src, req->src_len,
+			    req->src_len, &src);
+	if (ret)
+		return ret;
+
+	ret = wd_bounce_get(bounce, config, idx, req->dst, msg->avail_out, 0,
+			    &dst);
+	if (ret)
+		goto put_src;
+
+	/* the hardware ctx is only kept for a stream */
+	if (msg->stream_mode == WD_COMP_STATELESS) {
+		msg->ctx_buf = NULL;
+	} else if (msg->ctx_buf) {
+		ret = wd_bounce_get(bounce, config, idx, msg->ctx_buf,
+				    HW_CTX_SIZE, HW_CTX_SIZE, &ctx_buf);
+		if (ret)
+			goto put_dst;
+	}
+
+	msg->usr_src = req->src;
+	msg->usr_dst = req->dst;
+	msg->usr_ctx_buf = msg->ctx_buf;
+	req->src = src;
+	req->dst = dst;
+	msg->ctx_buf = ctx_buf;
+
+	return 0;
+
+put_dst:
+	wd_bounce_put(bounce, idx, req->dst, dst, 0);
+put_src:
+	wd_bounce_put(bounce, idx, req->src, src, 0);
+	return ret;
+}
+
+/* Copy the output back if the request is done, and free the bounce blocks */
+static void comp_bounce_out(struct wd_comp_msg *msg, __u32 idx, bool done)
+{
+	struct wd_bounce *bounce = &wd_comp_setting.bounce;
+	struct wd_comp_req *req = &msg->req;
+
+	if (!msg->usr_src)
+		return;
+
+	wd_bounce_put(bounce, idx, msg->usr_src, req->src, 0);
+	wd_bounce_put(bounce, idx, msg->usr_dst, req->dst,
+		      done ? msg->produced : 0);
+	wd_bounce_put(bounce, idx, msg->usr_ctx_buf, msg->ctx_buf,
+		      done ? HW_CTX_SIZE : 0);
+	req->src = msg->usr_src;
+	req->dst = msg->usr_dst;
+	msg->ctx_buf = msg->usr_ctx_buf;
+	msg->usr_src = NULL;
+}
+
+/*
+ * A sync request the device didn't complete may still be done by it later,
+ * into its bounce blocks. The blocks are kept with a copy of the request,
+ * until the late completion is drained from the ctx by comp_drain_lost().
+ * Until then the other requests of the ctx can't take its completion.
+ */
+static void comp_bounce_lose(struct wd_comp_msg *msg, __u32 idx)
+{
+	struct wd_comp_msg *lost;
+
+	if (!msg->usr_src)
+		return;
+
+	lost = malloc(sizeof(*lost));
+	if (lost) {
+		memcpy(lost, msg, sizeof(*lost));
+		wd_comp_setting.lost[idx] = lost;
+		WD_ERR("ctx %u lost a request, its bounce blocks are kept!\n",
+		       idx);
+	} else {
+		WD_ERR("ctx %u lost a request, its bounce blocks leak!\n", idx);
+	}
+
+	msg->req.src = msg->usr_src;
+	msg->req.dst = msg->usr_dst;
+	msg->ctx_buf = msg->usr_ctx_buf;
+	msg->usr_src = NULL;
+}
+
+/* Take the late completion of the lost request of a ctx, under its lock */
+static int comp_drain_lost(struct wd_ctx_internal *ctx, __u32 idx)
+{
+	struct wd_comp_msg *lost = wd_comp_setting.lost[idx];
+	int ret;
+
+	ret = wd_comp_setting.driver->comp_recv(ctx->ctx, lost,
+						wd_comp_setting.priv);
+	if (ret == -WD_EAGAIN)
+		return -WD_EBUSY;
+	else if (ret == -WD_HW_EACCESS)
+		return ret;
+
+	comp_bounce_out(lost, idx, false);
+	free(lost);
+	wd_comp_setting.lost[idx] = NULL;
+
+	return 0;
+}
+
 int wd_comp_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 {
 	struct wd_ctx_config_internal *config = &wd_comp_setting.config;
@@ -187,6 +436,7 @@ int wd_comp_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 	struct wd_comp_msg *msg;
 	struct wd_comp_req *req;
 	__u64 recv_count = 0;
+	__u32 src_len;
 	int ret;
 
 	if (unlikely(!count)) {
@@ -220,14 +470,17 @@ int wd_comp_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 			return -WD_EINVAL;
 		}
 
+		comp_bounce_out(msg, idx, true);
 		req = &msg->req;
+		src_len = req->src_len;
 		req->src_len = msg->in_cons;
 		req->dst_len = msg->produced;
-		if (req->cb)
-			req->cb(req, req->cb_param);
+		if (msg->stream_mode == WD_COMP_STATEFUL)
+			wd_comp_strm_async_done(msg, src_len);
 
-		/* free msg cache to msg_pool */
-		wd_put_msg_to_pool(&wd_comp_setting.pool, idx, resp_msg.tag);
+		/* the msg goes back to msg_pool after its callback */
+		wd_complete_msg(&wd_comp_setting.pool, idx, resp_msg.tag, msg,
+				comp_msg_done);
 		*count = recv_count;
 	} while (--expt);
 
@@ -286,6 +539,8 @@ handle_t wd_comp_alloc_sess(struct wd_comp_sess_setup *setup)
 	sess->comp_lv = setup->comp_lv;
 	sess->win_sz = setup->win_sz;
 	sess->stream_pos = WD_COMP_STREAM_NEW;
+	sess->chunk_size = STREAM_CHUNK;
+	sess->pipe_depth = 1;
 	/* Some simple scheduler don't need scheduling parameters */
 	sess->sched_key = (void *)wd_comp_setting.sched.sched_init(
 		     wd_comp_setting.sched.h_sched_ctx, setup->sched_param);
@@ -303,6 +558,19 @@ sess_err:
 	return (handle_t)0;
 }
 
+/* The stream of a ctx_buf may be left open when it's aborted */
+static void comp_free_ctx_buf(void *ctx_buf)
+{
+	struct wd_comp_driver *driver = wd_comp_setting.driver;
+
+	if (!ctx_buf)
+		return;
+
+	if (driver && driver->ctx_buf_free)
+		driver->ctx_buf_free(ctx_buf);
+	free(ctx_buf);
+}
+
 void wd_comp_free_sess(handle_t h_sess)
 {
 	struct wd_comp_sess *sess = (struct wd_comp_sess *)h_sess;
@@ -310,8 +578,7 @@ void wd_comp_free_sess(handle_t h_sess)
 	if (!sess)
 		return;
 
-	if (sess->ctx_buf)
-		free(sess->ctx_buf);
+	comp_free_ctx_buf(sess->ctx_buf);
 
 	if (sess->sched_key)
 		free(sess->sched_key);
@@ -326,10 +593,14 @@ static void fill_comp_msg(struct wd_comp_sess *sess, struct wd_comp_msg *msg,
 	msg->alg_type = sess->alg_type;
 	msg->comp_lv = sess->comp_lv;
 	msg->win_sz = sess->win_sz;
+	msg->mem_type = sess->mem_type;
 	msg->avail_out = req->dst_len;
 
 	/* if is last 1: flush end; other: sync flush */
 	msg->req.last = 1;
+
+	wd_prefault_req(req->src, req->src_len, req->dst, req->dst_len,
+			req->data_fmt);
 }
 
 static int wd_comp_check_buffer(struct wd_comp_req *req)
@@ -409,14 +680,35 @@ static int wd_comp_sync_job(struct wd_comp_sess *sess,
 	__u64 recv_count = 0;
 	__u32 idx;
 	int ret;
-	idx = wd_comp_setting.sched.pick_next_ctx(h_sched_ctx,
-						  sess->sched_key,
-						  CTX_MODE_SYNC);
+
+	if (msg->stream_mode == WD_COMP_STATEFUL &&
+	    sess->stream_pos == WD_COMP_STREAM_OLD)
+		idx = sess->strm_idx;
+	else
+		idx = wd_comp_setting.sched.pick_next_ctx(h_sched_ctx,
+							  sess->sched_key,
+							  CTX_MODE_SYNC);
 	ret = wd_check_ctx(config, CTX_MODE_SYNC, idx);
 	if (ret)
 		return ret;
 
+	if (msg->stream_mode == WD_COMP_STATEFUL)
+		sess->strm_idx = idx;
+
 	ctx = config->ctxs + idx;
+	if (wd_comp_setting.lost && wd_comp_setting.lost[idx]) {
+		pthread_spin_lock(&ctx->lock);
+		ret = wd_comp_setting.lost[idx] ? comp_drain_lost(ctx, idx) : 0;
+		pthread_spin_unlock(&ctx->lock);
+		if (ret)
+			return ret;
+	}
+
+	ret = comp_bounce_in(msg, idx);
+	if (ret)
+		return ret;
+
+	msg->is_polled |= wd_sync_wait_irq(ctx);
 
 	pthread_spin_lock(&ctx->lock);
 
@@ -424,22 +716,25 @@ static int wd_comp_sync_job(struct wd_comp_sess *sess,
 	if (ret < 0) {
 		pthread_spin_unlock(&ctx->lock);
 		WD_ERR("wd comp send err(%d)!\n", ret);
+		comp_bounce_out(msg, idx, false);
 		return ret;
 	}
 
 	do {
-		if (msg->is_polled) {
+		if (wd_sync_wait_sleep(ctx, msg->is_polled, recv_count)) {
 			ret = wd_ctx_wait(ctx->ctx, POLL_TIME);
 			if (ret < 0)
 				WD_ERR("wd ctx wait timeout(%d)!\n", ret);
 		}
 		ret = wd_comp_setting.driver->comp_recv(ctx->ctx, msg, priv);
 		if (ret == -WD_HW_EACCESS) {
+			comp_bounce_lose(msg, idx);
 			pthread_spin_unlock(&ctx->lock);
 			WD_ERR("wd comp recv hw err!\n");
 			return ret;
 		} else if (ret == -WD_EAGAIN) {
 			if (++recv_count > MAX_RETRY_COUNTS) {
+				comp_bounce_lose(msg, idx);
 				pthread_spin_unlock(&ctx->lock);
 				WD_ERR("wd comp recv timeout fail!\n");
 				return -WD_ETIMEDOUT;
@@ -447,7 +742,9 @@ static int wd_comp_sync_job(struct wd_comp_sess *sess,
 		}
 	} while (ret == -WD_EAGAIN);
 
+	wd_sync_wait_done(ctx, recv_count);
 	pthread_spin_unlock(&ctx->lock);
+	comp_bounce_out(msg, idx, !ret);
 
 	return ret;
 }
@@ -489,11 +786,414 @@ int wd_do_comp_sync(handle_t h_sess, struct wd_comp_req *req)
 	return 0;
 }
 
+int wd_comp_set_sync2_param(handle_t h_sess, __u32 chunk_size, __u32 depth)
+{
+	struct wd_comp_sess *sess = (struct wd_comp_sess *)h_sess;
+
+	if (!sess) {
+		WD_ERR("invalid: sess is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	if (chunk_size < STREAM_CHUNK_MIN || chunk_size > STREAM_CHUNK_MAX) {
+		WD_ERR("invalid: chunk_size is %u!\n", chunk_size);
+		return -WD_EINVAL;
+	}
+
+	if (!depth || depth > PIPE_MAX_DEPTH) {
+		WD_ERR("invalid: depth is %u!\n", depth);
+		return -WD_EINVAL;
+	}
+
+	sess->chunk_size = chunk_size;
+	sess->pipe_depth = depth;
+
+	return 0;
+}
+
+int wd_comp_set_mem_type(handle_t h_sess, enum wd_mem_type mem_type)
+{
+	struct wd_comp_sess *sess = (struct wd_comp_sess *)h_sess;
+
+	if (!sess) {
+		WD_ERR("invalid: sess is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	if (mem_type != WD_MEM_USER && mem_type != WD_MEM_MEMPOOL) {
+		WD_ERR("invalid: mem_type is %d!\n", mem_type);
+		return -WD_EINVAL;
+	}
+
+	sess->mem_type = mem_type;
+
+	return 0;
+}
+
+static unsigned int bit_reverse(register unsigned int x)
+{
+	x = (((x & 0xaaaaaaaa) >> 1) | ((x & 0x55555555) << 1));
+	x = (((x & 0xcccccccc) >> 2) | ((x & 0x33333333) << 2));
+	x = (((x & 0xf0f0f0f0) >> 4) | ((x & 0x0f0f0f0f) << 4));
+	x = (((x & 0xff00ff00) >> 8) | ((x & 0x00ff00ff) << 8));
+
+	return((x >> 16) | (x << 16));
+}
+
+/* x^(2^n) modulo the crc32 polynomial, bit reflected */
+static __u32 crc32_x2n[32];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+/* a * b modulo the crc32 polynomial, both bit reflected */
+static __u32 crc32_mult(__u32 a, __u32 b)
+{
+	__u32 m = 1U << 31;
+	__u32 p = 0;
+
+	while (m) {
+		if (a & m)
+			p ^= b;
+		m >>= 1;
+		b = (b & 1) ? CRC32_POLY ^ (b >> 1) : b >> 1;
+	}
+
+	return p;
+}
+
+static void crc32_init_x2n(void)
+{
+	int i;
+
+	/* x^1 */
+	crc32_x2n[0] = 1U << 30;
+	for (i = 1; i < ARRAY_SIZE(crc32_x2n); i++)
+		crc32_x2n[i] = crc32_mult(crc32_x2n[i - 1], crc32_x2n[i - 1]);
+}
+
+/*
+ * The crc32 of A + B from the ones of A and B: crc(A) is shifted over the
+ * 8 * len2 bits of B by a multiplication with x^(8 * len2).
+ */
+static __u32 comp_crc32_combine(__u32 crc1, __u32 crc2, __u32 len2)
+{
+	__u32 p = 1U << 31;
+	int k = 3;
+
+	pthread_once(&crc32_once, crc32_init_x2n);
+
+	for (; len2; len2 >>= 1, k++)
+		if (len2 & 1)
+			p = crc32_mult(crc32_x2n[k & 31], p);
+
+	return crc32_mult(p, crc1) ^ crc2;
+}
+
+/* The adler32 of A + B from the ones of A and B */
+static __u32 comp_adler32_combine(__u32 adler1, __u32 adler2, __u32 len2)
+{
+	__u32 rem = len2 % ADLER_BASE;
+	__u32 a = adler1 & 0xffff;
+	__u32 b = (rem * a) % ADLER_BASE;
+
+	a += (adler2 & 0xffff) + ADLER_BASE - 1;
+	b += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - rem;
+	a %= ADLER_BASE;
+	b %= ADLER_BASE;
+
+	return (b << 16) | a;
+}
+
+static int pipe_put_out(struct comp_pipe *pipe, const void *buf, __u32 len)
+{
+	struct wd_comp_req *req = pipe->req;
+
+	if (len > req->dst_len - req->src_len) {
+		WD_ERR("invalid: dst buffer is too small!\n");
+		return -WD_EINVAL;
+	}
+
+	memcpy(req->dst + req->src_len, buf, len);
+	req->src_len += len;
+
+	return 0;
+}
+
+/*
+ * The checksum of a chunk comes from the hardware, which compresses it as a
+ * new zlib or gzip stream. A gzip one is the crc32 register, reversed and
+ * not inverted, as append_store_block() takes it.
+ */
+static void pipe_add_checksum(struct comp_pipe *pipe, struct wd_comp_msg *msg)
+{
+	__u32 checksum = msg->checksum;
+
+	if (pipe->sess->alg_type == WD_ZLIB) {
+		pipe->checksum = comp_adler32_combine(pipe->checksum, checksum,
+						      msg->in_cons);
+	} else if (pipe->sess->alg_type == WD_GZIP) {
+		checksum = bit_reverse(~checksum);
+		pipe->checksum = comp_crc32_combine(pipe->checksum, checksum,
+						    msg->in_cons);
+	}
+}
+
+/* Complete the oldest chunk in flight, and join its output to the dst */
+static int pipe_recv(struct comp_pipe *pipe)
+{
+	struct comp_pipe_slot *slot = &pipe->slots[pipe->head % pipe->depth];
+	struct wd_comp_msg *msg = &slot->msg;
+	__u32 src_len = msg->req.src_len;
+	__u64 recv_count = 0;
+	__u32 hdr_sz = 0;
+	int ret;
+
+	do {
+		ret = wd_comp_setting.driver->comp_recv(slot->ctx->ctx, msg,
+							wd_comp_setting.priv);
+		if (ret == -WD_EAGAIN && ++recv_count > MAX_RETRY_COUNTS) {
+			WD_ERR("wd comp recv timeout fail!\n");
+			ret = -WD_ETIMEDOUT;
+		}
+	} while (ret == -WD_EAGAIN);
+	pthread_spin_unlock(&slot->ctx->lock);
+	pipe->head++;
+
+	if (ret < 0)
+		return ret;
+
+	if (msg->req.status != WD_SUCCESS || msg->in_cons != src_len) {
+		WD_ERR("wd comp pipe chunk failed, status(%u)!\n",
+		       msg->req.status);
+		if (!pipe->status)
+			pipe->status = msg->req.status ? msg->req.status :
+				       WD_IN_EPARA;
+		return -WD_EINVAL;
+	}
+
+	if (pipe->sess->alg_type == WD_ZLIB)
+		hdr_sz = ZLIB_HEADER_SZ;
+	else if (pipe->sess->alg_type == WD_GZIP)
+		hdr_sz = GZIP_HEADER_SZ;
+
+	if (msg->produced < hdr_sz) {
+		WD_ERR("wd comp pipe chunk has no header!\n");
+		pipe->status = WD_IN_EPARA;
+		return -WD_EINVAL;
+	}
+
+	pipe_add_checksum(pipe, msg);
+
+	/* the header of the stream is put once, drop the one of the chunk */
+	return pipe_put_out(pipe, slot->dst + hdr_sz, msg->produced - hdr_sz);
+}
+
+/*
+ * Lock the ctx of the next chunk. Spin only if nothing is in flight, as the
+ * locks held by the chunks in flight may be what another thread waits for.
+ */
+static int pipe_lock_ctx(struct comp_pipe *pipe, struct wd_ctx_internal *ctx)
+{
+	int ret;
+
+	while (pthread_spin_trylock(&ctx->lock)) {
+		if (pipe->head == pipe->tail) {
+			pthread_spin_lock(&ctx->lock);
+			break;
+		}
+
+		ret = pipe_recv(pipe);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Every chunk is compressed as a new stream of the session alg, so that the
+ * hardware does its checksum, and none is the last one: each ends with a sync
+ * flush instead of a final block or a trailer. The chunks join into one
+ * deflate stream, closed by pipe_put_trailer().
+ *
+ * This relies on a stateful request that isn't the last one ending on a byte
+ * boundary, which wd_do_comp_strm() relies on as well: the empty last request
+ * of a stream gets append_store_block(), whose stored block starts at a whole
+ * byte after the output of the requests before. Both the loopback driver
+ * (Z_SYNC_FLUSH) and hisi_zip end such a request that way.
+ */
+static int pipe_send(struct comp_pipe *pipe, void *src, __u32 len)
+{
+	struct wd_ctx_config_internal *config = &wd_comp_setting.config;
+	struct wd_comp_sess *sess = pipe->sess;
+	struct comp_pipe_slot *slot;
+	struct wd_comp_msg *msg;
+	__u32 idx;
+	int ret;
+
+	if (pipe->tail - pipe->head == pipe->depth) {
+		ret = pipe_recv(pipe);
+		if (ret)
+			return ret;
+	}
+
+	idx = wd_comp_setting.sched.pick_next_ctx(
+		wd_comp_setting.sched.h_sched_ctx, sess->sched_key,
+		CTX_MODE_SYNC);
+	ret = wd_check_ctx(config, CTX_MODE_SYNC, idx);
+	if (ret)
+		return ret;
+
+	slot = &pipe->slots[pipe->tail % pipe->depth];
+	slot->ctx = config->ctxs + idx;
+	msg = &slot->msg;
+	memset(msg, 0, sizeof(*msg));
+	msg->req.src = src;
+	msg->req.src_len = len;
+	msg->req.dst = slot->dst;
+	msg->req.dst_len = pipe->slot_out;
+	msg->req.op_type = WD_DIR_COMPRESS;
+	msg->req.data_fmt = WD_FLAT_BUF;
+	msg->alg_type = sess->alg_type;
+	msg->comp_lv = sess->comp_lv;
+	msg->win_sz = sess->win_sz;
+	msg->avail_out = pipe->slot_out;
+	msg->ctx_buf = slot->ctx_buf;
+	msg->stream_mode = WD_COMP_STATEFUL;
+	msg->stream_pos = WD_COMP_STREAM_NEW;
+
+	ret = pipe_lock_ctx(pipe, slot->ctx);
+	if (ret)
+		return ret;
+
+	ret = wd_comp_setting.driver->comp_send(slot->ctx->ctx, msg,
+						wd_comp_setting.priv);
+	if (ret < 0) {
+		pthread_spin_unlock(&slot->ctx->lock);
+		WD_ERR("wd comp send err(%d)!\n", ret);
+		return ret;
+	}
+	pipe->tail++;
+
+	return 0;
+}
+
+static void pipe_free(struct comp_pipe *pipe)
+{
+	__u32 i;
+
+	for (i = 0; i < pipe->depth; i++) {
+		comp_free_ctx_buf(pipe->slots[i].ctx_buf);
+		free(pipe->slots[i].dst);
+	}
+	free(pipe->slots);
+}
+
+static int pipe_alloc(struct comp_pipe *pipe, __u32 chunk)
+{
+	__u32 i;
+
+	pipe->slots = calloc(pipe->depth, sizeof(struct comp_pipe_slot));
+	if (!pipe->slots)
+		return -WD_ENOMEM;
+
+	pipe->slot_out = PIPE_OUT_SIZE(chunk);
+	for (i = 0; i < pipe->depth; i++) {
+		pipe->slots[i].ctx_buf = calloc(1, HW_CTX_SIZE);
+		pipe->slots[i].dst = malloc(pipe->slot_out);
+		if (!pipe->slots[i].ctx_buf || !pipe->slots[i].dst) {
+			pipe_free(pipe);
+			return -WD_ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void pipe_put_le32(__u8 *buf, __u32 val)
+{
+	buf[0] = val & 0xff;
+	buf[1] = (val >> 8) & 0xff;
+	buf[2] = (val >> 16) & 0xff;
+	buf[3] = val >> 24;
+}
+
+/*
+ * Close the stream with an empty final stored block, then the adler32 of
+ * zlib in big endian, or the crc32 and ISIZE of gzip in little endian.
+ */
+static int pipe_put_trailer(struct comp_pipe *pipe, __u32 isize)
+{
+	__u8 trailer[13] = {0x1, 0x00, 0x00, 0xff, 0xff};
+	__u32 len = 5;
+
+	if (pipe->sess->alg_type == WD_ZLIB) {
+		pipe_put_le32(trailer + len, cpu_to_be32(pipe->checksum));
+		len += sizeof(__u32);
+	} else if (pipe->sess->alg_type == WD_GZIP) {
+		pipe_put_le32(trailer + len, pipe->checksum);
+		pipe_put_le32(trailer + len + sizeof(__u32), isize);
+		len += sizeof(__u32) << 1;
+	}
+
+	return pipe_put_out(pipe, trailer, len);
+}
+
+/*
+ * Compress the chunks on up to pipe_depth sync ctxs at once. req->src_len
+ * counts the output bytes until the end, the input size is kept aside.
+ */
+static int wd_do_comp_sync2_pipe(struct wd_comp_sess *sess,
+				 struct wd_comp_req *req)
+{
+	__u32 chunk = sess->chunk_size;
+	__u32 total = req->src_len;
+	struct comp_pipe pipe;
+	__u32 off, len;
+	int ret;
+
+	memset(&pipe, 0, sizeof(pipe));
+	pipe.sess = sess;
+	pipe.req = req;
+	pipe.depth = sess->pipe_depth;
+	pipe.checksum = sess->alg_type == WD_ZLIB ? 1 : 0;
+	ret = pipe_alloc(&pipe, chunk);
+	if (ret)
+		return ret;
+
+	req->src_len = 0;
+	if (sess->alg_type == WD_ZLIB)
+		ret = pipe_put_out(&pipe, ZLIB_HEADER, ZLIB_HEADER_SZ);
+	else if (sess->alg_type == WD_GZIP)
+		ret = pipe_put_out(&pipe, GZIP_HEADER, GZIP_HEADER_SZ);
+
+	for (off = 0; !ret && off < total; off += len) {
+		len = total - off > chunk ? chunk : total - off;
+		ret = pipe_send(&pipe, req->src + off, len);
+	}
+
+	while (!ret && pipe.head != pipe.tail)
+		ret = pipe_recv(&pipe);
+
+	if (!ret)
+		ret = pipe_put_trailer(&pipe, total);
+
+	/* the chunks still in flight use the slots, wait for them anyway */
+	while (pipe.head != pipe.tail)
+		(void)pipe_recv(&pipe);
+	pipe_free(&pipe);
+
+	req->dst_len = req->src_len;
+	req->src_len = total;
+	req->status = pipe.status;
+
+	return ret;
+}
+
 int wd_do_comp_sync2(handle_t h_sess, struct wd_comp_req *req)
 {
 	struct wd_comp_sess *sess = (struct wd_comp_sess *)h_sess;
 	struct wd_comp_req strm_req;
-	__u32 chunk = STREAM_CHUNK;
+	__u32 chunk;
 	__u32 total_avail_in;
 	__u32 total_avail_out;
 	int ret;
@@ -509,6 +1209,17 @@ int wd_do_comp_sync2(handle_t h_sess, struct wd_comp_req *req)
 		return -WD_EINVAL;
 	}
 
+	chunk = sess->chunk_size;
+	/* the chunks of the pipe use their own buffers, which need SVA */
+	if (sess->pipe_depth > 1 && req->op_type == WD_DIR_COMPRESS &&
+	    sess->alg_type <= WD_GZIP && req->data_fmt == WD_FLAT_BUF &&
+	    req->src_len > chunk &&
+	    !wd_bounce_enabled(&wd_comp_setting.bounce)) {
+		wd_prefault_req(req->src, req->src_len, req->dst, req->dst_len,
+				WD_FLAT_BUF);
+		return wd_do_comp_sync2_pipe(sess, req);
+	}
+
 	total_avail_in = req->src_len;
 	total_avail_out = req->dst_len;
 	/* strm_req and req share the same src and dst buffer */
@@ -553,16 +1264,6 @@ int wd_do_comp_sync2(handle_t h_sess, struct wd_comp_req *req)
 	return 0;
 }
 
-static unsigned int bit_reverse(register unsigned int x)
-{
-	x = (((x & 0xaaaaaaaa) >> 1) | ((x & 0x55555555) << 1));
-	x = (((x & 0xcccccccc) >> 2) | ((x & 0x33333333) << 2));
-	x = (((x & 0xf0f0f0f0) >> 4) | ((x & 0x0f0f0f0f) << 4));
-	x = (((x & 0xff00ff00) >> 8) | ((x & 0x00ff00ff) << 8));
-
-	return((x >> 16) | (x << 16));
-}
-
 /**
  * append_store_block() - output an fixed store block when input
  * a empty block as last stream block. And supplement the packet
@@ -712,14 +1413,26 @@ int wd_do_comp_async(handle_t h_sess, struct wd_comp_req *req)
 	fill_comp_msg(sess, msg, req);
 	msg->tag = tag;
 	msg->stream_mode = WD_COMP_STATELESS;
+	/* a pooled msg may still point at the stream of another session */
+	msg->ctx_buf = NULL;
+	msg->strm_sess = NULL;
 	msg->is_polled = 0;
 
+	ret = comp_bounce_in(msg, idx);
+	if (ret) {
+		wd_put_msg_to_pool(&wd_comp_setting.pool, idx, msg->tag);
+		return ret;
+	}
+
 	pthread_spin_lock(&ctx->lock);
 
 	ret = wd_comp_setting.driver->comp_send(ctx->ctx, msg, priv);
 	if (ret < 0) {
+		pthread_spin_unlock(&ctx->lock);
 		WD_ERR("wd comp send err(%d)!\n", ret);
+		comp_bounce_out(msg, idx, false);
 		wd_put_msg_to_pool(&wd_comp_setting.pool, idx, msg->tag);
+		return ret;
 	}
 
 	pthread_spin_unlock(&ctx->lock);
@@ -729,6 +1442,214 @@ int wd_do_comp_async(handle_t h_sess, struct wd_comp_req *req)
 	return ret;
 }
 
+int wd_do_comp_strm_async(handle_t h_sess, struct wd_comp_req *req)
+{
+	struct wd_ctx_config_internal *config = &wd_comp_setting.config;
+	struct wd_comp_sess *sess = (struct wd_comp_sess *)h_sess;
+	handle_t h_sched_ctx = wd_comp_setting.sched.h_sched_ctx;
+	void *priv = wd_comp_setting.priv;
+	struct wd_ctx_internal *ctx;
+	struct wd_comp_msg *msg;
+	__u32 busy = 0;
+	int tag, ret;
+	__u32 idx;
+
+	ret = wd_comp_check_params(sess, req, CTX_MODE_ASYNC);
+	if (ret) {
+		WD_ERR("fail to check params!\n");
+		return ret;
+	}
+
+	if (req->data_fmt > WD_FLAT_BUF) {
+		WD_ERR("invalid: data_fmt is %d!\n", req->data_fmt);
+		return -WD_EINVAL;
+	}
+
+	/* one request of a stream at a time, it keeps the stream in order */
+	if (!__atomic_compare_exchange_n(&sess->strm_busy, &busy, 1, false,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return -WD_EBUSY;
+
+	if (sess->alg_type <= WD_GZIP && req->op_type == WD_DIR_COMPRESS &&
+	    req->last == 1 && req->src_len == 0) {
+		ret = append_store_block(sess, req);
+		__atomic_store_n(&sess->strm_busy, 0, __ATOMIC_RELEASE);
+		if (!ret)
+			req->cb(req, req->cb_param);
+		return ret;
+	}
+
+	if (sess->stream_pos == WD_COMP_STREAM_OLD)
+		idx = sess->strm_idx;
+	else
+		idx = wd_comp_setting.sched.pick_next_ctx(h_sched_ctx,
+							  sess->sched_key,
+							  CTX_MODE_ASYNC);
+	ret = wd_check_ctx(config, CTX_MODE_ASYNC, idx);
+	if (ret)
+		goto out;
+
+	sess->strm_idx = idx;
+	ctx = config->ctxs + idx;
+
+	tag = wd_get_msg_from_pool(&wd_comp_setting.pool, idx, (void **)&msg);
+	if (tag < 0) {
+		WD_ERR("busy, failed to get msg from pool!\n");
+		ret = -WD_EBUSY;
+		goto out;
+	}
+	fill_comp_msg(sess, msg, req);
+	msg->tag = tag;
+	msg->stream_pos = sess->stream_pos;
+	msg->ctx_buf = sess->ctx_buf;
+	msg->isize = sess->isize;
+	msg->checksum = sess->checksum;
+	msg->req.last = req->last;
+	msg->stream_mode = WD_COMP_STATEFUL;
+	msg->strm_sess = sess;
+	msg->is_polled = 0;
+
+	ret = comp_bounce_in(msg, idx);
+	if (ret) {
+		wd_put_msg_to_pool(&wd_comp_setting.pool, idx, msg->tag);
+		goto out;
+	}
+
+	pthread_spin_lock(&ctx->lock);
+
+	ret = wd_comp_setting.driver->comp_send(ctx->ctx, msg, priv);
+	if (ret < 0) {
+		pthread_spin_unlock(&ctx->lock);
+		WD_ERR("wd comp send err(%d)!\n", ret);
+		comp_bounce_out(msg, idx, false);
+		wd_put_msg_to_pool(&wd_comp_setting.pool, idx, msg->tag);
+		goto out;
+	}
+
+	pthread_spin_unlock(&ctx->lock);
+
+	wd_add_task_to_async_queue(&wd_comp_env_config, idx);
+
+	return 0;
+
+out:
+	__atomic_store_n(&sess->strm_busy, 0, __ATOMIC_RELEASE);
+	return ret;
+}
+
+static int comp_send_batch(handle_t h_ctx, struct wd_comp_msg **msgs,
+			   __u32 num, __u32 *count)
+{
+	struct wd_comp_driver *driver = wd_comp_setting.driver;
+	void *priv = wd_comp_setting.priv;
+	int ret = 0;
+
+	if (driver->comp_send_batch)
+		return driver->comp_send_batch(h_ctx, msgs, num, count, priv);
+
+	for (*count = 0; *count < num; (*count)++) {
+		ret = driver->comp_send(h_ctx, msgs[*count], priv);
+		if (ret < 0)
+			break;
+	}
+
+	return *count ? 0 : ret;
+}
+
+int wd_do_comp_async_batch(handle_t h_sess, struct wd_comp_req **reqs,
+			   __u32 num)
+{
+	struct wd_ctx_config_internal *config = &wd_comp_setting.config;
+	struct wd_comp_sess *sess = (struct wd_comp_sess *)h_sess;
+	handle_t h_sched_ctx = wd_comp_setting.sched.h_sched_ctx;
+	struct wd_comp_msg *msgs[WD_COMP_BATCH_NUM];
+	__u32 sent = 0, fill_num, cnt, idx, i;
+	struct wd_ctx_internal *ctx;
+	int tag, ret, fill_ret;
+
+	if (unlikely(!reqs || !num)) {
+		WD_ERR("invalid: comp batch reqs is NULL or num is 0!\n");
+		return -WD_EINVAL;
+	}
+
+	for (i = 0; i < num; i++) {
+		ret = wd_comp_check_params(sess, reqs[i], CTX_MODE_ASYNC);
+		if (ret) {
+			WD_ERR("fail to check params of req(%u)!\n", i);
+			return ret;
+		}
+
+		if (!reqs[i]->src_len) {
+			WD_ERR("invalid: req(%u) src_len is 0!\n", i);
+			return -WD_EINVAL;
+		}
+	}
+
+	idx = wd_comp_setting.sched.pick_next_ctx(h_sched_ctx,
+						  sess->sched_key,
+						  CTX_MODE_ASYNC);
+	ret = wd_check_ctx(config, CTX_MODE_ASYNC, idx);
+	if (ret)
+		return ret;
+
+	ctx = config->ctxs + idx;
+
+	while (sent < num) {
+		fill_ret = 0;
+		for (fill_num = 0; fill_num < WD_COMP_BATCH_NUM &&
+		     sent + fill_num < num; fill_num++) {
+			tag = wd_get_msg_from_pool(&wd_comp_setting.pool, idx,
+						   (void **)&msgs[fill_num]);
+			if (tag < 0)
+				break;
+
+			fill_comp_msg(sess, msgs[fill_num], reqs[sent + fill_num]);
+			msgs[fill_num]->tag = tag;
+			msgs[fill_num]->stream_mode = WD_COMP_STATELESS;
+			msgs[fill_num]->ctx_buf = NULL;
+			msgs[fill_num]->strm_sess = NULL;
+			msgs[fill_num]->is_polled = 0;
+			fill_ret = comp_bounce_in(msgs[fill_num], idx);
+			if (fill_ret) {
+				wd_put_msg_to_pool(&wd_comp_setting.pool, idx,
+						   tag);
+				break;
+			}
+		}
+
+		if (!fill_num) {
+			ret = fill_ret ? fill_ret : -WD_EBUSY;
+			break;
+		}
+
+		cnt = 0;
+		pthread_spin_lock(&ctx->lock);
+		ret = comp_send_batch(ctx->ctx, msgs, fill_num, &cnt);
+		pthread_spin_unlock(&ctx->lock);
+
+		for (i = cnt; i < fill_num; i++) {
+			comp_bounce_out(msgs[i], idx, false);
+			wd_put_msg_to_pool(&wd_comp_setting.pool, idx,
+					   msgs[i]->tag);
+		}
+
+		sent += cnt;
+		if (cnt < fill_num || fill_ret)
+			break;
+	}
+
+	for (i = 0; i < sent; i++)
+		wd_add_task_to_async_queue(&wd_comp_env_config, idx);
+
+	if (!sent) {
+		if (ret != -WD_EBUSY)
+			WD_ERR("wd comp batch send err(%d)!\n", ret);
+		return ret ? ret : -WD_EBUSY;
+	}
+
+	return sent;
+}
+
 int wd_comp_poll(__u32 expt, __u32 *count)
 {
 	handle_t h_sched_ctx;
@@ -817,3 +1738,14 @@ int wd_comp_get_env_param(__u32 node, __u32 type, __u32 mode,
 	return wd_alg_get_env_param(&wd_comp_env_config,
 				    ctx_attr, num, is_enable);
 }
+
+int wd_comp_get_sync_wait_stat(__u32 idx, struct wd_sync_wait_stat *stat)
+{
+	return wd_get_sync_wait_stat(&wd_comp_setting.config, idx, stat);
+}
+
+int wd_comp_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats)
+{
+	return wd_get_ctx_stats(&wd_comp_setting.config, &wd_comp_setting.pool,
+				idx, stats);
+}
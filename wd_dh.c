@@ -107,7 +107,8 @@ int wd_dh_init(struct wd_ctx_config *config, struct wd_sched *sched)
 		return ret;
 	}
 
-	ret = wd_init_sched(&wd_dh_setting.sched, sched);
+	ret = wd_init_sched(&wd_dh_setting.sched, sched,
+			    &wd_dh_setting.pool);
 	if (ret) {
 		WD_ERR("failed to wd initialize sched, ret = %d\n", ret);
 		goto out;
@@ -117,9 +118,10 @@ int wd_dh_init(struct wd_ctx_config *config, struct wd_sched *sched)
 	wd_dh_set_static_drv();
 #endif
 
-	/* initialize async request pool */
+	/* the msgs of the async ctxs are allocated on demand */
 	ret = wd_init_async_request_pool(&wd_dh_setting.pool,
-					 config->ctx_num, WD_POOL_MAX_ENTRIES,
+					 &wd_dh_setting.config,
+					 WD_POOL_MAX_ENTRIES,
 					 sizeof(struct wd_dh_msg));
 	if (ret) {
 		WD_ERR("failed to initialize async req pool, ret = %d!\n", ret);
@@ -253,6 +255,7 @@ static int dh_recv_sync(handle_t ctx, struct wd_dh_msg *msg)
 	} while (ret < 0);
 
 	balance = rx_cnt;
+	wd_ctx_stats_sync(wd_ctx_get_stats_area(ctx), rx_cnt);
 	req->status = msg->result;
 
 	return GET_NEGATIVE(req->status);
@@ -351,12 +354,18 @@ fail_with_msg:
 	return ret;
 }
 
+static void dh_msg_done(void *msg)
+{
+	struct wd_dh_req *req = &((struct wd_dh_msg *)msg)->req;
+
+	req->cb(req);
+}
+
 int wd_dh_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 {
 	struct wd_ctx_config_internal *config = &wd_dh_setting.config;
 	struct wd_ctx_internal *ctx;
 	struct wd_dh_msg rcv_msg;
-	struct wd_dh_req *req;
 	struct wd_dh_msg *msg;
 	__u32 rcv_cnt = 0;
 	int ret;
@@ -395,9 +404,8 @@ int wd_dh_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 
 		msg->req.pri_bytes = rcv_msg.req.pri_bytes;
 		msg->req.status = rcv_msg.result;
-		req = &msg->req;
-		req->cb(req);
-		wd_put_msg_to_pool(&wd_dh_setting.pool, idx, rcv_msg.tag);
+		wd_complete_msg(&wd_dh_setting.pool, idx, rcv_msg.tag, msg,
+				dh_msg_done);
 		*count = rcv_cnt;
 	} while (--expt);
 
@@ -596,3 +604,9 @@ int wd_dh_get_env_param(__u32 node, __u32 type, __u32 mode,
 	return wd_alg_get_env_param(&wd_dh_env_config,
 				    ctx_attr, num, is_enable);
 }
+
+int wd_dh_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats)
+{
+	return wd_get_ctx_stats(&wd_dh_setting.config, &wd_dh_setting.pool,
+				idx, stats);
+}
@@ -16,6 +16,8 @@
 #define DES3_3KEY_SIZE		(3 * DES_KEY_SIZE)
 
 #define WD_POOL_MAX_ENTRIES	1024
+/* msgs sent to the driver at a time in async batch */
+#define WD_DIGEST_BATCH_NUM	32
 #define DES_WEAK_KEY_NUM	4
 #define MAX_RETRY_COUNTS	200000000
 
@@ -50,6 +52,7 @@ struct wd_digest_sess {
 	int				state;
 	/* Total of data for stream mode */
 	__u64			 long_data_len;
+	struct wd_sqe_tmpl	tmpl;
 };
 
 struct wd_env_config wd_digest_env_config;
@@ -65,9 +68,12 @@ static void wd_digest_set_static_drv(void)
 static void __attribute__((constructor)) wd_digest_open_driver(void)
 {
 	/* Fix me: vendor driver should be put in /usr/lib/wd/ */
-	wd_digest_setting.dlhandle = dlopen("libhisi_sec.so", RTLD_NOW);
+	const char *lib = wd_is_loopback() ? "libloopback_sec.so" :
+			  "libhisi_sec.so";
+
+	wd_digest_setting.dlhandle = dlopen(lib, RTLD_NOW);
 	if (!wd_digest_setting.dlhandle)
-		WD_ERR("fail to open libhisi_sec.so\n");
+		WD_ERR("fail to open %s\n", lib);
 }
 
 static void __attribute__((destructor)) wd_digest_close_driver(void)
@@ -100,6 +106,7 @@ int wd_digest_set_key(handle_t h_sess, const __u8 *key, __u32 key_len)
 
 	sess->key_bytes = key_len;
 	memcpy(sess->key, key, key_len);
+	wd_key_fmt_reset(&sess->tmpl.fmt);
 
 	return 0;
 }
@@ -177,7 +184,8 @@ int wd_digest_init(struct wd_ctx_config *config, struct wd_sched *sched)
 		return ret;
 	}
 
-	ret = wd_init_sched(&wd_digest_setting.sched, sched);
+	ret = wd_init_sched(&wd_digest_setting.sched, sched,
+			    &wd_digest_setting.pool);
 	if (ret < 0) {
 		WD_ERR("failed to set sched, ret = %d!\n", ret);
 		goto out;
@@ -188,9 +196,10 @@ int wd_digest_init(struct wd_ctx_config *config, struct wd_sched *sched)
 	wd_digest_set_static_drv();
 #endif
 
-	/* allocate async pool for every ctx */
+	/* the msgs of the async ctxs are allocated on demand */
 	ret = wd_init_async_request_pool(&wd_digest_setting.pool,
-					 config->ctx_num, WD_POOL_MAX_ENTRIES,
+					 &wd_digest_setting.config,
+					 WD_POOL_MAX_ENTRIES,
 					 sizeof(struct wd_digest_msg));
 	if (ret < 0) {
 		WD_ERR("failed to init req pool, ret = %d!\n", ret);
@@ -292,6 +301,10 @@ static void fill_request_msg(struct wd_digest_msg *msg,
 	msg->out_bytes = req->out_bytes;
 	msg->data_fmt = req->data_fmt;
 	msg->has_next = req->has_next;
+	msg->tmpl = &sess->tmpl;
+	/* the digest is always written to a flat buffer */
+	wd_prefault_req(req->in, req->in_bytes, NULL, 0, req->data_fmt);
+	wd_prefault_submit(req->out, req->out_bytes, WD_PREFAULT_WRITE);
 	sess->long_data_len += req->in_bytes;
 	msg->long_data_len = sess->long_data_len;
 	/* To store the stream bd state */
@@ -316,7 +329,7 @@ static int send_recv_sync(struct wd_ctx_internal *ctx, struct wd_digest_sess *ds
 	}
 
 	do {
-		if (msg->is_polled) {
+		if (wd_sync_wait_sleep(ctx, msg->is_polled, recv_cnt)) {
 			ret = wd_ctx_wait(ctx->ctx, POLL_TIME);
 			if (unlikely(ret < 0))
 				WD_ERR("wd digest ctx wait timeout(%d)!\n", ret);
@@ -336,6 +349,7 @@ static int send_recv_sync(struct wd_ctx_internal *ctx, struct wd_digest_sess *ds
 			dsess->state = msg->out_bytes;
 	} while (ret < 0);
 
+	wd_sync_wait_done(ctx, recv_cnt);
 out:
 	pthread_spin_unlock(&ctx->lock);
 	return ret;
@@ -367,6 +381,7 @@ int wd_do_digest_sync(handle_t h_sess, struct wd_digest_req *req)
 		return ret;
 
 	ctx = config->ctxs + idx;
+	msg.is_polled |= wd_sync_wait_irq(ctx);
 	ret = send_recv_sync(ctx, dsess, &msg);
 	req->state = msg.result;
 
@@ -425,12 +440,113 @@ int wd_do_digest_async(handle_t h_sess, struct wd_digest_req *req)
 	return 0;
 }
 
+static int digest_send_batch(handle_t h_ctx, struct wd_digest_msg **msgs,
+			     __u32 num, __u32 *count)
+{
+	struct wd_digest_driver *driver = wd_digest_setting.driver;
+	int ret = 0;
+
+	if (driver->digest_send_batch)
+		return driver->digest_send_batch(h_ctx, msgs, num, count);
+
+	for (*count = 0; *count < num; (*count)++) {
+		ret = driver->digest_send(h_ctx, msgs[*count]);
+		if (ret < 0)
+			break;
+	}
+
+	return *count ? 0 : ret;
+}
+
+int wd_do_digest_async_batch(handle_t h_sess, struct wd_digest_req **reqs,
+			     __u32 num)
+{
+	struct wd_ctx_config_internal *config = &wd_digest_setting.config;
+	struct wd_digest_sess *dsess = (struct wd_digest_sess *)h_sess;
+	struct wd_digest_msg *msgs[WD_DIGEST_BATCH_NUM];
+	__u32 sent = 0, fill_num, cnt, idx, i;
+	struct wd_ctx_internal *ctx;
+	int tag, ret = 0;
+
+	if (unlikely(!reqs || !num)) {
+		WD_ERR("invalid: digest batch reqs is NULL or num is 0!\n");
+		return -WD_EINVAL;
+	}
+
+	for (i = 0; i < num; i++) {
+		ret = digest_param_check(dsess, reqs[i]);
+		if (unlikely(ret))
+			return -WD_EINVAL;
+
+		if (unlikely(!reqs[i]->cb)) {
+			WD_ERR("digest input req(%u) cb is NULL.\n", i);
+			return -WD_EINVAL;
+		}
+	}
+
+	idx = wd_digest_setting.sched.pick_next_ctx(
+		wd_digest_setting.sched.h_sched_ctx,
+		dsess->sched_key, CTX_MODE_ASYNC);
+	ret = wd_check_ctx(config, CTX_MODE_ASYNC, idx);
+	if (ret)
+		return ret;
+
+	ctx = config->ctxs + idx;
+
+	while (sent < num) {
+		for (fill_num = 0; fill_num < WD_DIGEST_BATCH_NUM &&
+		     sent + fill_num < num; fill_num++) {
+			tag = wd_get_msg_from_pool(&wd_digest_setting.pool, idx,
+						   (void **)&msgs[fill_num]);
+			if (tag < 0)
+				break;
+
+			fill_request_msg(msgs[fill_num], reqs[sent + fill_num],
+					 dsess);
+			msgs[fill_num]->tag = tag;
+			msgs[fill_num]->is_polled = 0;
+		}
+
+		if (!fill_num) {
+			ret = -WD_EBUSY;
+			break;
+		}
+
+		cnt = 0;
+		ret = digest_send_batch(ctx->ctx, msgs, fill_num, &cnt);
+		for (i = cnt; i < fill_num; i++)
+			wd_put_msg_to_pool(&wd_digest_setting.pool, idx,
+					   msgs[i]->tag);
+
+		sent += cnt;
+		if (cnt < fill_num)
+			break;
+	}
+
+	for (i = 0; i < sent; i++)
+		wd_add_task_to_async_queue(&wd_digest_env_config, idx);
+
+	if (!sent) {
+		if (ret != -WD_EBUSY)
+			WD_ERR("wd digest batch send err(%d)!\n", ret);
+		return ret ? ret : -WD_EBUSY;
+	}
+
+	return sent;
+}
+
+static void digest_msg_done(void *msg)
+{
+	struct wd_digest_req *req = &((struct wd_digest_msg *)msg)->req;
+
+	req->cb(req);
+}
+
 int wd_digest_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 {
 	struct wd_ctx_config_internal *config = &wd_digest_setting.config;
 	struct wd_ctx_internal *ctx;
 	struct wd_digest_msg recv_msg, *msg;
-	struct wd_digest_req *req;
 	__u32 recv_cnt = 0;
 	int ret;
 
@@ -467,12 +583,8 @@ int wd_digest_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 		}
 
 		msg->req.state = recv_msg.result;
-		req = &msg->req;
-		if (likely(req))
-			req->cb(req);
-
-		wd_put_msg_to_pool(&wd_digest_setting.pool, idx,
-				   recv_msg.tag);
+		wd_complete_msg(&wd_digest_setting.pool, idx, recv_msg.tag,
+				msg, digest_msg_done);
 		*count = recv_cnt;
 	} while (--expt);
 
@@ -550,3 +662,14 @@ int wd_digest_get_env_param(__u32 node, __u32 type, __u32 mode,
 	return wd_alg_get_env_param(&wd_digest_env_config,
 				    ctx_attr, num, is_enable);
 }
+
+int wd_digest_get_sync_wait_stat(__u32 idx, struct wd_sync_wait_stat *stat)
+{
+	return wd_get_sync_wait_stat(&wd_digest_setting.config, idx, stat);
+}
+
+int wd_digest_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats)
+{
+	return wd_get_ctx_stats(&wd_digest_setting.config, &wd_digest_setting.pool,
+				idx, stats);
+}
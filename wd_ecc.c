@@ -18,6 +18,8 @@
 #include "include/wd_ecc_curve.h"
 
 #define WD_POOL_MAX_ENTRIES		1024
+/* msgs sent to the driver at a time in async batch */
+#define WD_ECC_BATCH_NUM		32
 #define WD_ECC_CTX_MSG_NUM		64
 #define WD_ECC_MAX_CTX			256
 #define ECC_BALANCE_THRHD		1280
@@ -161,7 +163,8 @@ int wd_ecc_init(struct wd_ctx_config *config, struct wd_sched *sched)
 		return ret;
 	}
 
-	ret = wd_init_sched(&wd_ecc_setting.sched, sched);
+	ret = wd_init_sched(&wd_ecc_setting.sched, sched,
+			    &wd_ecc_setting.pool);
 	if (ret < 0) {
 		WD_ERR("failed to set sched, ret = %d!\n", ret);
 		goto out;
@@ -171,9 +174,10 @@ int wd_ecc_init(struct wd_ctx_config *config, struct wd_sched *sched)
 	wd_ecc_set_static_drv();
 #endif
 
-	/* fix me: sadly find we allocate async pool for every ctx */
+	/* the msgs of the async ctxs are allocated on demand */
 	ret = wd_init_async_request_pool(&wd_ecc_setting.pool,
-					 config->ctx_num, WD_POOL_MAX_ENTRIES,
+					 &wd_ecc_setting.config,
+					 WD_POOL_MAX_ENTRIES,
 					 sizeof(struct wd_ecc_msg));
 	if (ret < 0) {
 		WD_ERR("failed to initialize async req pool, ret = %d!\n", ret);
@@ -372,6 +376,7 @@ static struct wd_ecc_prikey *create_ecc_prikey(struct wd_ecc_sess *sess)
 
 	memset(data, 0, dsz);
 	prikey->size = dsz;
+	prikey->fmt = WD_KEY_FMT_RAW;
 	prikey->data = data;
 	init_ecc_prikey(prikey, sess->key_size, hsz);
 
@@ -401,6 +406,7 @@ static struct wd_ecc_pubkey *create_ecc_pubkey(struct wd_ecc_sess *sess)
 
 	memset(data, 0, dsz);
 	pubkey->size = dsz;
+	pubkey->fmt = WD_KEY_FMT_RAW;
 	pubkey->data = data;
 	init_ecc_pubkey(pubkey, sess->key_size, hsz);
 
@@ -1103,6 +1109,8 @@ int wd_ecc_set_prikey(struct wd_ecc_key *ecc_key,
 		return -WD_EINVAL;
 	}
 
+	wd_key_fmt_reset(&ecc_prikey->fmt);
+
 	ret = set_param_single(&ecc_prikey->d, prikey, "set prikey d");
 	if (ret)
 		return ret;
@@ -1141,6 +1149,8 @@ int wd_ecc_set_pubkey(struct wd_ecc_key *ecc_key, struct wd_ecc_point *pubkey)
 		return -WD_EINVAL;
 	}
 
+	wd_key_fmt_reset(&ecc_pubkey->fmt);
+
 	ret = set_param_single(&ecc_pubkey->pub.x, &pubkey->x, "ecc pubkey x");
 	if (ret)
 		return ret;
@@ -1398,16 +1408,6 @@ static int fill_ecc_msg(struct wd_ecc_msg *msg, struct wd_ecc_req *req,
 	return WD_SUCCESS;
 }
 
-static void msg_pack(char *dst, __u64 dst_len, __u64 *out_len,
-		     const void *src, __u32 src_len)
-{
-	if (!src || !src_len)
-		return;
-
-	memcpy(dst + *out_len, src, src_len);
-	*out_len += src_len;
-}
-
 static int ecc_send(handle_t ctx, struct wd_ecc_msg *msg)
 {
 	__u32 tx_cnt = 0;
@@ -1452,6 +1452,7 @@ static int ecc_recv_sync(handle_t ctx, struct wd_ecc_msg *msg)
 	} while (ret < 0);
 
 	balance = rx_cnt;
+	wd_ctx_stats_sync(wd_ctx_get_stats_area(ctx), rx_cnt);
 	req->status = msg->result;
 	req->dst_bytes = msg->req.dst_bytes;
 
@@ -1562,22 +1563,25 @@ static int generate_random(struct wd_ecc_sess *sess, struct wd_dtb *k)
 	return ret;
 }
 
+static void sm2_za_dtb(struct wd_dtb *dtb, void *data, __u32 dsize)
+{
+	dtb->data = data;
+	dtb->dsize = dsize;
+}
+
 static int sm2_compute_za_hash(__u8 *za, __u32 *len, struct wd_dtb *id,
 			       struct wd_ecc_sess *sess)
 
 {
 	__u32 key_size = BITS_TO_BYTES(sess->setup.key_bits);
 	struct wd_hash_mt *hash = &sess->setup.hash;
+	struct wd_dtb in[ZA_PARAM_NUM + 2];
 	struct wd_ecc_point *pub = sess->key.pub;
 	struct wd_ecc_curve *cv = sess->key.cv;
 	__u16 id_bytes = 0;
 	__u16 id_bits = 0;
-	__u64 in_len = 0;
 	__u32 hash_bytes;
-	char *p_in;
-	__u64 lens;
-	__u8 temp;
-	int ret;
+	__u8 entl[2];
 
 	if (id && (!BYTES_TO_BITS(id->dsize) || !id->data ||
 		   BYTES_TO_BITS(id->dsize) > UINT16_MAX)) {
@@ -1591,32 +1595,21 @@ static int sm2_compute_za_hash(__u8 *za, __u32 *len, struct wd_dtb *id,
 	}
 
 	/* ZA = h(ENTL || ID || a || b || xG || yG || xA || yA) */
-	lens = sizeof(__u16) + id_bytes + ZA_PARAM_NUM * key_size;
-	p_in = malloc(lens);
-	if (unlikely(!p_in))
-		return -WD_ENOMEM;
-
-	memset(p_in, 0, lens);
-	temp = id_bits >> 8;
-	msg_pack(p_in, lens, &in_len, &temp, sizeof(__u8));
-	temp = id_bits & 0xFF;
-	msg_pack(p_in, lens, &in_len, &temp, sizeof(__u8));
-	if (id)
-		msg_pack(p_in, lens, &in_len, id->data, id_bytes);
-	msg_pack(p_in, lens, &in_len, cv->a.data, key_size);
-	msg_pack(p_in, lens, &in_len, cv->b.data, key_size);
-	msg_pack(p_in, lens, &in_len, cv->g.x.data, key_size);
-	msg_pack(p_in, lens, &in_len, cv->g.y.data, key_size);
-	msg_pack(p_in, lens, &in_len, pub->x.data, key_size);
-	msg_pack(p_in, lens, &in_len, pub->y.data, key_size);
+	entl[0] = id_bits >> 8;
+	entl[1] = id_bits & 0xFF;
+	sm2_za_dtb(&in[0], entl, sizeof(entl));
+	sm2_za_dtb(&in[1], id ? id->data : NULL, id_bytes);
+	sm2_za_dtb(&in[2], cv->a.data, key_size);
+	sm2_za_dtb(&in[3], cv->b.data, key_size);
+	sm2_za_dtb(&in[4], cv->g.x.data, key_size);
+	sm2_za_dtb(&in[5], cv->g.y.data, key_size);
+	sm2_za_dtb(&in[6], pub->x.data, key_size);
+	sm2_za_dtb(&in[7], pub->y.data, key_size);
 	hash_bytes = get_hash_bytes(hash->type);
 	*len = hash_bytes;
-	ret = hash->cb((const char *)p_in, in_len,
-			(void *)za, hash_bytes, hash->usr);
 
-	free(p_in);
-
-	return ret;
+	return wd_ecc_hash_dtbs(hash, in, ARRAY_SIZE(in), (char *)za,
+				hash_bytes);
 }
 
 static int sm2_compute_digest(struct wd_ecc_sess *sess, struct wd_dtb *hash_msg,
@@ -1626,10 +1619,8 @@ static int sm2_compute_digest(struct wd_ecc_sess *sess, struct wd_dtb *hash_msg,
 	struct wd_hash_mt *hash = &sess->setup.hash;
 	__u8 za[SM2_KEY_SIZE] = {0};
 	__u32 za_len = SM2_KEY_SIZE;
+	struct wd_dtb in[2];
 	__u32 hash_bytes;
-	__u64 in_len = 0;
-	char *p_in;
-	__u64 lens;
 	int ret;
 
 	hash_bytes = get_hash_bytes(hash->type);
@@ -1644,23 +1635,15 @@ static int sm2_compute_digest(struct wd_ecc_sess *sess, struct wd_dtb *hash_msg,
 		return ret;
 	}
 
-	lens = plaintext->dsize + hash_bytes;
-	p_in = malloc(lens);
-	if (unlikely(!p_in))
-		return -WD_ENOMEM;
-
 	/* e = h(ZA || M) */
-	memset(p_in, 0, lens);
-	msg_pack(p_in, lens, &in_len, za, za_len);
-	msg_pack(p_in, lens, &in_len, plaintext->data, plaintext->dsize);
+	sm2_za_dtb(&in[0], za, za_len);
+	sm2_za_dtb(&in[1], plaintext->data, plaintext->dsize);
 	hash_msg->dsize = hash_bytes;
-	ret = hash->cb((const char *)p_in, in_len, hash_msg->data,
-			hash_bytes, hash->usr);
+	ret = wd_ecc_hash_dtbs(hash, in, ARRAY_SIZE(in), hash_msg->data,
+			       hash_bytes);
 	if (unlikely(ret))
 		WD_ERR("failed to compute e, ret = %d!\n", ret);
 
-	free(p_in);
-
 	return ret;
 }
 
@@ -2196,12 +2179,117 @@ fail_with_msg:
 	return ret;
 }
 
+static int ecc_send_batch(handle_t ctx, struct wd_ecc_msg **msgs, __u32 num,
+			  __u32 *count)
+{
+	const struct wd_ecc_driver *driver = wd_ecc_setting.driver;
+	int ret = 0;
+
+	if (driver->send_batch)
+		return driver->send_batch(ctx, msgs, num, count);
+
+	for (*count = 0; *count < num; (*count)++) {
+		ret = driver->send(ctx, msgs[*count]);
+		if (ret < 0)
+			break;
+	}
+
+	return *count ? 0 : ret;
+}
+
+int wd_do_ecc_async_batch(handle_t sess, struct wd_ecc_req **reqs,
+			  __u32 num)
+{
+	struct wd_ctx_config_internal *config = &wd_ecc_setting.config;
+	handle_t h_sched_ctx = wd_ecc_setting.sched.h_sched_ctx;
+	struct wd_ecc_sess *sess_t = (struct wd_ecc_sess *)sess;
+	struct wd_ecc_msg *msgs[WD_ECC_BATCH_NUM];
+	__u32 sent = 0, fill_num, cnt, idx, i;
+	struct wd_ctx_internal *ctx;
+	int ret = 0;
+	int mid;
+
+	if (unlikely(!sess || !reqs || !num)) {
+		WD_ERR("invalid: ecc batch sess or reqs is NULL or num is 0!\n");
+		return -WD_EINVAL;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (unlikely(!reqs[i] || !reqs[i]->cb)) {
+			WD_ERR("invalid: req(%u) or its cb is NULL!\n", i);
+			return -WD_EINVAL;
+		}
+	}
+
+	idx = wd_ecc_setting.sched.pick_next_ctx(h_sched_ctx,
+						sess_t->sched_key,
+						CTX_MODE_ASYNC);
+	ret = wd_check_ctx(config, CTX_MODE_ASYNC, idx);
+	if (ret)
+		return ret;
+
+	ctx = config->ctxs + idx;
+
+	while (sent < num) {
+		for (fill_num = 0; fill_num < WD_ECC_BATCH_NUM &&
+		     sent + fill_num < num; fill_num++) {
+			mid = wd_get_msg_from_pool(&wd_ecc_setting.pool, idx,
+						   (void **)&msgs[fill_num]);
+			if (mid < 0) {
+				ret = -WD_EBUSY;
+				break;
+			}
+
+			ret = fill_ecc_msg(msgs[fill_num], reqs[sent + fill_num],
+					  sess_t);
+			if (ret) {
+				wd_put_msg_to_pool(&wd_ecc_setting.pool, idx, mid);
+				break;
+			}
+			msgs[fill_num]->tag = mid;
+		}
+
+		if (!fill_num)
+			break;
+
+		cnt = 0;
+		pthread_spin_lock(&ctx->lock);
+		ret = ecc_send_batch(ctx->ctx, msgs, fill_num, &cnt);
+		pthread_spin_unlock(&ctx->lock);
+
+		for (i = cnt; i < fill_num; i++)
+			wd_put_msg_to_pool(&wd_ecc_setting.pool, idx,
+					   msgs[i]->tag);
+
+		sent += cnt;
+		if (ret || cnt < fill_num)
+			break;
+	}
+
+	for (i = 0; i < sent; i++)
+		wd_add_task_to_async_queue(&wd_ecc_env_config, idx);
+
+	if (!sent) {
+		if (ret != -WD_EBUSY)
+			WD_ERR("wd ecc batch send err(%d)!\n", ret);
+		return ret ? ret : -WD_EBUSY;
+	}
+
+	return sent;
+}
+
+static void ecc_msg_done(void *msg)
+{
+	struct wd_ecc_req *req = &((struct wd_ecc_msg *)msg)->req;
+
+	req->cb(req);
+}
+
 int wd_ecc_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 {
 	struct wd_ctx_config_internal *config = &wd_ecc_setting.config;
 	struct wd_ecc_msg recv_msg, *msg;
 	struct wd_ctx_internal *ctx;
-	struct wd_ecc_req *req;
 	__u32 rcv_cnt = 0;
 	int ret;
 
@@ -2239,9 +2327,8 @@ int wd_ecc_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 
 		msg->req.dst_bytes = recv_msg.req.dst_bytes;
 		msg->req.status = recv_msg.result;
-		req = &msg->req;
-		req->cb(req);
-		wd_put_msg_to_pool(&wd_ecc_setting.pool, idx, recv_msg.tag);
+		wd_complete_msg(&wd_ecc_setting.pool, idx, recv_msg.tag, msg,
+				ecc_msg_done);
 		*count = rcv_cnt;
 	} while (--expt);
 
@@ -2318,3 +2405,9 @@ int wd_ecc_get_env_param(__u32 node, __u32 type, __u32 mode,
 	return wd_alg_get_env_param(&wd_ecc_env_config,
 				    ctx_attr, num, is_enable);
 }
+
+int wd_ecc_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats)
+{
+	return wd_get_ctx_stats(&wd_ecc_setting.config, &wd_ecc_setting.pool,
+				idx, stats);
+}
@@ -0,0 +1,397 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd_ecc.h"
+#include "include/drv/wd_ecc_drv.h"
+
+/* inputs up to this size are packed on the stack for a user hash callback */
+#define HASH_STACK_IN_MAX		512
+#define HASH_LEN_BYTES			8
+#define HASH_PAD_BYTE			0x80
+/* the largest digest of a hash callback, and x2 || y2 of a 521 bits curve */
+#define KDF_HASH_MAX_BYTES		BITS_TO_BYTES(521)
+#define KDF_CTR_BYTES			4
+#define KDF_IN_MAX			(2 * KDF_HASH_MAX_BYTES + KDF_CTR_BYTES)
+
+#define ROTL32(x, n)	(((x) << ((n) & 31)) | ((x) >> ((32 - ((n) & 31)) & 31)))
+#define ROTR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static const __u32 sm3_iv[WD_ECC_HASH_WORDS] = {
+	0x7380166f, 0x4914b2b9, 0x172442d7, 0xda8a0600,
+	0xa96f30bc, 0x163138aa, 0xe38dee4d, 0xb0fb0e4e,
+};
+
+static const __u32 sha256_iv[WD_ECC_HASH_WORDS] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const __u32 sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static __u32 get_be32(const __u8 *p)
+{
+	return ((__u32)p[0] << 24) | ((__u32)p[1] << 16) |
+	       ((__u32)p[2] << 8) | (__u32)p[3];
+}
+
+static void put_be32(__u8 *p, __u32 val)
+{
+	p[0] = val >> 24;
+	p[1] = val >> 16;
+	p[2] = val >> 8;
+	p[3] = val;
+}
+
+#define SM3_P0(x)	((x) ^ ROTL32(x, 9) ^ ROTL32(x, 17))
+#define SM3_P1(x)	((x) ^ ROTL32(x, 15) ^ ROTL32(x, 23))
+
+static void sm3_compress(__u32 *v, const __u8 *blk)
+{
+	__u32 a, b, c, d, e, f, g, h;
+	__u32 ss1, ss2, tt1, tt2;
+	__u32 w[68];
+	int j;
+
+	for (j = 0; j < 16; j++)
+		w[j] = get_be32(blk + j * 4);
+
+	for (j = 16; j < 68; j++)
+		w[j] = SM3_P1(w[j - 16] ^ w[j - 9] ^ ROTL32(w[j - 3], 15)) ^
+		       ROTL32(w[j - 13], 7) ^ w[j - 6];
+
+	a = v[0];
+	b = v[1];
+	c = v[2];
+	d = v[3];
+	e = v[4];
+	f = v[5];
+	g = v[6];
+	h = v[7];
+
+	for (j = 0; j < 64; j++) {
+		ss1 = ROTL32(ROTL32(a, 12) + e +
+			     ROTL32(j < 16 ? 0x79cc4519 : 0x7a879d8a, j), 7);
+		ss2 = ss1 ^ ROTL32(a, 12);
+		if (j < 16) {
+			tt1 = (a ^ b ^ c) + d + ss2 + (w[j] ^ w[j + 4]);
+			tt2 = (e ^ f ^ g) + h + ss1 + w[j];
+		} else {
+			tt1 = ((a & b) | (a & c) | (b & c)) + d + ss2 +
+			      (w[j] ^ w[j + 4]);
+			tt2 = ((e & f) | (~e & g)) + h + ss1 + w[j];
+		}
+		d = c;
+		c = ROTL32(b, 9);
+		b = a;
+		a = tt1;
+		h = g;
+		g = ROTL32(f, 19);
+		f = e;
+		e = SM3_P0(tt2);
+	}
+
+	v[0] ^= a;
+	v[1] ^= b;
+	v[2] ^= c;
+	v[3] ^= d;
+	v[4] ^= e;
+	v[5] ^= f;
+	v[6] ^= g;
+	v[7] ^= h;
+}
+
+static void sha256_compress(__u32 *v, const __u8 *blk)
+{
+	__u32 a, b, c, d, e, f, g, h;
+	__u32 s0, s1, t1, t2;
+	__u32 w[64];
+	int j;
+
+	for (j = 0; j < 16; j++)
+		w[j] = get_be32(blk + j * 4);
+
+	for (j = 16; j < 64; j++) {
+		s0 = ROTR32(w[j - 15], 7) ^ ROTR32(w[j - 15], 18) ^
+		     (w[j - 15] >> 3);
+		s1 = ROTR32(w[j - 2], 17) ^ ROTR32(w[j - 2], 19) ^
+		     (w[j - 2] >> 10);
+		w[j] = w[j - 16] + s0 + w[j - 7] + s1;
+	}
+
+	a = v[0];
+	b = v[1];
+	c = v[2];
+	d = v[3];
+	e = v[4];
+	f = v[5];
+	g = v[6];
+	h = v[7];
+
+	for (j = 0; j < 64; j++) {
+		s1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+		t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[j] + w[j];
+		s0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+		t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	v[0] += a;
+	v[1] += b;
+	v[2] += c;
+	v[3] += d;
+	v[4] += e;
+	v[5] += f;
+	v[6] += g;
+	v[7] += h;
+}
+
+static void hash_compress(struct wd_ecc_hash_ctx *ctx, const __u8 *blk)
+{
+	if (ctx->type == WD_HASH_SM3)
+		sm3_compress(ctx->state, blk);
+	else
+		sha256_compress(ctx->state, blk);
+}
+
+bool wd_ecc_hash_is_soft(__u8 type)
+{
+	return type == WD_HASH_SM3 || type == WD_HASH_SHA256;
+}
+
+bool wd_ecc_hash_use_soft(const struct wd_hash_mt *hash)
+{
+	return !hash->cb && wd_ecc_hash_is_soft(hash->type);
+}
+
+int wd_ecc_hash_init(struct wd_ecc_hash_ctx *ctx, __u8 type)
+{
+	if (unlikely(!ctx || !wd_ecc_hash_is_soft(type))) {
+		WD_ERR("invalid: soft hash ctx is NULL or type %u is err!\n",
+		       type);
+		return -WD_EINVAL;
+	}
+
+	memcpy(ctx->state, type == WD_HASH_SM3 ? sm3_iv : sha256_iv,
+	       sizeof(ctx->state));
+	ctx->total = 0;
+	ctx->buf_len = 0;
+	ctx->type = type;
+
+	return 0;
+}
+
+void wd_ecc_hash_update(struct wd_ecc_hash_ctx *ctx, const void *data,
+			__u64 len)
+{
+	const __u8 *in = data;
+	__u32 fill;
+
+	if (!len)
+		return;
+
+	ctx->total += len;
+	if (ctx->buf_len) {
+		fill = WD_ECC_HASH_BLOCK - ctx->buf_len;
+		if (len < fill) {
+			memcpy(ctx->buf + ctx->buf_len, in, len);
+			ctx->buf_len += len;
+			return;
+		}
+
+		memcpy(ctx->buf + ctx->buf_len, in, fill);
+		hash_compress(ctx, ctx->buf);
+		ctx->buf_len = 0;
+		in += fill;
+		len -= fill;
+	}
+
+	/* whole blocks are hashed from the input without a copy */
+	for (; len >= WD_ECC_HASH_BLOCK; len -= WD_ECC_HASH_BLOCK) {
+		hash_compress(ctx, in);
+		in += WD_ECC_HASH_BLOCK;
+	}
+
+	memcpy(ctx->buf, in, len);
+	ctx->buf_len = len;
+}
+
+void wd_ecc_hash_final(struct wd_ecc_hash_ctx *ctx, void *out)
+{
+	__u64 bits = ctx->total << 3;
+	__u8 *dst = out;
+	int i;
+
+	ctx->buf[ctx->buf_len++] = HASH_PAD_BYTE;
+	if (ctx->buf_len > WD_ECC_HASH_BLOCK - HASH_LEN_BYTES) {
+		memset(ctx->buf + ctx->buf_len, 0,
+		       WD_ECC_HASH_BLOCK - ctx->buf_len);
+		hash_compress(ctx, ctx->buf);
+		ctx->buf_len = 0;
+	}
+
+	memset(ctx->buf + ctx->buf_len, 0,
+	       WD_ECC_HASH_BLOCK - HASH_LEN_BYTES - ctx->buf_len);
+	put_be32(ctx->buf + WD_ECC_HASH_BLOCK - HASH_LEN_BYTES, bits >> 32);
+	put_be32(ctx->buf + WD_ECC_HASH_BLOCK - HASH_LEN_BYTES / 2, bits);
+	hash_compress(ctx, ctx->buf);
+
+	for (i = 0; i < WD_ECC_HASH_WORDS; i++)
+		put_be32(dst + i * sizeof(__u32), ctx->state[i]);
+}
+
+int wd_ecc_hash_dtbs(struct wd_hash_mt *hash, const struct wd_dtb *in,
+		     __u32 num, char *out, __u32 out_len)
+{
+	char stack_in[HASH_STACK_IN_MAX];
+	struct wd_ecc_hash_ctx ctx;
+	__u64 lens = 0, in_len = 0;
+	char *p_in = stack_in;
+	__u32 i;
+	int ret;
+
+	if (wd_ecc_hash_use_soft(hash)) {
+		if (unlikely(out_len < WD_ECC_HASH_MAX_BYTES)) {
+			WD_ERR("invalid: hash out_len %u is too small!\n",
+			       out_len);
+			return -WD_EINVAL;
+		}
+
+		(void)wd_ecc_hash_init(&ctx, hash->type);
+		for (i = 0; i < num; i++)
+			wd_ecc_hash_update(&ctx, in[i].data, in[i].dsize);
+		wd_ecc_hash_final(&ctx, out);
+
+		return 0;
+	}
+
+	if (unlikely(!hash->cb)) {
+		WD_ERR("invalid: hash type %u needs hash cb!\n", hash->type);
+		return -WD_EINVAL;
+	}
+
+	/* the callback takes one buffer, so the inputs are packed into it */
+	for (i = 0; i < num; i++)
+		lens += in[i].dsize;
+
+	stack_in[0] = 0;
+	if (lens > HASH_STACK_IN_MAX) {
+		p_in = malloc(lens);
+		if (unlikely(!p_in))
+			return -WD_ENOMEM;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (!in[i].dsize)
+			continue;
+		memcpy(p_in + in_len, in[i].data, in[i].dsize);
+		in_len += in[i].dsize;
+	}
+
+	ret = hash->cb(p_in, in_len, out, out_len, hash->usr);
+	if (p_in != stack_in)
+		free(p_in);
+
+	return ret;
+}
+
+static void sm2_kdf_ctr(__u8 *ctr, __u32 i)
+{
+	/* the counter is big endian */
+	ctr[3] = i & 0xFF;
+	ctr[2] = (i >> 8) & 0xFF;
+	ctr[1] = (i >> 16) & 0xFF;
+	ctr[0] = (i >> 24) & 0xFF;
+}
+
+int wd_ecc_sm2_kdf(struct wd_dtb *out, const struct wd_ecc_point *x2y2,
+		   __u64 m_len, struct wd_hash_mt *hash, __u32 h_bytes)
+{
+	struct wd_ecc_hash_ctx prefix, ctx;
+	char p_out[KDF_HASH_MAX_BYTES] = {0};
+	char p_in[KDF_IN_MAX];
+	__u8 ctr[KDF_CTR_BYTES];
+	char *tmp = out->data;
+	__u32 x2y2_len;
+	char *t_out;
+	__u32 i = 1;
+	bool soft;
+	int ret = 0;
+
+	x2y2_len = x2y2->x.dsize + x2y2->y.dsize;
+	if (unlikely(x2y2_len > KDF_IN_MAX - KDF_CTR_BYTES ||
+		     !h_bytes || h_bytes > KDF_HASH_MAX_BYTES)) {
+		WD_ERR("invalid: sm2 kdf x2y2 len %u or hash len %u is err!\n",
+		       x2y2_len, h_bytes);
+		return -WD_EINVAL;
+	}
+
+	/* Z = x2 || y2 is hashed once, each block only hashes its counter */
+	soft = wd_ecc_hash_use_soft(hash);
+	if (soft) {
+		(void)wd_ecc_hash_init(&prefix, hash->type);
+		wd_ecc_hash_update(&prefix, x2y2->x.data, x2y2_len);
+	} else if (unlikely(!hash->cb)) {
+		WD_ERR("invalid: hash type %u needs hash cb!\n", hash->type);
+		return -WD_EINVAL;
+	} else {
+		memcpy(p_in, x2y2->x.data, x2y2_len);
+	}
+
+	out->dsize = m_len;
+	while (m_len) {
+		sm2_kdf_ctr(ctr, i);
+		t_out = m_len >= h_bytes ? tmp : p_out;
+		if (soft) {
+			memcpy(&ctx, &prefix, sizeof(ctx));
+			wd_ecc_hash_update(&ctx, ctr, sizeof(ctr));
+			wd_ecc_hash_final(&ctx, t_out);
+		} else {
+			memcpy(p_in + x2y2_len, ctr, sizeof(ctr));
+			ret = hash->cb(p_in, x2y2_len + sizeof(ctr), t_out,
+				       h_bytes, hash->usr);
+			if (ret) {
+				WD_ERR("failed to hash cb, ret = %d!\n", ret);
+				break;
+			}
+		}
+
+		if (m_len >= h_bytes) {
+			tmp += h_bytes;
+			m_len -= h_bytes;
+		} else {
+			memcpy(tmp, p_out, m_len);
+			m_len = 0;
+		}
+
+		i++;
+	}
+
+	return ret;
+}
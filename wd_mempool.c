@@ -4,6 +4,7 @@
  * Copyright 2020-2021 Linaro ltd.
  */
 
+#define _GNU_SOURCE
 #include <dirent.h>
 #include <errno.h>
 #include <numa.h>
@@ -14,6 +15,8 @@
 #include <sys/mman.h>
 #include <sys/param.h>
 #include <sys/queue.h>
+#include <sched.h>
+#include <unistd.h>
 #include "wd.h"
 
 #define SYSFS_NODE_PATH			"/sys/devices/system/node/node"
@@ -109,6 +112,22 @@ struct memzone {
 };
 TAILQ_HEAD(memzone_list, memzone);
 
+/*
+ * per cpu cache of free blocks in front of the blkpool stack
+ * @blk_elem: The free block addrs cached
+ * @top: The stack top pos for blk_elem
+ * @hit_num: Times of alloc and free done in the cache
+ * @miss_num: Times of refilling from and flushing to the blkpool stack
+ * @lock: lock of cache, only contended by the threads on the same cpu
+ */
+struct blk_cache {
+	void **blk_elem;
+	size_t top;
+	unsigned long hit_num;
+	unsigned long miss_num;
+	struct wd_lock lock;
+} __attribute__((aligned(64)));
+
 /*
  * @blk_elem: All the block unit addrs saved in blk_elem
  * @depth: The block pool deph, stack depth
@@ -118,7 +137,10 @@ TAILQ_HEAD(memzone_list, memzone);
  * @mz_list: List of memzone allocated from mempool
  * @free_block_num: Number of free blocks currently
  * @lock: lock of blkpool
- * @ref: ref of blkpool
+ * @ref: ref of blkpool, the blocks in caches are counted as allocated
+ * @caches: Per cpu caches, NULL if the blkpool is created without cache
+ * @cache_num: Number of caches
+ * @cache_size: Max block number in one cache
  */
 struct blkpool {
 	void **blk_elem;
@@ -130,6 +152,9 @@ struct blkpool {
 	unsigned long free_block_num;
 	struct wd_lock lock;
 	struct wd_ref ref;
+	struct blk_cache *caches;
+	size_t cache_num;
+	size_t cache_size;
 };
 
 struct sys_hugepage_config {
@@ -293,13 +318,110 @@ inline static size_t wd_get_page_size(void)
 	return sysconf(_SC_PAGESIZE);
 }
 
-void *wd_block_alloc(handle_t blkpool)
+static struct blk_cache *get_blk_cache(struct blkpool *bp)
 {
-	struct blkpool *bp = (struct blkpool*)blkpool;
-	void *p;
+	int cpu = sched_getcpu();
 
-	if (!bp)
-		return NULL;
+	if (cpu < 0)
+		cpu = 0;
+
+	return bp->caches + (size_t)cpu % bp->cache_num;
+}
+
+/* move blocks of the blkpool stack to the cache, cache lock is held */
+static void blk_cache_refill(struct blkpool *bp, struct blk_cache *cache)
+{
+	size_t num = MAX(bp->cache_size >> 1, 1);
+	size_t got;
+
+	if (!wd_atomic_test_add(&bp->ref, num, 0))
+		return;
+
+	wd_spinlock(&bp->lock);
+	got = MIN(num, bp->top);
+	bp->top -= got;
+	bp->free_block_num -= got;
+	memcpy(cache->blk_elem, bp->blk_elem + bp->top, got * sizeof(void *));
+	wd_unspinlock(&bp->lock);
+
+	cache->top = got;
+	if (got < num)
+		wd_atomic_sub(&bp->ref, num - got);
+}
+
+/* move blocks of the cache back to the blkpool stack, cache lock is held */
+static void blk_cache_flush(struct blkpool *bp, struct blk_cache *cache,
+			    size_t num)
+{
+	if (!num)
+		return;
+
+	cache->top -= num;
+	wd_spinlock(&bp->lock);
+	memcpy(bp->blk_elem + bp->top, cache->blk_elem + cache->top,
+	       num * sizeof(void *));
+	bp->top += num;
+	bp->free_block_num += num;
+	wd_unspinlock(&bp->lock);
+
+	wd_atomic_sub(&bp->ref, num);
+}
+
+static void blk_cache_drain_all(struct blkpool *bp)
+{
+	struct blk_cache *cache;
+	size_t i;
+
+	for (i = 0; i < bp->cache_num; i++) {
+		cache = bp->caches + i;
+		wd_spinlock(&cache->lock);
+		blk_cache_flush(bp, cache, cache->top);
+		wd_unspinlock(&cache->lock);
+	}
+}
+
+static void *blk_cache_alloc(struct blkpool *bp)
+{
+	struct blk_cache *cache = get_blk_cache(bp);
+	void *p = NULL;
+
+	wd_spinlock(&cache->lock);
+	if (cache->top) {
+		cache->hit_num++;
+	} else {
+		cache->miss_num++;
+		blk_cache_refill(bp, cache);
+	}
+
+	if (cache->top) {
+		cache->top--;
+		p = cache->blk_elem[cache->top];
+	}
+	wd_unspinlock(&cache->lock);
+
+	return p;
+}
+
+static void blk_cache_free(struct blkpool *bp, void *addr)
+{
+	struct blk_cache *cache = get_blk_cache(bp);
+
+	wd_spinlock(&cache->lock);
+	if (cache->top < bp->cache_size) {
+		cache->hit_num++;
+	} else {
+		cache->miss_num++;
+		blk_cache_flush(bp, cache, MAX(bp->cache_size >> 1, 1));
+	}
+
+	cache->blk_elem[cache->top] = addr;
+	cache->top++;
+	wd_unspinlock(&cache->lock);
+}
+
+static void *blkpool_alloc(struct blkpool *bp)
+{
+	void *p;
 
 	if (!wd_atomic_test_add(&bp->ref, 1, 0)) {
 		return NULL;
@@ -320,6 +442,27 @@ void *wd_block_alloc(handle_t blkpool)
 	return NULL;
 }
 
+void *wd_block_alloc(handle_t blkpool)
+{
+	struct blkpool *bp = (struct blkpool*)blkpool;
+	void *p;
+
+	if (!bp)
+		return NULL;
+
+	if (!bp->caches)
+		return blkpool_alloc(bp);
+
+	p = blk_cache_alloc(bp);
+	if (p)
+		return p;
+
+	/* the free blocks may be held by the caches of other cpus */
+	blk_cache_drain_all(bp);
+
+	return blkpool_alloc(bp);
+}
+
 void wd_block_free(handle_t blkpool, void *addr)
 {
 	struct blkpool *bp = (struct blkpool*)blkpool;
@@ -327,6 +470,11 @@ void wd_block_free(handle_t blkpool, void *addr)
 	if (!bp || !addr)
 		return;
 
+	if (bp->caches) {
+		blk_cache_free(bp, addr);
+		return;
+	}
+
 	wd_spinlock(&bp->lock);
 	if (bp->top < bp->depth) {
 		bp->blk_elem[bp->top] = addr;
@@ -537,8 +685,50 @@ static int init_blkpool_elem(struct blkpool *bp)
 	return 0;
 }
 
-handle_t wd_blockpool_create(handle_t mempool, size_t block_size,
-			     size_t block_num)
+static int init_blkpool_cache(struct blkpool *bp, size_t cache_size)
+{
+	long cpu_num = sysconf(_SC_NPROCESSORS_CONF);
+	size_t i;
+
+	bp->cache_num = cpu_num > 0 ? cpu_num : 1;
+	bp->cache_size = cache_size;
+	bp->caches = aligned_alloc(sizeof(struct blk_cache),
+				   bp->cache_num * sizeof(struct blk_cache));
+	if (!bp->caches)
+		return -ENOMEM;
+
+	memset(bp->caches, 0, bp->cache_num * sizeof(struct blk_cache));
+	for (i = 0; i < bp->cache_num; i++) {
+		bp->caches[i].blk_elem = calloc(cache_size, sizeof(void *));
+		if (!bp->caches[i].blk_elem)
+			goto err_free_cache;
+	}
+
+	return 0;
+
+err_free_cache:
+	while (i--)
+		free(bp->caches[i].blk_elem);
+	free(bp->caches);
+	bp->caches = NULL;
+	return -ENOMEM;
+}
+
+static void uninit_blkpool_cache(struct blkpool *bp)
+{
+	size_t i;
+
+	if (!bp->caches)
+		return;
+
+	for (i = 0; i < bp->cache_num; i++)
+		free(bp->caches[i].blk_elem);
+	free(bp->caches);
+	bp->caches = NULL;
+}
+
+static handle_t blkpool_create(handle_t mempool, size_t block_size,
+			       size_t block_num, size_t cache_size)
 {
 	struct mempool *mp = (struct mempool*)mempool;
 	struct blkpool *bp;
@@ -553,8 +743,10 @@ handle_t wd_blockpool_create(handle_t mempool, size_t block_size,
 		return (handle_t)(-WD_EBUSY);
 
 	bp = calloc(1, sizeof(struct blkpool));
-	if (!bp)
+	if (!bp) {
+		wd_atomic_sub(&mp->ref, 1);
 		return (handle_t)(-WD_ENOMEM);
+	}
 
 	bp->top = block_num;
 	bp->depth = block_num;
@@ -574,9 +766,19 @@ handle_t wd_blockpool_create(handle_t mempool, size_t block_size,
 		goto err_free_mem;
 	}
 
+	if (cache_size) {
+		ret = init_blkpool_cache(bp, cache_size);
+		if (ret < 0) {
+			WD_ERR("wd_mempool: failed to init blkpool cache\n");
+			goto err_free_elem;
+		}
+	}
+
 	wd_atomic_add(&bp->ref, 1);
 	return (handle_t)bp;
 
+err_free_elem:
+	free(bp->blk_elem);
 err_free_mem:
 	free_mem_to_mempool(bp);
 err_free_bp:
@@ -585,6 +787,23 @@ err_free_bp:
 	return (handle_t)(-WD_ENOMEM);
 }
 
+handle_t wd_blockpool_create(handle_t mempool, size_t block_size,
+			     size_t block_num)
+{
+	return blkpool_create(mempool, block_size, block_num, 0);
+}
+
+handle_t wd_blockpool_create_cached(handle_t mempool, size_t block_size,
+				    size_t block_num, size_t cache_size)
+{
+	if (!cache_size) {
+		WD_ERR("wd_mempool: cache size is zero\n");
+		return (handle_t)(-WD_EINVAL);
+	}
+
+	return blkpool_create(mempool, block_size, block_num, cache_size);
+}
+
 void wd_blockpool_destroy(handle_t blkpool)
 {
 	struct blkpool *bp = (struct blkpool *)blkpool;
@@ -597,7 +816,12 @@ void wd_blockpool_destroy(handle_t blkpool)
 
 	mp = bp->mp;
 	wd_atomic_sub(&bp->ref, 1);
-	while(wd_atomic_load(&bp->ref));
+	while(wd_atomic_load(&bp->ref)) {
+		/* the blocks freed to the caches are not back in the stack */
+		if (bp->caches)
+			blk_cache_drain_all(bp);
+	}
+	uninit_blkpool_cache(bp);
 	free_mem_to_mempool(bp);
 	free(bp->blk_elem);
 	free(bp);
@@ -872,6 +1096,10 @@ static int alloc_mempool_memory(struct mempool *mp)
 
 static void free_mempool_memory(struct mempool *mp)
 {
+	/* the reserved memory is released with its ctx */
+	if (mp->page_type == WD_DMA_PAGE)
+		return;
+
 	free_hugepage_mem(mp);
 }
 
@@ -934,6 +1162,48 @@ free_pool:
 	return (handle_t)(-WD_ENOMEM);
 }
 
+handle_t wd_mempool_create_dma(handle_t h_ctx, size_t size)
+{
+	struct mempool *mp;
+	int ret;
+
+	if (!h_ctx || !size)
+		return (handle_t)(-WD_EINVAL);
+
+	if (WD_MEMPOOL_SIZE_MASK & size)
+		size += WD_MEMPOOL_BLOCK_SIZE - (WD_MEMPOOL_SIZE_MASK & size);
+
+	mp = calloc(1, sizeof(*mp));
+	if (!mp)
+		return (handle_t)(-WD_ENOMEM);
+
+	mp->addr = wd_ctx_reserve_mem(h_ctx, size);
+	if (!mp->addr) {
+		WD_ERR("wd_mempool: failed to reserve dma memory\n");
+		free(mp);
+		return (handle_t)(-WD_ENOMEM);
+	}
+
+	mp->node = wd_get_numa_id(h_ctx);
+	mp->size = size;
+	mp->real_size = size;
+	mp->blk_size = WD_MEMPOOL_BLOCK_SIZE;
+	mp->page_type = WD_DMA_PAGE;
+	mp->page_size = wd_get_page_size();
+	mp->page_num = size / mp->page_size;
+
+	ret = init_mempool(mp);
+	if (ret < 0) {
+		/* the memory is the ctx's only once, let it be reserved again */
+		wd_ctx_unreserve_mem(h_ctx);
+		free(mp);
+		return (handle_t)(-WD_ENOMEM);
+	}
+
+	wd_atomic_add(&mp->ref, 1);
+	return (handle_t)mp;
+}
+
 void wd_mempool_destroy(handle_t mempool)
 {
 	struct mempool *mp = (struct mempool *)mempool;
@@ -977,20 +1247,31 @@ void wd_blockpool_stats(handle_t blkpool, struct wd_blockpool_stats *stats)
 {
 	struct blkpool *bp = (struct blkpool*)blkpool;
 	unsigned long size = 0;
+	struct blk_cache *cache;
 	struct memzone *iter;
+	size_t cached = 0;
+	size_t i;
 
 	if (!bp || !stats) {
 		WD_ERR("wd_mempool: blkpool or stats is NULL\n");
 		return;
 	}
 
+	/* cache locks are never taken inside the blkpool lock */
+	for (i = 0; i < bp->cache_num; i++) {
+		cache = bp->caches + i;
+		wd_spinlock(&cache->lock);
+		cached += cache->top;
+		wd_unspinlock(&cache->lock);
+	}
+
 	wd_spinlock(&bp->lock);
 
 	stats->block_size = bp->blk_size;
 	stats->block_num = bp->depth;
-	stats->free_block_num = bp->free_block_num;
-	stats->block_usage_rate = (bp->depth - bp->free_block_num) * WD_HUNDRED /
-				  bp->depth;
+	stats->free_block_num = bp->free_block_num + cached;
+	stats->block_usage_rate = (bp->depth - stats->free_block_num) *
+				  WD_HUNDRED / bp->depth;
 
 	TAILQ_FOREACH(iter, &bp->mz_list, node) {
 		size += (iter->end - iter->begin + 1) * bp->mp->blk_size;
@@ -1006,3 +1287,29 @@ void wd_blockpool_stats(handle_t blkpool, struct wd_blockpool_stats *stats)
 
 	wd_unspinlock(&bp->lock);
 }
+
+void wd_blockpool_cache_stats(handle_t blkpool,
+			      struct wd_blockpool_cache_stats *stats)
+{
+	struct blkpool *bp = (struct blkpool*)blkpool;
+	unsigned long hit = 0, miss = 0;
+	struct blk_cache *cache;
+	size_t i;
+
+	if (!bp || !stats) {
+		WD_ERR("wd_mempool: blkpool or stats is NULL\n");
+		return;
+	}
+
+	for (i = 0; i < bp->cache_num; i++) {
+		cache = bp->caches + i;
+		wd_spinlock(&cache->lock);
+		hit += cache->hit_num;
+		miss += cache->miss_num;
+		wd_unspinlock(&cache->lock);
+	}
+
+	stats->hit_num = hit;
+	stats->miss_num = miss;
+	stats->hit_rate = hit + miss ? hit * WD_HUNDRED / (hit + miss) : 0;
+}
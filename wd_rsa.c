@@ -17,6 +17,8 @@
 #include "wd_util.h"
 
 #define WD_POOL_MAX_ENTRIES		1024
+/* msgs sent to the driver at a time in async batch */
+#define WD_RSA_BATCH_NUM		32
 #define WD_HW_EACCESS			62
 
 #define RSA_BALANCE_THRHD		1280
@@ -30,6 +32,7 @@ struct wd_rsa_pubkey {
 	struct wd_dtb n;
 	struct wd_dtb e;
 	__u32 key_size;
+	__u32 fmt;
 	void *data[];
 };
 
@@ -52,6 +55,7 @@ struct wd_rsa_prikey2 {
 };
 
 struct wd_rsa_prikey {
+	__u32 fmt;
 	struct wd_rsa_prikey1 pkey1;
 	struct wd_rsa_prikey2 pkey2;
 };
@@ -147,7 +151,8 @@ int wd_rsa_init(struct wd_ctx_config *config, struct wd_sched *sched)
 		return ret;
 	}
 
-	ret = wd_init_sched(&wd_rsa_setting.sched, sched);
+	ret = wd_init_sched(&wd_rsa_setting.sched, sched,
+			    &wd_rsa_setting.pool);
 	if (ret < 0) {
 		WD_ERR("failed to set sched, ret = %d!\n", ret);
 		goto out;
@@ -157,9 +162,10 @@ int wd_rsa_init(struct wd_ctx_config *config, struct wd_sched *sched)
 	wd_rsa_set_static_drv();
 #endif
 
-	/* fix me: sadly find we allocate async pool for every ctx */
+	/* the msgs of the async ctxs are allocated on demand */
 	ret = wd_init_async_request_pool(&wd_rsa_setting.pool,
-					 config->ctx_num, WD_POOL_MAX_ENTRIES,
+					 &wd_rsa_setting.config,
+					 WD_POOL_MAX_ENTRIES,
 					 sizeof(struct wd_rsa_msg));
 	if (ret < 0) {
 		WD_ERR("failed to initialize async req pool, ret = %d!\n", ret);
@@ -233,12 +239,15 @@ static int fill_rsa_msg(struct wd_rsa_msg *msg, struct wd_rsa_req *req,
 	switch (msg->req.op_type) {
 	case WD_RSA_SIGN:
 		key = (__u8 *)sess->prikey;
+		msg->key_fmt = &sess->prikey->fmt;
 		break;
 	case WD_RSA_VERIFY:
 		key = (__u8 *)sess->pubkey;
+		msg->key_fmt = &sess->pubkey->fmt;
 		break;
 	case WD_RSA_GENKEY:
 		key = (__u8 *)req->src;
+		msg->key_fmt = NULL;
 		break;
 	default:
 		WD_ERR("rsa msguest op type err!\n");
@@ -313,6 +322,7 @@ static int rsa_recv_sync(handle_t ctx, struct wd_rsa_msg *msg)
 	} while (ret < 0);
 
 	balance = rx_cnt;
+	wd_ctx_stats_sync(wd_ctx_get_stats_area(ctx), rx_cnt);
 	req->status = msg->result;
 	req->dst_bytes = msg->req.dst_bytes;
 
@@ -406,11 +416,114 @@ fail_with_msg:
 	return ret;
 }
 
+static int rsa_send_batch(handle_t ctx, struct wd_rsa_msg **msgs, __u32 num,
+			  __u32 *count)
+{
+	const struct wd_rsa_driver *driver = wd_rsa_setting.driver;
+	int ret = 0;
+
+	if (driver->send_batch)
+		return driver->send_batch(ctx, msgs, num, count);
+
+	for (*count = 0; *count < num; (*count)++) {
+		ret = driver->send(ctx, msgs[*count]);
+		if (ret < 0)
+			break;
+	}
+
+	return *count ? 0 : ret;
+}
+
+int wd_do_rsa_async_batch(handle_t sess, struct wd_rsa_req **reqs,
+			  __u32 num)
+{
+	struct wd_ctx_config_internal *config = &wd_rsa_setting.config;
+	handle_t h_sched_ctx = wd_rsa_setting.sched.h_sched_ctx;
+	struct wd_rsa_sess *sess_t = (struct wd_rsa_sess *)sess;
+	struct wd_rsa_msg *msgs[WD_RSA_BATCH_NUM];
+	__u32 sent = 0, fill_num, cnt, idx, i;
+	struct wd_ctx_internal *ctx;
+	int ret = 0;
+	int mid;
+
+	if (unlikely(!sess || !reqs || !num)) {
+		WD_ERR("invalid: rsa batch sess or reqs is NULL or num is 0!\n");
+		return -WD_EINVAL;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (unlikely(!reqs[i] || !reqs[i]->cb)) {
+			WD_ERR("invalid: req(%u) or its cb is NULL!\n", i);
+			return -WD_EINVAL;
+		}
+	}
+
+	idx = wd_rsa_setting.sched.pick_next_ctx(h_sched_ctx,
+						sess_t->sched_key,
+						CTX_MODE_ASYNC);
+	ret = wd_check_ctx(config, CTX_MODE_ASYNC, idx);
+	if (ret)
+		return ret;
+
+	ctx = config->ctxs + idx;
+
+	while (sent < num) {
+		for (fill_num = 0; fill_num < WD_RSA_BATCH_NUM &&
+		     sent + fill_num < num; fill_num++) {
+			mid = wd_get_msg_from_pool(&wd_rsa_setting.pool, idx,
+						   (void **)&msgs[fill_num]);
+			if (mid < 0) {
+				ret = -WD_EBUSY;
+				break;
+			}
+
+			ret = fill_rsa_msg(msgs[fill_num], reqs[sent + fill_num],
+					  sess_t);
+			if (ret) {
+				wd_put_msg_to_pool(&wd_rsa_setting.pool, idx, mid);
+				break;
+			}
+			msgs[fill_num]->tag = mid;
+		}
+
+		if (!fill_num)
+			break;
+
+		cnt = 0;
+		ret = rsa_send_batch(ctx->ctx, msgs, fill_num, &cnt);
+
+		for (i = cnt; i < fill_num; i++)
+			wd_put_msg_to_pool(&wd_rsa_setting.pool, idx,
+					   msgs[i]->tag);
+
+		sent += cnt;
+		if (ret || cnt < fill_num)
+			break;
+	}
+
+	for (i = 0; i < sent; i++)
+		wd_add_task_to_async_queue(&wd_rsa_env_config, idx);
+
+	if (!sent) {
+		if (ret != -WD_EBUSY)
+			WD_ERR("wd rsa batch send err(%d)!\n", ret);
+		return ret ? ret : -WD_EBUSY;
+	}
+
+	return sent;
+}
+
+static void rsa_msg_done(void *msg)
+{
+	struct wd_rsa_req *req = &((struct wd_rsa_msg *)msg)->req;
+
+	req->cb(req);
+}
+
 int wd_rsa_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 {
 	struct wd_ctx_config_internal *config = &wd_rsa_setting.config;
 	struct wd_ctx_internal *ctx;
-	struct wd_rsa_req *req;
 	struct wd_rsa_msg recv_msg, *msg;
 	__u32 rcv_cnt = 0;
 	int ret;
@@ -448,9 +561,8 @@ int wd_rsa_poll_ctx(__u32 idx, __u32 expt, __u32 *count)
 
 		msg->req.dst_bytes = recv_msg.req.dst_bytes;
 		msg->req.status = recv_msg.result;
-		req = &msg->req;
-		req->cb(req);
-		wd_put_msg_to_pool(&wd_rsa_setting.pool, idx, recv_msg.tag);
+		wd_complete_msg(&wd_rsa_setting.pool, idx, recv_msg.tag, msg,
+				rsa_msg_done);
 		*count = rcv_cnt;
 	} while (--expt);
 
@@ -894,6 +1006,8 @@ int wd_rsa_set_pubkey_params(handle_t sess, struct wd_dtb *e, struct wd_dtb *n)
 		return -WD_EINVAL;
 	}
 
+	wd_key_fmt_reset(&c->pubkey->fmt);
+
 	if (e) {
 		if (!e->dsize || !e->data || e->dsize > c->pubkey->key_size) {
 			WD_ERR("e err in set rsa public key!\n");
@@ -943,6 +1057,7 @@ int wd_rsa_set_prikey_params(handle_t sess, struct wd_dtb *d, struct wd_dtb *n)
 		return -WD_EINVAL;
 	}
 	pkey1 = &c->prikey->pkey1;
+	wd_key_fmt_reset(&c->prikey->fmt);
 	if (d) {
 		if (!d->dsize || !d->data || d->dsize > pkey1->key_size) {
 			WD_ERR("d err in set rsa private key1!\n");
@@ -1050,6 +1165,7 @@ int wd_rsa_set_crt_prikey_params(handle_t sess, struct wd_dtb *dq,
 	}
 
 	pkey2 = &c->prikey->pkey2;
+	wd_key_fmt_reset(&c->prikey->fmt);
 	ret = rsa_prikey2_param_set(pkey2, dq, WD_CRT_PRIKEY_DQ);
 	if (ret) {
 		WD_ERR("dq err in set rsa private key2!\n");
@@ -1192,3 +1308,9 @@ int wd_rsa_get_env_param(__u32 node, __u32 type, __u32 mode,
 	return wd_alg_get_env_param(&wd_rsa_env_config,
 				    ctx_attr, num, is_enable);
 }
+
+int wd_rsa_get_ctx_stats(__u32 idx, struct wd_ctx_stats *stats)
+{
+	return wd_get_ctx_stats(&wd_rsa_setting.config, &wd_rsa_setting.pool,
+				idx, stats);
+}
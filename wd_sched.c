@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include "wd_sched.h"
+#include "wd_util.h"
 
 #define MAX_POLL_TIMES 1000
 
@@ -16,6 +17,22 @@ enum sched_region_mode {
 	SCHED_MODE_BUTT
 };
 
+/**
+ * struct sched_ctx_range - define one ctx pos.
+ * @begin: the start pos in ctxs of config.
+ * @end: the end pos in ctxx of config.
+ * @last: the last one which be distributed.
+ * @cursor: lock-free request counter used by the spread and load policies.
+ */
+struct sched_ctx_region {
+	__u32 begin;
+	__u32 end;
+	__u32 last;
+	__u32 cursor;
+	bool valid;
+	pthread_mutex_t lock;
+};
+
 /**
  * sched_key - The key if schedule region.
  * @numa_id: The numa_id map the hardware.
@@ -23,6 +40,7 @@ enum sched_region_mode {
  * @type: Service type , the value must smaller than type_num.
  * @sync_ctxid: alloc ctx id for sync mode
  * @async_ctxid: alloc ctx id for async mode
+ * @region: the sync and async regions which the key belongs to
  */
 struct sched_key {
 	int numa_id;
@@ -30,20 +48,7 @@ struct sched_key {
 	__u8 mode;
 	__u32 sync_ctxid;
 	__u32 async_ctxid;
-};
-
-/**
- * struct sched_ctx_range - define one ctx pos.
- * @begin: the start pos in ctxs of config.
- * @end: the end pos in ctxx of config.
- * @last: the last one which be distributed.
- */
-struct sched_ctx_region {
-	__u32 begin;
-	__u32 end;
-	__u32 last;
-	bool valid;
-	pthread_mutex_t lock;
+	struct sched_ctx_region *region[SCHED_MODE_BUTT];
 };
 
 /**
@@ -66,6 +71,8 @@ struct wd_sched_info {
  * @type_num: the max operation types of the scheduler.
  * @numa_id: current task's numa id
  * @poll_func: the task's poll operation function.
+ * @pool: the message pools of the algorithm, the load of each ctx is read
+ *	  from them by the load policy.
  * @sched_info: the context of the scheduler
  */
 struct wd_sched_ctx {
@@ -73,6 +80,7 @@ struct wd_sched_ctx {
 	__u32 type_num;
 	__u8  numa_num;
 	user_poll_func poll_func;
+	struct wd_async_msg_pool *pool;
 	struct wd_sched_info sched_info[0];
 };
 
@@ -99,6 +107,52 @@ static __u32 sched_get_next_pos_rr(struct sched_ctx_region *region,
 	return pos;
 }
 
+/**
+ * sched_get_next_pos_spread - Get next resource pos without taking a lock.
+ * Every call moves the region cursor, so the requests of one session are
+ * distributed over all the ctxs in the region.
+ */
+static __u32 sched_get_next_pos_spread(struct sched_ctx_region *region)
+{
+	__u32 num = region->end - region->begin + 1;
+	__u32 cnt;
+
+	cnt = __atomic_fetch_add(&region->cursor, 1, __ATOMIC_RELAXED);
+
+	return region->begin + cnt % num;
+}
+
+/**
+ * sched_get_next_pos_load - Get the pos with the fewest requests in flight.
+ * An async request holds a message of the pool of its ctx from its send to
+ * its completion, so the count is right whoever polls and whether the send
+ * fails or not. The scan starts from a moving cursor, so ctxs with the same
+ * load are used in turn. It's read without lock, a stale value only makes
+ * the choice a little less accurate.
+ */
+static __u32 sched_get_next_pos_load(struct wd_async_msg_pool *pool,
+				     struct sched_ctx_region *region)
+{
+	__u32 num = region->end - region->begin + 1;
+	__u32 start, min, load, i, n;
+	__u32 pick;
+
+	start = __atomic_fetch_add(&region->cursor, 1, __ATOMIC_RELAXED) % num;
+	pick = start;
+	min = wd_get_msg_pool_in_use(pool, region->begin + start);
+
+	for (i = 1; i < num && min; i++) {
+		n = (start + i) % num;
+		load = wd_get_msg_pool_in_use(pool, region->begin + n);
+		if (load < min) {
+			min = load;
+			pick = n;
+		}
+	}
+
+	return region->begin + pick;
+}
+
 /**
  * sched_get_ctx_range - Get ctx range from ctx_map by the wd comp arg
  */
@@ -273,6 +327,8 @@ static __u32 session_sched_init_ctx(handle_t sched_ctx,
 	if (!region)
 		return INVALID_POS;
 
+	key->region[sched_mode] = region;
+
 	return sched_get_next_pos_rr(region, NULL);
 }
 
@@ -287,9 +343,8 @@ handle_t session_sched_init(handle_t h_sched_ctx, void *sched_param)
 		return (handle_t)(-WD_ENOMEM);
 	}
 
-	if (!param) {
-		memset(skey, 0, sizeof(struct sched_key));
-	} else {
+	memset(skey, 0, sizeof(struct sched_key));
+	if (param) {
 		skey->type = param->type;
 		skey->numa_id = param->numa_id;
 	}
@@ -326,6 +381,73 @@ static __u32 session_sched_pick_next_ctx(handle_t sched_ctx,
 	return key->async_ctxid;
 }
 
+/**
+ * session_sched_pick_next_ctx_spread - Get one ctx for every request.
+ * @sched_ctx: Schedule ctx, reference the struct sample_sched_ctx.
+ * @sched_key: The key of schedule region.
+ * @sched_mode: The sched async/sync mode.
+ *
+ * Unlike the RR policy, the ctx is not bound to the session, so a single busy
+ * session can use all the ctxs in its region. Requests depending on the ctx
+ * used before, such as stateful stream requests, are kept on one ctx by the
+ * algorithm layer.
+ */
+static __u32 session_sched_pick_next_ctx_spread(handle_t sched_ctx,
+		void *sched_key, const int sched_mode)
+{
+	struct sched_key *key = (struct sched_key *)sched_key;
+	struct sched_ctx_region *region;
+
+	if (unlikely(!sched_ctx || !key)) {
+		WD_ERR("ERROR: %s the pointer para is NULL!\n", __FUNCTION__);
+		return INVALID_POS;
+	}
+
+	if (unlikely(sched_mode >= SCHED_MODE_BUTT))
+		return INVALID_POS;
+
+	region = key->region[sched_mode];
+	if (unlikely(!region))
+		return INVALID_POS;
+
+	return sched_get_next_pos_spread(region);
+}
+
+/**
+ * session_sched_pick_next_ctx_load - Get the least loaded ctx of the region.
+ * @sched_ctx: Schedule ctx, reference the struct sample_sched_ctx.
+ * @sched_key: The key of schedule region.
+ * @sched_mode: The sched async/sync mode.
+ *
+ * The load of a ctx is the number of its async requests in flight. A sync
+ * request completes before the call returns, so sync requests, and async
+ * ones before the algorithm binds its pools, are spread over the region.
+ */
+static __u32 session_sched_pick_next_ctx_load(handle_t sched_ctx,
+		void *sched_key, const int sched_mode)
+{
+	struct wd_sched_ctx *ctx = (struct wd_sched_ctx *)sched_ctx;
+	struct sched_key *key = (struct sched_key *)sched_key;
+	struct sched_ctx_region *region;
+
+	if (unlikely(!ctx || !key)) {
+		WD_ERR("ERROR: %s the pointer para is NULL!\n", __FUNCTION__);
+		return INVALID_POS;
+	}
+
+	if (unlikely(sched_mode >= SCHED_MODE_BUTT))
+		return INVALID_POS;
+
+	region = key->region[sched_mode];
+	if (unlikely(!region))
+		return INVALID_POS;
+
+	if (sched_mode == CTX_MODE_SYNC || !ctx->pool)
+		return sched_get_next_pos_spread(region);
+
+	return sched_get_next_pos_load(ctx->pool, region);
+}
+
 static struct wd_sched sched_table[SCHED_POLICY_BUTT] = {
 	{
 		.name = "RR scheduler",
@@ -333,6 +455,18 @@ static struct wd_sched sched_table[SCHED_POLICY_BUTT] = {
 		.sched_init = session_sched_init,
 		.pick_next_ctx = session_sched_pick_next_ctx,
 		.poll_policy = session_sched_poll_policy,
+	}, {
+		.name = "Spread scheduler",
+		.sched_policy = SCHED_POLICY_SPREAD,
+		.sched_init = session_sched_init,
+		.pick_next_ctx = session_sched_pick_next_ctx_spread,
+		.poll_policy = session_sched_poll_policy,
+	}, {
+		.name = "Load scheduler",
+		.sched_policy = SCHED_POLICY_LOAD,
+		.sched_init = session_sched_init,
+		.pick_next_ctx = session_sched_pick_next_ctx_load,
+		.poll_policy = session_sched_poll_policy,
 	},
 };
 
@@ -374,6 +508,7 @@ int wd_sched_rr_instance(const struct wd_sched *sched,
 	sched_info[numa_id].ctx_region[mode][type].begin = param->begin;
 	sched_info[numa_id].ctx_region[mode][type].end = param->end;
 	sched_info[numa_id].ctx_region[mode][type].last = param->begin;
+	sched_info[numa_id].ctx_region[mode][type].cursor = 0;
 	sched_info[numa_id].ctx_region[mode][type].valid = true;
 	sched_info[numa_id].valid = true;
 
@@ -472,3 +607,16 @@ err_out:
 	wd_sched_rr_release(sched);
 	return NULL;
 }
+
+void wd_sched_bind_pool(struct wd_sched *sched, struct wd_async_msg_pool *pool)
+{
+	struct wd_sched_ctx *sched_ctx;
+
+	/* the pick function tells the load policy of this sample scheduler */
+	if (!sched || sched->pick_next_ctx != session_sched_pick_next_ctx_load)
+		return;
+
+	sched_ctx = (struct wd_sched_ctx *)sched->h_sched_ctx;
+	if (sched_ctx)
+		sched_ctx->pool = pool;
+}
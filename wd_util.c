@@ -15,15 +15,43 @@
 #include "wd_sched.h"
 
 #define WD_ASYNC_DEF_POLL_NUM		1
-#define WD_ASYNC_DEF_QUEUE_DEPTH	1024
+/* CPUs the polling threads are bound to, in the format of "0-3,8" */
+#define WD_ASYNC_POLL_CPUS_ENV		"WD_ASYNC_POLL_CPUS"
+#define WD_CB_DEF_DEPTH			1024
+/* idle rounds a polling thread spins before it yields or parks */
+#define WD_ASYNC_SPIN_NUM		1024
+
+/* recv retries a sync request spins for before it sleeps on the ctx */
+#define WD_SPIN_BUDGET_MIN		128
+#define WD_SPIN_BUDGET_MAX		16384
+/* weight of the latest request in the moving average is 1 / 8 */
+#define WD_SPIN_AVG_SHIFT		3
+
+/* messages are allocated by segments of 64 when the pool runs dry */
+#define MSG_SEG_SHIFT			6
+#define MSG_SEG_SIZE			(1U << MSG_SEG_SHIFT)
+#define MSG_SEG_MASK			(MSG_SEG_SIZE - 1)
 
 struct msg_pool {
-	/* message array allocated dynamically */
-	void *msgs;
+	/* message segments, only the ones ever needed are allocated */
+	void **segs;
+	__u32 seg_num;
+	/* node the segments are allocated on, -1 to use the heap */
+	int numa_id;
+	pthread_mutex_t grow_lock;
 	int *used;
+	/* counters of the ctx, and the send time of each msg if lat_en */
+	struct wd_ctx_stats_area *stats;
+	__u64 *stamp;
 	__u32 msg_num;
 	__u32 msg_size;
-	int tail;
+	/* stack of the free messages, next[i] is the one below msg i */
+	__u32 *next;
+	/* free top msg index + 1 in low 32 bits, ABA tag in high 32 bits */
+	__u64 top __attribute__((aligned(64)));
+	/* occupancy counters */
+	__u32 in_use __attribute__((aligned(64)));
+	__u32 peak;
 };
 
 /* parse wd env begin */
@@ -37,31 +65,88 @@ static const char *comp_ctx_type[2][2] = {
 /* define two ctx mode here for cipher and other alg*/
 static const char *ctx_type[2][1] = { {"sync:"}, {"async:"} };
 
+/*
+ * One slot of the task ring. A slot is ready to be consumed when its seq is
+ * one ahead of the position, and free to be produced when equal to it.
+ */
 struct async_task {
+	__u32 seq;
 	__u32 idx;
 };
 
+/*
+ * The lock free task queue of a polling thread. Requests are counted in
+ * pending per ctx, and a ctx is put into the ring only when its count rises
+ * from zero, so the ring never holds a ctx twice and can not overflow.
+ */
 struct async_task_queue {
 	struct async_task *head;
-	int depth;
-	int prod;
-	int cons;
-	int cur_task;
-	int left_task;
+	__u32 mask;
+	__u32 prod;
+	__u32 cons;
+	/* pending requests of each ctx, indexed by ctx idx */
+	__u32 *pending;
+	__u32 ctx_num;
+	/* the polling thread sleeps on wake_sem when parked is set */
+	int parked;
 	int end;
-	sem_t empty_sem;
-	sem_t full_sem;
-	pthread_mutex_t lock;
+	/* set by the polling thread when it exits */
+	int exited;
+	sem_t wake_sem;
 	pthread_t tid;
 	int (*alg_poll_ctx)(__u32, __u32, __u32 *);
+	/* completions reaped, only written by the polling thread */
+	__u64 poll_num;
+	/* all the task queues started, for wd_get_async_thread_stat() */
+	struct async_task_queue *next;
+};
+
+static struct async_task_queue *async_queue_list;
+static pthread_mutex_t async_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * One completion in the queue of the dispatcher threads, with the same
+ * sequence scheme as struct async_task.
+ */
+struct cb_task {
+	__u32 seq;
+	__u32 idx;
+	__u32 tag;
+	struct wd_async_msg_pool *pool;
+	void *msg;
+	wd_msg_done_t done;
+};
+
+/*
+ * The completion queue is produced by the polling threads and consumed by
+ * the dispatcher threads, both sides claim a slot by a CAS on their index.
+ */
+struct cb_dispatcher {
+	struct cb_task *ring;
+	__u32 mask;
+	__u32 prod __attribute__((aligned(64)));
+	__u32 cons __attribute__((aligned(64)));
+	__u32 queued __attribute__((aligned(64)));
+	__u32 peak;
+	__u64 cb_num;
+	__u64 full_num;
+	/* dispatcher threads sleeping on wake_sem */
+	__u32 parked __attribute__((aligned(64)));
+	int end;
+	sem_t wake_sem;
+	pthread_t *tids;
+	__u32 thread_num;
 };
 
+static struct cb_dispatcher *cb_dispatcher;
+
 static void clone_ctx_to_internal(struct wd_ctx *ctx,
 				  struct wd_ctx_internal *ctx_in)
 {
 	ctx_in->ctx = ctx->ctx;
 	ctx_in->op_type = ctx->op_type;
 	ctx_in->ctx_mode = ctx->ctx_mode;
+	ctx_in->stats = wd_ctx_get_stats_area(ctx->ctx);
 }
 
 int wd_init_ctx_config(struct wd_ctx_config_internal *in,
@@ -104,7 +189,8 @@ int wd_init_ctx_config(struct wd_ctx_config_internal *in,
 	return 0;
 }
 
-int wd_init_sched(struct wd_sched *in, struct wd_sched *from)
+int wd_init_sched(struct wd_sched *in, struct wd_sched *from,
+		  struct wd_async_msg_pool *pool)
 {
 	if (!from->name || !from->sched_init ||
 	    !from->pick_next_ctx || !from->poll_policy)
@@ -115,6 +201,7 @@ int wd_init_sched(struct wd_sched *in, struct wd_sched *from)
 	in->sched_init = from->sched_init;
 	in->pick_next_ctx = from->pick_next_ctx;
 	in->poll_policy = from->poll_policy;
+	wd_sched_bind_pool(in, pool);
 
 	return 0;
 }
@@ -125,6 +212,8 @@ void wd_clear_sched(struct wd_sched *in)
 
 	if (name)
 		free(name);
+	if (in->h_sched_ctx)
+		wd_sched_bind_pool(in, NULL);
 	in->h_sched_ctx = 0;
 	in->name = NULL;
 	in->sched_init = NULL;
@@ -159,48 +248,200 @@ void wd_memset_zero(void *data, __u32 size)
 		*s++ = 0;
 }
 
-static int init_msg_pool(struct msg_pool *pool, __u32 msg_num, __u32 msg_size)
+static int init_msg_pool(struct msg_pool *pool, __u32 msg_num,
+			 __u32 msg_size, struct wd_ctx_internal *ctx)
 {
-	pool->msgs = calloc(1, msg_num * msg_size);
-	if (!pool->msgs)
+	int numa_id = wd_get_numa_id(ctx->ctx);
+
+	pool->msg_size = msg_size;
+	pool->numa_id = numa_available() < 0 ? -1 : numa_id;
+	pool->stats = ctx->stats;
+	/* the pool of a sync ctx stays empty */
+	if (!msg_num)
+		return 0;
+
+	if (pool->stats && pool->stats->lat_en) {
+		pool->stamp = calloc(msg_num, sizeof(__u64));
+		if (!pool->stamp)
+			return -WD_ENOMEM;
+	}
+
+	pool->segs = calloc((msg_num + MSG_SEG_MASK) >> MSG_SEG_SHIFT,
+			    sizeof(void *));
+	if (!pool->segs)
 		return -WD_ENOMEM;
 
 	pool->used = calloc(1, msg_num * sizeof(int));
-	if (!pool->used) {
-		free(pool->msgs);
-		pool->msgs = NULL;
-		return -WD_ENOMEM;
-	}
+	if (!pool->used)
+		goto free_segs;
 
-	pool->msg_size = msg_size;
+	pool->next = calloc(msg_num, sizeof(__u32));
+	if (!pool->next)
+		goto free_used;
+
+	pthread_mutex_init(&pool->grow_lock, NULL);
+	/* no message yet, the first get allocates the first segment */
+	pool->top = 0;
 	pool->msg_num = msg_num;
-	pool->tail = 0;
 
 	return 0;
+
+free_used:
+	free(pool->used);
+	pool->used = NULL;
+free_segs:
+	free(pool->segs);
+	pool->segs = NULL;
+	free(pool->stamp);
+	pool->stamp = NULL;
+	return -WD_ENOMEM;
+}
+
+static __u32 msg_seg_len(struct msg_pool *pool, __u32 seg)
+{
+	__u32 num = pool->msg_num - (seg << MSG_SEG_SHIFT);
+
+	return (num < MSG_SEG_SIZE ? num : MSG_SEG_SIZE) * pool->msg_size;
 }
 
 static void uninit_msg_pool(struct msg_pool *pool)
 {
-	free(pool->msgs);
+	__u32 i;
+
+	for (i = 0; i < pool->seg_num; i++) {
+		if (pool->numa_id < 0)
+			free(pool->segs[i]);
+		else
+			numa_free(pool->segs[i], msg_seg_len(pool, i));
+	}
+
+	if (pool->msg_num)
+		pthread_mutex_destroy(&pool->grow_lock);
+
+	free(pool->segs);
 	free(pool->used);
-	pool->msgs = NULL;
-	pool->used = NULL;
+	free(pool->next);
+	free(pool->stamp);
 	memset(pool, 0, sizeof(*pool));
 }
 
-int wd_init_async_request_pool(struct wd_async_msg_pool *pool, __u32 pool_num,
+/*
+ * The free messages are kept in a lock free stack, so getting and putting
+ * a message takes one CAS whatever the occupancy is. The tag in the high
+ * half of top is bumped on every change to defeat ABA. The last put message
+ * is got first, it is likely still in the cache.
+ */
+static bool msg_pool_pop(struct msg_pool *p, __u32 *idx)
+{
+	__u64 top, new_top;
+	__u32 cur;
+
+	top = __atomic_load_n(&p->top, __ATOMIC_ACQUIRE);
+	do {
+		cur = (__u32)top;
+		if (!cur)
+			return false;
+
+		/* may be stale if cur is taken meanwhile, then the CAS fails */
+		new_top = ((top >> 32) + 1) << 32 |
+			  __atomic_load_n(&p->next[cur - 1], __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&p->top, &top, new_top, true,
+					      __ATOMIC_ACQUIRE,
+					      __ATOMIC_ACQUIRE));
+
+	*idx = cur - 1;
+
+	return true;
+}
+
+static void msg_pool_push(struct msg_pool *p, __u32 idx)
+{
+	__u64 top, new_top;
+
+	top = __atomic_load_n(&p->top, __ATOMIC_RELAXED);
+	do {
+		__atomic_store_n(&p->next[idx], (__u32)top, __ATOMIC_RELAXED);
+		new_top = ((top >> 32) + 1) << 32 | (idx + 1);
+	} while (!__atomic_compare_exchange_n(&p->top, &top, new_top, true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+/*
+ * Only the first get of a message finds the pool dry. The next segment is
+ * allocated on the node of the device then, so a pool holds no more messages
+ * than the requests ever in flight on its ctx, rounded up to a segment.
+ */
+static int msg_pool_grow(struct msg_pool *p)
+{
+	__u32 seg, begin, end;
+	int ret = 0;
+	void *msgs;
+
+	pthread_mutex_lock(&p->grow_lock);
+	/* messages may have been put back or allocated by others meanwhile */
+	if ((__u32)__atomic_load_n(&p->top, __ATOMIC_ACQUIRE))
+		goto out;
+
+	seg = p->seg_num;
+	begin = seg << MSG_SEG_SHIFT;
+	if (begin >= p->msg_num) {
+		ret = -WD_EBUSY;
+		goto out;
+	}
+
+	if (p->numa_id < 0)
+		msgs = calloc(1, msg_seg_len(p, seg));
+	else
+		msgs = numa_alloc_onnode(msg_seg_len(p, seg), p->numa_id);
+	if (!msgs) {
+		WD_ERR("failed to alloc msg segment %u!\n", seg);
+		ret = -WD_ENOMEM;
+		goto out;
+	}
+
+	__atomic_store_n(&p->segs[seg], msgs, __ATOMIC_RELEASE);
+	__atomic_store_n(&p->seg_num, seg + 1, __ATOMIC_RELAXED);
+
+	/* pushed from the end, so the first message of the segment is got first */
+	end = begin + MSG_SEG_SIZE < p->msg_num ? begin + MSG_SEG_SIZE : p->msg_num;
+	while (end > begin)
+		msg_pool_push(p, --end);
+out:
+	pthread_mutex_unlock(&p->grow_lock);
+	return ret;
+}
+
+static void *msg_pool_addr(struct msg_pool *p, __u32 idx)
+{
+	void *seg = __atomic_load_n(&p->segs[idx >> MSG_SEG_SHIFT],
+				    __ATOMIC_ACQUIRE);
+
+	if (unlikely(!seg))
+		return NULL;
+
+	return (void *)((uintptr_t)seg + p->msg_size * (idx & MSG_SEG_MASK));
+}
+
+int wd_init_async_request_pool(struct wd_async_msg_pool *pool,
+			       struct wd_ctx_config_internal *config,
 			       __u32 msg_num, __u32 msg_size)
 {
-	int i, j, ret;
+	struct wd_ctx_internal *ctx;
+	__u32 i, j;
+	int ret;
 
-	pool->pool_num = pool_num;
+	pool->pool_num = config->ctx_num;
 
 	pool->pools = calloc(1, pool->pool_num * sizeof(struct msg_pool));
 	if (!pool->pools)
 		return -WD_ENOMEM;
 
 	for (i = 0; i < pool->pool_num; i++) {
-		ret = init_msg_pool(&pool->pools[i], msg_num, msg_size);
+		ctx = config->ctxs + i;
+		ret = init_msg_pool(&pool->pools[i],
+				    ctx->ctx_mode == CTX_MODE_ASYNC ? msg_num : 0,
+				    msg_size, ctx);
 		if (ret < 0)
 			goto err;
 	}
@@ -216,7 +457,11 @@ err:
 
 void wd_uninit_async_request_pool(struct wd_async_msg_pool *pool)
 {
-	int i;
+	__u32 i;
+
+	/* the dispatcher threads still use the msgs queued to them */
+	while (__atomic_load_n(&pool->cb_pending, __ATOMIC_ACQUIRE))
+		sched_yield();
 
 	for (i = 0; i < pool->pool_num; i++)
 		uninit_msg_pool(&pool->pools[i]);
@@ -239,27 +484,41 @@ void *wd_find_msg_in_pool(struct wd_async_msg_pool *pool,
 		return NULL;
 	}
 
-	return (void *)((uintptr_t)p->msgs + p->msg_size * (tag - 1));
+	return msg_pool_addr(p, tag - 1);
 }
 
 int wd_get_msg_from_pool(struct wd_async_msg_pool *pool,
 			 int ctx_idx, void **msg)
 {
 	struct msg_pool *p = &pool->pools[ctx_idx];
-	__u32 msg_num = p->msg_num;
-	__u32 msg_size = p->msg_size;
-	int cnt = 0;
-	__u32 idx = p->tail;
+	__u32 in_use, peak;
+	__u32 idx;
+	int ret;
 
-	while (__atomic_test_and_set(&p->used[idx], __ATOMIC_ACQUIRE)) {
-		idx = (idx + 1) % msg_num;
-		cnt++;
-		if (cnt == msg_num)
-			return -WD_EBUSY;
+	while (unlikely(!msg_pool_pop(p, &idx))) {
+		ret = msg_pool_grow(p);
+		if (ret == -WD_EBUSY && p->stats)
+			__atomic_fetch_add(&wd_ctx_req_shard(p->stats)->busy_num,
+					   1, __ATOMIC_RELAXED);
+		if (ret)
+			return ret;
 	}
 
-	p->tail = (idx + 1) % msg_num;
-	*msg = (void *)((uintptr_t)p->msgs + msg_size * idx);
+	__atomic_store_n(&p->used[idx], 1, __ATOMIC_RELAXED);
+	*msg = msg_pool_addr(p, idx);
+	if (p->stats) {
+		__atomic_fetch_add(&wd_ctx_req_shard(p->stats)->async_num, 1,
+				   __ATOMIC_RELAXED);
+		if (p->stamp)
+			p->stamp[idx] = wd_ctx_stats_ns();
+	}
+
+	in_use = __atomic_add_fetch(&p->in_use, 1, __ATOMIC_RELAXED);
+	peak = __atomic_load_n(&p->peak, __ATOMIC_RELAXED);
+	while (in_use > peak &&
+	       !__atomic_compare_exchange_n(&p->peak, &peak, in_use, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
 
 	return idx + 1;
 }
@@ -275,7 +534,416 @@ void wd_put_msg_to_pool(struct wd_async_msg_pool *pool, int ctx_idx, __u32 tag)
 		return;
 	}
 
-	__atomic_clear(&p->used[tag - 1], __ATOMIC_RELEASE);
+	/* a message put twice would be handed out twice */
+	if (unlikely(!__atomic_exchange_n(&p->used[tag - 1], 0,
+					  __ATOMIC_RELAXED))) {
+		WD_ERR("message cache idx(%u) is already free\n", tag);
+		return;
+	}
+
+	__atomic_sub_fetch(&p->in_use, 1, __ATOMIC_RELAXED);
+	msg_pool_push(p, tag - 1);
+}
+
+static void msg_pool_stats_add(struct msg_pool *p,
+			       struct wd_ctx_msg_stats *stats)
+{
+	__u32 alloc_num, peak;
+
+	alloc_num = __atomic_load_n(&p->seg_num, __ATOMIC_RELAXED) <<
+		    MSG_SEG_SHIFT;
+	stats->msg_num += p->msg_num;
+	stats->alloc_num += alloc_num > p->msg_num ? p->msg_num : alloc_num;
+	stats->in_use += __atomic_load_n(&p->in_use, __ATOMIC_RELAXED);
+	peak = __atomic_load_n(&p->peak, __ATOMIC_RELAXED);
+	if (peak > stats->peak)
+		stats->peak = peak;
+}
+
+__u32 wd_get_msg_pool_in_use(struct wd_async_msg_pool *pool, __u32 index)
+{
+	if (!pool->pools || index >= pool->pool_num)
+		return 0;
+
+	return __atomic_load_n(&pool->pools[index].in_use, __ATOMIC_RELAXED);
+}
+
+static bool cb_task_push(struct cb_dispatcher *d, struct cb_task *in)
+{
+	struct cb_task *task;
+	__u32 pos, seq;
+
+	pos = __atomic_load_n(&d->prod, __ATOMIC_RELAXED);
+	while (1) {
+		task = d->ring + (pos & d->mask);
+		seq = __atomic_load_n(&task->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&d->prod, &pos, pos + 1,
+							true, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if ((int)(seq - pos) < 0) {
+			/* the slot of the last round is not consumed yet */
+			return false;
+		} else {
+			pos = __atomic_load_n(&d->prod, __ATOMIC_RELAXED);
+		}
+	}
+
+	task->idx = in->idx;
+	task->tag = in->tag;
+	task->pool = in->pool;
+	task->msg = in->msg;
+	task->done = in->done;
+	__atomic_store_n(&task->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+static bool cb_task_pop(struct cb_dispatcher *d, struct cb_task *out)
+{
+	struct cb_task *task;
+	__u32 pos, seq;
+
+	pos = __atomic_load_n(&d->cons, __ATOMIC_RELAXED);
+	while (1) {
+		task = d->ring + (pos & d->mask);
+		seq = __atomic_load_n(&task->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos + 1) {
+			if (__atomic_compare_exchange_n(&d->cons, &pos, pos + 1,
+							true, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if ((int)(seq - (pos + 1)) < 0) {
+			return false;
+		} else {
+			pos = __atomic_load_n(&d->cons, __ATOMIC_RELAXED);
+		}
+	}
+
+	*out = *task;
+	__atomic_store_n(&task->seq, pos + d->mask + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+static bool cb_task_empty(struct cb_dispatcher *d)
+{
+	__u32 pos = __atomic_load_n(&d->cons, __ATOMIC_RELAXED);
+	struct cb_task *task = d->ring + (pos & d->mask);
+
+	return __atomic_load_n(&task->seq, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+static void cb_dispatcher_wake(struct cb_dispatcher *d)
+{
+	__u32 parked;
+
+	/* pairs with the fence before a dispatcher thread checks the queue */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	parked = __atomic_load_n(&d->parked, __ATOMIC_RELAXED);
+	while (parked &&
+	       !__atomic_compare_exchange_n(&d->parked, &parked, parked - 1,
+					    true, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+
+	if (parked)
+		sem_post(&d->wake_sem);
+}
+
+static void cb_dispatcher_park(struct cb_dispatcher *d)
+{
+	__u32 parked;
+
+	__atomic_add_fetch(&d->parked, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (cb_task_empty(d) && !__atomic_load_n(&d->end, __ATOMIC_ACQUIRE))
+		goto wait;
+
+	/* take back the park, unless a producer has taken it to wake us */
+	parked = __atomic_load_n(&d->parked, __ATOMIC_RELAXED);
+	while (parked) {
+		if (__atomic_compare_exchange_n(&d->parked, &parked, parked - 1,
+						true, __ATOMIC_RELAXED,
+						__ATOMIC_RELAXED))
+			return;
+	}
+wait:
+	/* a spurious wakeup just goes round the loop again */
+	while (sem_wait(&d->wake_sem) && errno == EINTR)
+		;
+}
+
+static void cb_task_run(struct cb_dispatcher *d, struct cb_task *task)
+{
+	task->done(task->msg);
+	wd_put_msg_to_pool(task->pool, task->idx, task->tag);
+	__atomic_sub_fetch(&task->pool->cb_pending, 1, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&d->queued, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&d->cb_num, 1, __ATOMIC_RELAXED);
+}
+
+static void *cb_dispatch_func(void *args)
+{
+	struct cb_dispatcher *d = args;
+	struct cb_task task;
+	__u32 spin = 0;
+
+	while (1) {
+		if (cb_task_pop(d, &task)) {
+			cb_task_run(d, &task);
+			spin = 0;
+			continue;
+		}
+
+		/* the queue is drained before the thread ends */
+		if (__atomic_load_n(&d->end, __ATOMIC_ACQUIRE))
+			break;
+
+		if (++spin < WD_ASYNC_SPIN_NUM)
+			continue;
+
+		cb_dispatcher_park(d);
+		spin = 0;
+	}
+
+	return NULL;
+}
+
+void wd_complete_msg(struct wd_async_msg_pool *pool, int ctx_idx, __u32 tag,
+		     void *msg, wd_msg_done_t done)
+{
+	struct cb_dispatcher *d = __atomic_load_n(&cb_dispatcher,
+						  __ATOMIC_ACQUIRE);
+	struct msg_pool *p = &pool->pools[ctx_idx];
+	struct cb_task task;
+	__u32 queued, peak;
+
+	/* the request is reaped, the time in the callback is not counted */
+	if (p->stamp && tag && tag <= p->msg_num)
+		wd_ctx_stats_lat(wd_ctx_req_shard(p->stats)->lat,
+				 wd_ctx_stats_ns() - p->stamp[tag - 1]);
+
+	if (d) {
+		task.idx = ctx_idx;
+		task.tag = tag;
+		task.pool = pool;
+		task.msg = msg;
+		task.done = done;
+		__atomic_add_fetch(&pool->cb_pending, 1, __ATOMIC_RELAXED);
+		queued = __atomic_add_fetch(&d->queued, 1, __ATOMIC_RELAXED);
+		if (likely(cb_task_push(d, &task))) {
+			/* counts the pushes in progress too, so it may be over */
+			if (queued > d->mask + 1)
+				queued = d->mask + 1;
+			peak = __atomic_load_n(&d->peak, __ATOMIC_RELAXED);
+			while (queued > peak &&
+			       !__atomic_compare_exchange_n(&d->peak, &peak,
+							    queued, true,
+							    __ATOMIC_RELAXED,
+							    __ATOMIC_RELAXED))
+				;
+			cb_dispatcher_wake(d);
+			return;
+		}
+
+		__atomic_sub_fetch(&d->queued, 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&pool->cb_pending, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&d->full_num, 1, __ATOMIC_RELAXED);
+	}
+
+	done(msg);
+	wd_put_msg_to_pool(pool, ctx_idx, tag);
+}
+
+static int set_thread_cpu(pthread_attr_t *attr, __u32 cpu)
+{
+	cpu_set_t cpuset;
+
+	if (cpu >= CPU_SETSIZE) {
+		WD_ERR("invalid: cpu %u is out of range!\n", cpu);
+		return -WD_EINVAL;
+	}
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+
+	return -pthread_attr_setaffinity_np(attr, sizeof(cpuset), &cpuset);
+}
+
+static void cb_dispatcher_stop(struct cb_dispatcher *d, __u32 thread_num)
+{
+	__u32 i;
+
+	__atomic_store_n(&d->end, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < thread_num; i++)
+		sem_post(&d->wake_sem);
+
+	for (i = 0; i < thread_num; i++)
+		pthread_join(d->tids[i], NULL);
+}
+
+static void cb_dispatcher_free(struct cb_dispatcher *d)
+{
+	sem_destroy(&d->wake_sem);
+	free(d->tids);
+	free(d->ring);
+	free(d);
+}
+
+static int cb_dispatcher_start(struct cb_dispatcher *d,
+			       struct wd_cb_dispatch_config *config)
+{
+	pthread_attr_t attr;
+	__u32 i;
+	int ret;
+
+	for (i = 0; i < config->thread_num; i++) {
+		pthread_attr_init(&attr);
+		if (config->cpus) {
+			ret = set_thread_cpu(&attr,
+					     config->cpus[i % config->cpu_num]);
+			if (ret) {
+				pthread_attr_destroy(&attr);
+				goto stop;
+			}
+		}
+
+		ret = -pthread_create(&d->tids[i], &attr, cb_dispatch_func, d);
+		pthread_attr_destroy(&attr);
+		if (ret) {
+			WD_ERR("failed to create dispatcher thread, ret = %d!\n",
+			       ret);
+			goto stop;
+		}
+	}
+
+	return 0;
+
+stop:
+	cb_dispatcher_stop(d, i);
+	return ret;
+}
+
+int wd_cb_dispatch_init(struct wd_cb_dispatch_config *config)
+{
+	struct cb_dispatcher *d;
+	__u32 depth = 1;
+	__u32 i;
+	int ret;
+
+	if (!config || !config->thread_num ||
+	    (config->cpus && !config->cpu_num)) {
+		WD_ERR("invalid: dispatch config is NULL or thread/cpu num is 0!\n");
+		return -WD_EINVAL;
+	}
+
+	if (config->queue_depth > WD_CB_DEF_DEPTH * WD_CB_DEF_DEPTH) {
+		WD_ERR("invalid: dispatch queue depth %u is too large!\n",
+		       config->queue_depth);
+		return -WD_EINVAL;
+	}
+
+	while (depth < (config->queue_depth ? config->queue_depth :
+			WD_CB_DEF_DEPTH))
+		depth <<= 1;
+
+	d = calloc(1, sizeof(*d));
+	if (!d)
+		return -WD_ENOMEM;
+
+	d->ring = calloc(depth, sizeof(struct cb_task));
+	d->tids = calloc(config->thread_num, sizeof(pthread_t));
+	if (!d->ring || !d->tids) {
+		ret = -WD_ENOMEM;
+		goto free_d;
+	}
+
+	for (i = 0; i < depth; i++)
+		d->ring[i].seq = i;
+	d->mask = depth - 1;
+	d->thread_num = config->thread_num;
+
+	if (sem_init(&d->wake_sem, 0, 0)) {
+		ret = -errno;
+		goto free_d;
+	}
+
+	ret = cb_dispatcher_start(d, config);
+	if (ret)
+		goto uninit_sem;
+
+	if (__atomic_exchange_n(&cb_dispatcher, d, __ATOMIC_ACQ_REL)) {
+		WD_ERR("invalid: dispatcher threads are started already!\n");
+		ret = -WD_EEXIST;
+		goto stop;
+	}
+
+	return 0;
+
+stop:
+	cb_dispatcher_stop(d, d->thread_num);
+uninit_sem:
+	sem_destroy(&d->wake_sem);
+free_d:
+	free(d->tids);
+	free(d->ring);
+	free(d);
+	return ret;
+}
+
+void wd_cb_dispatch_uninit(void)
+{
+	struct cb_dispatcher *d;
+
+	d = __atomic_exchange_n(&cb_dispatcher, NULL, __ATOMIC_ACQ_REL);
+	if (!d)
+		return;
+
+	cb_dispatcher_stop(d, d->thread_num);
+	cb_dispatcher_free(d);
+}
+
+int wd_get_async_thread_stat(struct wd_async_thread_stat *stat)
+{
+	struct async_task_queue *task_queue;
+	struct cb_dispatcher *d;
+	__u32 i;
+
+	if (!stat) {
+		WD_ERR("invalid: async thread stat is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	memset(stat, 0, sizeof(*stat));
+
+	pthread_mutex_lock(&async_queue_lock);
+	for (task_queue = async_queue_list; task_queue;
+	     task_queue = task_queue->next) {
+		stat->poll_thread_num++;
+		stat->poll_num += __atomic_load_n(&task_queue->poll_num,
+						  __ATOMIC_RELAXED);
+		for (i = 0; i < task_queue->ctx_num; i++)
+			stat->poll_queued +=
+				__atomic_load_n(&task_queue->pending[i],
+						__ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&async_queue_lock);
+
+	/* the dispatcher is only freed by wd_cb_dispatch_uninit() */
+	d = __atomic_load_n(&cb_dispatcher, __ATOMIC_ACQUIRE);
+	if (!d)
+		return 0;
+
+	stat->cb_thread_num = d->thread_num;
+	stat->cb_depth = d->mask + 1;
+	stat->cb_queued = __atomic_load_n(&d->queued, __ATOMIC_RELAXED);
+	stat->cb_peak = __atomic_load_n(&d->peak, __ATOMIC_RELAXED);
+	stat->cb_num = __atomic_load_n(&d->cb_num, __ATOMIC_RELAXED);
+	stat->cb_full_num = __atomic_load_n(&d->full_num, __ATOMIC_RELAXED);
+
+	return 0;
 }
 
 int wd_check_datalist(struct wd_datalist *head, __u32 size)
@@ -1062,188 +1730,343 @@ static struct async_task_queue *find_async_queue(struct wd_env_config *config,
 	return head;
 }
 
+static void async_task_push(struct async_task_queue *task_queue, __u32 idx)
+{
+	struct async_task *task;
+	__u32 pos, seq;
+
+	pos = __atomic_load_n(&task_queue->prod, __ATOMIC_RELAXED);
+	while (1) {
+		task = task_queue->head + (pos & task_queue->mask);
+		seq = __atomic_load_n(&task->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&task_queue->prod, &pos,
+							pos + 1, true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if ((int)(seq - pos) < 0) {
+			/* the slot is not consumed yet, can't be here normally */
+			sched_yield();
+			pos = __atomic_load_n(&task_queue->prod, __ATOMIC_RELAXED);
+		} else {
+			pos = __atomic_load_n(&task_queue->prod, __ATOMIC_RELAXED);
+		}
+	}
+
+	task->idx = idx;
+	__atomic_store_n(&task->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/* only the polling thread pops */
+static bool async_task_pop(struct async_task_queue *task_queue, __u32 *idx)
+{
+	__u32 pos = task_queue->cons;
+	struct async_task *task;
+
+	task = task_queue->head + (pos & task_queue->mask);
+	if (__atomic_load_n(&task->seq, __ATOMIC_ACQUIRE) != pos + 1)
+		return false;
+
+	*idx = task->idx;
+	__atomic_store_n(&task->seq, pos + task_queue->mask + 1,
+			 __ATOMIC_RELEASE);
+	task_queue->cons = pos + 1;
+
+	return true;
+}
+
+static bool async_task_empty(struct async_task_queue *task_queue)
+{
+	struct async_task *task;
+	__u32 pos = task_queue->cons;
+
+	task = task_queue->head + (pos & task_queue->mask);
+
+	return __atomic_load_n(&task->seq, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+static void async_task_wake(struct async_task_queue *task_queue)
+{
+	/* pairs with the fence before the polling thread checks the ring */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&task_queue->parked, __ATOMIC_RELAXED) &&
+	    __atomic_exchange_n(&task_queue->parked, 0, __ATOMIC_RELAXED))
+		sem_post(&task_queue->wake_sem);
+}
+
 /* fix me: all return value here, and no config input */
 int wd_add_task_to_async_queue(struct wd_env_config *config, __u32 idx)
 {
 	struct async_task_queue *task_queue;
-	struct async_task *head, *task;
-	int prod;
 
 	if (!config->enable_internal_poll)
 		return 0;
 
 	task_queue = find_async_queue(config, idx);
-	if (!task_queue)
+	if (!task_queue || idx >= task_queue->ctx_num)
 		return 0;
 
-	if (sem_wait(&task_queue->empty_sem))
-		return 0;
+	/* the ctx is in the ring or being polled already */
+	if (__atomic_fetch_add(&task_queue->pending[idx], 1, __ATOMIC_ACQ_REL))
+		return 1;
 
-	pthread_mutex_lock(&task_queue->lock);
+	async_task_push(task_queue, idx);
+	async_task_wake(task_queue);
 
-	prod = task_queue->prod;
-	head = task_queue->head;
-	task = head + prod;
-	/* fix me */
-	task->idx = idx;
+	return 1;
+}
+
+/* Return the completions reaped from the ctx, or less than 0 on error */
+static int async_poll_one_ctx(struct async_task_queue *task_queue, __u32 idx)
+{
+	__u32 expect, count, left;
+	__u32 total = 0;
+	int ret;
 
-	prod = (prod + 1) % task_queue->depth;
-	task_queue->prod = prod;
-	task_queue->cur_task++;
-	task_queue->left_task--;
+	do {
+		expect = __atomic_load_n(&task_queue->pending[idx],
+					 __ATOMIC_ACQUIRE);
+		count = 0;
+		ret = task_queue->alg_poll_ctx(idx, expect, &count);
+		if (ret < 0 && ret != -WD_EAGAIN)
+			return ret;
 
-	pthread_mutex_unlock(&task_queue->lock);
+		task_queue->poll_num += count;
+		total += count;
+		left = __atomic_sub_fetch(&task_queue->pending[idx], count,
+					  __ATOMIC_ACQ_REL);
+		/* the requests not completed yet are polled in next round */
+	} while (left && ret != -WD_EAGAIN);
 
-	if (sem_post(&task_queue->full_sem))
-		return 0;
+	if (left)
+		async_task_push(task_queue, idx);
 
-	return 1;
+	return total;
 }
 
 static void *async_poll_process_func(void *args)
 {
 	struct async_task_queue *task_queue = args;
-	struct async_task *head, *task;
-	__u32 count;
-	int cons, ret;
+	__u32 spin = 0;
+	__u32 idx;
+	int ret;
 
-	while (1) {
-		if (sem_wait(&task_queue->full_sem)) {
-			if (errno == EINTR) {
+	/* the ctxs with requests in flight stay in the ring, so check end first */
+	while (!__atomic_load_n(&task_queue->end, __ATOMIC_ACQUIRE)) {
+		if (async_task_pop(task_queue, &idx)) {
+			ret = async_poll_one_ctx(task_queue, idx);
+			if (ret < 0)
+				break;
+			if (ret) {
+				spin = 0;
 				continue;
 			}
 		}
-		if (__atomic_load_n(&task_queue->end, __ATOMIC_ACQUIRE)) {
-			__atomic_store_n(&task_queue->end, 0, __ATOMIC_RELEASE);
-			goto out;
-		}
 
-		pthread_mutex_lock(&task_queue->lock);
+		if (++spin < WD_ASYNC_SPIN_NUM)
+			continue;
 
-		/* async sending message isn't submitted yet */
-		if (task_queue->cons == task_queue->prod) {
-			pthread_mutex_unlock(&task_queue->lock);
-			sem_post(&task_queue->full_sem);
+		/*
+		 * Only requests the hardware is still working on. Their queues
+		 * raise no completion interrupt to sleep on, so give the cpu
+		 * away between rounds rather than sleep on their latency.
+		 */
+		if (!async_task_empty(task_queue)) {
+			sched_yield();
 			continue;
 		}
 
-		cons = task_queue->cons;
-		head = task_queue->head;
-		task = head + cons;
-
-		task_queue->cons = (cons + 1) % task_queue->depth;
-		task_queue->cur_task--;
-		task_queue->left_task++;
-
-		pthread_mutex_unlock(&task_queue->lock);
-
-		ret = task_queue->alg_poll_ctx(task->idx, 1, &count);
-		if (ret < 0) {
-			pthread_mutex_lock(&task_queue->lock);
-			task_queue->cons = cons;
-			task_queue->cur_task++;
-			task_queue->left_task--;
-			pthread_mutex_unlock(&task_queue->lock);
-			if (ret == -WD_EAGAIN) {
-				sem_post(&task_queue->full_sem);
-				continue;
-			} else
-				goto out;
+		__atomic_store_n(&task_queue->parked, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (!async_task_empty(task_queue) ||
+		    __atomic_load_n(&task_queue->end, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&task_queue->parked, 0,
+					 __ATOMIC_RELAXED);
+			continue;
 		}
 
-		if (sem_post(&task_queue->empty_sem))
-			goto out;
+		/* a spurious wakeup just goes round the loop again */
+		while (sem_wait(&task_queue->wake_sem) && errno == EINTR)
+			;
+		spin = 0;
 	}
-out:
+
+	__atomic_store_n(&task_queue->exited, 1, __ATOMIC_RELEASE);
 	pthread_exit(NULL);
 	return NULL;
 }
 
 static int wd_init_one_task_queue(struct async_task_queue *task_queue,
-				  void *alg_poll_ctx)
+				  void *alg_poll_ctx, __u32 ctx_num, int cpu)
 
 {
 	struct async_task *head;
 	pthread_t thread_id;
 	pthread_attr_t attr;
-	int depth, ret;
+	__u32 depth = 1;
+	__u32 i;
+	int ret;
 
-	task_queue->depth = depth = WD_ASYNC_DEF_QUEUE_DEPTH;
+	/* each ctx takes one slot at most */
+	while (depth < ctx_num)
+		depth <<= 1;
 
-	head = calloc(task_queue->depth, sizeof(*head));
+	head = calloc(depth, sizeof(*head));
 	if (!head)
 		return -WD_ENOMEM;
 
-	task_queue->head = head;
-	task_queue->left_task = depth;
-	task_queue->alg_poll_ctx = alg_poll_ctx;
+	for (i = 0; i < depth; i++)
+		head[i].seq = i;
 
-	if (sem_init(&task_queue->empty_sem, 0, depth)) {
-		WD_ERR("empty_sem init failed.\n");
+	task_queue->pending = calloc(ctx_num, sizeof(__u32));
+	if (!task_queue->pending)
 		goto err_free_head;
-	}
 
-	if (sem_init(&task_queue->full_sem, 0, 0)) {
-		WD_ERR("full_sem init failed.\n");
-		goto err_uninit_empty_sem;
-	}
+	task_queue->head = head;
+	task_queue->mask = depth - 1;
+	task_queue->ctx_num = ctx_num;
+	task_queue->alg_poll_ctx = alg_poll_ctx;
 
-	if (pthread_mutex_init(&task_queue->lock, NULL)) {
-		WD_ERR("mutex init failed.\n");
-		goto err_uninit_full_sem;
+	if (sem_init(&task_queue->wake_sem, 0, 0)) {
+		WD_ERR("wake_sem init failed.\n");
+		goto err_free_pending;
 	}
 
 	pthread_attr_init(&attr);
 	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (cpu >= 0 && set_thread_cpu(&attr, cpu))
+		goto err_uninit_wake_sem;
+
 	task_queue->tid = 0;
+	task_queue->end = 0;
+	task_queue->exited = 0;
 	if (pthread_create(&thread_id, &attr, async_poll_process_func,
 			   task_queue)) {
 		WD_ERR("create poll thread failed.\n");
-		goto err_destory_mutex;
+		goto err_uninit_wake_sem;
 	}
 
 	task_queue->tid = thread_id;
 	pthread_attr_destroy(&attr);
 
+	pthread_mutex_lock(&async_queue_lock);
+	task_queue->next = async_queue_list;
+	async_queue_list = task_queue;
+	pthread_mutex_unlock(&async_queue_lock);
+
 	return 0;
 
-err_destory_mutex:
+err_uninit_wake_sem:
 	pthread_attr_destroy(&attr);
-	pthread_mutex_destroy(&task_queue->lock);
-err_uninit_full_sem:
-	sem_destroy(&task_queue->full_sem);
-err_uninit_empty_sem:
-	sem_destroy(&task_queue->empty_sem);
+	sem_destroy(&task_queue->wake_sem);
+err_free_pending:
+	free(task_queue->pending);
+	task_queue->pending = NULL;
 err_free_head:
 	free(head);
-	ret = -errno;
+	ret = errno ? -errno : -WD_ENOMEM;
 	return ret;
 }
 
 static void wd_uninit_one_task_queue(struct async_task_queue *task_queue)
 {
+	struct async_task_queue **pos;
+
+	pthread_mutex_lock(&async_queue_lock);
+	for (pos = &async_queue_list; *pos; pos = &(*pos)->next) {
+		if (*pos == task_queue) {
+			*pos = task_queue->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&async_queue_lock);
+
 	/*
 	 * If there's no async task, async_poll_process_func() is sleeping
-	 * on task_queue->full_sem. It'll cause that threads could not
+	 * on task_queue->wake_sem. It'll cause that threads could not
 	 * be end and memory leak.
 	 */
-	sem_post(&task_queue->full_sem);
 	__atomic_store_n(&task_queue->end, 1, __ATOMIC_RELEASE);
-	while (__atomic_load_n(&task_queue->end, __ATOMIC_ACQUIRE))
+	sem_post(&task_queue->wake_sem);
+	while (!__atomic_load_n(&task_queue->exited, __ATOMIC_ACQUIRE))
 		sched_yield();
 
-	pthread_mutex_destroy(&task_queue->lock);
-	sem_destroy(&task_queue->full_sem);
-	sem_destroy(&task_queue->empty_sem);
+	sem_destroy(&task_queue->wake_sem);
+	free(task_queue->pending);
+	task_queue->pending = NULL;
 	free(task_queue->head);
 	task_queue->head = NULL;
 }
 
+/* CPUs from WD_ASYNC_POLL_CPUS, given to the polling threads in turn */
+struct poll_cpu_list {
+	__u32 cpus[CPU_SETSIZE];
+	__u32 num;
+	__u32 next;
+};
+
+static int parse_cpu_range(char *s, __u32 *first, __u32 *last)
+{
+	char *end = s;
+
+	s = strsep(&end, "-");
+	if (!is_number(s) || (end && !is_number(end)))
+		return -WD_EINVAL;
+
+	*first = strtoul(s, NULL, 10);
+	*last = end ? strtoul(end, NULL, 10) : *first;
+	if (*first > *last || *last >= CPU_SETSIZE)
+		return -WD_EINVAL;
+
+	return 0;
+}
+
+static int parse_poll_cpus(struct wd_env_config *config,
+			   struct poll_cpu_list *list)
+{
+	char *left, *section, *start;
+	__u32 first, last;
+	const char *s;
+	int ret = 0;
+
+	list->num = 0;
+	list->next = 0;
+	if (config->disable_env)
+		return 0;
+
+	s = secure_getenv(WD_ASYNC_POLL_CPUS_ENV);
+	if (!s || !strlen(s))
+		return 0;
+
+	start = strdup(s);
+	if (!start)
+		return -WD_ENOMEM;
+
+	left = start;
+	while ((section = strsep(&left, ","))) {
+		ret = parse_cpu_range(section, &first, &last);
+		if (ret) {
+			WD_ERR("invalid: %s is not a cpu list!\n", s);
+			break;
+		}
+
+		for (; first <= last && list->num < CPU_SETSIZE; first++)
+			list->cpus[list->num++] = first;
+	}
+
+	free(start);
+	return ret;
+}
+
 static int wd_init_async_polling_thread_per_numa(struct wd_env_config *config,
-				struct wd_env_config_per_numa *config_numa)
+				struct wd_env_config_per_numa *config_numa,
+				struct poll_cpu_list *cpu_list)
 {
 	struct async_task_queue *task_queue, *head;
-	int i, j, n, ret;
+	struct wd_env_config_per_numa *numa;
+	__u32 ctx_num = 0;
+	int i, j, n, cpu, ret;
 
 	if (!config_numa->async_ctx_num)
 		return 0;
@@ -1270,8 +2093,14 @@ static int wd_init_async_polling_thread_per_numa(struct wd_env_config *config,
 		       config_numa->async_ctx_num);
 	} else
 		n = config_numa->async_poll_num;
+	FOREACH_NUMA(i, config, numa)
+		ctx_num += numa->sync_ctx_num + numa->async_ctx_num;
+
 	for (i = 0; i < n; task_queue++, i++) {
-		ret = wd_init_one_task_queue(task_queue, config->alg_poll_ctx);
+		cpu = cpu_list->num ?
+		      (int)cpu_list->cpus[cpu_list->next++ % cpu_list->num] : -1;
+		ret = wd_init_one_task_queue(task_queue, config->alg_poll_ctx,
+					     ctx_num, cpu);
 		if (ret) {
 			task_queue = head;
 			for (j = 0; j < i; task_queue++, j++)
@@ -1305,18 +2134,30 @@ static void wd_uninit_async_polling_thread_per_numa(struct wd_env_config *cfg,
 static int wd_init_async_polling_thread(struct wd_env_config *config)
 {
 	struct wd_env_config_per_numa *config_numa;
+	struct poll_cpu_list *cpu_list;
 	int i, ret;
 
 	if (!config->enable_internal_poll)
 		return 0;
 
+	cpu_list = malloc(sizeof(*cpu_list));
+	if (!cpu_list)
+		return -WD_ENOMEM;
+
+	ret = parse_poll_cpus(config, cpu_list);
+	if (ret)
+		goto out;
+
 	FOREACH_NUMA(i, config, config_numa) {
-		ret = wd_init_async_polling_thread_per_numa(config, config_numa);
+		ret = wd_init_async_polling_thread_per_numa(config, config_numa,
+							    cpu_list);
 		if (ret)
-			return ret;
+			goto out;
 	}
 
-	return 0;
+out:
+	free(cpu_list);
+	return ret;
 }
 
 static void wd_uninit_async_polling_thread(struct wd_env_config *config)
@@ -1581,3 +2422,289 @@ int wd_check_ctx(struct wd_ctx_config_internal *config, __u8 mode, __u32 idx)
 
 	return 0;
 }
+
+static __u32 sync_spin_budget(struct wd_ctx_internal *ctx)
+{
+	__u32 budget = ctx->spin_avg << 1;
+
+	if (budget < WD_SPIN_BUDGET_MIN)
+		return WD_SPIN_BUDGET_MIN;
+	if (budget > WD_SPIN_BUDGET_MAX)
+		return WD_SPIN_BUDGET_MAX;
+
+	return budget;
+}
+
+bool wd_sync_wait_irq(struct wd_ctx_internal *ctx)
+{
+	return (ctx->spin_avg << 1) >= WD_SPIN_BUDGET_MAX;
+}
+
+bool wd_sync_wait_sleep(struct wd_ctx_internal *ctx, __u8 irq, __u64 retry)
+{
+	/* nothing to wait for before the first recv */
+	if (!retry)
+		return false;
+
+	if (!irq || retry <= sync_spin_budget(ctx)) {
+		ctx->wait_stat.spins++;
+		return false;
+	}
+
+	ctx->wait_stat.sleeps++;
+
+	return true;
+}
+
+static void prefault_list(struct wd_datalist *list, __u32 bytes, __u32 flags)
+{
+	__u32 len;
+
+	for (; list && bytes; list = list->next) {
+		len = list->len < bytes ? list->len : bytes;
+		wd_prefault_submit(list->data, len, flags);
+		bytes -= len;
+	}
+}
+
+void wd_prefault_req(void *src, __u32 src_bytes, void *dst, __u32 dst_bytes,
+		     __u8 data_fmt)
+{
+	if (data_fmt == WD_SGL_BUF) {
+		prefault_list(src, src_bytes, 0);
+		prefault_list(dst, dst_bytes, WD_PREFAULT_WRITE);
+		return;
+	}
+
+	wd_prefault_submit(src, src_bytes, 0);
+	wd_prefault_submit(dst, dst_bytes, WD_PREFAULT_WRITE);
+}
+
+void wd_ctx_stats_sync(struct wd_ctx_stats_area *stats, __u64 retry)
+{
+	struct wd_ctx_req_stats *shard;
+
+	if (!stats)
+		return;
+
+	shard = wd_ctx_req_shard(stats);
+	__atomic_fetch_add(&shard->sync_num, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&shard->spin_num, retry, __ATOMIC_RELAXED);
+}
+
+void wd_sync_wait_done(struct wd_ctx_internal *ctx, __u64 retry)
+{
+	__u32 cost;
+
+	wd_ctx_stats_sync(ctx->stats, retry);
+
+	/* the requests out of the budget push the ctx to the interrupt mode */
+	cost = retry > sync_spin_budget(ctx) ? WD_SPIN_BUDGET_MAX : retry;
+	ctx->spin_avg = ctx->spin_avg - (ctx->spin_avg >> WD_SPIN_AVG_SHIFT) +
+			(cost >> WD_SPIN_AVG_SHIFT);
+}
+
+int wd_get_ctx_stats(struct wd_ctx_config_internal *config,
+		     struct wd_async_msg_pool *pool, __u32 idx,
+		     struct wd_ctx_stats *stats)
+{
+	__u32 i;
+
+	if (unlikely(!stats)) {
+		WD_ERR("invalid: ctx stats is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	if (unlikely(!config->ctxs)) {
+		WD_ERR("invalid: ctxs are not initialized!\n");
+		return -WD_EINVAL;
+	}
+
+	if (idx != WD_CTX_STATS_ALL && unlikely(idx >= config->ctx_num)) {
+		WD_ERR("invalid: ctx idx %u is out of range!\n", idx);
+		return -WD_EINVAL;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < config->ctx_num; i++) {
+		if (idx != WD_CTX_STATS_ALL && i != idx)
+			continue;
+		if (config->ctxs[i].stats)
+			wd_ctx_stats_add(config->ctxs[i].stats, stats);
+		if (pool->pools && i < pool->pool_num)
+			msg_pool_stats_add(&pool->pools[i], &stats->msg);
+	}
+
+	return 0;
+}
+
+int wd_get_sync_wait_stat(struct wd_ctx_config_internal *config, __u32 idx,
+			  struct wd_sync_wait_stat *stat)
+{
+	struct wd_ctx_internal *ctx;
+	int ret;
+
+	if (unlikely(!stat)) {
+		WD_ERR("invalid: sync wait stat is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	ret = wd_check_ctx(config, CTX_MODE_SYNC, idx);
+	if (ret)
+		return ret;
+
+	ctx = config->ctxs + idx;
+	pthread_spin_lock(&ctx->lock);
+	*stat = ctx->wait_stat;
+	pthread_spin_unlock(&ctx->lock);
+
+	return 0;
+}
+
+void wd_uninit_bounce(struct wd_bounce *bounce)
+{
+	struct wd_bounce_pool *pool;
+	__u32 i;
+
+	if (!bounce->pools)
+		return;
+
+	for (i = 0; i < bounce->pool_num; i++) {
+		pool = bounce->pools + i;
+		if (pool->blkpool)
+			wd_blockpool_destroy(pool->blkpool);
+		if (pool->mempool)
+			wd_mempool_destroy(pool->mempool);
+	}
+
+	free(bounce->pools);
+	bounce->pools = NULL;
+	bounce->pool_num = 0;
+}
+
+/* a block across two discontiguous dma slices can't be used by the device */
+static int bounce_check_blocks(struct wd_bounce_pool *pool, handle_t h_ctx,
+			       __u32 blk_size, __u32 blk_num)
+{
+	__u32 num, i;
+	void **blks;
+	int ret = 0;
+
+	blks = calloc(blk_num, sizeof(void *));
+	if (!blks)
+		return -WD_ENOMEM;
+
+	for (num = 0; num < blk_num; num++) {
+		blks[num] = wd_block_alloc(pool->blkpool);
+		if (!blks[num]) {
+			ret = -WD_ENOMEM;
+			break;
+		}
+	}
+
+	for (i = 0; i < num; i++) {
+		if (!ret && !wd_ctx_iova_map(h_ctx, blks[i], blk_size)) {
+			WD_ERR("reserved memory isn't contiguous for a block!\n");
+			ret = -WD_ENOMEM;
+		}
+		wd_block_free(pool->blkpool, blks[i]);
+	}
+	free(blks);
+
+	return ret;
+}
+
+int wd_init_bounce(struct wd_bounce *bounce,
+		   struct wd_ctx_config_internal *config,
+		   __u32 blk_size, __u32 blk_num)
+{
+	struct wd_bounce_pool *pool;
+	handle_t h_ctx;
+	__u32 i;
+	int ret;
+
+	if (!bounce || !config || !blk_size || !blk_num) {
+		WD_ERR("invalid: bounce or config is NULL, or size is 0!\n");
+		return -WD_EINVAL;
+	}
+
+	memset(bounce, 0, sizeof(*bounce));
+	if (wd_is_sva(config->ctxs[0].ctx))
+		return 0;
+
+	bounce->pools = calloc(config->ctx_num, sizeof(*bounce->pools));
+	if (!bounce->pools)
+		return -WD_ENOMEM;
+
+	bounce->pool_num = config->ctx_num;
+	bounce->blk_size = blk_size;
+	for (i = 0; i < config->ctx_num; i++) {
+		pool = bounce->pools + i;
+		h_ctx = config->ctxs[i].ctx;
+		pool->mempool = wd_mempool_create_dma(h_ctx,
+					(size_t)blk_size * blk_num);
+		if (WD_IS_ERR(pool->mempool)) {
+			ret = WD_HANDLE_ERR(pool->mempool);
+			pool->mempool = 0;
+			goto out_uninit;
+		}
+
+		pool->blkpool = wd_blockpool_create(pool->mempool, blk_size,
+						    blk_num);
+		if (WD_IS_ERR(pool->blkpool)) {
+			ret = WD_HANDLE_ERR(pool->blkpool);
+			pool->blkpool = 0;
+			goto out_uninit;
+		}
+
+		ret = bounce_check_blocks(pool, h_ctx, blk_size, blk_num);
+		if (ret)
+			goto out_uninit;
+	}
+
+	return 0;
+
+out_uninit:
+	WD_ERR("failed to init bounce blocks of ctx %u, ret = %d!\n", i, ret);
+	wd_uninit_bounce(bounce);
+	return ret;
+}
+
+int wd_bounce_get(struct wd_bounce *bounce,
+		  struct wd_ctx_config_internal *config, __u32 idx,
+		  void *buf, __u32 len, __u32 copy, void **out)
+{
+	void *blk;
+
+	if (wd_ctx_iova_map(config->ctxs[idx].ctx, buf, len)) {
+		*out = buf;
+		return 0;
+	}
+
+	if (unlikely(len > bounce->blk_size)) {
+		WD_ERR("invalid: %u bytes is bigger than a bounce block!\n",
+		       len);
+		return -WD_EINVAL;
+	}
+
+	blk = wd_block_alloc(bounce->pools[idx].blkpool);
+	if (unlikely(!blk))
+		return -WD_EBUSY;
+
+	if (copy)
+		memcpy(blk, buf, copy);
+	*out = blk;
+
+	return 0;
+}
+
+void wd_bounce_put(struct wd_bounce *bounce, __u32 idx, void *buf, void *blk,
+		   __u32 copy)
+{
+	if (!blk || blk == buf)
+		return;
+
+	if (copy)
+		memcpy(buf, blk, copy);
+	wd_block_free(bounce->pools[idx].blkpool, blk);
+}
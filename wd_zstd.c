@@ -0,0 +1,1264 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020-2021 Huawei Technologies Co.,Ltd. All rights reserved. */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd_zstd.h"
+
+#define ZSTD_MAGIC			0xFD2FB528
+/* window log 17, the decoder can't be asked for less than one block */
+#define ZSTD_WIN_DESC			0x38
+#define ZSTD_FCS_16_MIN			256
+#define ZSTD_FCS_16_MAX			(0xffff + ZSTD_FCS_16_MIN)
+#define ZSTD_FHD_FCS_SHIFT		6
+#define ZSTD_BLK_HEADER_SZ		3
+#define ZSTD_BLK_TYPE_SHIFT		1
+#define ZSTD_BLK_SIZE_SHIFT		3
+
+#define ZSTD_REP_NUM			3
+#define ZSTD_MIN_MATCH			3
+#define ZSTD_SEQ_MAX			(WD_ZSTD_BLOCK_MAX / ZSTD_MIN_MATCH + 1)
+/* unit of lit_length_overflow_cnt, literal lengths are 16 bits in hardware */
+#define ZSTD_LONG_LEN_UNIT		0x10000
+#define ZSTD_SEQ_LONG			0x7f00
+
+#define LIT_RAW				0
+#define LIT_RLE				1
+#define LIT_HUF				2
+/* literals shorter than this are not worth a Huffman table */
+#define LIT_HUF_MIN			64
+#define LIT_HUF_1X_MAX			1023
+#define LIT_SIZE_14_MAX			0x3fff
+
+#define HUF_MAX_BITS			11
+#define HUF_MAX_SYM			255
+#define HUF_WEIGHT_LOG			6
+#define HUF_DIRECT_MAX			128
+#define HUF_DIRECT_BASE			127
+#define HUF_STREAMS			4
+#define HUF_JUMP_SZ			6
+
+#define FSE_MIN_LOG			5
+#define FSE_MAX_LOG			9
+#define FSE_MAX_SYM			52
+#define LL_MAX_CODE			35
+#define ML_MAX_CODE			52
+#define OF_MAX_CODE			31
+#define LL_FSE_LOG			9
+#define ML_FSE_LOG			9
+#define OF_FSE_LOG			8
+
+#define MODE_PREDEF			0
+#define MODE_RLE			1
+#define MODE_FSE			2
+
+/* costs are kept in 1/256 bits */
+#define COST_SHIFT			8
+
+enum zstd_blk_type {
+	BLK_RAW,
+	BLK_RLE,
+	BLK_COMP,
+};
+
+/* a sequence output by the hardware, the same as seqDef of libzstd */
+struct zstd_hw_seq {
+	__u32 off;
+	__u16 ll;
+	__u16 ml;
+};
+
+struct zstd_seq {
+	/* Offset_Value of the zstd format, 1 to 3 are the repeat offsets */
+	__u32 off;
+	__u32 ll;
+	/* match length - ZSTD_MIN_MATCH */
+	__u32 ml;
+};
+
+struct bit_writer {
+	__u64 bits;
+	__u32 pos;
+	__u8 *start;
+	__u8 *ptr;
+	__u8 *end;
+	bool overflow;
+};
+
+struct fse_sym {
+	__s32 delta_find;
+	__u32 delta_nb;
+};
+
+struct fse_ctable {
+	__u16 state[1 << FSE_MAX_LOG];
+	struct fse_sym sym[FSE_MAX_SYM + 1];
+	__u32 log;
+	bool rle;
+};
+
+struct fse_state {
+	const struct fse_ctable *ct;
+	__u32 value;
+};
+
+struct seq_stream {
+	const __u8 *codes;
+	__u32 max_code;
+	__u32 max_log;
+	const __s16 *predef;
+	__u32 predef_max;
+	__u32 predef_log;
+};
+
+struct wd_zstd_enc {
+	__u64 content_size;
+	__u64 in_size;
+	/* repeat offsets after the last two blocks seen by the hardware */
+	__u32 rep_hw[ZSTD_REP_NUM];
+	__u32 rep_hw_prev[ZSTD_REP_NUM];
+	/* repeat offsets of the decoder */
+	__u32 rep[ZSTD_REP_NUM];
+	__u32 ended;
+	struct fse_ctable ct[3];
+	struct zstd_seq seqs[ZSTD_SEQ_MAX];
+	__u8 ll_code[ZSTD_SEQ_MAX];
+	__u8 ml_code[ZSTD_SEQ_MAX];
+	__u8 of_code[ZSTD_SEQ_MAX];
+};
+
+static const __u32 rep_init[ZSTD_REP_NUM] = {1, 4, 8};
+
+static const __u8 ll_bits[LL_MAX_CODE + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+	13, 14, 15, 16
+};
+
+static const __u8 ml_bits[ML_MAX_CODE + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+	12, 13, 14, 15, 16
+};
+
+static const __u8 ll_code_tbl[64] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 16, 17, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21,
+	22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24
+};
+
+static const __u8 ml_code_tbl[128] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+	32, 32, 33, 33, 34, 34, 35, 35, 36, 36, 36, 36, 37, 37, 37, 37,
+	38, 38, 38, 38, 38, 38, 38, 38, 39, 39, 39, 39, 39, 39, 39, 39,
+	40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40,
+	41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41,
+	42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42,
+	42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42
+};
+
+/* the predefined distributions of the zstd format */
+static const __s16 ll_predef[LL_MAX_CODE + 1] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1
+};
+
+static const __s16 ml_predef[ML_MAX_CODE + 1] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1
+};
+
+static const __s16 of_predef[] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+static inline __u32 highbit(__u32 val)
+{
+	return 31 - __builtin_clz(val);
+}
+
+/* log2 of @val in 1/256 bits, with the mantissa taken as linear */
+static __u32 log2_cost(__u32 val)
+{
+	__u32 hb = highbit(val);
+
+	return (hb << COST_SHIFT) +
+	       ((((__u64)val << COST_SHIFT) >> hb) - (1 << COST_SHIFT));
+}
+
+static void put_le16(__u8 *p, __u32 val)
+{
+	p[0] = (__u8)val;
+	p[1] = (__u8)(val >> 8);
+}
+
+static void put_le24(__u8 *p, __u32 val)
+{
+	put_le16(p, val);
+	p[2] = (__u8)(val >> 16);
+}
+
+static void put_le32(__u8 *p, __u32 val)
+{
+	put_le16(p, val);
+	put_le16(p + 2, val >> 16);
+}
+
+/*
+ * The bits are packed from the lowest bit of the first byte. The streams of
+ * zstd are read from their end, so the encoder writes the symbols backwards.
+ */
+static void bw_init(struct bit_writer *bw, __u8 *dst, __u32 len)
+{
+	bw->bits = 0;
+	bw->pos = 0;
+	bw->start = dst;
+	bw->ptr = dst;
+	bw->end = dst + len;
+	bw->overflow = false;
+}
+
+static void bw_flush(struct bit_writer *bw)
+{
+	while (bw->pos >= 8) {
+		if (unlikely(bw->ptr == bw->end)) {
+			bw->overflow = true;
+			bw->pos = 0;
+			return;
+		}
+		*bw->ptr++ = (__u8)bw->bits;
+		bw->bits >>= 8;
+		bw->pos -= 8;
+	}
+}
+
+static inline void bw_add(struct bit_writer *bw, __u32 val, __u32 nb)
+{
+	if (!nb)
+		return;
+
+	if (bw->pos + nb > 64)
+		bw_flush(bw);
+
+	bw->bits |= ((__u64)val & ((1ULL << nb) - 1)) << bw->pos;
+	bw->pos += nb;
+}
+
+/* Write the bits left, return the size written or -WD_EINVAL if no room */
+static int bw_finish(struct bit_writer *bw)
+{
+	bw_flush(bw);
+	if (bw->pos) {
+		if (bw->ptr == bw->end)
+			return -WD_EINVAL;
+		*bw->ptr++ = (__u8)bw->bits;
+		bw->bits = 0;
+		bw->pos = 0;
+	}
+
+	return bw->overflow ? -WD_EINVAL : bw->ptr - bw->start;
+}
+
+/* A backward stream ends with a 1 bit, where the decoder starts */
+static int bw_close(struct bit_writer *bw)
+{
+	bw_add(bw, 1, 1);
+
+	return bw_finish(bw);
+}
+
+/*
+ * Count the symbols with four tables, so the increments of the same symbol
+ * next to each other don't wait for each other. Return the largest symbol.
+ */
+static __u32 hist_count(const __u8 *src, __u32 len, __u32 *count,
+			__u32 max_sym)
+{
+	__u32 sub[4][256];
+	__u32 i, s;
+
+	memset(sub, 0, sizeof(sub));
+	for (i = 0; i + 4 <= len; i += 4) {
+		sub[0][src[i]]++;
+		sub[1][src[i + 1]]++;
+		sub[2][src[i + 2]]++;
+		sub[3][src[i + 3]]++;
+	}
+	for (; i < len; i++)
+		sub[0][src[i]]++;
+
+	for (s = 0; s <= max_sym; s++)
+		count[s] = sub[0][s] + sub[1][s] + sub[2][s] + sub[3][s];
+
+	while (max_sym && !count[max_sym])
+		max_sym--;
+
+	return max_sym;
+}
+
+static __u32 fse_table_log(__u32 total, __u32 max_sym, __u32 max_log)
+{
+	__u32 log = max_log;
+	__u32 src_log = highbit(total - 1) - 2;
+	__u32 min_log = highbit(total - 1) + 1;
+
+	if (min_log > highbit(max_sym) + 2)
+		min_log = highbit(max_sym) + 2;
+	if (src_log < log)
+		log = src_log;
+	if (min_log > log)
+		log = min_log;
+	if (log < FSE_MIN_LOG)
+		log = FSE_MIN_LOG;
+
+	return log > max_log ? max_log : log;
+}
+
+/*
+ * Scale the counts to a sum of 1 << @log, every symbol present keeps at
+ * least 1. The rounding error is taken from and given to the largest ones.
+ */
+static void fse_normalize(__s16 *norm, __u32 log, const __u32 *count,
+			  __u32 max_sym, __u32 total)
+{
+	__u32 size = 1 << log;
+	__u32 sum = 0;
+	__u32 largest = 0;
+	__u32 s, big;
+	__u64 n;
+
+	for (s = 0; s <= max_sym; s++) {
+		if (!count[s]) {
+			norm[s] = 0;
+			continue;
+		}
+
+		n = ((__u64)count[s] * size + total / 2) / total;
+		norm[s] = n ? n : 1;
+		sum += norm[s];
+		if (count[s] > count[largest])
+			largest = s;
+	}
+
+	while (sum > size) {
+		big = largest;
+		for (s = 0; s <= max_sym; s++)
+			if (norm[s] > norm[big])
+				big = s;
+		norm[big]--;
+		sum--;
+	}
+
+	norm[largest] += size - sum;
+}
+
+/* The same table as the one built by the decoder from @norm */
+static void fse_build(struct fse_ctable *ct, const __s16 *norm, __u32 max_sym,
+		      __u32 log)
+{
+	__u32 size = 1 << log;
+	__u32 mask = size - 1;
+	__u32 step = (size >> 1) + (size >> 3) + 3;
+	__u32 high = size - 1;
+	__u8 spread[1 << FSE_MAX_LOG];
+	__u32 cumul[FSE_MAX_SYM + 2];
+	__u32 pos = 0;
+	__u32 total = 0;
+	__u32 s, u, nb;
+	__s32 i;
+
+	ct->log = log;
+	ct->rle = false;
+
+	cumul[0] = 0;
+	for (s = 0; s <= max_sym; s++) {
+		if (norm[s] == -1) {
+			cumul[s + 1] = cumul[s] + 1;
+			spread[high--] = s;
+		} else {
+			cumul[s + 1] = cumul[s] + norm[s];
+		}
+	}
+
+	for (s = 0; s <= max_sym; s++) {
+		for (i = 0; i < norm[s]; i++) {
+			spread[pos] = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+
+	for (u = 0; u < size; u++)
+		ct->state[cumul[spread[u]]++] = size + u;
+
+	for (s = 0; s <= max_sym; s++) {
+		switch (norm[s]) {
+		case 0:
+			ct->sym[s].delta_nb = ((log + 1) << 16) - size;
+			break;
+		case -1:
+		case 1:
+			ct->sym[s].delta_nb = (log << 16) - size;
+			ct->sym[s].delta_find = total - 1;
+			total++;
+			break;
+		default:
+			nb = log - highbit(norm[s] - 1);
+			ct->sym[s].delta_nb = (nb << 16) - (norm[s] << nb);
+			ct->sym[s].delta_find = total - norm[s];
+			total += norm[s];
+			break;
+		}
+	}
+}
+
+static int fse_write_ncount(struct bit_writer *bw, const __s16 *norm,
+			    __u32 max_sym, __u32 log)
+{
+	__s32 remaining = (1 << log) + 1;
+	__s32 threshold = 1 << log;
+	__u32 nb = log + 1;
+	bool prev_zero = false;
+	__u32 sym = 0;
+	__s32 count, max;
+	__u32 start;
+
+	bw_add(bw, log - FSE_MIN_LOG, 4);
+	while (sym <= max_sym && remaining > 1) {
+		if (prev_zero) {
+			start = sym;
+			while (sym <= max_sym && !norm[sym])
+				sym++;
+			if (sym > max_sym)
+				return -WD_EINVAL;
+			while (sym >= start + 3) {
+				start += 3;
+				bw_add(bw, 3, 2);
+			}
+			bw_add(bw, sym - start, 2);
+		}
+
+		count = norm[sym++];
+		max = (2 * threshold - 1) - remaining;
+		remaining -= count < 0 ? -count : count;
+		count++;
+		if (count >= threshold)
+			count += max;
+		bw_add(bw, count, nb - (count < max));
+		prev_zero = count == 1;
+		if (remaining < 1)
+			return -WD_EINVAL;
+		while (remaining < threshold) {
+			nb--;
+			threshold >>= 1;
+		}
+	}
+
+	return remaining == 1 ? 0 : -WD_EINVAL;
+}
+
+/* The first symbol to encode is the last one decoded, it needs no bits */
+static void fse_init_state(struct fse_state *st, const struct fse_ctable *ct,
+			   __u32 sym)
+{
+	const struct fse_sym *tt = &ct->sym[sym];
+	__u32 nb, val;
+
+	st->ct = ct;
+	st->value = 0;
+	if (ct->rle)
+		return;
+
+	nb = (tt->delta_nb + (1 << 15)) >> 16;
+	val = (nb << 16) - tt->delta_nb;
+	st->value = ct->state[(val >> nb) + tt->delta_find];
+}
+
+static inline void fse_encode(struct bit_writer *bw, struct fse_state *st,
+			      __u32 sym)
+{
+	const struct fse_sym *tt = &st->ct->sym[sym];
+	__u32 nb;
+
+	if (st->ct->rle)
+		return;
+
+	nb = (st->value + tt->delta_nb) >> 16;
+	bw_add(bw, st->value, nb);
+	st->value = st->ct->state[(st->value >> nb) + tt->delta_find];
+}
+
+static void fse_flush_state(struct bit_writer *bw, struct fse_state *st)
+{
+	if (!st->ct->rle)
+		bw_add(bw, st->value, st->ct->log);
+}
+
+/* Sum of -log2 of the probabilities of the symbols */
+static __u64 fse_cost(const __u32 *count, __u32 max_sym, const __s16 *norm,
+		      __u32 log)
+{
+	__u64 cost = 0;
+	__u32 s;
+
+	for (s = 0; s <= max_sym; s++) {
+		if (!count[s])
+			continue;
+		cost += (__u64)count[s] * ((log << COST_SHIFT) -
+			log2_cost(norm[s] < 0 ? 1 : norm[s]));
+	}
+
+	return cost;
+}
+
+/*
+ * Huffman code lengths of the symbols present. A tree deeper than
+ * HUF_MAX_BITS is built again with the small counts raised, which always
+ * ends up with a complete code.
+ */
+static __u32 huf_build_lengths(const __u32 *count, __u32 max_sym, __u8 *len)
+{
+	__u32 node_cnt[2 * (HUF_MAX_SYM + 1)];
+	__u16 parent[2 * (HUF_MAX_SYM + 1)];
+	__u8 depth[2 * (HUF_MAX_SYM + 1)];
+	__u16 syms[HUF_MAX_SYM + 1];
+	__u32 floor = 1;
+	__u32 n, i, j, k, a, b, leaf, node, next, max_len, c;
+
+	while (1) {
+		n = 0;
+		for (i = 0; i <= max_sym; i++) {
+			if (!count[i])
+				continue;
+			c = count[i] < floor ? floor : count[i];
+			/* insertion sort, ascending counts then symbols */
+			for (j = n; j > 0 && node_cnt[j - 1] > c; j--) {
+				node_cnt[j] = node_cnt[j - 1];
+				syms[j] = syms[j - 1];
+			}
+			node_cnt[j] = c;
+			syms[j] = i;
+			n++;
+		}
+
+		/* leaves and internal nodes both come in ascending order */
+		leaf = 0;
+		node = n;
+		next = n;
+		for (k = 0; k + 1 < n; k++) {
+			if (node == next || (leaf < n &&
+			    node_cnt[leaf] <= node_cnt[node]))
+				a = leaf++;
+			else
+				a = node++;
+			if (node == next || (leaf < n &&
+			    node_cnt[leaf] <= node_cnt[node]))
+				b = leaf++;
+			else
+				b = node++;
+			node_cnt[next] = node_cnt[a] + node_cnt[b];
+			parent[a] = next;
+			parent[b] = next;
+			next++;
+		}
+
+		max_len = 0;
+		depth[next - 1] = 0;
+		for (i = next - 1; i-- > 0;) {
+			depth[i] = depth[parent[i]] + 1;
+			if (i < n && depth[i] > max_len)
+				max_len = depth[i];
+		}
+
+		if (max_len <= HUF_MAX_BITS)
+			break;
+		floor <<= 1;
+	}
+
+	memset(len, 0, max_sym + 1);
+	for (i = 0; i < n; i++)
+		len[syms[i]] = depth[i];
+
+	return max_len;
+}
+
+/* Canonical codes, given from the longest lengths in symbol order */
+static void huf_build_codes(const __u8 *len, __u32 max_sym, __u32 max_len,
+			    __u16 *code)
+{
+	__u32 val = 0;
+	__u32 l, s;
+
+	for (l = max_len; l > 0; l--) {
+		for (s = 0; s <= max_sym; s++)
+			if (len[s] == l)
+				code[s] = val++;
+		val >>= 1;
+	}
+}
+
+/* FSE coded weights of the tree description, with two interleaved states */
+static int huf_write_weights_fse(const __u8 *w, __u32 num, __u8 *dst,
+				 __u32 cap)
+{
+	struct fse_ctable ct;
+	struct fse_state st1, st2;
+	struct bit_writer bw;
+	__u32 count[HUF_MAX_BITS + 1];
+	__s16 norm[HUF_MAX_BITS + 1];
+	__u32 max_w, log, s, used = 0;
+	const __u8 *ip = w + num;
+	int head, ret;
+
+	memset(count, 0, sizeof(count));
+	for (s = 0; s < num; s++)
+		count[w[s]]++;
+	for (s = 0, max_w = 0; s <= HUF_MAX_BITS; s++) {
+		if (count[s]) {
+			used++;
+			max_w = s;
+		}
+	}
+	if (used < 2)
+		return -WD_EINVAL;
+
+	log = fse_table_log(num, max_w, HUF_WEIGHT_LOG);
+	fse_normalize(norm, log, count, max_w, num);
+	fse_build(&ct, norm, max_w, log);
+
+	bw_init(&bw, dst, cap);
+	ret = fse_write_ncount(&bw, norm, max_w, log);
+	if (ret)
+		return ret;
+	head = bw_finish(&bw);
+	if (head < 0)
+		return head;
+
+	bw_init(&bw, dst + head, cap - head);
+	if (num & 1) {
+		fse_init_state(&st1, &ct, *--ip);
+		fse_init_state(&st2, &ct, *--ip);
+		fse_encode(&bw, &st1, *--ip);
+	} else {
+		fse_init_state(&st2, &ct, *--ip);
+		fse_init_state(&st1, &ct, *--ip);
+	}
+	while (ip > w) {
+		fse_encode(&bw, &st2, *--ip);
+		fse_encode(&bw, &st1, *--ip);
+	}
+	fse_flush_state(&bw, &st2);
+	fse_flush_state(&bw, &st1);
+	ret = bw_close(&bw);
+	if (ret < 0)
+		return ret;
+
+	return head + ret;
+}
+
+/*
+ * Write the Huffman tree description: the weights of the symbols before the
+ * last one present, the decoder works out the last weight by itself.
+ */
+static int huf_write_tree(const __u8 *len, __u32 max_sym, __u32 max_len,
+			  __u8 *dst, __u32 cap)
+{
+	__u8 w[HUF_MAX_SYM + 1];
+	__u32 i, direct;
+	int ret;
+
+	if (!cap)
+		return -WD_EINVAL;
+
+	for (i = 0; i < max_sym; i++)
+		w[i] = len[i] ? max_len + 1 - len[i] : 0;
+
+	direct = max_sym <= HUF_DIRECT_MAX ? (max_sym + 1) / 2 + 1 : 0;
+	ret = huf_write_weights_fse(w, max_sym, dst + 1, cap - 1);
+	if (ret > 0 && ret < HUF_DIRECT_BASE + 1 &&
+	    (!direct || (__u32)ret + 1 < direct)) {
+		dst[0] = ret;
+		return ret + 1;
+	}
+
+	if (!direct || direct > cap)
+		return -WD_EINVAL;
+
+	dst[0] = HUF_DIRECT_BASE + max_sym;
+	memset(dst + 1, 0, direct - 1);
+	for (i = 0; i < max_sym; i++)
+		dst[1 + i / 2] |= (i & 1) ? w[i] : w[i] << 4;
+
+	return direct;
+}
+
+static int huf_write_stream(const __u8 *src, __u32 n, const __u16 *code,
+			    const __u8 *len, __u8 *dst, __u32 cap)
+{
+	struct bit_writer bw;
+	__u32 i = n;
+
+	bw_init(&bw, dst, cap);
+	while (i >= 4) {
+		bw_add(&bw, code[src[i - 1]], len[src[i - 1]]);
+		bw_add(&bw, code[src[i - 2]], len[src[i - 2]]);
+		bw_add(&bw, code[src[i - 3]], len[src[i - 3]]);
+		bw_add(&bw, code[src[i - 4]], len[src[i - 4]]);
+		i -= 4;
+	}
+	while (i--)
+		bw_add(&bw, code[src[i]], len[src[i]]);
+
+	return bw_close(&bw);
+}
+
+static int lit_write_raw(const __u8 *lit, __u32 n, __u32 type, __u8 *dst,
+			 __u32 cap)
+{
+	__u32 body = type == LIT_RLE ? 1 : n;
+	__u32 head;
+
+	if (n < 32) {
+		head = 1;
+		if (head + body > cap)
+			return -WD_EINVAL;
+		dst[0] = type | (n << 3);
+	} else if (n < 4096) {
+		head = 2;
+		if (head + body > cap)
+			return -WD_EINVAL;
+		put_le16(dst, type | (1 << 2) | (n << 4));
+	} else {
+		head = 3;
+		if (head + body > cap)
+			return -WD_EINVAL;
+		put_le24(dst, type | (3 << 2) | (n << 4));
+	}
+
+	memcpy(dst + head, lit, body);
+
+	return head + body;
+}
+
+/* Huffman coded literals, return 0 if they are better stored as they are */
+static int lit_write_huf(const __u8 *lit, __u32 n, const __u32 *count,
+			 __u32 max_sym, __u8 *dst, __u32 cap)
+{
+	__u8 len[HUF_MAX_SYM + 1];
+	__u16 code[HUF_MAX_SYM + 1];
+	__u32 head, pos, seg, i, max_len, comp, fmt, jump;
+	int ret;
+
+	max_len = huf_build_lengths(count, max_sym, len);
+	huf_build_codes(len, max_sym, max_len, code);
+
+	head = n <= LIT_HUF_1X_MAX ? 3 : (n <= LIT_SIZE_14_MAX ? 4 : 5);
+	if (head >= cap)
+		return 0;
+
+	ret = huf_write_tree(len, max_sym, max_len, dst + head, cap - head);
+	if (ret < 0)
+		return 0;
+	pos = head + ret;
+
+	if (n <= LIT_HUF_1X_MAX) {
+		ret = huf_write_stream(lit, n, code, len, dst + pos, cap - pos);
+		if (ret < 0)
+			return 0;
+		pos += ret;
+	} else {
+		if (pos + HUF_JUMP_SZ > cap)
+			return 0;
+		seg = (n + HUF_STREAMS - 1) / HUF_STREAMS;
+		jump = pos;
+		pos += HUF_JUMP_SZ;
+		for (i = 0; i < HUF_STREAMS; i++) {
+			ret = huf_write_stream(lit + i * seg,
+					       i + 1 < HUF_STREAMS ? seg :
+					       n - i * seg, code, len,
+					       dst + pos, cap - pos);
+			if (ret < 0)
+				return 0;
+			if (i + 1 < HUF_STREAMS)
+				put_le16(dst + jump + 2 * i, ret);
+			pos += ret;
+		}
+	}
+
+	comp = pos - head;
+	if (n <= LIT_HUF_1X_MAX) {
+		if (comp > LIT_HUF_1X_MAX)
+			return 0;
+		fmt = 0;
+		put_le24(dst, LIT_HUF | (fmt << 2) | (n << 4) | (comp << 14));
+	} else if (n <= LIT_SIZE_14_MAX) {
+		if (comp > LIT_SIZE_14_MAX)
+			return 0;
+		fmt = 2;
+		put_le32(dst, LIT_HUF | (fmt << 2) | (n << 4) | (comp << 18));
+	} else {
+		fmt = 3;
+		put_le32(dst, LIT_HUF | (fmt << 2) | (n << 4) | (comp << 22));
+		dst[4] = (__u8)(comp >> 10);
+	}
+
+	return pos;
+}
+
+static int enc_literals(const __u8 *lit, __u32 n, __u8 *dst, __u32 cap)
+{
+	__u32 count[HUF_MAX_SYM + 1];
+	__u32 max_sym;
+	int ret;
+
+	if (n < LIT_HUF_MIN)
+		return lit_write_raw(lit, n, LIT_RAW, dst, cap);
+
+	max_sym = hist_count(lit, n, count, HUF_MAX_SYM);
+	if (count[max_sym] == n)
+		return lit_write_raw(lit, n, LIT_RLE, dst, cap);
+
+	ret = lit_write_huf(lit, n, count, max_sym, dst, cap);
+	if (ret > 0 && (__u32)ret < n)
+		return ret;
+
+	return lit_write_raw(lit, n, LIT_RAW, dst, cap);
+}
+
+static inline __u8 ll_to_code(__u32 ll)
+{
+	return ll > 63 ? highbit(ll) + 19 : ll_code_tbl[ll];
+}
+
+static inline __u8 ml_to_code(__u32 ml)
+{
+	return ml > 127 ? highbit(ml) + 36 : ml_code_tbl[ml];
+}
+
+/*
+ * Pick the cheapest of RLE, the predefined table and a new FSE table for a
+ * stream of codes, build it and write its description if there is one.
+ */
+static int seq_select_table(const struct seq_stream *ss, __u32 num,
+			    struct fse_ctable *ct, __u8 *dst, __u32 cap,
+			    __u32 *mode)
+{
+	__u32 count[FSE_MAX_SYM + 1];
+	__s16 norm[FSE_MAX_SYM + 1];
+	__u64 predef_cost = ~0ULL;
+	struct bit_writer bw;
+	__u32 max_sym, log;
+	int ret;
+
+	max_sym = hist_count(ss->codes, num, count, ss->max_code);
+	if (count[max_sym] == num) {
+		if (!cap)
+			return -WD_EINVAL;
+		dst[0] = max_sym;
+		ct->log = 0;
+		ct->rle = true;
+		*mode = MODE_RLE;
+		return 1;
+	}
+
+	if (max_sym <= ss->predef_max)
+		predef_cost = fse_cost(count, max_sym, ss->predef,
+				       ss->predef_log);
+
+	log = fse_table_log(num, max_sym, ss->max_log);
+	fse_normalize(norm, log, count, max_sym, num);
+	bw_init(&bw, dst, cap);
+	ret = fse_write_ncount(&bw, norm, max_sym, log);
+	if (!ret)
+		ret = bw_finish(&bw);
+	if (ret > 0 && fse_cost(count, max_sym, norm, log) +
+	    ((__u64)ret << (3 + COST_SHIFT)) < predef_cost) {
+		fse_build(ct, norm, max_sym, log);
+		*mode = MODE_FSE;
+		return ret;
+	}
+
+	if (max_sym > ss->predef_max)
+		return -WD_EINVAL;
+
+	fse_build(ct, ss->predef, ss->predef_max, ss->predef_log);
+	*mode = MODE_PREDEF;
+
+	return 0;
+}
+
+static int enc_sequences(struct wd_zstd_enc *enc, __u32 num, __u8 *dst,
+			 __u32 cap)
+{
+	const struct seq_stream ss[] = {
+		{ enc->ll_code, LL_MAX_CODE, LL_FSE_LOG,
+		  ll_predef, ARRAY_SIZE(ll_predef) - 1, 6 },
+		{ enc->of_code, OF_MAX_CODE, OF_FSE_LOG,
+		  of_predef, ARRAY_SIZE(of_predef) - 1, 5 },
+		{ enc->ml_code, ML_MAX_CODE, ML_FSE_LOG,
+		  ml_predef, ARRAY_SIZE(ml_predef) - 1, 6 },
+	};
+	struct fse_state st_ll, st_of, st_ml;
+	struct zstd_seq *seq;
+	struct bit_writer bw;
+	__u32 pos, mode_pos, mode, i;
+	__u8 modes = 0;
+	int ret;
+
+	if (cap < 4)
+		return -WD_EINVAL;
+
+	if (num < 0x80) {
+		dst[0] = num;
+		pos = 1;
+	} else if (num < ZSTD_SEQ_LONG) {
+		dst[0] = (num >> 8) + 0x80;
+		dst[1] = (__u8)num;
+		pos = 2;
+	} else {
+		dst[0] = 0xff;
+		put_le16(dst + 1, num - ZSTD_SEQ_LONG);
+		pos = 3;
+	}
+	if (!num)
+		return pos;
+
+	/* the modes of literal length, offset and match length, in order */
+	mode_pos = pos++;
+	for (i = 0; i < ARRAY_SIZE(ss); i++) {
+		ret = seq_select_table(&ss[i], num, &enc->ct[i], dst + pos,
+				       cap - pos, &mode);
+		if (ret < 0)
+			return ret;
+		pos += ret;
+		modes |= mode << (6 - 2 * i);
+	}
+	dst[mode_pos] = modes;
+
+	/*
+	 * The decoder gets the states in the order of literal length, offset
+	 * and match length. For each sequence it reads the extra bits of
+	 * offset, match length and literal length, then updates the states of
+	 * literal length, match length and offset.
+	 */
+	bw_init(&bw, dst + pos, cap - pos);
+	seq = &enc->seqs[num - 1];
+	fse_init_state(&st_ml, &enc->ct[2], enc->ml_code[num - 1]);
+	fse_init_state(&st_of, &enc->ct[1], enc->of_code[num - 1]);
+	fse_init_state(&st_ll, &enc->ct[0], enc->ll_code[num - 1]);
+	bw_add(&bw, seq->ll, ll_bits[enc->ll_code[num - 1]]);
+	bw_add(&bw, seq->ml, ml_bits[enc->ml_code[num - 1]]);
+	bw_add(&bw, seq->off, enc->of_code[num - 1]);
+
+	for (i = num - 1; i-- > 0;) {
+		seq = &enc->seqs[i];
+		fse_encode(&bw, &st_of, enc->of_code[i]);
+		fse_encode(&bw, &st_ml, enc->ml_code[i]);
+		fse_encode(&bw, &st_ll, enc->ll_code[i]);
+		bw_add(&bw, seq->ll, ll_bits[enc->ll_code[i]]);
+		bw_add(&bw, seq->ml, ml_bits[enc->ml_code[i]]);
+		bw_add(&bw, seq->off, enc->of_code[i]);
+	}
+
+	fse_flush_state(&bw, &st_ml);
+	fse_flush_state(&bw, &st_of);
+	fse_flush_state(&bw, &st_ll);
+	ret = bw_close(&bw);
+	if (ret < 0)
+		return ret;
+
+	return pos + ret;
+}
+
+/* Apply an Offset_Value to the repeat offsets, return the offset or 0 */
+static __u32 rep_update(__u32 *rep, __u32 off, __u32 ll)
+{
+	__u32 offset, idx;
+
+	if (off > ZSTD_REP_NUM) {
+		offset = off - ZSTD_REP_NUM;
+		rep[2] = rep[1];
+		rep[1] = rep[0];
+		rep[0] = offset;
+		return offset;
+	}
+
+	if (!off)
+		return 0;
+
+	/* without literals before, the repeat offsets are shifted by one */
+	idx = off - 1 + !ll;
+	if (!idx)
+		return rep[0];
+
+	offset = idx == ZSTD_REP_NUM ? rep[0] - 1 : rep[idx];
+	if (idx != 1)
+		rep[2] = rep[1];
+	rep[1] = rep[0];
+	rep[0] = offset;
+
+	return offset;
+}
+
+/*
+ * Copy the sequences of the hardware, and get their codes. The hardware
+ * starts from the repeat offsets of the block before the previous one if it
+ * was told the previous block wasn't compressed. Once the repeat offsets of
+ * the hardware and the decoder differ, the offsets are written as they are.
+ */
+static int enc_prepare_seqs(struct wd_zstd_enc *enc,
+			    struct wd_lz77_zstd_data *data, __u32 src_len,
+			    __u32 *rep_hw, __u32 *rep)
+{
+	const struct zstd_hw_seq *hw = data->sequences_start;
+	__u32 num = data->seq_num;
+	__u64 out = data->lit_num;
+	struct zstd_seq *seq;
+	__u64 lit = 0;
+	__u32 offset, i;
+	bool same;
+
+	if (unlikely(num > ZSTD_SEQ_MAX || (num && !hw) ||
+		     (data->lit_num && !data->literals_start) ||
+		     (data->lit_length_overflow_cnt &&
+		      data->lit_length_overflow_pos >= num))) {
+		WD_ERR("invalid: lz77_zstd data is wrong!\n");
+		return -WD_EINVAL;
+	}
+
+	memcpy(rep_hw, data->blk_type == BLK_COMP ? enc->rep_hw :
+	       enc->rep_hw_prev, sizeof(enc->rep_hw));
+	memcpy(rep, enc->rep, sizeof(enc->rep));
+
+	for (i = 0; i < num; i++) {
+		seq = &enc->seqs[i];
+		seq->ll = hw[i].ll;
+		seq->ml = hw[i].ml;
+		if (data->lit_length_overflow_cnt &&
+		    i == data->lit_length_overflow_pos)
+			seq->ll += data->lit_length_overflow_cnt *
+				   ZSTD_LONG_LEN_UNIT;
+
+		same = !memcmp(rep_hw, rep, sizeof(enc->rep));
+		offset = rep_update(rep_hw, hw[i].off, seq->ll);
+		if (unlikely(!offset)) {
+			WD_ERR("invalid: lz77_zstd sequence %u offset is 0!\n",
+			       i);
+			return -WD_EINVAL;
+		}
+
+		if (same)
+			seq->off = hw[i].off;
+		else if (seq->ll && offset == rep[0])
+			seq->off = 1;
+		else
+			seq->off = offset + ZSTD_REP_NUM;
+		(void)rep_update(rep, seq->off, seq->ll);
+
+		enc->ll_code[i] = ll_to_code(seq->ll);
+		enc->ml_code[i] = ml_to_code(seq->ml);
+		enc->of_code[i] = highbit(seq->off);
+		if (unlikely(enc->ll_code[i] > LL_MAX_CODE ||
+			     enc->ml_code[i] > ML_MAX_CODE)) {
+			WD_ERR("invalid: lz77_zstd sequence %u is too long!\n",
+			       i);
+			return -WD_EINVAL;
+		}
+
+		lit += seq->ll;
+		out += seq->ml + ZSTD_MIN_MATCH;
+	}
+
+	if (unlikely(lit > data->lit_num || out != src_len)) {
+		WD_ERR("invalid: lz77_zstd output doesn't match input(%u)!\n",
+		       src_len);
+		return -WD_EINVAL;
+	}
+
+	return 0;
+}
+
+static bool is_rle(const __u8 *src, __u32 len)
+{
+	return len > 1 && !memcmp(src, src + 1, len - 1);
+}
+
+handle_t wd_zstd_alloc_encoder(void)
+{
+	struct wd_zstd_enc *enc;
+
+	enc = calloc(1, sizeof(struct wd_zstd_enc));
+	if (!enc) {
+		WD_ERR("failed to alloc zstd encoder!\n");
+		return (handle_t)0;
+	}
+	/* a frame must be begun before its blocks */
+	enc->ended = 1;
+
+	return (handle_t)enc;
+}
+
+void wd_zstd_free_encoder(handle_t h_enc)
+{
+	free((struct wd_zstd_enc *)h_enc);
+}
+
+int wd_zstd_encode_begin(handle_t h_enc, __u64 content_size, void *dst,
+			 __u32 dst_len)
+{
+	struct wd_zstd_enc *enc = (struct wd_zstd_enc *)h_enc;
+	__u8 *out = dst;
+	__u32 fcs_flag, fcs_sz;
+
+	if (unlikely(!enc || !dst)) {
+		WD_ERR("invalid: zstd encoder or dst is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	if (!content_size) {
+		fcs_flag = 0;
+		fcs_sz = 0;
+	} else if (content_size >= ZSTD_FCS_16_MIN &&
+		   content_size <= ZSTD_FCS_16_MAX) {
+		fcs_flag = 1;
+		fcs_sz = 2;
+	} else if (content_size <= UINT32_MAX) {
+		fcs_flag = 2;
+		fcs_sz = 4;
+	} else {
+		fcs_flag = 3;
+		fcs_sz = 8;
+	}
+
+	if (unlikely(dst_len < sizeof(__u32) + 2 + fcs_sz)) {
+		WD_ERR("invalid: zstd frame header needs %u bytes!\n",
+		       (__u32)sizeof(__u32) + 2 + fcs_sz);
+		return -WD_EINVAL;
+	}
+
+	put_le32(out, ZSTD_MAGIC);
+	out[4] = fcs_flag << ZSTD_FHD_FCS_SHIFT;
+	out[5] = ZSTD_WIN_DESC;
+	if (fcs_sz == 2) {
+		put_le16(out + 6, content_size - ZSTD_FCS_16_MIN);
+	} else if (fcs_sz) {
+		put_le32(out + 6, (__u32)content_size);
+		if (fcs_sz == 8)
+			put_le32(out + 10, (__u32)(content_size >> 32));
+	}
+
+	memcpy(enc->rep_hw, rep_init, sizeof(rep_init));
+	memcpy(enc->rep_hw_prev, rep_init, sizeof(rep_init));
+	memcpy(enc->rep, rep_init, sizeof(rep_init));
+	enc->content_size = content_size;
+	enc->in_size = 0;
+	enc->ended = 0;
+
+	return sizeof(__u32) + 2 + fcs_sz;
+}
+
+int wd_zstd_encode_block(handle_t h_enc, struct wd_lz77_zstd_data *data,
+			 const void *src, __u32 src_len, __u32 last,
+			 void *dst, __u32 dst_len)
+{
+	struct wd_zstd_enc *enc = (struct wd_zstd_enc *)h_enc;
+	__u32 rep_hw[ZSTD_REP_NUM], rep[ZSTD_REP_NUM];
+	__u32 type = BLK_RAW;
+	__u32 size = src_len;
+	__u8 *out = dst;
+	__u32 cap;
+	int ret;
+
+	if (unlikely(!enc || !data || !dst || (src_len && !src))) {
+		WD_ERR("invalid: zstd encode parameter is NULL!\n");
+		return -WD_EINVAL;
+	}
+
+	if (unlikely(src_len > WD_ZSTD_BLOCK_MAX ||
+		     dst_len < ZSTD_BLK_HEADER_SZ)) {
+		WD_ERR("invalid: zstd block src_len(%u) or dst_len(%u)!\n",
+		       src_len, dst_len);
+		return -WD_EINVAL;
+	}
+
+	if (unlikely(enc->ended)) {
+		WD_ERR("invalid: zstd frame isn't begun!\n");
+		return -WD_EINVAL;
+	}
+
+	if (unlikely(last && enc->content_size &&
+		     enc->in_size + src_len != enc->content_size)) {
+		WD_ERR("invalid: zstd frame size doesn't match content size!\n");
+		return -WD_EINVAL;
+	}
+
+	if (src_len) {
+		ret = enc_prepare_seqs(enc, data, src_len, rep_hw, rep);
+		if (ret)
+			return ret;
+
+		/* only a block smaller than the input is worth it */
+		cap = dst_len - ZSTD_BLK_HEADER_SZ;
+		if (cap >= src_len)
+			cap = src_len - 1;
+		ret = enc_literals(data->literals_start, data->lit_num,
+				   out + ZSTD_BLK_HEADER_SZ, cap);
+		if (ret > 0) {
+			size = ret;
+			ret = enc_sequences(enc, data->seq_num,
+					    out + ZSTD_BLK_HEADER_SZ + size,
+					    cap - size);
+		}
+		if (ret > 0) {
+			size += ret;
+			type = BLK_COMP;
+		} else {
+			size = src_len;
+		}
+	}
+
+	if (type != BLK_COMP) {
+		if (is_rle(src, src_len)) {
+			type = BLK_RLE;
+			if (dst_len < ZSTD_BLK_HEADER_SZ + 1)
+				return -WD_EINVAL;
+			out[ZSTD_BLK_HEADER_SZ] = *(const __u8 *)src;
+		} else {
+			if (dst_len < ZSTD_BLK_HEADER_SZ + src_len) {
+				WD_ERR("invalid: zstd block dst_len(%u) is too small!\n",
+				       dst_len);
+				return -WD_EINVAL;
+			}
+			if (src_len)
+				memcpy(out + ZSTD_BLK_HEADER_SZ, src, src_len);
+		}
+	}
+
+	put_le24(out, (last ? 1 : 0) | (type << ZSTD_BLK_TYPE_SHIFT) |
+		 (size << ZSTD_BLK_SIZE_SHIFT));
+
+	if (src_len) {
+		memcpy(enc->rep_hw_prev, enc->rep_hw, sizeof(enc->rep_hw));
+		memcpy(enc->rep_hw, rep_hw, sizeof(enc->rep_hw));
+		if (type == BLK_COMP)
+			memcpy(enc->rep, rep, sizeof(enc->rep));
+		data->blk_type = type;
+	}
+	enc->in_size += src_len;
+	enc->ended = !!last;
+
+	if (type == BLK_RLE)
+		return ZSTD_BLK_HEADER_SZ + 1;
+
+	return ZSTD_BLK_HEADER_SZ + size;
+}